@@ -6,6 +6,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <windows.h>
 #include <conio.h>
 #include <time.h>
@@ -16,6 +20,8 @@
 #define L_PER_COL           6
 #define PACK_COLS           2   /* Number of cols in pack select. */
 #define LEVEL_COLS          9   /* Number of cols in level select. */
+#define PACKS_PER_PAGE      (L_PER_COL * PACK_COLS)
+#define LEVELS_PER_PAGE     (L_PER_COL * LEVEL_COLS)
 
 #define TIME_BETWEEN_FRAMES     100     /* Milliseconds. */
 
@@ -37,6 +43,7 @@
 #define RIGHT               'd'
 #define DOWN                's'
 #define BOMB_INPUT          'x'
+#define HINT                'h'
 #define QUIT                'q'
 #define RESTART             'r'
 #define PLAY                'p'
@@ -44,6 +51,13 @@
 #define CLEAR_EDITOR        'c'
 #define YES                 'y'
 #define NO                  'n'
+#define NEXT_PAGE           'n'
+#define PREV_PAGE           'b'
+#define STEP_FORWARD        RIGHT
+#define STEP_BACK           LEFT
+#define FAST_FORWARD        'f'
+#define REWIND              'r'
+#define SEEK                'g'
 
 /* Screen symbols. */
 #define EMPTY_SYMBOL        ' '
@@ -80,16 +94,259 @@
 /* Message constants. */
 #define MAX_MSG             30
 #define BOMB_DESTROYED_MSG  "Bomb was destroyed"
-
-/* Number of levels. */
-#define MAX_LEVELPACKS      10
-#define MAX_LEVELS          50
+#define LEVEL_LOST_MSG      "Goal out of reach, press r"
+#define HINT_WAIT_MSG       "Working out a hint..."
+#define HINT_NONE_MSG       "No hint for this level"
 
 /* File constants. */
-#define MAX_FILE_LEN        13
-#define FILE_NAME           "slider"
+#define MAX_FILE_LEN        13      /* Longest built in file name. */
+#define PACK_DIR_PATTERN    "*"     /* Files searched for levelpacks. */
 #define SAVE_FILE           ".sav"
 #define LEVEL_FILE          ".lvl"
+#define COMPILED_FILE       ".lvb"
+#define STORE_FILE          ".lvs"
+#define STORE_INDEX_FILE    ".lvi"
+#define OLD_FILE            ".old"  /* Added to text packs once converted. */
+#define HASHED_FILE         ".lvh"
+#define CONTENT_STORE_FILE  "levels.lcs"
+#define STDIO_FILE          "-"     /* Reads stdin or writes stdout. */
+#define WATCH_DIR           "."     /* Directory watched for changed packs. */
+#define WATCH_CHANGES       (FILE_NOTIFY_CHANGE_FILE_NAME \
+                             | FILE_NOTIFY_CHANGE_SIZE \
+                             | FILE_NOTIFY_CHANGE_LAST_WRITE)
+
+/* Compiled level pack constants. */
+#define LVB_MAGIC           "SLVB"
+#define LVB_MAGIC_LEN       4
+#define LVB_VERSION         2
+#define LVB_NAME_LEN        16
+#define LVB_ALIGN           4       /* Level records start on this boundary. */
+
+/* Shared level cache constants. */
+#define CACHE_DIR           "cache"
+#define CACHE_FILE          ".lvc"
+#define LVC_MAGIC           "SLVC"
+#define LVC_VERSION         1
+
+/* Distance table constants. */
+#define TABLE_DIR           "tables"
+#define TABLE_FILE          ".tbl"
+#define TABLE_MAGIC         "SDTB"
+#define TABLE_VERSION       2
+#define TABLE_BUILDING      -1      /* Result of a table still being made. */
+
+/* Solution cache constants. */
+#define SOLUTION_FILE       "solutions.slc"
+#define SLC_MAGIC           "SSLC"
+#define SLC_VERSION         2
+#define SLC_MAX_LEN         256     /* Longest solution kept. */
+#define SLC_LOCK_OFFSET     0x7FFFFFFF /* High word of the byte locked while
+                                     * the cache is used, past its data so 
+                                     * reads and writes aren't blocked. */
+#define SOLVE_RULES         1       /* Version of the rules the solvers 
+                                     * follow. Cached results found under 
+                                     * any other are ignored. */
+
+/* Custom level store constants. */
+#define LVS_MAGIC           "SLVS"
+#define LVI_MAGIC           "SLVI"
+#define LVS_VERSION         1
+#define STORE_COMPACT_MIN   4096    /* Unused bytes a store may hold before
+                                     * it is compacted, as long as they are
+                                     * also fewer than the used bytes. */
+
+/* Save file constants. */
+#define SAVE_MAGIC          "SSAV"
+#define SAVE_MAGIC_LEN      4
+#define SAVE_VERSION        1
+#define SAVE_CLEAR_ALL      0xFFFFFFFF  /* Record level that clears all 
+                                         * levels. */
+#define SAVE_COMPACT_SLACK  64      /* Records beyond one per level that a
+                                     * save file may hold before it is
+                                     * compacted. */
+#define TEMP_FILE           ".tmp"
+
+/* Progress record limits. Counts past these are kept at the limit. */
+#define PROGRESS_MAX_MOVES  0xFFF       /* 12 bits. */
+#define PROGRESS_MAX_ATTEMPTS 0x3FFFF   /* 18 bits. */
+
+/* Content addressed level store constants. */
+#define LCS_MAGIC           "SLCS"
+#define LVH_MAGIC           "SLVH"
+#define LCS_VERSION         2
+#define LCS_ALIGN           8       /* Records start on this boundary. */
+#define NSYMMETRIES         8       /* Rotations and reflections. */
+#define FNV_OFFSET          0xCBF29CE484222325ULL
+#define FNV_PRIME           0x00000100000001B3ULL
+#define MIN_TABLE_SIZE      1024    /* First number of slots in a table. */
+
+/* Results of adding a level to the content store. */
+#define CONTENT_ERROR       0
+#define CONTENT_NEW         1
+#define CONTENT_FOUND       2
+
+/* Replay archive constants. */
+#define REPLAY_FILE         "replays"
+#define REPLAY_ARCHIVE_FILE ".rpa"
+#define REPLAY_INDEX_FILE   ".rpi"
+#define RPA_MAGIC           "SRPA"
+#define RPI_MAGIC           "SRPI"
+#define REPLAY_VERSION      1
+#define REPLAY_NAME_LEN     16      /* Longest player name, with the null. */
+#define REPLAY_DEFAULT_NAME "player"
+#define REPLAY_INDEX_SLACK  65536   /* Replays the archive may hold past the
+                                     * end of the index before it is
+                                     * rebuilt. */
+#define REPLAY_NO_ID        UINT32_MAX
+#define REPLAY_MAX_SLIDES   0xFFFFFF    /* Longest attempt kept. */
+#define REPLAY_TIME_FORMAT  "%Y-%m-%d %H:%M:%S"
+
+/* Kinds of replay archive record. */
+#define REPLAY_RECORD       0
+#define LEVEL_RECORD        1
+#define PLAYER_RECORD       2
+
+/* How an attempt ended. */
+#define REPLAY_QUIT         0
+#define REPLAY_WON          1
+#define REPLAY_RESTART      2
+#define REPLAY_HOLE         3
+
+/* Verdicts of the verify tool that aren't how an attempt ended. */
+#define REPLAY_DAMAGED      4
+#define REPLAY_NO_LEVEL     5   /* The level isn't in the pack. */
+#define REPLAY_TOO_LONG     6   /* Slides after the goal or a fall. */
+#define VERIFY_CHUNK        4096    /* Replays checked by each job. */
+#define KEYFRAME_INTERVAL   32      /* Slides between replay keyframes. */
+#define VIEW_FRAME_TIME     (TIME_BETWEEN_FRAMES / 2)   /* Milliseconds
+                                     * between slides when fast
+                                     * forwarding or rewinding. */
+
+/* Storage constants. */
+#define ARENA_ALIGN         4       /* Alignment of arena allocations. */
+#define ARENA_MIN_SIZE      4096
+#define ARENA_FAILED        ((size_t)-1)
+#define MIN_INDEX_LEN       64      /* First size of growing index arrays. */
+#define MAX_ERROR_LEN       (2 * MAX_PATH)
+
+/* Solver constants. */
+#define SOLVE_MAX_NODES     (BOARD_MAX_R * BOARD_MAX_C)
+#define SOLVE_NONE          0xFFFF  /* Edge of a slide that doesn't move the
+                                     * player, or ends in a hole. */
+#define SOLVE_GOAL          0xFFFE  /* Edge of a slide that reaches the
+                                     * goal. */
+#define SOLVE_NO_SOLUTION   -1
+#define SOLVE_NOT_STATIC    -2      /* Level has moving blocks or bombs. */
+#define SOLVE_TOO_BIG       -3      /* States didn't fit in SOLVE_MEMORY. */
+#define SOLVE_CANCELLED     -4      /* Solver was told to stop. */
+#define SOLVE_MAX_WORDS     16      /* Most words in a packed state. */
+#define SOLVE_MEMORY        (64 << 20) /* Bytes the full rules solver may
+                                     * use for states. */
+#define SOLVE_CELL_BITS     10      /* Bits in a packed cell number. */
+#define SOLVE_NO_CELL       0x3FF   /* Cell of a destroyed block. */
+#define SOLVE_BOMB          4       /* Added to a slide that follows a
+                                     * bomb. */
+#define STATE_FOUND         0xFFFFFFFF /* State was already in the table. */
+#define STATE_FULL          0xFFFFFFFE /* Table has no room for states. */
+#define STATE_NONE          0xFFFFFFFD /* State isn't in the table. */
+#define SOLVE_FAR           0xFFFF  /* Distance from a cell the goal can't 
+                                     * be reached from. */
+#define SOLVE_MAX_DEPTH     256     /* Most moves IDA* will search to. */
+#define SOLVE_IDA_NODES     10000000 /* Most states IDA* will expand. */
+#define SOLVE_MODE_BFS      "bfs"   /* Breadth first search. */
+#define SOLVE_MODE_ASTAR    "astar" /* A*, keeping every state found. */
+#define SOLVE_MODE_IDA      "ida"   /* IDA*, keeping only the path. */
+#define SOLVE_MODE_BIDIR    "bidir" /* Bidirectional BFS, static levels 
+                                     * only. */
+#define SOLVE_SET_WORDS     ((SOLVE_MAX_NODES + 63) / 64)
+#define SOLVE_MODE_PARALLEL "par"   /* Breadth first search on every 
+                                     * core. */
+#define SOLVE_JOBS_PER_CORE 4       /* Jobs each layer is split into, per 
+                                     * core. */
+#define SOLVE_CHUNK         16      /* States a job claims from the pool at
+                                     * once. */
+#define REACH_OPEN          0       /* Cell kinds for finding dead cells. 
+                                     * Can always be slid through. */
+#define REACH_MAYBE         1       /* May be open or in the way. */
+#define REACH_SHUT          2
+#define REACH_HOLE          3
+#define REACH_GOAL          4
+#define SOLVE_MODE_EXTERNAL "ext"   /* Breadth first search with its 
+                                     * layers on disk. */
+#define EXT_DIR             "solve" /* Directory of external searches. */
+#define EXT_LAYER_FILE      ".lyr"
+#define EXT_RUN_FILE        ".run"
+#define EXT_CANDIDATE_FILE  ".cnd"
+#define EXT_CHECKPOINT_FILE ".ckp"
+#define EXT_MAGIC           "SCKP"
+#define EXT_VERSION         1
+#define EXT_MEMORY          (64 << 20) /* Bytes the external solver may
+                                     * use, half for runs, a quarter for
+                                     * its Bloom filter. */
+#define EXT_MAX_RUNS        256     /* Most sorted runs merged at once. A
+                                     * layer with more is merged in 
+                                     * passes. */
+#define EXT_HASHES          3       /* Bloom filter bits for each state. */
+#define SCHED_TICK          10      /* Milliseconds between checks for 
+                                     * tasks that have run too long. */
+#define AUDIT_TIMEOUT       60      /* Seconds the audit tool spends on a 
+                                     * level by default. */
+
+/* Stored level feature flags. */
+#define LEVEL_HAS_BOMB      0x01
+#define LEVEL_HAS_WEAK_WALL 0x02
+#define LEVEL_HAS_MOVING_BLOCK 0x04
+#define LEVEL_HAS_HOLE      0x08
+
+/* Encoded board tokens. Each token is one nibble, board values 0 to 11 are
+ * written as they are. A run is the token, the value, then the length less
+ * RLE_MIN_RUN in one nibble, or in two nibbles for a long run. */
+#define RLE_SAME_ROW        0x0D    /* Row is a copy of the row above. */
+#define RLE_LONG_RUN        0x0E
+#define RLE_RUN             0x0F
+#define RLE_MIN_RUN         4       /* Shorter runs are written as values. */
+#define RLE_MAX_RUN         (RLE_MIN_RUN + 15)
+#define RLE_MAX_LONG_RUN    (RLE_MIN_RUN + 255)
+
+/* Largest stored level, when every cell is written as a value. */
+#define STORED_LEVEL_MAX    (sizeof(stored_level_t) \
+                             + (BOARD_MAX_R * BOARD_MAX_C + 1) / 2)
+
+/* Levelpack file formats. */
+#define PACK_TEXT           0
+#define PACK_COMPILED       1
+#define PACK_STORE          2
+#define PACK_HASHED         3
+
+/* Levelpack load states. */
+#define PACK_UNLOADED       0   /* Only the name has been read. */
+#define PACK_LOADED         1   /* Levels and save data have been read. */
+#define PACK_FAILED         2   /* Levels could not be read. */
+
+/* Return codes when reading a level from a text file. */
+#define LEVEL_READ_OK       1
+#define LEVEL_READ_END      2
+#define LEVEL_READ_ERROR    3
+
+/* Command line tools. */
+#define CMD_COMPILE         "compile"
+#define CMD_DECOMPILE       "decompile"
+#define CMD_VALIDATE        "validate"
+#define CMD_PLAY            "play"
+#define CMD_DELETE          "delete"
+#define CMD_REPLACE         "replace"
+#define CMD_COMPACT         "compact"
+#define CMD_IMPORT          "import"
+#define CMD_HASH            "hash"
+#define CMD_REPLAYS         "replays"
+#define CMD_LEVEL           "level"
+#define CMD_PLAYER          "player"
+#define CMD_INDEX           "index"
+#define CMD_VERIFY          "verify"
+#define CMD_VIEW            "view"
+#define CMD_SOLVE           "solve"
+#define CMD_AUDIT           "audit"
+#define CMD_TABLES          "tables"
 
 /* Level editor constants. */
 #define CUSTOM_LEVEL_FILE   "custom"
@@ -103,6 +360,7 @@
 #define SUCCESSFUL_CODE     3
 #define QUIT_EDITOR_CODE    4
 #define CLEAR_EDITOR_CODE   5
+#define WRITE_FAILED_CODE   6
 
 /* Other. */
 #define MAX_NAME_LEN        15
@@ -130,26 +388,208 @@ typedef struct
     char    message[MAX_MSG];   /* Message to be printed. */
 } level_t;
 
+/* Save file (.sav) layout. The header is followed by records, each of
+ * which sets the completion of one level. Records are only ever appended,
+ * so a write cut short by a crash can only damage the last record. */
+typedef struct
+{
+    char     magic[SAVE_MAGIC_LEN];
+    uint32_t version;
+} save_header_t;
+
+/* Progress on one level. Completion, best moves and attempts share one
+ * word, see pack_progress(). */
+typedef struct
+{
+    uint32_t bits;              /* FALSE, BEATEN or ACED in bits 0-1, best
+                                 * moves in bits 2-13 and attempts in bits
+                                 * 14-31. */
+    uint32_t best_time;         /* Fastest win in milliseconds, 0 if the
+                                 * level hasn't been won. */
+    uint32_t played;            /* When last played, in seconds since
+                                 * 1970. */
+} progress_t;
+
+typedef struct
+{
+    uint32_t level;             /* Level number, or SAVE_CLEAR_ALL. */
+    progress_t progress;        /* New progress on the level. */
+    uint32_t check;             /* CRC-32 of the fields above. */
+} save_record_t;
+
+/* Records waiting to be written to a save file. */
+typedef struct save_batch
+{
+    struct save_batch *next;
+    char   *sav_file;
+    int     replace;            /* True to replace the file with the
+                                 * records, rather than append them. */
+    int     nrecords;
+    save_record_t record[];
+} save_batch_t;
+
+/* Writes save records on a background thread, so that play never waits
+ * for the disk. */
+typedef struct
+{
+    CRITICAL_SECTION lock;      /* Guards the queue and stop. */
+    save_batch_t *head;         /* Batches in the order they were made. */
+    save_batch_t *tail;
+    int     stop;               /* True once the thread should finish. */
+    HANDLE  wake;               /* Set when batches are queued. */
+    HANDLE  idle;               /* Set when every batch has been written. */
+    HANDLE  thread;             /* NULL if batches are written directly. */
+} save_writer_t;
+
 typedef struct 
 {
-    int     data[MAX_LEVELS];
-    char    sav_file[MAX_FILE_LEN];
+    progress_t *data;           /* Progress on each level. */
+    char   *sav_file;
     int     nlevels;
+    int     nbeaten;            /* Levels that are BEATEN or ACED. */
+    int     naced;              /* Levels that are ACED. */
+    save_writer_t *writer;      /* Writes changes to sav_file, NULL if
+                                 * there is no save file. */
 } save_t;
 
+typedef struct
+{
+    uint64_t time;              /* Last write time of a file. */
+    uint64_t size;              /* Size of a file in bytes. */
+} file_stamp_t;
+
+/* Growing block of memory. Allocations are referred to by their offset, as
+ * the block moves when it grows. */
+typedef struct
+{
+    uint8_t *base;              /* Start of the arena, NULL when empty. */
+    size_t   used;              /* Bytes handed out. */
+    size_t   size;              /* Bytes allocated. */
+} arena_t;
+
+/* Level as stored in a levelpack arena or a compiled pack. The board is
+ * encoded with encode_level(), so it takes only as much space as its
+ * contents need. */
+typedef struct
+{
+    uint8_t  rows;              /* Number of rows in level. */
+    uint8_t  cols;              /* Number of columns in level. */
+    uint8_t  p_row;             /* Player starting row. */
+    uint8_t  p_col;             /* Player starting column. */
+    uint16_t moves;             /* Min number of moves to beat level. */
+    uint16_t size;              /* Bytes in cells. */
+    uint8_t  flags;             /* LEVEL_HAS_* feature flags. */
+    uint8_t  reserved;
+    uint8_t  cells[];           /* Encoded board, two nibbles per byte with
+                                 * the first in the low nibble. */
+} stored_level_t;
+
+/* Reads an encoded board one row at a time. */
+typedef struct
+{
+    const uint8_t *cells;       /* Encoded board. */
+    size_t   next;              /* Next nibble to read. */
+    size_t   end;               /* Number of nibbles in cells. */
+    int      cols;              /* Values in each row. */
+} row_decoder_t;
+
+/* A compiled pack or custom level store mapped into memory. */
+typedef struct
+{
+    HANDLE              file;
+    HANDLE              mapping;
+    const uint8_t      *base;   /* Start of the mapped file. */
+    uint32_t            size;   /* Size of the mapped file. */
+    const char         *name;   /* Name of the pack, null terminated. */
+    uint32_t            nlevels;
+    uint32_t            start;  /* Offset of the first level record. */
+    const uint32_t     *index;  /* Offsets of level records. */
+    uint32_t           *own_index; /* Index read from an index file, NULL if
+                                 * the index is in the mapped file. */
+    char                own_name[LVB_NAME_LEN]; /* Name read from an index
+                                 * file. */
+} lvb_t;
+
 typedef struct 
 {
-    level_t level[MAX_LEVELS];  /* Array holding levels. */
+    arena_t  arena;             /* Holds the levels, index and save data,
+                                 * or only the save data if the levels 
+                                 * are in the cache. */
+    const uint8_t *levels;      /* Start of the level records. */
+    const uint32_t *index;      /* Offsets of the levels from levels. */
+    lvb_t   cache;              /* Shared cache the levels are mapped from,
+                                 * with a NULL base if they are in the
+                                 * arena. */
     int     nlevels;            /* Number of levels. */
     char    name[MAX_NAME_LEN]; /* Name of levelpack. */
     save_t  save;               /* Save state. */
+    char   *lvl_file;           /* File the levels are read from. */
+    int     format;             /* Format of lvl_file, PACK_TEXT to
+                                 * PACK_HASHED. */
+    file_stamp_t stamp;         /* Stamp of lvl_file when it was found. */
+    long    parsed;             /* Bytes of a text lvl_file read as whole
+                                 * levels, 0 if unknown. */
+    int     parsed_line;        /* Line reached at parsed. */
+    uint32_t parsed_check;      /* CRC-32 of the bytes up to parsed. */
+    int     state;              /* Load state, PACK_UNLOADED to FAILED. */
+    char   *error;              /* Where loading failed, NULL if it
+                                 * didn't. */
 } levelpack_t;
 
-typedef struct 
+/* Function run by worker threads for each job number. */
+typedef void (*job_fn_t)(void *ctx, int job);
+
+/* Jobs shared between worker threads. */
+typedef struct
 {
-    levelpack_t pack[MAX_LEVELPACKS];
-    int         npacks;
-} all_packs_t;
+    job_fn_t      fn;
+    void         *ctx;
+    LONG          njobs;
+    volatile LONG next;         /* Next job to be claimed. */
+} job_queue_t;
+
+typedef struct sched_worker sched_worker_t;
+
+/* Function run by a work stealing scheduler for each task, on worker. It
+ * should give up once stop is set. */
+typedef void (*task_fn_t)(void *ctx, sched_worker_t *worker, int task,
+    volatile LONG *stop);
+
+/* Tasks waiting for one worker. The worker takes its own from the back, 
+ * and idle workers steal from the front. */
+typedef struct
+{
+    CRITICAL_SECTION lock;
+    int    *task;
+    int     head;
+    int     tail;
+} task_deque_t;
+
+/* A thread of a work stealing scheduler, with its own tasks and memory. */
+struct sched_worker
+{
+    struct scheduler *sched;
+    task_deque_t  deque;
+    arena_t       arena;        /* Memory for the results of its tasks. */
+    volatile LONG running;      /* Task it is running plus one, or 0. */
+    volatile LONG started;      /* Tick count the task started at. */
+    HANDLE        thread;
+    int           index;
+};
+
+/* Runs tasks of very different lengths on a thread per core. Tasks are 
+ * dealt out in turn, and a worker that runs out steals from the others, so
+ * that no core sits idle while there is work left. */
+typedef struct scheduler
+{
+    sched_worker_t *worker;
+    int            nworkers;
+    task_fn_t      fn;
+    void          *ctx;
+    volatile LONG *stop;        /* Set for each task to cancel it. */
+    volatile LONG  remaining;   /* Tasks not yet finished. */
+    HANDLE         done;        /* Set when no tasks remain. */
+} scheduler_t;
 
 typedef struct
 {
@@ -157,6 +597,636 @@ typedef struct
     int     col;                  /* col on board. */
 } coord_t;
 
+/* Compiled level pack (.lvb) layout. The file starts with the header, level
+ * records follow as stored_level_t, each aligned to LVB_ALIGN bytes, and
+ * the index of level record offsets is stored last. All values are little
+ * endian. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN]; /* LVB_MAGIC, not null terminated. */
+    uint32_t version;           /* LVB_VERSION. */
+    uint32_t nlevels;           /* Number of levels in the pack. */
+    uint32_t index_offset;      /* File offset of the level offset index. */
+    char     name[LVB_NAME_LEN];   /* Name of levelpack. */
+} lvb_header_t;
+
+/* Shared level cache (.lvc) layout. A cache holds the levels of one 
+ * levelpack as a compiled pack, followed by this trailer, which ties it to
+ * the version of the file it was made from. Caches are in CACHE_DIR, 
+ * named by a hash of the file's path and its stamp, so a file that 
+ * changes gets a new cache and the old one can stay mapped by running 
+ * games. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+    file_stamp_t stamp;         /* Stamp of the levelpack file. */
+    int32_t  parsed;            /* Where the last whole level ended, for
+                                 * text levelpacks. */
+    int32_t  parsed_line;
+    uint32_t parsed_check;
+    uint32_t check;             /* CRC-32 of the levels and index, from the
+                                 * end of the header to the trailer. */
+} lvc_trailer_t;
+
+/* Reads levels from a text levelpack, keeping track of the position so
+ * that errors can be reported. */
+typedef struct
+{
+    FILE   *fp;
+    char   *file_name;          /* Name used in error messages. */
+    int     line;               /* Current line, starting from 1. */
+    int     level_line;         /* Line of the current level's header. */
+    int     nlevels;            /* Number of levels read so far. */
+    char   *error;              /* First error found, NULL if none. */
+    int     error_line;         /* Line of the first error. */
+} level_reader_t;
+
+/* Called for each level read by stream_levels(). Returns FALSE to stop
+ * reading, after calling reader_error() if it failed. */
+typedef int (*level_fn_t)(void *ctx, level_reader_t *reader, level_t *lvl);
+
+/* Custom level store (.lvs) layout. Level records follow the header, in
+ * the same form as in a compiled pack. Levels are only ever appended, and
+ * their order is kept in an index file (.lvi) of the same name, which is
+ * the index header followed by the offset of each level. Replaced and
+ * deleted levels stay in the store, unused, until it is compacted. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+    uint32_t generation;        /* Changed each time the store is
+                                 * compacted. */
+    uint32_t reserved;
+    char     name[LVB_NAME_LEN];
+} lvs_header_t;
+
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+    uint32_t generation;        /* Generation of the store it indexes. */
+    uint32_t nlevels;
+} lvi_header_t;
+
+/* Level layout, so that identical levels can be found. Every cell is 
+ * kept, with the player, as even empty space changes how far a block can 
+ * be pushed, and so is par. */
+typedef struct
+{
+    int      rows;
+    int      cols;
+    int      moves;             /* Par of the level. */
+    uint8_t  cells[BOARD_MAX_R * BOARD_MAX_C]; /* Row by row. */
+} layout_t;
+
+/* Content addressed level store (levels.lcs) layout. Records follow the
+ * header, each aligned to LCS_ALIGN bytes. A record is the keys of a level
+ * followed by the level as a stored_level_t. Records are only appended,
+ * and each layout is stored once. A hashed levelpack (.lvh) is its header
+ * followed by an entry for each level. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+} lcs_header_t;
+
+typedef struct
+{
+    uint64_t key;               /* Hash of the canonical layout. */
+    uint64_t sym_key;           /* Smallest key of the layout over all
+                                 * rotations and reflections. */
+} level_keys_t;
+
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+    uint32_t nlevels;
+    uint32_t reserved;
+    char     name[LVB_NAME_LEN];
+} lvh_header_t;
+
+typedef struct
+{
+    uint64_t key;               /* Key of the level. */
+    uint32_t offset;            /* Offset of the level in the store. */
+    uint32_t reserved;
+} lvh_entry_t;
+
+/* Open addressing hash table of store offsets by key. Slots with a key of
+ * 0 are empty. */
+typedef struct
+{
+    uint64_t key;
+    uint32_t offset;
+} key_slot_t;
+
+typedef struct
+{
+    key_slot_t *slot;
+    uint32_t    size;           /* Number of slots, a power of two. */
+    uint32_t    count;          /* Number of slots used. */
+} key_table_t;
+
+/* The content addressed level store, opened for adding levels. */
+typedef struct
+{
+    FILE       *fp;             /* NULL if the store doesn't exist. */
+    uint32_t    size;           /* Bytes in the store file. */
+    key_table_t by_key;         /* Levels by key. */
+    key_table_t by_sym;         /* Levels by symmetry key. */
+} content_store_t;
+
+/* Hashed levelpack being built by the import tool. */
+typedef struct
+{
+    content_store_t *store;
+    lvh_entry_t *entry;
+    int      nlevels;
+    int      capacity;          /* Length of entry. */
+    int      nnew;              /* Levels that weren't in the store. */
+} hashed_pack_t;
+
+/* A replay of one attempt at a level. Slides are packed four to a byte,
+ * the first in the low bits, as 0 to 3 for UP, RIGHT, DOWN and LEFT. Bit i
+ * of bombs is set if a bomb was used before slide i. */
+typedef struct
+{
+    uint32_t nslides;
+    int      result;            /* How the attempt ended, REPLAY_QUIT to
+                                 * REPLAY_HOLE. */
+    uint32_t level;             /* Level id in the archive. */
+    uint32_t player;            /* Player id in the archive. */
+    uint32_t time;              /* Seconds after the archive was made. */
+    const uint8_t *slides;
+    const uint8_t *bombs;       /* NULL if no bomb was used. */
+} replay_t;
+
+/* Records the attempt being played. */
+typedef struct
+{
+    uint8_t *slides;
+    uint8_t *bombs;
+    uint32_t nslides;
+    uint32_t capacity;          /* Slides that fit in the buffers. */
+    int      nbombs;
+    int      failed;            /* True if memory ran out, so the attempt
+                                 * isn't kept. */
+} replay_recorder_t;
+
+/* A record read from the replay archive. */
+typedef struct
+{
+    int      kind;              /* REPLAY_RECORD, LEVEL_RECORD or
+                                 * PLAYER_RECORD. */
+    replay_t replay;
+    uint64_t key;               /* Key of the level of a level record. */
+    char     name[REPLAY_NAME_LEN]; /* Name of a player record. */
+} replay_record_t;
+
+/* Replay archive (.rpa) layout. Records follow the header. Each starts
+ * with a variable length number holding the kind in its low 2 bits, and
+ * ends with the low byte of the CRC-32 of the rest of the record. Level
+ * and player records give ids, in order, to the levels and players used by
+ * the replay records after them. The index (.rpi) is its header, the
+ * offsets of the replays, the offsets of the level and player records,
+ * then the replays of each level and of each player as a start for each
+ * id followed by the replay numbers. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+    uint32_t base_time;         /* Time the archive was made. */
+    uint32_t reserved;
+} rpa_header_t;
+
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];
+    uint32_t version;
+    uint32_t archive_size;      /* Bytes of the archive that are indexed. */
+    uint32_t nreplays;
+    uint32_t nlevels;
+    uint32_t nplayers;
+    uint32_t base_time;         /* Base time of the archive. */
+    uint32_t reserved;
+} rpi_header_t;
+
+/* The replay archive and its index, mapped for reading. Replays past the
+ * end of the index are found when it is opened. */
+typedef struct
+{
+    char     archive_file[MAX_PATH];
+    char     index_file[MAX_PATH];
+    lvb_t    archive;
+    lvb_t    index;             /* Not mapped if there is no usable
+                                 * index. */
+    uint32_t base_time;
+    uint32_t end;               /* End of the last whole record. */
+    uint32_t nindexed;          /* Replays in the index. */
+    uint32_t index_end;         /* End of the indexed part of the
+                                 * archive. */
+    const uint32_t *offset;     /* Offsets of the indexed replays. */
+    const uint32_t *level_start; /* Replays of each level, by id. */
+    const uint32_t *by_level;
+    const uint32_t *player_start; /* Replays of each player, by id. */
+    const uint32_t *by_player;
+    uint32_t *tail;             /* Offsets of the replays after the index. */
+    uint32_t ntail;
+    uint32_t *level_def;        /* Offsets of the level records. */
+    uint32_t nlevels;
+    uint32_t *player_def;       /* Offsets of the player records. */
+    uint32_t nplayers;
+} replay_reader_t;
+
+/* The replay archive, opened for adding replays. */
+typedef struct
+{
+    FILE    *fp;                /* NULL if replays aren't recorded. */
+    uint32_t size;              /* Bytes in the archive. */
+    uint32_t base_time;
+    key_table_t levels;         /* Level ids by key, in the offsets. */
+    uint32_t nlevels;
+    uint32_t player;            /* Id of this player, REPLAY_NO_ID until
+                                 * the player has a record. */
+    uint32_t nplayers;
+    char     name[REPLAY_NAME_LEN]; /* Name of this player. */
+    uint32_t unindexed;         /* Replays past the end of the index. */
+} replay_archive_t;
+
+typedef struct 
+{
+    levelpack_t *pack;          /* Packs in the order they are listed. */
+    int         npacks;
+    HANDLE      prefetch;       /* Thread loading packs in the background,
+                                 * NULL if there isn't one. */
+    save_writer_t writer;       /* Writes the save files of every pack. */
+    replay_archive_t replays;   /* Records every attempt. */
+    HANDLE      watch;          /* Signalled when files in WATCH_DIR 
+                                 * change, INVALID_HANDLE_VALUE if they
+                                 * aren't watched. */
+    int         changed;        /* TRUE if files may have changed since
+                                 * the packs were listed. */
+} all_packs_t;
+
+/* Result of checking a replay. */
+typedef struct
+{
+    uint32_t moves;             /* Moves made by the replay. */
+    int      result;            /* REPLAY_QUIT if it doesn't reach the
+                                 * goal, REPLAY_WON, REPLAY_HOLE, or
+                                 * REPLAY_DAMAGED to REPLAY_TOO_LONG. */
+    int      recorded;          /* How the attempt ended when played. */
+    int      level;             /* Level in the pack, -1 if none. */
+} verdict_t;
+
+/* Level compiled for the solver. Nodes are the cells a slide can stop on,
+ * numbered in the order they are found from the start, so the start is
+ * node 0. Each node has an edge for each slide, in the order UP, RIGHT, 
+ * DOWN and LEFT. */
+typedef struct
+{
+    int      nnodes;
+    uint16_t cell[SOLVE_MAX_NODES];     /* row * BOARD_MAX_C + col. */
+    uint16_t next[SOLVE_MAX_NODES][4];  /* Node the slide stops on,
+                                         * SOLVE_GOAL or SOLVE_NONE. */
+} stop_graph_t;
+
+/* Level prepared for the full rules solver. A state of the level is the
+ * player's cell, whether a bomb is held, which weak walls and bombs are
+ * left, and the cells of the moving blocks in order, packed into words.
+ * Cells are numbered row * cols + col. */
+typedef struct
+{
+    int      rows;
+    int      cols;
+    uint8_t  base[SOLVE_MAX_NODES];     /* Board without the player, weak
+                                         * walls, bombs or blocks. */
+    uint16_t weak[SOLVE_MAX_NODES];     /* Cells of the weak walls. */
+    uint16_t bomb[SOLVE_MAX_NODES];     /* Cells of the bombs. */
+    uint16_t floor[SOLVE_MAX_NODES];    /* Cells a block can be on. */
+    uint16_t dist[SOLVE_MAX_NODES];     /* Fewest moves to the goal from
+                                         * each cell, at least, or 
+                                         * SOLVE_FAR. */
+    uint64_t dead[SOLVE_SET_WORDS];     /* Cells the goal can never be 
+                                         * reached from. */
+    int      nweak;
+    int      nbombs;
+    int      nblocks;
+    int      nfloor;
+    int      words;                     /* Words in a packed state. */
+} state_space_t;
+
+/* Transposition table of the states found by the full rules solver, in
+ * the order they were found, with how each was reached. It is open 
+ * addressed, with slots holding state numbers plus one, or 0 if empty, 
+ * and grows until it would use more than memory bytes. */
+typedef struct
+{
+    uint64_t *state;            /* words for each state. */
+    uint32_t *from;             /* State each was reached from. */
+    uint8_t  *action;           /* Slide 0 to 3 that reached each, plus
+                                 * SOLVE_BOMB if a bomb was used first. */
+    int       words;
+    uint32_t  count;
+    uint32_t  capacity;         /* States that fit, half the slots. */
+    uint32_t *slot;
+    size_t    memory;
+} state_table_t;
+
+/* Min heap of the states A* has still to expand, each as its estimate of
+ * the moves to the goal through it, the moves to it inverted so that 
+ * deeper states come first, and its number, high bits to low. */
+typedef struct
+{
+    uint64_t *entry;
+    uint32_t  count;
+    uint32_t  size;
+} state_heap_t;
+
+/* The path an IDA* search is following, with the bounds of the current 
+ * pass. */
+typedef struct
+{
+    state_space_t space;
+    uint64_t path[SOLVE_MAX_DEPTH + 1][SOLVE_MAX_WORDS];
+    uint8_t  action[SOLVE_MAX_DEPTH];   /* Action taken from each state. */
+    int      bound;                     /* Most moves tried this pass. */
+    int      next_bound;                /* Fewest moves over bound seen. */
+    uint64_t nodes;                     /* States expanded. */
+    volatile LONG *stop;                /* Set to give up, or NULL. */
+} ida_search_t;
+
+/* A bidirectional search of a static level, forward from the player's 
+ * start and backward from the goal. Side 0 is forward and side 1 
+ * backward, and cells are numbered as in a stop graph. */
+typedef struct
+{
+    uint64_t frontier[2][SOLVE_SET_WORDS];  /* Cells found last layer. */
+    uint64_t seen[2][SOLVE_SET_WORDS];      /* Cells found so far. */
+    uint16_t depth[2][SOLVE_MAX_NODES];     /* Moves from the start, or 
+                                             * to the goal. */
+    uint16_t link[2][SOLVE_MAX_NODES];      /* Cell before, or cell after
+                                             * or SOLVE_GOAL. */
+    uint8_t  by[2][SOLVE_MAX_NODES];        /* Slide between them. */
+} bidir_search_t;
+
+/* Checkpoint of an external search, rewritten after every layer. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];  /* EXT_MAGIC, not null terminated. */
+    uint32_t version;
+    uint64_t key;                   /* Layout key of the level. */
+    uint32_t words;
+    uint32_t nlayers;               /* Layers finished, each in a file. */
+    uint64_t nodes;                 /* States expanded so far. */
+} ext_checkpoint_t;
+
+/* Follows the words of a state in the records of an external search. */
+typedef struct
+{
+    uint32_t parent;            /* Record of the state it was reached from
+                                 * in the layer before. */
+    uint8_t  action;
+    uint8_t  check;             /* TRUE if it may be in an earlier layer. */
+    uint16_t reserved;
+} ext_link_t;
+
+/* A breadth first search of a level that keeps its layers in files of
+ * sorted records in EXT_DIR, so that it isn't bounded by memory. New 
+ * states are gathered into sorted runs, merged, and then checked against 
+ * the earlier layers, but only those that the Bloom filter of every state
+ * found so far can't rule out. */
+typedef struct
+{
+    state_space_t space;
+    uint64_t  key;              /* Layout key of the level. */
+    size_t    state_size;       /* Bytes of a state. */
+    size_t    rec_size;         /* Bytes of a record. */
+    uint64_t *bloom;
+    uint64_t  bloom_mask;       /* Number of bits minus one. */
+    uint8_t  *buffer;           /* Records of the run being gathered. */
+    size_t    nbuffer;
+    size_t    buffer_size;
+    int       nruns;
+    uint32_t  nlayers;
+    uint64_t  nodes;
+} ext_search_t;
+
+/* States found by one job of a parallel search layer, which it alone 
+ * writes, and the states of the pool it has claimed but not yet used. */
+typedef struct
+{
+    uint32_t *found;
+    uint32_t  nfound;
+    uint32_t  size;
+    uint32_t  next;
+    uint32_t  end;
+} layer_job_t;
+
+/* A breadth first search of the full rules spread over every core, a 
+ * layer at a time. States go in a pool claimed a chunk at a time, and the
+ * set of states found is open addressed, with slots claimed by compare and
+ * swap, so no thread ever waits on another. Each job of a layer keeps its
+ * own list of the states it found for the next. */
+typedef struct
+{
+    state_space_t  space;
+    uint64_t      *state;
+    uint32_t      *from;
+    uint8_t       *action;
+    uint32_t       capacity;
+    volatile LONG  used;        /* States claimed from the pool. */
+    volatile LONG *slot;        /* State numbers plus one, 0 if empty. */
+    uint32_t       mask;        /* Number of slots minus one. */
+    uint32_t      *layer;       /* States of the layer being expanded. */
+    uint32_t       nlayer;
+    layer_job_t   *jobs;
+    int            njobs;
+    volatile LONG  goal;        /* State and action that reach the goal, 
+                                 * as state * 8 + action + 1, or 0. */
+    volatile LONG  full;        /* TRUE if the pool or memory ran out. */
+    volatile LONG *stop;        /* Set to give up, or NULL. */
+} parallel_bfs_t;
+
+/* Solves a level, returning the number of moves and the moves, and
+ * counting the states it expands in nodes. Gives up with SOLVE_CANCELLED
+ * once stop, if not NULL, is set. */
+typedef int (*solver_fn)(level_t *lvl, char **moves, uint64_t *nodes,
+    volatile LONG *stop);
+
+/* Totals for the solve tool. */
+typedef struct
+{
+    solver_fn solver;           /* NULL to solve static levels on their 
+                                 * stop graphs and others by BFS. */
+    int       solved;
+    int       below_par;
+    int       too_big;
+    int       cached;           /* Levels found in the solution cache. */
+    uint64_t  nodes;
+} solve_totals_t;
+
+/* Full state of a replay after a multiple of KEYFRAME_INTERVAL slides. The
+ * board is kept as an encoded level. */
+typedef struct
+{
+    size_t   level;             /* Arena offset of the stored level. */
+    int      nmoves;
+    int      bomb;
+    int      moving_block_check;
+} keyframe_t;
+
+/* A replay being watched, positioned after pos slides. */
+typedef struct
+{
+    const replay_t *replay;
+    level_t  start;             /* Level before the first slide. */
+    level_t  lvl;               /* Level after pos slides. */
+    uint32_t pos;
+    uint32_t end;               /* Slides before the goal or a hole. */
+    arena_t  arena;             /* Levels of the keyframes. */
+    keyframe_t *keyframe;
+    uint32_t nkeyframes;
+} replay_view_t;
+
+/* Replays checked by the verify tool, shared by its jobs. */
+typedef struct
+{
+    replay_reader_t *reader;
+    level_t *levels;            /* Levels of the pack. */
+    int     *pack_level;        /* Pack level of each level of the archive,
+                                 * -1 if it isn't in the pack. */
+    verdict_t *verdict;         /* One for each replay. */
+    int     *fewest;            /* Fewest moves for each level of the pack
+                                 * from the solution cache, or 0. */
+    uint32_t nreplays;
+} verify_t;
+
+/* What the audit tool found for one level. */
+typedef struct
+{
+    int      moves;             /* Fewest moves, or a SOLVE_ result. */
+    int      worker;            /* Worker whose arena holds the moves. */
+    size_t   solution;          /* Offset of the moves in the arena. */
+    uint64_t nodes;
+    DWORD    time;              /* Milliseconds spent. */
+    int      cached;            /* TRUE if found in the solution cache. */
+} audit_result_t;
+
+/* What the tables tool made for one level. */
+typedef struct
+{
+    int      moves;             /* Fewest moves, or a SOLVE_ result. */
+    uint32_t nstates;           /* States in the table. */
+    DWORD    time;              /* Milliseconds spent. */
+} table_result_t;
+
+/* Levels of a pack worked on by a tool, shared by its tasks. */
+typedef struct
+{
+    levelpack_t *pack;
+    void        *result;        /* One for each level, of the tool's type. */
+} pack_tasks_t;
+
+/* Distance table (.tbl) layout. The header is followed by every state of
+ * the level that the goal can be reached from, as packed by its state 
+ * space, sorted by their bytes. Then come the fewest moves to the goal 
+ * from each, as uint16_t. States number cells by row * cols + col, so a 
+ * table is only used for a level of the same size, board and start. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];  /* TABLE_MAGIC, not null terminated. */
+    uint32_t version;
+    uint64_t key;                   /* Key of the level's board. */
+    uint32_t words;                 /* Words in a state. */
+    uint32_t nstates;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t board;                 /* CRC-32 of the level's board. */
+    uint32_t reserved;
+    uint64_t start[SOLVE_MAX_WORDS]; /* Start state, packed. */
+} table_header_t;
+
+/* Distance table of a level mapped into memory. */
+typedef struct
+{
+    lvb_t           map;
+    state_space_t   space;
+    const uint64_t *state;
+    const uint16_t *dist;
+    uint32_t        nstates;
+} dist_table_t;
+
+/* Distance table being made for play() by another thread. Whichever of 
+ * the two lets go of it last frees it. */
+typedef struct
+{
+    level_t       lvl;
+    volatile LONG result;       /* TABLE_BUILDING, then TRUE if written. */
+    volatile LONG owners;
+} table_job_t;
+
+/* Hints for the level being played. */
+typedef struct
+{
+    dist_table_t table;
+    int          open;          /* TRUE once the table is mapped. */
+    table_job_t *job;           /* Making the table, or NULL. */
+} hint_t;
+
+/* Solution cache (.slc) layout. The header is followed by nslots slots, 
+ * found by linear probing from a hash of the board and rules of a 
+ * level. A slot whose check is wrong is empty, so a write cut short by a 
+ * crash can lose a result but never give a wrong one. */
+typedef struct
+{
+    char     magic[LVB_MAGIC_LEN];  /* SLC_MAGIC, not null terminated. */
+    uint32_t version;
+    uint32_t nslots;                /* A power of two. */
+    uint32_t count;                 /* Slots in use. */
+    uint32_t check;                 /* CRC-32 of the fields above. */
+} slc_header_t;
+
+typedef struct
+{
+    uint64_t key;               /* Layout key of the level. */
+    uint64_t nodes;
+    uint32_t rules;             /* SOLVE_RULES it was solved under. */
+    int32_t  moves;
+    uint32_t time;
+    uint32_t board;             /* Second hash of the board, so that keys
+                                 * that collide aren't taken as equal. */
+    uint16_t len;               /* Characters in solution. */
+    uint16_t reserved;
+    char     solution[SLC_MAX_LEN]; /* Not null terminated. */
+    uint32_t check;             /* CRC-32 of the fields above. */
+} slc_slot_t;
+
+/* What a solver found for a level, as kept in the solution cache. */
+typedef struct
+{
+    int      moves;             /* Fewest moves, or SOLVE_NO_SOLUTION. */
+    uint64_t nodes;             /* States the solver found. */
+    DWORD    time;              /* Milliseconds it took. */
+    char     solution[SLC_MAX_LEN + 1]; /* Moves, empty if there are 
+                                 * none. */
+} solution_t;
+
+/* The custom level store, opened for changes. */
+typedef struct
+{
+    uint32_t generation;        /* Generation of the store file. */
+    uint32_t *index;            /* Offsets of the levels, in order. */
+    int      nlevels;
+    int      capacity;          /* Length of index. */
+    uint32_t size;              /* Bytes in the store file. */
+    uint32_t used;              /* Bytes of levels that are in the index. */
+    HANDLE   compact;           /* Thread compacting the store, NULL if
+                                 * there isn't one. */
+} level_store_t;
+
 /*
  * Function Prototypes.
  */
@@ -164,12 +1234,24 @@ typedef struct
 /* Gameplay functions. */
 void menu(all_packs_t *all_packs);
 void pack_select(all_packs_t *all_packs);
-void level_select(levelpack_t *levelpack);
-int play(level_t *level, save_t *save, int level_num, int edit_mode);
+void level_select(all_packs_t *all_packs, int n);
+int play(level_t *level, save_t *save, int level_num, int edit_mode, 
+    replay_archive_t *replays);
 int move(level_t *lvl, char move);
 void hole(level_t *stored_lvl, level_t *lvl);
 void moving_block(level_t *lvl, char direction);
 void use_bomb(level_t *lvl);
+void bomb_blast(level_t *lvl);
+int simulate_slide(level_t *lvl, char direction);
+void check_replay(level_t *start, const replay_t *replay, verdict_t *verdict);
+int replay_step(level_t *lvl, const replay_t *replay, uint32_t n);
+int open_replay_view(replay_view_t *view, level_t *start, 
+    const replay_t *replay);
+void close_replay_view(replay_view_t *view);
+int add_keyframe(replay_view_t *view, level_t *lvl);
+void seek_replay(replay_view_t *view, uint32_t pos);
+void view_replay(replay_view_t *view);
+void disp_replay(replay_view_t *view);
 void bomb_animation(level_t lvl);
 
 /* Special screens. */
@@ -183,38 +1265,344 @@ void disp_board(level_t *level);
 void disp_editor(level_t *level, coord_t cursor);
 void clear_screen(void);
 void print_message_screen(char *msg[]);
-void print_level_select(char *name, save_t save);
-void print_pack_select(all_packs_t *all_packs);
+void print_level_select(char *name, save_t save, int first);
+void print_pack_select(all_packs_t *all_packs, int first);
 
 /* Saving functions. */
 void read_save(save_t *save);
-void write_save(save_t save);
+int read_save_records(save_t *save, char *buf, size_t size);
+void read_text_save(save_t *save, char *text);
+void apply_save_record(save_t *save, save_record_t *record);
+void write_save(save_t *save, uint32_t level);
+void compact_save(save_t *save);
 void clear_save(all_packs_t *all_packs);
+uint32_t save_check(save_record_t *record);
+
+/* Progress functions. */
+void clear_progress(save_t *save);
+void set_progress(save_t *save, int level, progress_t *progress);
+void update_progress(save_t *save, int level, int status, int moves, 
+    uint32_t msecs, int attempts);
+uint32_t pack_progress(int status, int moves, int attempts);
+int progress_status(progress_t *progress);
+int progress_moves(progress_t *progress);
+int progress_attempts(progress_t *progress);
+uint32_t crc32(const void *data, size_t len);
+uint32_t crc32_add(uint32_t crc, const void *data, size_t len);
+
+/* Save writer functions. */
+void start_save_writer(save_writer_t *writer);
+void stop_save_writer(save_writer_t *writer);
+void flush_saves(save_writer_t *writer);
+save_batch_t *new_save_batch(char *sav_file, int nrecords);
+void queue_save_batch(save_writer_t *writer, save_batch_t *batch);
+DWORD WINAPI save_writer(LPVOID arg);
+void write_save_batches(save_batch_t *batch);
+void replace_save_file(save_batch_t *batch);
+HANDLE open_save_file(char *sav_file);
 
 /* Level pack functions. */
 void get_levels(all_packs_t *all_packs);
-int get_pack(levelpack_t *levelpack, FILE *fp);
+char **find_pack_files(int *nfiles);
+int pack_file_cmp(const void *p1, const void *p2);
+int pack_sort_cmp(const void *p1, const void *p2);
+int pack_file_rank(char *file);
+int natural_cmp(const char *s1, const char *s2);
+char *file_ext(char *file_name);
+void init_pack(levelpack_t *levelpack, char *file_name, 
+    file_stamp_t stamp, save_writer_t *writer);
+void free_pack(levelpack_t *levelpack);
+int get_pack_name(levelpack_t *levelpack);
+int load_pack(levelpack_t *levelpack);
+int read_levels(levelpack_t *levelpack, const levelpack_t *old);
+int read_text_pack(levelpack_t *levelpack, const levelpack_t *old);
+int packs_changed(all_packs_t *all_packs);
+void refresh_pack(levelpack_t *levelpack);
+int reload_pack(levelpack_t *levelpack, char *file_name, 
+    file_stamp_t stamp);
+int is_appended(const levelpack_t *old, levelpack_t *levelpack);
+int carry_progress(levelpack_t *levelpack, levelpack_t *old);
+int file_check(char *file_name, long size, uint32_t *check);
+int cache_name(levelpack_t *levelpack, char *name, int all);
+uint64_t path_key(char *file_name);
+int attach_cache(levelpack_t *levelpack);
+int write_cache(levelpack_t *levelpack);
+void remove_old_caches(levelpack_t *levelpack, char *keep);
+int load_packs(all_packs_t *all_packs, int first, int n);
+void load_pack_job(void *ctx, int job);
+void get_pack_name_job(void *ctx, int job);
+void pack_error(levelpack_t *levelpack, char *message);
+int add_level(levelpack_t *levelpack, level_t *lvl);
+int add_stored_level(levelpack_t *levelpack, const stored_level_t *rec);
+int finish_pack(levelpack_t *levelpack);
+void get_level(levelpack_t *levelpack, int n, level_t *level);
+
+/* Level encoding functions. */
+size_t encode_level(level_t *lvl, stored_level_t *rec);
+int decode_level(const stored_level_t *rec, level_t *level);
+void init_row_decoder(row_decoder_t *dec, const stored_level_t *rec);
+int decode_row(row_decoder_t *dec, int *prev, int *row);
+void put_nibble(uint8_t *cells, size_t n, int value);
+int get_nibble(row_decoder_t *dec);
+size_t stored_level_size(const stored_level_t *rec);
+void start_prefetch(all_packs_t *all_packs);
+void finish_prefetch(all_packs_t *all_packs);
+DWORD WINAPI prefetch_packs(LPVOID arg);
+int get_file_stamp(char *file_name, file_stamp_t *stamp);
+int get_pack(levelpack_t *levelpack, level_reader_t *reader);
+void init_reader(level_reader_t *reader, FILE *fp, char *file_name);
+int stream_levels(level_reader_t *reader, char *name, int len, 
+    level_fn_t fn, void *ctx);
+int store_level(void *ctx, level_reader_t *reader, level_t *lvl);
+int read_level(level_reader_t *reader, level_t *level);
+int read_int(level_reader_t *reader, int *value);
+int read_word(level_reader_t *reader, char *word, int len);
+void reader_error(level_reader_t *reader, char *message, int line);
+void describe_error(level_reader_t *reader, char *buf, size_t len);
 int set_board(levelpack_t *levelpack);
 int all_beaten(save_t save);
 int moving_block_check(level_t *lvl);
+char *check_level(level_t *lvl);
+
+/* Compiled level pack functions. */
+int open_mapped_pack(lvb_t *lvb, char *file_name);
+int map_pack_file(lvb_t *lvb, char *file_name);
+int map_file(lvb_t *lvb, char *file_name, uint32_t min_size);
+int truncate_file(char *file_name, uint32_t size);
+int lvb_open(lvb_t *lvb, char *file_name);
+int lvs_open(lvb_t *lvb, char *file_name);
+int lvh_open(lvb_t *lvb, char *file_name);
+void lvb_close(lvb_t *lvb);
+const stored_level_t *lvb_level(lvb_t *lvb, int n);
+int lvb_get_level(lvb_t *lvb, int n, level_t *level);
+int get_compiled_pack(levelpack_t *levelpack, lvb_t *lvb);
+int compile_pack(FILE *in, char *in_name, FILE *out);
+int decompile_pack(char *in_name, FILE *out);
+
+/* Arena functions. */
+size_t arena_alloc(arena_t *arena, size_t n);
+int arena_trim(arena_t *arena);
+void arena_free(arena_t *arena);
+
+/* Worker thread functions. */
+void run_parallel(job_fn_t fn, void *ctx, int njobs);
+DWORD WINAPI job_worker(LPVOID arg);
+int count_cores(void);
+int start_scheduler(scheduler_t *sched, task_fn_t fn, void *ctx, 
+    int ntasks);
+void wait_scheduler(scheduler_t *sched, DWORD timeout);
+void free_scheduler(scheduler_t *sched);
+DWORD WINAPI stealing_worker(LPVOID arg);
+int take_task(sched_worker_t *worker, int *task);
+
+/* Command line tool functions. */
+int run_tool(int argc, char *argv[]);
+void tool_usage(void);
+int stream_tool(char *file_name, level_fn_t fn, void *ctx);
+int count_level(void *ctx, level_reader_t *reader, level_t *lvl);
+int play_level(void *ctx, level_reader_t *reader, level_t *lvl);
+int first_level(void *ctx, level_reader_t *reader, level_t *lvl);
+int store_tool(int argc, char *argv[]);
+int import_tool(char *in_name, char *out_name);
+int import_hashed_level(void *ctx, level_reader_t *reader, level_t *lvl);
+int print_level_keys(void *ctx, level_reader_t *reader, level_t *lvl);
+
+/* Content addressed store functions. */
+void get_layouts(level_t *lvl, layout_t *plain, layout_t *sym, 
+    level_keys_t *keys);
+void canonical_layout(level_t *lvl, layout_t *layout);
+void transform_layout(layout_t *src, int t, layout_t *dst);
+uint64_t layout_key(layout_t *layout);
+int same_layout(layout_t *l1, layout_t *l2);
+int open_content_store(content_store_t *store, int create);
+void close_content_store(content_store_t *store);
+int add_content_level(content_store_t *store, level_t *lvl, 
+    uint64_t *key, uint32_t *offset);
+int find_content_level(content_store_t *store, key_table_t *table, 
+    uint64_t key, layout_t *layout, int sym, uint32_t *offset);
+int read_content_level(content_store_t *store, uint32_t offset, 
+    level_t *lvl);
+int key_table_add(key_table_t *table, uint64_t key, uint32_t offset);
+int key_table_find(key_table_t *table, uint64_t key, uint32_t *offset);
+void free_key_table(key_table_t *table);
+
+/* Replay functions. */
+void start_recording(replay_recorder_t *rec);
+void restart_recording(replay_recorder_t *rec);
+int grow_recording(replay_recorder_t *rec);
+void record_slide(replay_recorder_t *rec, char direction);
+void record_bomb(replay_recorder_t *rec);
+void stop_recording(replay_recorder_t *rec);
+char replay_move(const replay_t *replay, uint32_t n);
+int replay_bomb(const replay_t *replay, uint32_t n);
+int open_replays(replay_archive_t *archive);
+void close_replays(replay_archive_t *archive);
+int add_replay(replay_archive_t *archive, uint64_t key, 
+    replay_recorder_t *rec, int result);
+int append_replay_record(replay_archive_t *archive, int kind, uint32_t value,
+    const uint8_t *data, size_t len);
+int open_replay_reader(replay_reader_t *reader, char *file_name);
+void close_replay_reader(replay_reader_t *reader);
+int read_replay_index(replay_reader_t *reader);
+uint32_t read_replay_record(lvb_t *archive, uint32_t offset, 
+    replay_record_t *record);
+int get_replay(replay_reader_t *reader, uint32_t n, replay_t *replay);
+uint32_t replay_count(replay_reader_t *reader);
+int get_replay_level(replay_reader_t *reader, uint32_t id, uint64_t *key);
+int get_replay_player(replay_reader_t *reader, uint32_t id, char *name);
+int write_replay_index(replay_reader_t *reader);
+int replays_tool(int argc, char *argv[]);
+void print_replay(replay_reader_t *reader, uint32_t n);
+void print_replays_of(replay_reader_t *reader, int by_player, uint32_t id);
+int verify_tool(char *pack_name, char *archive_name);
+int view_tool(char *pack_name, char *replay_num, char *archive_name);
+int start_pack_tasks(char *pack_name, levelpack_t *pack, pack_tasks_t *tasks,
+    size_t result_size, task_fn_t task, scheduler_t *sched);
+void finish_pack_tasks(levelpack_t *pack, pack_tasks_t *tasks, 
+    scheduler_t *sched);
+int audit_tool(char *pack_name, char *seconds);
+void audit_level(void *ctx, sched_worker_t *worker, int task, 
+    volatile LONG *stop);
+void verify_job(void *ctx, int job);
+int push_offset(uint32_t **array, uint32_t *count, uint32_t value);
+int put_varint(uint8_t *p, uint32_t value);
+int get_varint(const uint8_t *p, const uint8_t *end, uint32_t *value);
 
 /* General functions. */
 void int_swap(int *p1, int *p2);
 void clear(void);
-void level_load_error(void);
-void set_zero(int array[], int n);
-void itoa_2digit(int i, char *s);
+void level_load_error(char *detail);
+char *copy_string(char *src);
 
 /* Level editor functions. */
 void level_editor(void);
 level_t create_empty_lvl(void);
 void move_cursor(coord_t *cursor, char direction);
 level_t crop_lvl(level_t *src_lvl);
+int level_bounds(level_t *lvl, int *min_row, int *min_col, int *max_row, 
+    int *max_col);
 int is_player_and_goal_valid(level_t *lvl, coord_t goal);
-void write_level(level_t lvl);
+int write_level(level_store_t *store, level_t lvl);
+
+/* Custom level store functions. */
+int open_store(level_store_t *store);
+void close_store(level_store_t *store);
+int create_store(level_store_t *store);
+int import_level(void *ctx, level_reader_t *reader, level_t *lvl);
+uint32_t *read_store_index(char *file_name, uint32_t generation, 
+    uint32_t *nlevels);
+uint32_t *scan_store(lvb_t *lvb, uint32_t *nlevels);
+int store_append(level_store_t *store, level_t *lvl, uint32_t *offset);
+int store_add_level(level_store_t *store, level_t *lvl);
+int store_replace_level(level_store_t *store, int n, level_t *lvl);
+int store_delete_level(level_store_t *store, int n);
+int write_store_index(level_store_t *store, char *file_name, int first);
+int store_needs_compaction(level_store_t *store);
+int compact_store(level_store_t *store);
+void start_store_compaction(level_store_t *store);
+void finish_store_compaction(level_store_t *store);
+DWORD WINAPI store_compaction(LPVOID arg);
 void editor_message_screen(int message_code);
 char editor_decision_screen(int message_code);
 
+/* Solver functions. */
+int is_static_level(level_t *lvl);
+int slide_stop(level_t *lvl, int cell, int dir);
+int build_stop_graph(level_t *lvl, stop_graph_t *graph);
+int solve_level(level_t *lvl, char *moves);
+int solve_print(void *ctx, level_reader_t *reader, level_t *lvl);
+int init_state_space(level_t *lvl, state_space_t *space, uint64_t *start);
+uint64_t state_key(const uint64_t *state, int words);
+void pack_state(const state_space_t *space, const uint8_t *board, 
+    int player, int bomb, uint64_t *state);
+void unpack_state(const state_space_t *space, const uint64_t *state, 
+    uint8_t *board, int *player, int *bomb);
+void put_bits(uint64_t *words, int *pos, uint32_t value, int nbits);
+uint32_t get_bits(const uint64_t *words, int *pos, int nbits);
+int state_slide(const state_space_t *space, uint8_t *board, int *player,
+    int *bomb, int dir);
+void state_blast(const state_space_t *space, uint8_t *board, int player);
+void open_state_table(state_table_t *table, int words, size_t memory);
+int grow_state_table(state_table_t *table);
+uint32_t add_state(state_table_t *table, const uint64_t *state, 
+    uint32_t from, int action);
+void free_state_table(state_table_t *table);
+int solve_full(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop);
+uint32_t find_state(const state_table_t *table, const uint64_t *state);
+int state_moves(const uint32_t *from, const uint8_t *actions, uint32_t n, 
+    int action, char **moves);
+int action_moves(const uint8_t *action, int nmoves, char **moves);
+void init_distances(state_space_t *space, int bombs);
+void find_dead_cells(level_t *lvl, uint64_t *dead);
+int level_lost(level_t *lvl);
+int heap_push(state_heap_t *heap, uint64_t entry);
+uint64_t heap_pop(state_heap_t *heap);
+int solve_astar(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop);
+int ida_search(ida_search_t *ida, int g);
+int solve_ida(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop);
+int slide_blocked(level_t *lvl, int cell, int dir);
+void add_slide_starts(level_t *lvl, bidir_search_t *search, int cell, 
+    int to, int dir, uint64_t *next);
+int count_cells(const uint64_t *set);
+int solve_bidir(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop);
+int insert_parallel_state(parallel_bfs_t *bfs, uint32_t n);
+void expand_layer(void *ctx, int job);
+int solve_parallel(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop);
+int solve_external(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop);
+int ext_name(ext_search_t *ext, char *name, uint32_t n, const char *suffix);
+int bloom_check_add(ext_search_t *ext, const uint64_t *state);
+void sort_records(uint8_t *rec, size_t n, size_t size, size_t key_size);
+void sift_record(uint8_t *rec, size_t root, size_t n, size_t size, 
+    size_t key_size);
+void swap_records(uint8_t *a, uint8_t *b, size_t size);
+int start_search(ext_search_t *ext, const uint64_t *start);
+int resume_search(ext_search_t *ext, const uint64_t *start);
+int write_checkpoint(ext_search_t *ext);
+int expand_external(ext_search_t *ext, char **moves, volatile LONG *stop);
+int flush_run(ext_search_t *ext);
+int merge_runs(ext_search_t *ext, uint32_t n, const char *suffix, 
+    uint64_t *count);
+int compact_runs(ext_search_t *ext);
+int64_t drop_seen(ext_search_t *ext, uint64_t ncandidates);
+int mark_seen(ext_search_t *ext, FILE *cand, uint64_t first, uint64_t nwindow,
+    uint32_t layer, uint64_t *seen);
+void remove_runs(ext_search_t *ext);
+void remove_search(ext_search_t *ext);
+int ext_moves(ext_search_t *ext, uint32_t rec, int action, char **moves);
+int tables_tool(char *pack_name);
+void table_level(void *ctx, sched_worker_t *worker, int task, 
+    volatile LONG *stop);
+int table_name(level_t *lvl, char *name, uint64_t *key, uint32_t *board);
+int build_table(level_t *lvl, uint32_t *nstates, volatile LONG *stop);
+int write_table(level_t *lvl, const uint64_t *rec, uint32_t n, int words);
+int open_table(level_t *lvl, dist_table_t *table);
+uint16_t table_distance(const dist_table_t *table, const uint64_t *state);
+int get_hint(const dist_table_t *table, level_t *lvl, int *action);
+void show_hint(level_t *level, level_t *current, hint_t *hint);
+DWORD WINAPI table_thread(LPVOID arg);
+void release_table_job(table_job_t *job);
+void close_hint(hint_t *hint);
+int find_solution(level_t *lvl, solution_t *sol, int wait);
+int store_solution(level_t *lvl, int moves, const char *solution, 
+    uint64_t nodes, DWORD time);
+HANDLE open_solutions(int write, int wait);
+void close_solutions(HANDLE file);
+int read_at(HANDLE file, uint64_t offset, void *buf, DWORD size);
+int write_at(HANDLE file, uint64_t offset, const void *buf, DWORD size);
+uint64_t solution_key(level_t *lvl, uint32_t *board);
+uint32_t solution_slot(uint64_t key, uint32_t rules, uint32_t nslots);
+int read_slot(HANDLE file, uint32_t i, slc_slot_t *slot);
+int write_slot(HANDLE file, uint32_t i, const slc_slot_t *slot);
+int read_solutions_header(HANDLE file, slc_header_t *header);
+int write_solutions_header(HANDLE file, slc_header_t *header);
+int grow_solutions(HANDLE file, slc_header_t *header, uint32_t nslots);
+
 /*---------------------------------------------------------------------------*/
 /*
  * Main Function.
@@ -227,2596 +1615,14355 @@ main(int argc, char *argv[])
      * least a full screen. */
     setvbuf(stdout, NULL, _IOFBF, (SCREEN_MAX_R + 3)*(SCREEN_MAX_C + 3));
     
+    /* Any arguments select a command line tool instead of the game. */
+    if (argc > 1)
+    {
+        return run_tool(argc, argv);
+    }
+    
     /* Set levelpack. */
     all_packs_t all_packs;
+    all_packs.pack = NULL;
+    all_packs.npacks = 0;
+    all_packs.prefetch = NULL;
+    all_packs.changed = FALSE;
+    
+    /* Save files are written in the background from here on. */
+    start_save_writer(&all_packs.writer);
     
-    /* Get levels from file. */
+    /* Every attempt is recorded, if the replay archive can be opened. */
+    open_replays(&all_packs.replays);
+    
+    /* Find the levelpacks. Only their names are read here, levels are
+     * loaded when they are first needed. */
     get_levels(&all_packs);
     
+    /* Packs that change while the game runs are reloaded, so that levels
+     * can be worked on without restarting. */
+    all_packs.watch = FindFirstChangeNotification(WATCH_DIR, FALSE, 
+        WATCH_CHANGES);
+    
+    /* Load the pack the player is likely to choose while the title screen
+     * is up. */
+    start_prefetch(&all_packs);
+    
     /* Display the title screen. */
     title_screen();
     
     /* Go to menu to start gameplay. */
     menu(&all_packs);
+    
+    /* Make sure all progress is on disk before quitting. */
+    finish_prefetch(&all_packs);
+    stop_save_writer(&all_packs.writer);
+    close_replays(&all_packs.replays);
+    
+    if (all_packs.watch != INVALID_HANDLE_VALUE)
+    {
+        FindCloseChangeNotification(all_packs.watch);
+    }
 
     return 0;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Menu screen.
+ * Runs a command line tool instead of the game. Returns the exit status.
  */
 
-#define HOW_TO_PLAY     'h'
-#define CLEAR_SAVE      'c'
-#define LEVEL_EDITOR    'e'
-
-void
-menu(all_packs_t *all_packs) 
+int
+run_tool(int argc, char *argv[])
 {
-    int junk;
-    char player_choice = '\0';
+    int ok;
+    FILE *in, *out;
     
-    /* Pointer to string array for menu screen. */
-    char *menu[] = {
-" ",
-" ",
-"     MENU:",
-" ",
-" ",
-"       p:  Play game",
-" ",
-" ",
-" ",
-"       h:  How to play",
-" ",
-"       e:  Level editor",
-" ",
-"       c:  Clear completion data",
-" ",
-"       q:  Quit game",
-    NULL};
-    
-    while(TRUE) 
+    /* Convert a text levelpack into a compiled levelpack. */
+    if (argc == 4 && strcmp(argv[1], CMD_COMPILE) == 0)
     {
-        /* Display message screen. */
-        print_message_screen(menu);
+        in = stdin;
         
-        /* Get player input. */
-        junk = scanf("%c", &player_choice);
-        junk++;
+        if (   strcmp(argv[2], STDIO_FILE) != 0
+            && (in = fopen(argv[2], "r")) == NULL)
+        {
+            fprintf(stderr, "%s: cannot open file\n", argv[2]);
+            return EXIT_FAILURE;
+        }
         
-        /* Enter sub-menu depending on choice. */ 
-        if (player_choice == HOW_TO_PLAY)
+        if ((out = fopen(argv[3], "wb")) == NULL)
         {
-            how_to_play();
+            fprintf(stderr, "%s: cannot create file\n", argv[3]);
+            return EXIT_FAILURE;
         }
-        else if (player_choice == PLAY)
+        
+        ok = compile_pack(in, argv[2], out);
+        
+        fclose(out);
+        if (in != stdin)
         {
-            pack_select(all_packs);
+            fclose(in);
         }
-        else if (player_choice == LEVEL_EDITOR)
+        
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Convert a compiled levelpack back into a text levelpack. */
+    if (argc == 4 && strcmp(argv[1], CMD_DECOMPILE) == 0)
+    {
+        out = stdout;
+        
+        if (   strcmp(argv[3], STDIO_FILE) != 0
+            && (out = fopen(argv[3], "w")) == NULL)
         {
-            level_editor();
+            fprintf(stderr, "%s: cannot create file\n", argv[3]);
+            return EXIT_FAILURE;
         }
-        else if (player_choice == CLEAR_SAVE)
+        
+        ok = decompile_pack(argv[2], out);
+        
+        if (out != stdout)
         {
-            clear_save(all_packs);
+            fclose(out);
         }
-        else if (player_choice == QUIT)
+        
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Check every level of a text levelpack. */
+    if (argc == 3 && strcmp(argv[1], CMD_VALIDATE) == 0)
+    {
+        int nlevels = 0;
+        
+        if (!stream_tool(argv[2], count_level, &nlevels))
         {
-            return;
+            return EXIT_FAILURE;
         }
         
+        printf("%s: %d levels ok\n", argv[2], nlevels);
+        
+        return EXIT_SUCCESS;
     }
     
-    return;
-}
-
-/*---------------------------------------------------------------------------*/
-/*
- * Levelpack select screen.
- */
-
-void
-pack_select(all_packs_t *all_packs)
-{
-    char player_quit;
-    int junk, pack_sel;
+    /* Play each level of a text levelpack as it is read. */
+    if (argc == 3 && strcmp(argv[1], CMD_PLAY) == 0)
+    {
+        return stream_tool(argv[2], play_level, NULL) 
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     
-    /* Refresh level list. */
-    get_levels(all_packs);
+    /* Change the custom level store. */
+    if (   (argc == 3 && strcmp(argv[1], CMD_DELETE) == 0)
+        || (argc == 4 && strcmp(argv[1], CMD_REPLACE) == 0)
+        || (argc == 2 && strcmp(argv[1], CMD_COMPACT) == 0))
+    {
+        return store_tool(argc, argv);
+    }
     
-    while(TRUE)
-    {    
-        /* Display the packs available. */
-        print_pack_select(all_packs);
-        
-        /* Set values to zero after every game. */
-        pack_sel = 0;
-        player_quit = '\0';
+    /* Add the levels of a text levelpack to the content addressed store. */
+    if (argc == 4 && strcmp(argv[1], CMD_IMPORT) == 0)
+    {
+        return import_tool(argv[2], argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Look up recorded attempts. */
+    if (argc >= 2 && argc <= 4 && strcmp(argv[1], CMD_REPLAYS) == 0)
+    {
+        return replays_tool(argc, argv);
+    }
+    
+    /* Check recorded attempts against the levels of a pack. */
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], CMD_VERIFY) == 0)
+    {
+        return verify_tool(argv[2], argc == 4 
+                ? argv[3] : REPLAY_FILE REPLAY_ARCHIVE_FILE) 
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Watch a recorded attempt. */
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], CMD_VIEW) == 0)
+    {
+        return view_tool(argv[2], argv[3], argc == 5 
+                ? argv[4] : REPLAY_FILE REPLAY_ARCHIVE_FILE) 
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Find the fewest moves for each level of a levelpack on every core. */
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], CMD_AUDIT) == 0)
+    {
+        return audit_tool(argv[2], argc == 4 ? argv[3] : NULL)
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Make the distance tables that hints are taken from. */
+    if (argc == 3 && strcmp(argv[1], CMD_TABLES) == 0)
+    {
+        return tables_tool(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    /* Find the fewest moves for each level of a text levelpack. */
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], CMD_SOLVE) == 0)
+    {
+        solve_totals_t totals = {NULL, 0, 0, 0, 0, 0};
         
-        /* Get player input. */
-        if(scanf("%d", &pack_sel)!= 1)
+        if (argc == 4 && strcmp(argv[3], SOLVE_MODE_ASTAR) == 0)
         {
-            junk = scanf("%c", &player_quit);
-            junk++;
-            
-            if (player_quit == QUIT) 
-            {
-                return;
-            }
+            totals.solver = solve_astar;
+        }
+        else if (argc == 4 && strcmp(argv[3], SOLVE_MODE_IDA) == 0)
+        {
+            totals.solver = solve_ida;
+        }
+        else if (argc == 4 && strcmp(argv[3], SOLVE_MODE_BIDIR) == 0)
+        {
+            totals.solver = solve_bidir;
+        }
+        else if (argc == 4 && strcmp(argv[3], SOLVE_MODE_PARALLEL) == 0)
+        {
+            totals.solver = solve_parallel;
+        }
+        else if (argc == 4 && strcmp(argv[3], SOLVE_MODE_EXTERNAL) == 0)
+        {
+            totals.solver = solve_external;
+        }
+        else if (argc == 4 && strcmp(argv[3], SOLVE_MODE_BFS) != 0)
+        {
+            tool_usage();
+            return EXIT_FAILURE;
         }
         
-        /* Play game if correct input given. */
-        if (   pack_sel > 0 
-            && pack_sel <= (all_packs->npacks)) 
+        if (!stream_tool(argv[2], solve_print, &totals))
         {
-            /* Move to level select screen. */
-            level_select(&all_packs->pack[pack_sel-1]);
+            return EXIT_FAILURE;
         }
+        
+        printf("%s: %d solved, %d below par, %d too big, %d cached, %" 
+            PRIu64 " states\n", argv[2], totals.solved, totals.below_par, 
+            totals.too_big, totals.cached, totals.nodes);
+        
+        return EXIT_SUCCESS;
     }
     
-    return;
-}
-
-
-/*---------------------------------------------------------------------------*/
-/* 
- * Level select screen. Player returns here once the current level is
- * finished.
- */
-
-void
-level_select(levelpack_t *levelpack) 
-{
-    char player_quit;
-    int junk, level_sel;
-    
-    while(TRUE)
+    /* Print the keys of each level, and whether it is already stored. */
+    if (argc == 3 && strcmp(argv[1], CMD_HASH) == 0)
     {
-        /* Display the levels available. */                
-        print_level_select(levelpack->name, levelpack->save);
-        
-        /* Set values to zero after every game. */
-        level_sel = 0;
-        player_quit = '\0';
+        content_store_t store;
         
-        /* Get player input. */
-        if(scanf("%d", &level_sel)!= 1)
+        if (!open_content_store(&store, FALSE))
         {
-            junk = scanf("%c", &player_quit);
-            junk++;
-            
-            if (player_quit == QUIT) 
-            {
-                return;
-            }
+            fprintf(stderr, "%s: cannot open store\n", CONTENT_STORE_FILE);
+            return EXIT_FAILURE;
         }
         
-        /* Play game if correct input given. */
-        if (   level_sel > 0 
-            && level_sel <= (levelpack->nlevels)) 
-        {
-            /* Use level_sel-1 as levels are listed to player starting from
-             * 1, rather than starting from 0 as they are in the arrays. */
-            play(&levelpack->level[level_sel-1], 
-                &levelpack->save, level_sel-1, FALSE);
-        }
+        ok = stream_tool(argv[2], print_level_keys, &store);
+        close_content_store(&store);
+        
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     
-    return;
+    tool_usage();
+    
+    return EXIT_FAILURE;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Opens all levelpacks. 
+/*
+ * Reads a text levelpack from a file, or from stdin if the name is "-",
+ * passing each level to fn. Prints the first error. Returns FALSE if the
+ * levelpack couldn't be read.
  */
 
-void 
-get_levels(all_packs_t *all_packs)
+int
+stream_tool(char *file_name, level_fn_t fn, void *ctx)
 {
-    int i, pack = 0;
-    char    lvl_name[MAX_FILE_LEN],
-            sav_name[MAX_FILE_LEN],
-            pack_num[] = "00";
-    FILE *fp;
+    int ok;
+    char name[MAX_NAME_LEN], error[MAX_ERROR_LEN];
+    FILE *fp = stdin;
+    level_reader_t reader;
     
-    for (i = 0; i < MAX_LEVELPACKS; i++)
+    if (   strcmp(file_name, STDIO_FILE) != 0
+        && (fp = fopen(file_name, "r")) == NULL)
     {
-        /* Make .lvl and .sav filenames. */
-        strcpy(lvl_name, FILE_NAME);
-        itoa_2digit(i, pack_num);
-        strcat(lvl_name, pack_num);
-        
-        strcpy(sav_name, lvl_name);
-        
-        strcat(lvl_name, LEVEL_FILE);
-        strcat(sav_name, SAVE_FILE);
-        
-        if (i == (MAX_LEVELPACKS - 1))
-        {
-            strcpy(lvl_name, CUSTOM_LEVEL_FILE);
-            strcpy(sav_name, CUSTOM_LEVEL_FILE);
-            strcat(lvl_name, LEVEL_FILE);
-            strcat(sav_name, SAVE_FILE);
-        }
-        
-        /* Open file. */
-        if ((fp = fopen(lvl_name, "r")) != NULL)
-        {
-            /* Check if files are loaded successfully. */
-            if (!get_pack(&all_packs->pack[pack], fp))
-            {
-                level_load_error();
-                exit(EXIT_FAILURE);
-            }    
-            
-            /* Close file pointer. */
-            fclose(fp);
-            
-            /* Copy save file name to levelpack. */
-            strcpy(all_packs->pack[pack].save.sav_file, sav_name);
-            
-            /* Copy nlevels. */
-            all_packs->pack[pack].save.nlevels = 
-                all_packs->pack[pack].nlevels;
-            
-            /* Set save file. First assume there is no save data, then look
-             * to see if save data exists. */
-            set_zero(all_packs->pack[pack].save.data,
-                all_packs->pack[pack].nlevels);
-            
-            read_save(&all_packs->pack[pack].save);
-            
-            pack++;
-        }
+        fprintf(stderr, "%s: cannot open file\n", file_name);
+        return FALSE;
     }
     
-    /* Set total number of levelpacks. */
-    all_packs->npacks = pack;
-
-    /* Exit if no levels have been loaded. */
-    if (!pack) 
+    init_reader(&reader, fp, file_name);
+    ok = stream_levels(&reader, name, MAX_NAME_LEN, fn, ctx);
+    
+    if (!ok)
     {
-        level_load_error();
-        exit(EXIT_FAILURE);
-    }    
+        describe_error(&reader, error, sizeof(error));
+        fprintf(stderr, "%s\n", error);
+    }
+    
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+    
+    return ok;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Opens a levelpack and copies the levels.
+ * Level function for the validate tool. Levels have already been checked
+ * when they are read, so this only counts them.
  */
 
 int
-get_pack(levelpack_t *levelpack, FILE *fp)
+count_level(void *ctx, level_reader_t *reader, level_t *lvl)
 {
-    int i, j, level = 0;
-    int rows = 0, 
-        cols = 0, 
-        moves = 0;
-            
-    /* Get levelpack name. */    
-    fscanf(fp, "%s", levelpack->name);
-        
-    /* Loop while data is available. The information about the board is
-     * contained in the first row. */
-    while (fscanf(fp, "%d%d%d", &rows, &cols, &moves) == 3) 
-    {
-        /* Check if the board is too big. */
-        if (   rows > BOARD_MAX_R
-            || cols > BOARD_MAX_C)
-        {
-            return FALSE;
-        }
-        
-        /* Check if there are too many levels. */
-        if (level >= MAX_LEVELS)
-        {
-            /* Previous levels can still be used. Skip reading the following
-             * levels. */
-            break;
-        }
-        
-        /* Copy values into level. */
-        levelpack->level[level].rows = rows;
-        levelpack->level[level].cols = cols;
-        levelpack->level[level].moves = moves;
-        levelpack->level[level].nmoves = 0;
-        levelpack->level[level].moving_block_check = 
-            moving_block_check(&levelpack->level[level]);
-        levelpack->level[level].bomb = 0;
-        levelpack->level[level].message_available = FALSE;        
-        
-        for (i = 0; i < rows; i++)
-        {
-            for (j = 0; j < cols; j++)
-            {   
-                /* Get each individual level feature and copy into board. */
-                fscanf(fp, "%d", 
-                    &levelpack->level[level].board[i][j]);
-                
-                /* Get player location. */
-                if (levelpack->level[level].board[i][j] == PLAYER)
-                {
-                    levelpack->level[level].p_row = i;
-                    levelpack->level[level].p_col = j;
-                }
-            }
-        }
-        
-        /* Increment counter that tracks level number. */
-        level++;
-    }
-        
-    /* Set number of levels in the level pack. */
-    levelpack->nlevels = level;
+    (void)reader;
+    (void)lvl;
+    
+    (*(int *)ctx)++;
     
     return TRUE;
 }
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level function for the play tool. The level is played like a level from
+ * the editor, so there is no save data. Stops when the player quits.
+ */
+
+int
+play_level(void *ctx, level_reader_t *reader, level_t *lvl)
+{
+    save_t dummy_save;
     
+    (void)ctx;
+    (void)reader;
+    
+    return play(lvl, &dummy_save, 0, TRUE, NULL) > 0;
+}
+
 /*---------------------------------------------------------------------------*/
-/* 
- * Plays the game. First makes a local copy of the level that gets edited
- * while playing. It looks for input from the player, calls move() to move the
- * player accordingly.
+/*
+ * Level function that copies the first level into ctx, and stops.
  */
 
 int
-play(level_t *level, save_t *save, int level_num, int edit_mode)
+first_level(void *ctx, level_reader_t *reader, level_t *lvl)
 {
-    char direction = '\0';
-    int val, check;
+    (void)reader;
     
-    /* Make a local copy of the chosen level, so that it can be edited
-     * without changing the actual level. */
-    level_t currentlvl = *level;
-        
-    disp_board(&currentlvl);
+    *(level_t *)ctx = *lvl;
     
-    /* Clear the input buffer. Not necessary if in edit mode. */
-    if (!edit_mode)
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Deletes or replaces a level of the custom level store, or compacts it.
+ * Levels are numbered from 1. Otherwise the store is compacted by the
+ * level editor, once it has enough unused space. Returns the exit status.
+ */
+
+int
+store_tool(int argc, char *argv[])
+{
+    int n = 0, ok;
+    level_store_t store;
+    level_t lvl;
+    
+    if (argc > 2)
     {
-        clear();
+        n = atoi(argv[2]) - 1;
     }
     
-    /* Get input for player without displaying to the screen. */
-    while ( (direction = getch()) )
+    /* Read the new level before changing anything. */
+    lvl.rows = 0;
+    if (   argc == 4
+        && (!stream_tool(argv[3], first_level, &lvl) || lvl.rows == 0))
     {
-        check = TRUE;
-        
-        /* Remove messages that were previously displayed. */
-        currentlvl.message_available = FALSE;        
-        
-        /* Another move has occurred, so increment move counter. Using a bomb
+        if (lvl.rows == 0)
+        {
+            fprintf(stderr, "%s: no levels\n", argv[3]);
+        }
+        return EXIT_FAILURE;
+    }
+    
+    if (!open_store(&store))
+    {
+        fprintf(stderr, "%s: cannot open store\n", 
+            CUSTOM_LEVEL_FILE STORE_FILE);
+        return EXIT_FAILURE;
+    }
+    
+    if (argc > 2 && (n < 0 || n >= store.nlevels))
+    {
+        fprintf(stderr, "%s: no level %s\n", 
+            CUSTOM_LEVEL_FILE STORE_FILE, argv[2]);
+        close_store(&store);
+        return EXIT_FAILURE;
+    }
+    
+    if (argc == 3)
+    {
+        ok = store_delete_level(&store, n);
+    }
+    else if (argc == 4)
+    {
+        ok = store_replace_level(&store, n, &lvl);
+    }
+    else
+    {
+        ok = TRUE;
+    }
+    
+    /* The compact command compacts even a store with little unused space,
+     * but only if there is some. */
+    if (argc == 2 && store.size > sizeof(lvs_header_t) + store.used)
+    {
+        ok = compact_store(&store);
+    }
+    
+    if (!ok)
+    {
+        fprintf(stderr, "%s: write failed\n", CUSTOM_LEVEL_FILE STORE_FILE);
+    }
+    else
+    {
+        printf("%s: %d levels, %lu bytes\n", CUSTOM_LEVEL_FILE STORE_FILE, 
+            store.nlevels, (unsigned long)store.size);
+    }
+    
+    close_store(&store);
+    
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds the levels of a text levelpack to the content addressed store, and
+ * writes a hashed levelpack that lists them. Levels already in the store
+ * aren't stored again. Returns FALSE if anything failed.
+ */
+
+int
+import_tool(char *in_name, char *out_name)
+{
+    int ok;
+    char name[MAX_NAME_LEN], error[MAX_ERROR_LEN];
+    FILE *in = stdin, *out;
+    level_reader_t reader;
+    content_store_t store;
+    hashed_pack_t pack;
+    lvh_header_t header;
+    
+    if (   strcmp(in_name, STDIO_FILE) != 0
+        && (in = fopen(in_name, "r")) == NULL)
+    {
+        fprintf(stderr, "%s: cannot open file\n", in_name);
+        return FALSE;
+    }
+    
+    if (!open_content_store(&store, TRUE))
+    {
+        fprintf(stderr, "%s: cannot open store\n", CONTENT_STORE_FILE);
+        if (in != stdin)
+        {
+            fclose(in);
+        }
+        return FALSE;
+    }
+    
+    pack.store = &store;
+    pack.entry = NULL;
+    pack.nlevels = 0;
+    pack.capacity = 0;
+    pack.nnew = 0;
+    
+    init_reader(&reader, in, in_name);
+    ok = stream_levels(&reader, name, MAX_NAME_LEN, import_hashed_level, 
+        &pack);
+    
+    if (!ok)
+    {
+        describe_error(&reader, error, sizeof(error));
+        fprintf(stderr, "%s\n", error);
+    }
+    
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    
+    /* The levels must be in the store before a pack refers to them. */
+    if (ok && fflush(store.fp) != 0)
+    {
+        fprintf(stderr, "%s: write failed\n", CONTENT_STORE_FILE);
+        ok = FALSE;
+    }
+    
+    if (ok && (out = fopen(out_name, "wb")) == NULL)
+    {
+        fprintf(stderr, "%s: cannot create file\n", out_name);
+        ok = FALSE;
+    }
+    
+    if (ok)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, LVH_MAGIC, LVB_MAGIC_LEN);
+        header.version = LCS_VERSION;
+        header.nlevels = pack.nlevels;
+        strncpy(header.name, name, LVB_NAME_LEN - 1);
+        
+        ok = (   fwrite(&header, sizeof(header), 1, out) == 1
+              && fwrite(pack.entry, sizeof(lvh_entry_t), pack.nlevels, out)
+                 == (size_t)pack.nlevels);
+        
+        if (fclose(out) != 0 || !ok)
+        {
+            fprintf(stderr, "%s: write failed\n", out_name);
+            ok = FALSE;
+        }
+    }
+    
+    if (ok)
+    {
+        printf("%s: %d levels, %d new\n", out_name, pack.nlevels, pack.nnew);
+    }
+    
+    free(pack.entry);
+    close_content_store(&store);
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level function for the import tool. Adds the level to the store, if it
+ * isn't there yet, and to the hashed levelpack.
+ */
+
+int
+import_hashed_level(void *ctx, level_reader_t *reader, level_t *lvl)
+{
+    hashed_pack_t *pack = ctx;
+    lvh_entry_t *entry;
+    int result;
+    
+    if (pack->nlevels == pack->capacity)
+    {
+        pack->capacity = pack->capacity ? pack->capacity * 2 : 64;
+        entry = realloc(pack->entry, pack->capacity * sizeof(lvh_entry_t));
+        
+        if (entry == NULL)
+        {
+            reader_error(reader, "out of memory", reader->level_line);
+            return FALSE;
+        }
+        
+        pack->entry = entry;
+    }
+    
+    entry = &pack->entry[pack->nlevels];
+    
+    if ((result = add_content_level(pack->store, lvl, &entry->key, 
+                                    &entry->offset)) == CONTENT_ERROR)
+    {
+        reader_error(reader, "cannot add level to store", 
+            reader->level_line);
+        return FALSE;
+    }
+    
+    if (result == CONTENT_NEW)
+    {
+        pack->nnew++;
+    }
+    
+    entry->reserved = 0;
+    pack->nlevels++;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level function for the hash tool. Prints the keys of the level, and
+ * whether the store has the same level, or one that is a rotation or
+ * reflection of it.
+ */
+
+int
+print_level_keys(void *ctx, level_reader_t *reader, level_t *lvl)
+{
+    content_store_t *store = ctx;
+    layout_t plain, sym;
+    level_keys_t keys;
+    uint32_t offset;
+    char *status = "new";
+    
+    get_layouts(lvl, &plain, &sym, &keys);
+    
+    if (find_content_level(store, &store->by_key, keys.key, &plain, FALSE, 
+                           &offset))
+    {
+        status = "stored";
+    }
+    else if (find_content_level(store, &store->by_sym, keys.sym_key, &sym,
+                                TRUE, &offset))
+    {
+        status = "symmetric";
+    }
+    
+    printf("level %d: %016" PRIx64 " %016" PRIx64 " %s\n", reader->nlevels,
+        keys.key, keys.sym_key, status);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints the levels and players of the replay archive, the replays of one
+ * level or player, or one replay. Levels and replays are numbered from 1.
+ * Can also rebuild the index. Returns the exit status.
+ */
+
+int
+replays_tool(int argc, char *argv[])
+{
+    uint32_t i, id, *nlevel, *nplayer;
+    uint64_t key;
+    char name[REPLAY_NAME_LEN];
+    replay_reader_t reader;
+    replay_t replay;
+    int ok = TRUE;
+    
+    if (!open_replay_reader(&reader, REPLAY_FILE REPLAY_ARCHIVE_FILE))
+    {
+        fprintf(stderr, "%s: cannot open archive\n", 
+            REPLAY_FILE REPLAY_ARCHIVE_FILE);
+        return EXIT_FAILURE;
+    }
+    
+    if (argc == 2)
+    {
+        nlevel = calloc(reader.nlevels + 1, sizeof(uint32_t));
+        nplayer = calloc(reader.nplayers + 1, sizeof(uint32_t));
+        
+        for (i = 0; nlevel != NULL && nplayer != NULL 
+                    && i < replay_count(&reader); i++)
+        {
+            if (get_replay(&reader, i, &replay))
+            {
+                nlevel[replay.level]++;
+                nplayer[replay.player]++;
+            }
+        }
+        
+        printf("%s: %lu replays, %lu not indexed\n", 
+            REPLAY_FILE REPLAY_ARCHIVE_FILE, 
+            (unsigned long)replay_count(&reader), 
+            (unsigned long)reader.ntail);
+        
+        for (id = 0; nlevel != NULL && id < reader.nlevels; id++)
+        {
+            if (get_replay_level(&reader, id, &key))
+            {
+                printf("level %lu: %016" PRIx64 ", %lu replays\n", 
+                    (unsigned long)id + 1, key, (unsigned long)nlevel[id]);
+            }
+        }
+        
+        for (id = 0; nplayer != NULL && id < reader.nplayers; id++)
+        {
+            if (get_replay_player(&reader, id, name))
+            {
+                printf("player %s: %lu replays\n", name, 
+                    (unsigned long)nplayer[id]);
+            }
+        }
+        
+        free(nlevel);
+        free(nplayer);
+    }
+    else if (argc == 4 && strcmp(argv[2], CMD_LEVEL) == 0)
+    {
+        id = strtoul(argv[3], NULL, 10) - 1;
+        
+        if ((ok = id < reader.nlevels))
+        {
+            print_replays_of(&reader, FALSE, id);
+        }
+    }
+    else if (argc == 4 && strcmp(argv[2], CMD_PLAYER) == 0)
+    {
+        for (id = 0; id < reader.nplayers; id++)
+        {
+            if (   get_replay_player(&reader, id, name) 
+                && strcmp(name, argv[3]) == 0)
+            {
+                break;
+            }
+        }
+        
+        if ((ok = id < reader.nplayers))
+        {
+            print_replays_of(&reader, TRUE, id);
+        }
+    }
+    else if (argc == 3 && strcmp(argv[2], CMD_INDEX) == 0)
+    {
+        if ((ok = write_replay_index(&reader)))
+        {
+            printf("%s: %lu replays indexed\n", REPLAY_FILE REPLAY_INDEX_FILE,
+                (unsigned long)reader.nindexed);
+        }
+        else
+        {
+            fprintf(stderr, "%s: write failed\n", 
+                REPLAY_FILE REPLAY_INDEX_FILE);
+        }
+        
+        close_replay_reader(&reader);
+        
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else if (argc == 3)
+    {
+        id = strtoul(argv[2], NULL, 10) - 1;
+        
+        if ((ok = id < replay_count(&reader)))
+        {
+            print_replay(&reader, id);
+        }
+    }
+    else
+    {
+        close_replay_reader(&reader);
+        tool_usage();
+        return EXIT_FAILURE;
+    }
+    
+    if (!ok)
+    {
+        fprintf(stderr, "%s: no %s %s\n", REPLAY_FILE REPLAY_ARCHIVE_FILE, 
+            argc == 3 ? "replay" : argv[2], argv[argc - 1]);
+    }
+    
+    close_replay_reader(&reader);
+    
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints every replay of a level, or of a player if by_player is TRUE. The
+ * indexed replays are listed by the index, only the rest are read to find 
+ * out whose they are.
+ */
+
+void
+print_replays_of(replay_reader_t *reader, int by_player, uint32_t id)
+{
+    const uint32_t *start = by_player ? reader->player_start 
+                                      : reader->level_start;
+    const uint32_t *list = by_player ? reader->by_player : reader->by_level;
+    const rpi_header_t *header = (const rpi_header_t *)reader->index.base;
+    uint32_t i;
+    replay_t replay;
+    
+    /* Levels and players after the end of the index have no list. */
+    if (   header != NULL 
+        && id < (by_player ? header->nplayers : header->nlevels)
+        && start[id] <= start[id + 1])
+    {
+        for (i = start[id]; i < start[id + 1] && i < reader->nindexed; i++)
+        {
+            print_replay(reader, list[i]);
+        }
+    }
+    
+    for (i = reader->nindexed; i < replay_count(reader); i++)
+    {
+        if (   get_replay(reader, i, &replay)
+            && (by_player ? replay.player : replay.level) == id)
+        {
+            print_replay(reader, i);
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints a replay on one line: when it was played, by whom, how it ended,
+ * and its slides, with a bomb shown before the slide it was used before.
+ */
+
+void
+print_replay(replay_reader_t *reader, uint32_t n)
+{
+    char name[REPLAY_NAME_LEN], date[MAX_NAME_LEN * 2];
+    char *result[] = {"quit", "won", "restarted", "fell"};
+    uint32_t i;
+    time_t when;
+    struct tm *local;
+    replay_t replay;
+    
+    if (   !get_replay(reader, n, &replay)
+        || !get_replay_player(reader, replay.player, name))
+    {
+        printf("replay %lu: damaged\n", (unsigned long)n + 1);
+        return;
+    }
+    
+    when = (time_t)reader->base_time + replay.time;
+    
+    /* A time too far out to convert is shown as unknown. */
+    if (   (local = localtime(&when)) == NULL
+        || strftime(date, sizeof(date), REPLAY_TIME_FORMAT, local) == 0)
+    {
+        strcpy(date, "unknown time");
+    }
+    
+    printf("replay %lu: level %lu, %s, %s, %s, %lu moves ", 
+        (unsigned long)n + 1, (unsigned long)replay.level + 1, name, date, 
+        result[replay.result], (unsigned long)replay.nslides);
+    
+    for (i = 0; i <= replay.nslides; i++)
+    {
+        if (replay_bomb(&replay, i))
+        {
+            putchar(BOMB_INPUT);
+        }
+        if (i < replay.nslides)
+        {
+            putchar(replay_move(&replay, i));
+        }
+    }
+    
+    putchar('\n');
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Plays every replay of an archive whose level is in a pack, without 
+ * showing anything, and prints whether it reaches the goal and how its
+ * moves compare with par, and with the fewest if the level is in the 
+ * solution cache. Replays are checked in parallel. Returns FALSE if the 
+ * pack or the archive can't be read.
+ */
+
+int
+verify_tool(char *pack_name, char *archive_name)
+{
+    char *result[] = {"no goal after", "goal in", "no goal after", 
+                      "fell after"};
+    char *recorded[] = {"quit", "won", "restarted", "fell"};
+    char *name = copy_string(pack_name);
+    file_stamp_t stamp;
+    levelpack_t pack;
+    replay_reader_t reader;
+    key_table_t levels;
+    layout_t layout;
+    level_keys_t keys;
+    verify_t verify;
+    verdict_t *v;
+    solution_t sol;
+    uint32_t i, id, nwon = 0, npar = 0, nchecked = 0;
+    uint64_t key;
+    int ok;
+    
+    if (name == NULL)
+    {
+        return FALSE;
+    }
+    
+    /* With its stamp, the pack can use the shared cache. */
+    if (!get_file_stamp(name, &stamp))
+    {
+        memset(&stamp, 0, sizeof(stamp));
+    }
+    memset(&levels, 0, sizeof(levels));
+    memset(&verify, 0, sizeof(verify));
+    init_pack(&pack, name, stamp, NULL);
+    
+    if (!load_pack(&pack))
+    {
+        fprintf(stderr, "%s: %s\n", pack_name, 
+            pack.error != NULL ? pack.error : "cannot load levelpack");
+        free_pack(&pack);
+        return FALSE;
+    }
+    
+    if (!open_replay_reader(&reader, archive_name))
+    {
+        fprintf(stderr, "%s: cannot open archive\n", archive_name);
+        free_pack(&pack);
+        return FALSE;
+    }
+    
+    verify.reader = &reader;
+    verify.nreplays = replay_count(&reader);
+    verify.levels = malloc((pack.nlevels + 1) * sizeof(level_t));
+    verify.fewest = calloc(pack.nlevels + 1, sizeof(int));
+    verify.pack_level = malloc((reader.nlevels + 1) * sizeof(int));
+    verify.verdict = malloc((verify.nreplays + 1) * sizeof(verdict_t));
+    
+    ok = (   verify.levels != NULL && verify.pack_level != NULL 
+          && verify.verdict != NULL && verify.fewest != NULL);
+    
+    /* Levels are matched by the key of their layout. */
+    for (i = 0; ok && i < (uint32_t)pack.nlevels; i++)
+    {
+        get_level(&pack, i, &verify.levels[i]);
+        get_layouts(&verify.levels[i], &layout, NULL, &keys);
+        ok = key_table_add(&levels, keys.key, i);
+        
+        if (ok && find_solution(&verify.levels[i], &sol, TRUE) 
+            && sol.moves > 0)
+        {
+            verify.fewest[i] = sol.moves;
+        }
+    }
+    
+    for (id = 0; ok && id < reader.nlevels; id++)
+    {
+        verify.pack_level[id] = -1;
+        
+        if (   get_replay_level(&reader, id, &key)
+            && key_table_find(&levels, key, &i))
+        {
+            verify.pack_level[id] = i;
+        }
+    }
+    
+    if (!ok)
+    {
+        fprintf(stderr, "%s: out of memory\n", archive_name);
+    }
+    else
+    {
+        run_parallel(verify_job, &verify, 
+            (verify.nreplays + VERIFY_CHUNK - 1) / VERIFY_CHUNK);
+    }
+    
+    for (i = 0; ok && i < verify.nreplays; i++)
+    {
+        v = &verify.verdict[i];
+        
+        if (v->result == REPLAY_NO_LEVEL)
+        {
+            continue;
+        }
+        
+        printf("replay %lu: ", (unsigned long)i + 1);
+        
+        if (v->result == REPLAY_DAMAGED)
+        {
+            printf("damaged\n");
+            continue;
+        }
+        
+        nchecked++;
+        printf("level %d, ", v->level + 1);
+        
+        if (v->result == REPLAY_TOO_LONG)
+        {
+            printf("moves after the end of the attempt\n");
+            continue;
+        }
+        
+        printf("%s in %lu moves, par %d", result[v->result], 
+            (unsigned long)v->moves, verify.levels[v->level].moves);
+        
+        if (verify.fewest[v->level] > 0)
+        {
+            printf(", fewest %d", verify.fewest[v->level]);
+        }
+        
+        if (v->result == REPLAY_WON)
+        {
+            nwon++;
+            npar += v->moves <= (uint32_t)verify.levels[v->level].moves;
+        }
+        
+        /* A restart is also an attempt that didn't reach the goal. */
+        if (   (v->result == REPLAY_WON) != (v->recorded == REPLAY_WON)
+            || (v->result == REPLAY_HOLE) != (v->recorded == REPLAY_HOLE))
+        {
+            printf(", recorded as %s", recorded[v->recorded]);
+        }
+        
+        printf("\n");
+    }
+    
+    if (ok)
+    {
+        printf("%s: %lu replays of %s, %lu reach the goal, %lu at par\n",
+            archive_name, (unsigned long)nchecked, pack.name, 
+            (unsigned long)nwon, (unsigned long)npar);
+    }
+    
+    free(verify.levels);
+    free(verify.pack_level);
+    free(verify.verdict);
+    free(verify.fewest);
+    free_key_table(&levels);
+    close_replay_reader(&reader);
+    free_pack(&pack);
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Shows replay number replay_num of an archive, on its level from a pack.
+ * Returns FALSE if the replay or its level can't be found.
+ */
+
+int
+view_tool(char *pack_name, char *replay_num, char *archive_name)
+{
+    char *name = copy_string(pack_name);
+    uint32_t n = strtoul(replay_num, NULL, 10) - 1;
+    int i, found = FALSE;
+    uint64_t key;
+    file_stamp_t stamp;
+    levelpack_t pack;
+    replay_reader_t reader;
+    replay_t replay;
+    replay_view_t view;
+    layout_t layout;
+    level_keys_t keys;
+    level_t lvl;
+    
+    if (name == NULL)
+    {
+        return FALSE;
+    }
+    
+    if (!get_file_stamp(name, &stamp))
+    {
+        memset(&stamp, 0, sizeof(stamp));
+    }
+    init_pack(&pack, name, stamp, NULL);
+    
+    if (!load_pack(&pack))
+    {
+        fprintf(stderr, "%s: %s\n", pack_name, 
+            pack.error != NULL ? pack.error : "cannot load levelpack");
+        free_pack(&pack);
+        return FALSE;
+    }
+    
+    if (!open_replay_reader(&reader, archive_name))
+    {
+        fprintf(stderr, "%s: cannot open archive\n", archive_name);
+        free_pack(&pack);
+        return FALSE;
+    }
+    
+    if (   !get_replay(&reader, n, &replay)
+        || !get_replay_level(&reader, replay.level, &key))
+    {
+        fprintf(stderr, "%s: no replay %s\n", archive_name, replay_num);
+    }
+    else
+    {
+        for (i = 0; !found && i < pack.nlevels; i++)
+        {
+            get_level(&pack, i, &lvl);
+            get_layouts(&lvl, &layout, NULL, &keys);
+            found = (keys.key == key);
+        }
+        
+        if (!found)
+        {
+            fprintf(stderr, "%s: replay %s is not of a level in %s\n", 
+                archive_name, replay_num, pack_name);
+        }
+        else if (!open_replay_view(&view, &lvl, &replay))
+        {
+            fprintf(stderr, "%s: out of memory\n", archive_name);
+            found = FALSE;
+        }
+        else
+        {
+            view_replay(&view);
+            close_replay_view(&view);
+        }
+    }
+    
+    close_replay_reader(&reader);
+    free_pack(&pack);
+    
+    return found;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Loads a levelpack into pack and starts a task on sched for each of its 
+ * levels, with tasks as the context, after giving tasks one zeroed result 
+ * of result_size bytes for each level. Returns FALSE, having printed why, 
+ * if the pack can't be loaded or out of memory.
+ */
+
+int
+start_pack_tasks(char *pack_name, levelpack_t *pack, pack_tasks_t *tasks,
+    size_t result_size, task_fn_t task, scheduler_t *sched)
+{
+    char *name = copy_string(pack_name);
+    file_stamp_t stamp;
+    
+    if (name == NULL)
+    {
+        return FALSE;
+    }
+    
+    /* With its stamp, the pack can use the shared cache. */
+    if (!get_file_stamp(name, &stamp))
+    {
+        memset(&stamp, 0, sizeof(stamp));
+    }
+    init_pack(pack, name, stamp, NULL);
+    
+    if (!load_pack(pack))
+    {
+        fprintf(stderr, "%s: %s\n", pack_name, 
+            pack->error != NULL ? pack->error : "cannot load levelpack");
+        free_pack(pack);
+        return FALSE;
+    }
+    
+    tasks->pack = pack;
+    tasks->result = calloc(pack->nlevels + 1, result_size);
+    
+    if (   tasks->result == NULL 
+        || !start_scheduler(sched, task, tasks, pack->nlevels))
+    {
+        fprintf(stderr, "%s: out of memory\n", pack_name);
+        free(tasks->result);
+        free_pack(pack);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees what start_pack_tasks() set up, once the scheduler is done.
+ */
+
+void
+finish_pack_tasks(levelpack_t *pack, pack_tasks_t *tasks, scheduler_t *sched)
+{
+    free_scheduler(sched);
+    free(tasks->result);
+    free_pack(pack);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Solves every level of a levelpack on a work stealing scheduler, giving 
+ * up on any level after seconds, or AUDIT_TIMEOUT if NULL, and prints the
+ * fewest moves for each next to its par. Levels in the solution cache 
+ * aren't solved again. Returns FALSE if the pack can't be loaded or out 
+ * of memory.
+ */
+
+int
+audit_tool(char *pack_name, char *seconds)
+{
+    char *moves;
+    int i, timeout = AUDIT_TIMEOUT, counts[5] = {0, 0, 0, 0, 0};
+    levelpack_t pack;
+    scheduler_t sched;
+    pack_tasks_t tasks;
+    audit_result_t *res;
+    level_t lvl;
+    
+    if (seconds != NULL && (sscanf(seconds, "%d", &timeout) != 1 
+                            || timeout < 0))
+    {
+        tool_usage();
+        return FALSE;
+    }
+    
+    if (!start_pack_tasks(pack_name, &pack, &tasks, sizeof(audit_result_t),
+                          audit_level, &sched))
+    {
+        return FALSE;
+    }
+    
+    wait_scheduler(&sched, (DWORD)timeout * 1000);
+    
+    for (i = 0; i < pack.nlevels; i++)
+    {
+        res = (audit_result_t *)tasks.result + i;
+        get_level(&pack, i, &lvl);
+        printf("level %d: ", i + 1);
+        counts[4] += res->cached;
+        
+        if (res->moves == SOLVE_CANCELLED)
+        {
+            printf("timed out\n");
+            counts[2]++;
+        }
+        else if (res->moves == SOLVE_TOO_BIG)
+        {
+            printf("too many states\n");
+            counts[3]++;
+        }
+        else if (res->moves == SOLVE_NO_SOLUTION)
+        {
+            printf("no solution\n");
+        }
+        else
+        {
+            moves = (res->solution != ARENA_FAILED) 
+                ? (char *)sched.worker[res->worker].arena.base + res->solution 
+                : "";
+            printf("%d moves, par %d%s, %" PRIu64 " states, %lu ms: %s\n",
+                res->moves, lvl.moves, 
+                res->moves < lvl.moves ? " (below par)" : "", res->nodes,
+                (unsigned long)res->time, moves);
+            counts[0]++;
+            counts[1] += (res->moves < lvl.moves);
+        }
+    }
+    
+    printf("%s: %d solved, %d below par, %d timed out, %d too big, "
+        "%d cached\n", pack_name, counts[0], counts[1], counts[2], 
+        counts[3], counts[4]);
+    
+    finish_pack_tasks(&pack, &tasks, &sched);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Makes the distance table of every level of a levelpack on a work 
+ * stealing scheduler, and prints the fewest moves for each and how many 
+ * states its table holds. Returns FALSE if the pack can't be loaded or 
+ * out of memory.
+ */
+
+int
+tables_tool(char *pack_name)
+{
+    int i, counts[2] = {0, 0};
+    levelpack_t pack;
+    scheduler_t sched;
+    pack_tasks_t tasks;
+    table_result_t *res;
+    
+    if (!start_pack_tasks(pack_name, &pack, &tasks, sizeof(table_result_t),
+                          table_level, &sched))
+    {
+        return FALSE;
+    }
+    
+    wait_scheduler(&sched, 0);
+    
+    for (i = 0; i < pack.nlevels; i++)
+    {
+        res = (table_result_t *)tasks.result + i;
+        printf("level %d: ", i + 1);
+        
+        if (res->moves == SOLVE_TOO_BIG)
+        {
+            printf("too many states\n");
+            counts[1]++;
+            continue;
+        }
+        
+        if (res->moves == SOLVE_NO_SOLUTION)
+        {
+            printf("no solution, ");
+        }
+        else
+        {
+            printf("%d moves, ", res->moves);
+        }
+        
+        printf("%lu states, %lu ms\n", (unsigned long)res->nstates, 
+            (unsigned long)res->time);
+        counts[0]++;
+    }
+    
+    printf("%s: %d tables written, %d too big\n", pack_name, counts[0], 
+        counts[1]);
+    
+    finish_pack_tasks(&pack, &tasks, &sched);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Job for the verify tool. Checks replays job * VERIFY_CHUNK onwards. The
+ * archive is only read, so jobs don't need to take turns.
+ */
+
+void
+verify_job(void *ctx, int job)
+{
+    verify_t *verify = ctx;
+    verdict_t *v;
+    replay_t replay;
+    uint32_t i = (uint32_t)job * VERIFY_CHUNK;
+    uint32_t end = i + VERIFY_CHUNK;
+    
+    if (end > verify->nreplays)
+    {
+        end = verify->nreplays;
+    }
+    
+    for ( ; i < end; i++)
+    {
+        v = &verify->verdict[i];
+        v->level = -1;
+        
+        if (!get_replay(verify->reader, i, &replay))
+        {
+            v->result = REPLAY_DAMAGED;
+        }
+        else if ((v->level = verify->pack_level[replay.level]) < 0)
+        {
+            v->result = REPLAY_NO_LEVEL;
+        }
+        else
+        {
+            v->recorded = replay.result;
+            check_replay(&verify->levels[v->level], &replay, v);
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints the command line tools that are available.
+ */
+
+void
+tool_usage(void)
+{
+    fprintf(stderr, 
+        "usage: slider\n"
+        "       slider %s <in.lvl | -> <out.lvb>\n"
+        "       slider %s <in.lvb | in.lvs | in.lvh> <out.lvl | ->\n"
+        "       slider %s <in.lvl | ->\n"
+        "       slider %s <in.lvl | ->\n"
+        "       slider %s <level>\n"
+        "       slider %s <level> <in.lvl | ->\n"
+        "       slider %s\n"
+        "       slider %s <in.lvl | -> <out.lvh>\n"
+        "       slider %s <in.lvl | ->\n"
+        "       slider %s [<replay> | %s <level> | %s <name> | %s]\n"
+        "       slider %s <pack> [<in.rpa>]\n"
+        "       slider %s <pack> <replay> [<in.rpa>]\n"
+        "       slider %s <in.lvl | -> [%s | %s | %s | %s | %s | %s]\n"
+        "       slider %s <pack> [<seconds>]\n"
+        "       slider %s <pack>\n",
+        CMD_COMPILE, CMD_DECOMPILE, CMD_VALIDATE, CMD_PLAY,
+        CMD_DELETE, CMD_REPLACE, CMD_COMPACT, CMD_IMPORT, CMD_HASH,
+        CMD_REPLAYS, CMD_LEVEL, CMD_PLAYER, CMD_INDEX, CMD_VERIFY, CMD_VIEW,
+        CMD_SOLVE, SOLVE_MODE_BFS, SOLVE_MODE_ASTAR, SOLVE_MODE_IDA,
+        SOLVE_MODE_BIDIR, SOLVE_MODE_PARALLEL, SOLVE_MODE_EXTERNAL, 
+        CMD_AUDIT, CMD_TABLES);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Menu screen.
+ */
+
+#define HOW_TO_PLAY     'h'
+#define CLEAR_SAVE      'c'
+#define LEVEL_EDITOR    'e'
+
+void
+menu(all_packs_t *all_packs) 
+{
+    int junk;
+    char player_choice = '\0';
+    
+    /* Pointer to string array for menu screen. */
+    char *menu[] = {
+" ",
+" ",
+"     MENU:",
+" ",
+" ",
+"       p:  Play game",
+" ",
+" ",
+" ",
+"       h:  How to play",
+" ",
+"       e:  Level editor",
+" ",
+"       c:  Clear completion data",
+" ",
+"       q:  Quit game",
+    NULL};
+    
+    while(TRUE) 
+    {
+        /* Display message screen. */
+        print_message_screen(menu);
+        
+        /* Get player input. */
+        junk = scanf("%c", &player_choice);
+        junk++;
+        
+        /* Enter sub-menu depending on choice. */ 
+        if (player_choice == HOW_TO_PLAY)
+        {
+            how_to_play();
+        }
+        else if (player_choice == PLAY)
+        {
+            pack_select(all_packs);
+        }
+        else if (player_choice == LEVEL_EDITOR)
+        {
+            level_editor();
+        }
+        else if (player_choice == CLEAR_SAVE)
+        {
+            clear_save(all_packs);
+        }
+        else if (player_choice == QUIT)
+        {
+            return;
+        }
+        
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Levelpack select screen.
+ */
+
+void
+pack_select(all_packs_t *all_packs)
+{
+    char player_quit;
+    int junk, pack_sel, i, first = 0;
+    
+    /* Refresh level list. Packs that haven't changed stay loaded. */
+    finish_prefetch(all_packs);
+    get_levels(all_packs);
+    all_packs->changed = FALSE;
+    
+    while(TRUE)
+    {    
+        /* List the packs again if their files have changed. */
+        if (packs_changed(all_packs))
+        {
+            get_levels(all_packs);
+            all_packs->changed = FALSE;
+            
+            if (first >= all_packs->npacks)
+            {
+                first = 0;
+            }
+        }
+        
+        /* Load the packs shown on screen, as their beaten status is
+         * needed. */
+        if ((i = load_packs(all_packs, first, PACKS_PER_PAGE)) >= 0)
+        {
+            level_load_error(all_packs->pack[i].error);
+            exit(EXIT_FAILURE);
+        }
+        
+        /* Display the packs available. */
+        print_pack_select(all_packs, first);
+        
+        /* Set values to zero after every game. */
+        pack_sel = 0;
+        player_quit = '\0';
+        
+        /* Get player input. */
+        if(scanf("%d", &pack_sel)!= 1)
+        {
+            junk = scanf("%c", &player_quit);
+            junk++;
+            
+            if (player_quit == QUIT) 
+            {
+                return;
+            }
+            
+            /* Change page if there is one. */
+            if (   player_quit == NEXT_PAGE
+                && first + PACKS_PER_PAGE < all_packs->npacks)
+            {
+                first += PACKS_PER_PAGE;
+            }
+            else if (player_quit == PREV_PAGE && first > 0)
+            {
+                first -= PACKS_PER_PAGE;
+            }
+        }
+        
+        /* Play game if correct input given. */
+        if (   pack_sel > 0 
+            && pack_sel <= (all_packs->npacks)) 
+        {
+            /* Move to level select screen. */
+            level_select(all_packs, pack_sel-1);
+        }
+    }
+    
+    return;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Level select screen. Player returns here once the current level is
+ * finished.
+ */
+
+void
+level_select(all_packs_t *all_packs, int n) 
+{
+    char player_quit;
+    int junk, level_sel, first = 0;
+    level_t level;
+    levelpack_t *levelpack = &all_packs->pack[n];
+    
+    /* Make sure levels have been loaded. */
+    if (!load_pack(levelpack))
+    {
+        level_load_error(levelpack->error);
+        exit(EXIT_FAILURE);
+    }
+    
+    while(TRUE)
+    {
+        /* Pick up changes to the pack's file between games. */
+        if (packs_changed(all_packs))
+        {
+            refresh_pack(levelpack);
+            
+            if (first >= levelpack->nlevels)
+            {
+                first = 0;
+            }
+        }
+        
+        /* Display the levels available. */                
+        print_level_select(levelpack->name, levelpack->save, first);
+        
+        /* Set values to zero after every game. */
+        level_sel = 0;
+        player_quit = '\0';
+        
+        /* Get player input. */
+        if(scanf("%d", &level_sel)!= 1)
+        {
+            junk = scanf("%c", &player_quit);
+            junk++;
+            
+            if (player_quit == QUIT) 
+            {
+                return;
+            }
+            
+            /* Change page if there is one. */
+            if (   player_quit == NEXT_PAGE
+                && first + LEVELS_PER_PAGE < levelpack->nlevels)
+            {
+                first += LEVELS_PER_PAGE;
+            }
+            else if (player_quit == PREV_PAGE && first > 0)
+            {
+                first -= LEVELS_PER_PAGE;
+            }
+        }
+        
+        /* Play game if correct input given. */
+        if (   level_sel > 0 
+            && level_sel <= (levelpack->nlevels)) 
+        {
+            /* Use level_sel-1 as levels are listed to player starting from
+             * 1, rather than starting from 0 as they are in the arrays. */
+            get_level(levelpack, level_sel-1, &level);
+            play(&level, &levelpack->save, level_sel-1, FALSE, 
+                &all_packs->replays);
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Finds all levelpacks in the current directory, and reads their names.
+ * Levels are loaded later by load_pack(). Packs that were found before and
+ * whose files haven't changed keep their loaded levels, and loaded packs
+ * whose files have changed are reloaded.
+ */
+
+void 
+get_levels(all_packs_t *all_packs)
+{
+    int i, nfiles, old = 0, pack = 0, cmp;
+    char **files;
+    file_stamp_t stamp;
+    levelpack_t *packs, *levelpack;
+    
+    files = find_pack_files(&nfiles);
+    packs = malloc((nfiles ? nfiles : 1) * sizeof(levelpack_t));
+    
+    if (files == NULL || packs == NULL)
+    {
+        level_load_error(NULL);
+        exit(EXIT_FAILURE);
+    }
+    
+    for (i = 0; i < nfiles; i++)
+    {
+        /* The file may have been removed since it was found. */
+        if (!get_file_stamp(files[i], &stamp))
+        {
+            free(files[i]);
+            continue;
+        }
+        
+        /* Both lists are sorted, so old packs that come before this file
+         * are no longer there. */
+        cmp = -1;
+        while (   old < all_packs->npacks
+               && (cmp = pack_file_cmp(&all_packs->pack[old].lvl_file, 
+                                       &files[i])) < 0)
+        {
+            free_pack(&all_packs->pack[old++]);
+        }
+        
+        levelpack = &packs[pack++];
+        
+        /* Keep the pack if it was found last time and hasn't changed. */
+        if (   cmp == 0
+            && all_packs->pack[old].state == PACK_LOADED
+            && strcmp(all_packs->pack[old].lvl_file, files[i]) == 0
+            && all_packs->pack[old].stamp.time == stamp.time
+            && all_packs->pack[old].stamp.size == stamp.size)
+        {
+            *levelpack = all_packs->pack[old++];
+            free(files[i]);
+            continue;
+        }
+        
+        /* A loaded pack is reloaded in place, so that its progress goes
+         * with its levels. If it can't be read, the old levels stay. */
+        if (cmp == 0 && all_packs->pack[old].state == PACK_LOADED)
+        {
+            *levelpack = all_packs->pack[old++];
+            
+            if (!reload_pack(levelpack, files[i], stamp))
+            {
+                free(files[i]);
+            }
+            continue;
+        }
+        
+        if (cmp == 0)
+        {
+            free_pack(&all_packs->pack[old++]);
+        }
+        
+        init_pack(levelpack, files[i], stamp, &all_packs->writer);
+        
+        if (levelpack->save.sav_file == NULL)
+        {
+            level_load_error(NULL);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    /* Free the old packs that are left over. */
+    while (old < all_packs->npacks)
+    {
+        free_pack(&all_packs->pack[old++]);
+    }
+    
+    free(all_packs->pack);
+    free(files);
+    
+    /* Set levelpacks. */
+    all_packs->pack = packs;
+    all_packs->npacks = pack;
+
+    /* Exit if no levels have been found. */
+    if (!pack) 
+    {
+        level_load_error(NULL);
+        exit(EXIT_FAILURE);
+    }    
+    
+    /* Read the names of new packs in parallel. */
+    run_parallel(get_pack_name_job, all_packs, pack);
+    
+    /* Check if the names are loaded successfully. Errors are checked in
+     * order, so the same one is always reported. */
+    for (i = 0; i < pack; i++)
+    {
+        if (all_packs->pack[i].error != NULL)
+        {
+            level_load_error(all_packs->pack[i].error);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Lists the levelpack files in the current directory, in the order they are
+ * shown to the player. When a pack has more than one file, only the one 
+ * pack_file_rank() puts first is listed. Returns NULL if out of memory.
+ */
+
+char **
+find_pack_files(int *nfiles)
+{
+    int i, n = 0, capacity = MIN_INDEX_LEN;
+    char *ext, **files, **new_files;
+    HANDLE find;
+    WIN32_FIND_DATA data;
+    
+    if ((files = malloc(capacity * sizeof(char *))) == NULL)
+    {
+        return NULL;
+    }
+    
+    find = FindFirstFile(PACK_DIR_PATTERN, &data);
+    
+    while (find != INVALID_HANDLE_VALUE)
+    {
+        ext = file_ext(data.cFileName);
+        
+        if (   !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            && (   strcmp(ext, LEVEL_FILE) == 0 
+                || strcmp(ext, COMPILED_FILE) == 0
+                || strcmp(ext, STORE_FILE) == 0
+                || strcmp(ext, HASHED_FILE) == 0))
+        {
+            /* Grow the list if needed. */
+            if (n == capacity)
+            {
+                capacity *= 2;
+                new_files = realloc(files, capacity * sizeof(char *));
+                
+                if (new_files == NULL)
+                {
+                    break;
+                }
+                files = new_files;
+            }
+            
+            if ((files[n] = copy_string(data.cFileName)) != NULL)
+            {
+                n++;
+            }
+        }
+        
+        if (!FindNextFile(find, &data))
+        {
+            FindClose(find);
+            find = INVALID_HANDLE_VALUE;
+        }
+    }
+    
+    qsort(files, n, sizeof(char *), pack_sort_cmp);
+    
+    /* Files of the same pack sort by rank, so remove any file that follows
+     * one with its name. */
+    *nfiles = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (   *nfiles > 0
+            && pack_file_cmp(&files[*nfiles - 1], &files[i]) == 0)
+        {
+            free(files[i]);
+        }
+        else
+        {
+            files[(*nfiles)++] = files[i];
+        }
+    }
+    
+    return files;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Orders levelpacks by their file names. The custom levelpack is always
+ * last, others are in natural order so that slider2 comes before slider10.
+ * Extensions are ignored, so the files of the same pack compare equal.
+ */
+
+int
+pack_file_cmp(const void *p1, const void *p2)
+{
+    char *f1 = *(char **)p1, *f2 = *(char **)p2;
+    size_t len1 = file_ext(f1) - f1, len2 = file_ext(f2) - f2;
+    int custom1, custom2;
+    char base1[MAX_PATH], base2[MAX_PATH];
+    
+    /* Compare file names without their extensions. */
+    if (len1 >= MAX_PATH || len2 >= MAX_PATH)
+    {
+        return strcmp(f1, f2);
+    }
+    memcpy(base1, f1, len1);
+    memcpy(base2, f2, len2);
+    base1[len1] = '\0';
+    base2[len2] = '\0';
+    
+    custom1 = (strcmp(base1, CUSTOM_LEVEL_FILE) == 0);
+    custom2 = (strcmp(base2, CUSTOM_LEVEL_FILE) == 0);
+    
+    if (custom1 != custom2)
+    {
+        return custom1 - custom2;
+    }
+    
+    return natural_cmp(base1, base2);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Orders levelpack files for qsort(). Files of the same pack are ordered by
+ * pack_file_rank().
+ */
+
+int
+pack_sort_cmp(const void *p1, const void *p2)
+{
+    int cmp = pack_file_cmp(p1, p2);
+    
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    
+    return pack_file_rank(*(char **)p1) - pack_file_rank(*(char **)p2);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Ranks the files of one levelpack, lowest first. The custom level store,
+ * where the editor saves, comes first, then the other compiled forms, and
+ * the text file last, so a text file left beside them is never used.
+ */
+
+int
+pack_file_rank(char *file)
+{
+    static const char *order[] = {STORE_FILE, HASHED_FILE, COMPILED_FILE, 
+                                  LEVEL_FILE, NULL};
+    char *ext = file_ext(file);
+    int i;
+    
+    for (i = 0; order[i] != NULL && strcmp(ext, order[i]) != 0; i++)
+        ;
+    
+    return i;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Compares two strings, treating runs of digits as numbers.
+ */
+
+int
+natural_cmp(const char *s1, const char *s2)
+{
+    const char *d1, *d2;
+    size_t len1, len2;
+    int cmp;
+    
+    while (*s1 && *s2)
+    {
+        if (isdigit((unsigned char)*s1) && isdigit((unsigned char)*s2))
+        {
+            /* Skip leading zeros, then the longer number is larger. */
+            while (*s1 == '0')
+            {
+                s1++;
+            }
+            while (*s2 == '0')
+            {
+                s2++;
+            }
+            
+            for (d1 = s1; isdigit((unsigned char)*d1); d1++);
+            for (d2 = s2; isdigit((unsigned char)*d2); d2++);
+            
+            len1 = d1 - s1;
+            len2 = d2 - s2;
+            
+            if (len1 != len2)
+            {
+                return len1 < len2 ? -1 : 1;
+            }
+            if ((cmp = strncmp(s1, s2, len1)) != 0)
+            {
+                return cmp;
+            }
+            
+            s1 = d1;
+            s2 = d2;
+        }
+        else if (*s1 != *s2)
+        {
+            return (unsigned char)*s1 - (unsigned char)*s2;
+        }
+        else
+        {
+            s1++;
+            s2++;
+        }
+    }
+    
+    return (unsigned char)*s1 - (unsigned char)*s2;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns a pointer to the extension of a file name, including the dot, or
+ * to the end of the name if there is no extension.
+ */
+
+char *
+file_ext(char *file_name)
+{
+    char *dot = strrchr(file_name, '.');
+    
+    return dot != NULL ? dot : file_name + strlen(file_name);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Sets up a levelpack that has been found but not loaded. The file name is
+ * taken over by the levelpack.
+ */
+
+void
+init_pack(levelpack_t *levelpack, char *file_name, file_stamp_t stamp, 
+    save_writer_t *writer)
+{
+    size_t len = file_ext(file_name) - file_name;
+    
+    levelpack->arena.base = NULL;
+    levelpack->arena.used = 0;
+    levelpack->arena.size = 0;
+    levelpack->levels = NULL;
+    levelpack->index = NULL;
+    levelpack->cache.base = NULL;
+    levelpack->nlevels = 0;
+    levelpack->name[0] = '\0';
+    levelpack->lvl_file = file_name;
+    levelpack->format = PACK_TEXT;
+    
+    if (strcmp(file_ext(file_name), COMPILED_FILE) == 0)
+    {
+        levelpack->format = PACK_COMPILED;
+    }
+    else if (strcmp(file_ext(file_name), STORE_FILE) == 0)
+    {
+        levelpack->format = PACK_STORE;
+    }
+    else if (strcmp(file_ext(file_name), HASHED_FILE) == 0)
+    {
+        levelpack->format = PACK_HASHED;
+    }
+    levelpack->stamp = stamp;
+    levelpack->parsed = 0;
+    levelpack->parsed_line = 0;
+    levelpack->parsed_check = 0;
+    levelpack->state = PACK_UNLOADED;
+    levelpack->error = NULL;
+    
+    /* Save file has the same name as the levelpack. It is read with the
+     * levels. */
+    levelpack->save.data = NULL;
+    levelpack->save.nlevels = 0;
+    levelpack->save.nbeaten = 0;
+    levelpack->save.naced = 0;
+    levelpack->save.writer = writer;
+    levelpack->save.sav_file = malloc(len + strlen(SAVE_FILE) + 1);
+    
+    if (levelpack->save.sav_file != NULL)
+    {
+        memcpy(levelpack->save.sav_file, file_name, len);
+        strcpy(levelpack->save.sav_file + len, SAVE_FILE);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees the memory used by a levelpack.
+ */
+
+void
+free_pack(levelpack_t *levelpack)
+{
+    arena_free(&levelpack->arena);
+    free(levelpack->lvl_file);
+    free(levelpack->save.sav_file);
+    free(levelpack->error);
+    
+    if (levelpack->cache.base != NULL)
+    {
+        lvb_close(&levelpack->cache);
+    }
+    
+    levelpack->levels = NULL;
+    levelpack->index = NULL;
+    levelpack->error = NULL;
+    levelpack->save.data = NULL;
+    levelpack->lvl_file = NULL;
+    levelpack->save.sav_file = NULL;
+    levelpack->nlevels = 0;
+    levelpack->state = PACK_UNLOADED;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads only the name of a levelpack. Returns FALSE if the file can't be
+ * read.
+ */
+
+int
+get_pack_name(levelpack_t *levelpack)
+{
+    int ok;
+    FILE *fp;
+    lvb_t lvb;
+    level_reader_t reader;
+    
+    if (levelpack->format != PACK_TEXT)
+    {
+        if (!open_mapped_pack(&lvb, levelpack->lvl_file))
+        {
+            pack_error(levelpack, "not a compiled levelpack");
+            return FALSE;
+        }
+        
+        strncpy(levelpack->name, lvb.name, MAX_NAME_LEN - 1);
+        levelpack->name[MAX_NAME_LEN - 1] = '\0';
+        
+        lvb_close(&lvb);
+        
+        return TRUE;
+    }
+    
+    if ((fp = fopen(levelpack->lvl_file, "r")) == NULL)
+    {
+        pack_error(levelpack, "cannot open file");
+        return FALSE;
+    }
+    
+    /* The name is the first word of the file. */
+    init_reader(&reader, fp, levelpack->lvl_file);
+    ok = read_word(&reader, levelpack->name, MAX_NAME_LEN);
+    
+    if (!ok)
+    {
+        pack_error(levelpack, "missing levelpack name");
+    }
+    
+    fclose(fp);
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Job for run_parallel(), reads the name of pack number job if it hasn't
+ * been read yet.
+ */
+
+void
+get_pack_name_job(void *ctx, int job)
+{
+    levelpack_t *levelpack = &((all_packs_t *)ctx)->pack[job];
+    
+    if (levelpack->state == PACK_UNLOADED && levelpack->name[0] == '\0')
+    {
+        get_pack_name(levelpack);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Loads the levels and save data of a levelpack, if this hasn't been done
+ * already. Returns FALSE if the levels couldn't be loaded.
+ */
+
+int
+load_pack(levelpack_t *levelpack)
+{
+    if (levelpack->state != PACK_UNLOADED)
+    {
+        return levelpack->state == PACK_LOADED;
+    }
+    
+    if (!read_levels(levelpack, NULL))
+    {
+        levelpack->state = PACK_FAILED;
+        return FALSE;
+    }
+    
+    /* Copy nlevels. */
+    levelpack->save.nlevels = levelpack->nlevels;
+    
+    /* Set save file. First assume there is no save data, then look to see
+     * if save data exists. */
+    clear_progress(&levelpack->save);
+    read_save(&levelpack->save);
+    
+    levelpack->state = PACK_LOADED;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the levels of a levelpack into its arena, and adds the index and
+ * space for save data after them. A text pack carries on from the end of
+ * old if old isn't NULL, see read_text_pack(). If the shared cache has
+ * this version of the file, its levels are used instead, and otherwise 
+ * the cache is made from the levels read, for the next game to use. 
+ * Returns FALSE, with the arena emptied, if the levels couldn't be read.
+ */
+
+int
+read_levels(levelpack_t *levelpack, const levelpack_t *old)
+{
+    int ok = FALSE;
+    arena_t own;
+    lvb_t lvb;
+    
+    if (attach_cache(levelpack))
+    {
+        return TRUE;
+    }
+    
+    if (levelpack->format != PACK_TEXT)
+    {
+        if (open_mapped_pack(&lvb, levelpack->lvl_file))
+        {
+            ok = get_compiled_pack(levelpack, &lvb);
+            lvb_close(&lvb);
+        }
+        else
+        {
+            pack_error(levelpack, "not a compiled levelpack");
+        }
+    }
+    else
+    {
+        ok = read_text_pack(levelpack, old);
+    }
+    
+    /* Add the index and save data after the levels. */
+    if (ok && !finish_pack(levelpack))
+    {
+        pack_error(levelpack, "out of memory");
+        ok = FALSE;
+    }
+    
+    if (!ok)
+    {
+        arena_free(&levelpack->arena);
+        levelpack->nlevels = 0;
+        return FALSE;
+    }
+    
+    /* Share the pages of the new cache, rather than keep a copy. */
+    if (write_cache(levelpack))
+    {
+        own = levelpack->arena;
+        memset(&levelpack->arena, 0, sizeof(levelpack->arena));
+        
+        if (attach_cache(levelpack))
+        {
+            arena_free(&own);
+        }
+        else
+        {
+            levelpack->arena = own;
+        }
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Makes the name of the shared cache for the current version of a 
+ * levelpack file, or if all is TRUE, a pattern that matches the caches of
+ * every version. The file is named by a hash of its full path, so that 
+ * caches stay in CACHE_DIR whatever the path. Store packs aren't cached, 
+ * as their levels also depend on the index file, which the stamp doesn't
+ * cover. Returns FALSE if there is no name.
+ */
+
+int
+cache_name(levelpack_t *levelpack, char *name, int all)
+{
+    uint64_t key = path_key(levelpack->lvl_file);
+    int len;
+    
+    if (levelpack->format == PACK_STORE)
+    {
+        return FALSE;
+    }
+    
+    if (all)
+    {
+        len = snprintf(name, MAX_PATH, "%s\\%016" PRIx64 "-*%s", CACHE_DIR, 
+            key, CACHE_FILE);
+    }
+    else
+    {
+        len = snprintf(name, MAX_PATH, "%s\\%016" PRIx64 "-%" PRIx64 "-%" 
+            PRIx64 "%s", CACHE_DIR, key, levelpack->stamp.time, 
+            levelpack->stamp.size, CACHE_FILE);
+    }
+    
+    return len > 0 && len < MAX_PATH;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Hashes the full path of a file with 64 bit FNV-1a, ignoring case as 
+ * Windows does. A name that can't be made full is hashed as it is.
+ */
+
+uint64_t
+path_key(char *file_name)
+{
+    char full[MAX_PATH], *path = file_name;
+    uint64_t hash = FNV_OFFSET;
+    DWORD len = GetFullPathName(file_name, MAX_PATH, full, NULL);
+    
+    if (len > 0 && len < MAX_PATH)
+    {
+        path = full;
+    }
+    
+    for ( ; *path != '\0'; path++)
+    {
+        hash = (hash ^ (uint8_t)tolower((unsigned char)*path)) * FNV_PRIME;
+    }
+    
+    return hash;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Uses the levels in the shared cache of a levelpack, if there is one for
+ * the current version of its file. The levels are checked as a whole
+ * against the CRC-32 in the trailer, without decoding any. None are 
+ * copied, and only space for the save data is allocated. Returns FALSE, 
+ * leaving the pack as it was, if there is no cache to use.
+ */
+
+int
+attach_cache(levelpack_t *levelpack)
+{
+    char name[MAX_PATH];
+    size_t data;
+    uint32_t index_end;
+    const lvc_trailer_t *trailer;
+    arena_t arena;
+    lvb_t lvb;
+    
+    /* Packs opened without a stamp can't be matched to a cache. */
+    if (   (levelpack->stamp.time == 0 && levelpack->stamp.size == 0)
+        || !cache_name(levelpack, name, FALSE)
+        || !lvb_open(&lvb, name))
+    {
+        return FALSE;
+    }
+    
+    index_end = (const uint8_t *)lvb.index - lvb.base 
+                + lvb.nlevels * sizeof(uint32_t);
+    trailer = (const lvc_trailer_t *)(lvb.base + lvb.size - sizeof(*trailer));
+    
+    if (   lvb.size < index_end + sizeof(*trailer)
+        || memcmp(trailer->magic, LVC_MAGIC, LVB_MAGIC_LEN) != 0
+        || trailer->version != LVC_VERSION
+        || trailer->stamp.time != levelpack->stamp.time
+        || trailer->stamp.size != levelpack->stamp.size
+        /* A damaged cache is passed over, and made again from the file. */
+        || trailer->check != crc32(lvb.base + lvb.start, 
+                                   lvb.size - sizeof(*trailer) - lvb.start))
+    {
+        lvb_close(&lvb);
+        return FALSE;
+    }
+    
+    memset(&arena, 0, sizeof(arena));
+    data = arena_alloc(&arena, lvb.nlevels * sizeof(progress_t));
+    
+    if (data == ARENA_FAILED || !arena_trim(&arena))
+    {
+        arena_free(&arena);
+        lvb_close(&lvb);
+        return FALSE;
+    }
+    
+    arena_free(&levelpack->arena);
+    
+    if (levelpack->cache.base != NULL)
+    {
+        lvb_close(&levelpack->cache);
+    }
+    
+    strncpy(levelpack->name, lvb.name, MAX_NAME_LEN - 1);
+    levelpack->name[MAX_NAME_LEN - 1] = '\0';
+    levelpack->arena = arena;
+    levelpack->cache = lvb;
+    levelpack->levels = lvb.base;
+    levelpack->index = lvb.index;
+    levelpack->nlevels = lvb.nlevels;
+    levelpack->save.data = (progress_t *)(arena.base + data);
+    levelpack->parsed = trailer->parsed;
+    levelpack->parsed_line = trailer->parsed_line;
+    levelpack->parsed_check = trailer->parsed_check;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the levels of a loaded levelpack to its shared cache. The cache
+ * is written to a temporary file and renamed once complete, so other games
+ * never see part of one. Caches of older versions of the file are removed,
+ * unless a running game still has them mapped. Returns FALSE if the cache
+ * couldn't be made.
+ */
+
+int
+write_cache(levelpack_t *levelpack)
+{
+    static const uint8_t pad[LVB_ALIGN];
+    char name[MAX_PATH], temp[MAX_PATH + 16];
+    int ok, level;
+    uint32_t offset, *index;
+    size_t size;
+    FILE *fp;
+    const stored_level_t *rec;
+    file_stamp_t stamp;
+    lvb_header_t header;
+    lvc_trailer_t trailer;
+    
+    if (   (levelpack->stamp.time == 0 && levelpack->stamp.size == 0)
+        || !cache_name(levelpack, name, FALSE))
+    {
+        return FALSE;
+    }
+    
+    /* Fails harmlessly if the directory is already there. */
+    CreateDirectory(CACHE_DIR, NULL);
+    
+    snprintf(temp, sizeof(temp), "%s.%lu%s", name, 
+        (unsigned long)GetCurrentProcessId(), TEMP_FILE);
+    
+    if ((index = malloc((levelpack->nlevels + 1) * sizeof(uint32_t))) 
+        == NULL)
+    {
+        return FALSE;
+    }
+    
+    if ((fp = fopen(temp, "wb")) == NULL)
+    {
+        free(index);
+        return FALSE;
+    }
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LVB_MAGIC, LVB_MAGIC_LEN);
+    header.version = LVB_VERSION;
+    header.nlevels = levelpack->nlevels;
+    strncpy(header.name, levelpack->name, LVB_NAME_LEN - 1);
+    
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, LVC_MAGIC, LVB_MAGIC_LEN);
+    trailer.version = LVC_VERSION;
+    trailer.stamp = levelpack->stamp;
+    trailer.parsed = levelpack->parsed;
+    trailer.parsed_line = levelpack->parsed_line;
+    trailer.parsed_check = levelpack->parsed_check;
+    
+    /* Levels are written as they are stored, padded to stay aligned. */
+    offset = sizeof(header);
+    ok = (fseek(fp, offset, SEEK_SET) == 0);
+    
+    for (level = 0; ok && level < levelpack->nlevels; level++)
+    {
+        rec = (const stored_level_t *)
+            (levelpack->levels + levelpack->index[level]);
+        size = sizeof(stored_level_t) + rec->size;
+        index[level] = offset;
+        
+        ok = (   fwrite(rec, 1, size, fp) == size
+              && fwrite(pad, 1, (LVB_ALIGN - size % LVB_ALIGN) % LVB_ALIGN, 
+                        fp) == (LVB_ALIGN - size % LVB_ALIGN) % LVB_ALIGN);
+        trailer.check = crc32_add(crc32_add(trailer.check, rec, size), pad,
+            (LVB_ALIGN - size % LVB_ALIGN) % LVB_ALIGN);
+        offset += (size + LVB_ALIGN - 1) / LVB_ALIGN * LVB_ALIGN;
+    }
+    
+    header.index_offset = offset;
+    trailer.check = crc32_add(trailer.check, index, 
+        levelpack->nlevels * sizeof(uint32_t));
+    
+    ok = (   ok
+          && fwrite(index, sizeof(uint32_t), levelpack->nlevels, fp) 
+             == (size_t)levelpack->nlevels
+          && fwrite(&trailer, sizeof(trailer), 1, fp) == 1
+          && fseek(fp, 0, SEEK_SET) == 0
+          && fwrite(&header, sizeof(header), 1, fp) == 1);
+    
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    free(index);
+    
+    /* Another game may have made the same cache first, which is just as
+     * good. */
+    if (!ok || !MoveFileEx(temp, name, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(temp);
+        return ok && get_file_stamp(name, &stamp);
+    }
+    
+    remove_old_caches(levelpack, name);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Removes the caches of a levelpack other than the one called keep. Caches
+ * still mapped by a running game can't be removed, and are left for later.
+ */
+
+void
+remove_old_caches(levelpack_t *levelpack, char *keep)
+{
+    char pattern[MAX_PATH], name[MAX_PATH];
+    HANDLE find;
+    WIN32_FIND_DATA data;
+    
+    if (!cache_name(levelpack, pattern, TRUE))
+    {
+        return;
+    }
+    
+    find = FindFirstFile(pattern, &data);
+    
+    while (find != INVALID_HANDLE_VALUE)
+    {
+        if (   snprintf(name, sizeof(name), "%s\\%s", CACHE_DIR, 
+                   data.cFileName) < (int)sizeof(name)
+            && strcmp(name, keep) != 0)
+        {
+            DeleteFile(name);
+        }
+        
+        if (!FindNextFile(find, &data))
+        {
+            FindClose(find);
+            find = INVALID_HANDLE_VALUE;
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the levels of a text levelpack. If old isn't NULL, it is the same
+ * file before levels were added to the end, and only the new levels are
+ * read, after a copy of the levels of old. Where the last whole level 
+ * ended is kept, so that the next reload can do the same.
+ */
+
+int
+read_text_pack(levelpack_t *levelpack, const levelpack_t *old)
+{
+    int ok, i;
+    char error[MAX_ERROR_LEN];
+    FILE *fp;
+    level_t lvl;
+    level_reader_t reader;
+    
+    if ((fp = fopen(levelpack->lvl_file, "r")) == NULL)
+    {
+        pack_error(levelpack, "cannot open file");
+        return FALSE;
+    }
+    
+    init_reader(&reader, fp, levelpack->lvl_file);
+    
+    if (old == NULL)
+    {
+        ok = get_pack(levelpack, &reader);
+    }
+    else
+    {
+        ok = (fseek(fp, old->parsed, SEEK_SET) == 0);
+        
+        for (i = 0; ok && i < old->nlevels; i++)
+        {
+            ok = add_stored_level(levelpack, (const stored_level_t *)
+                (old->levels + old->index[i]));
+        }
+        
+        if (ok)
+        {
+            strcpy(levelpack->name, old->name);
+            levelpack->parsed = old->parsed;
+            levelpack->parsed_line = old->parsed_line;
+            reader.line = old->parsed_line;
+            reader.nlevels = old->nlevels;
+            
+            while (   read_level(&reader, &lvl) == LEVEL_READ_OK
+                   && store_level(levelpack, &reader, &lvl));
+            
+            ok = (reader.error == NULL);
+        }
+    }
+    
+    fclose(fp);
+    
+    if (!ok)
+    {
+        if (reader.error != NULL)
+        {
+            describe_error(&reader, error, sizeof(error));
+            levelpack->error = copy_string(error);
+        }
+        else
+        {
+            pack_error(levelpack, "cannot read file");
+        }
+        
+        return FALSE;
+    }
+    
+    /* Without a check, the next reload reads the whole file. */
+    if (   levelpack->parsed > 0
+        && !file_check(levelpack->lvl_file, levelpack->parsed, 
+                       &levelpack->parsed_check))
+    {
+        levelpack->parsed = 0;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if files in the pack directory may have changed since the
+ * packs were listed. The change is remembered until the packs are listed 
+ * again, as a level select screen only reloads its own pack.
+ */
+
+int
+packs_changed(all_packs_t *all_packs)
+{
+    if (   all_packs->watch != INVALID_HANDLE_VALUE
+        && WaitForSingleObject(all_packs->watch, 0) == WAIT_OBJECT_0)
+    {
+        all_packs->changed = TRUE;
+        
+        /* Watch for the next change. */
+        if (!FindNextChangeNotification(all_packs->watch))
+        {
+            FindCloseChangeNotification(all_packs->watch);
+            all_packs->watch = INVALID_HANDLE_VALUE;
+        }
+    }
+    
+    return all_packs->changed;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reloads a loaded levelpack if its file has changed since it was loaded.
+ */
+
+void
+refresh_pack(levelpack_t *levelpack)
+{
+    char *file_name;
+    file_stamp_t stamp;
+    
+    if (   levelpack->state != PACK_LOADED
+        || !get_file_stamp(levelpack->lvl_file, &stamp)
+        || (   stamp.time == levelpack->stamp.time
+            && stamp.size == levelpack->stamp.size))
+    {
+        return;
+    }
+    
+    if (   (file_name = copy_string(levelpack->lvl_file)) != NULL
+        && !reload_pack(levelpack, file_name, stamp))
+    {
+        free(file_name);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reloads a loaded levelpack from file_name, which has changed. The levels
+ * are read into a new pack, which replaces the old one only once it is
+ * complete, so the old pack is left whole if the file can't be read, as
+ * it may be part way through being saved. A text pack that has only had
+ * levels added to the end just reads the new levels. Returns FALSE if the
+ * pack wasn't replaced, in which case file_name isn't used.
+ */
+
+int
+reload_pack(levelpack_t *levelpack, char *file_name, file_stamp_t stamp)
+{
+    levelpack_t fresh;
+    
+    init_pack(&fresh, file_name, stamp, levelpack->save.writer);
+    
+    if (   fresh.save.sav_file == NULL
+        || !read_levels(&fresh, is_appended(levelpack, &fresh) 
+                                ? levelpack : NULL)
+        || !carry_progress(&fresh, levelpack))
+    {
+        /* file_name still belongs to the caller. */
+        fresh.lvl_file = NULL;
+        free_pack(&fresh);
+        return FALSE;
+    }
+    
+    fresh.state = PACK_LOADED;
+    free_pack(levelpack);
+    *levelpack = fresh;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if the file of levelpack is the text file of old with more
+ * added to the end, so that only the new part has to be read.
+ */
+
+int
+is_appended(const levelpack_t *old, levelpack_t *levelpack)
+{
+    uint32_t check;
+    
+    return old->format == PACK_TEXT
+        && levelpack->format == PACK_TEXT
+        && old->parsed > 0
+        && strcmp(old->lvl_file, levelpack->lvl_file) == 0
+        && levelpack->stamp.size >= (uint64_t)old->parsed
+        && file_check(levelpack->lvl_file, old->parsed, &check)
+        && check == old->parsed_check;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Gives the levels of a reloaded pack the progress they had in the old
+ * pack. If the old levels are still at the start of the pack, progress is
+ * copied across. Otherwise levels are matched by the key of their layout,
+ * as they may have moved or been edited, and the save file is rewritten 
+ * if the progress has moved. Returns FALSE if out of memory.
+ */
+
+int
+carry_progress(levelpack_t *levelpack, levelpack_t *old)
+{
+    int i, kept = 0;
+    uint32_t j;
+    const stored_level_t *rec, *old_rec;
+    save_t *save = &levelpack->save;
+    key_table_t table;
+    layout_t layout;
+    level_keys_t keys;
+    level_t lvl;
+    
+    memset(&table, 0, sizeof(table));
+    save->nlevels = levelpack->nlevels;
+    clear_progress(save);
+    
+    for (i = 0; i < old->nlevels && i < levelpack->nlevels; i++)
+    {
+        rec = (const stored_level_t *)
+            (levelpack->levels + levelpack->index[i]);
+        old_rec = (const stored_level_t *)(old->levels + old->index[i]);
+        
+        if (   rec->size != old_rec->size
+            || memcmp(rec, old_rec, sizeof(stored_level_t) + rec->size) != 0)
+        {
+            break;
+        }
+    }
+    
+    if (i == old->nlevels)
+    {
+        for (i = 0; i < old->nlevels; i++)
+        {
+            set_progress(save, i, &old->save.data[i]);
+        }
+        
+        return TRUE;
+    }
+    
+    for (i = 0; i < old->nlevels; i++)
+    {
+        if (old->save.data[i].played == 0 && old->save.data[i].bits == 0)
+        {
+            continue;
+        }
+        
+        get_level(old, i, &lvl);
+        get_layouts(&lvl, &layout, NULL, &keys);
+        
+        if (!key_table_add(&table, keys.key, i))
+        {
+            free_key_table(&table);
+            return FALSE;
+        }
+    }
+    
+    for (i = 0; i < levelpack->nlevels && table.count > 0; i++)
+    {
+        get_level(levelpack, i, &lvl);
+        get_layouts(&lvl, &layout, NULL, &keys);
+        
+        if (key_table_find(&table, keys.key, &j))
+        {
+            set_progress(save, i, &old->save.data[j]);
+            kept += (j == (uint32_t)i);
+        }
+    }
+    
+    /* The save file has progress by level number. */
+    if (kept != (int)table.count)
+    {
+        compact_save(save);
+    }
+    
+    free_key_table(&table);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the CRC-32 of the first size bytes of a file. Returns FALSE if the
+ * file is shorter than that, or can't be read.
+ */
+
+int
+file_check(char *file_name, long size, uint32_t *check)
+{
+    int ok;
+    char *buf;
+    FILE *fp;
+    
+    if ((fp = fopen(file_name, "rb")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    if ((buf = malloc(size)) == NULL)
+    {
+        fclose(fp);
+        return FALSE;
+    }
+    
+    if ((ok = (fread(buf, 1, size, fp) == (size_t)size)))
+    {
+        *check = crc32(buf, size);
+    }
+    
+    free(buf);
+    fclose(fp);
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Loads up to n packs starting from pack number first, in parallel. Each
+ * pack is read into its own arena, along with its save data. Returns the
+ * number of the first pack that failed to load, or -1 if they all loaded.
+ */
+
+int
+load_packs(all_packs_t *all_packs, int first, int n)
+{
+    int i;
+    
+    if (first + n > all_packs->npacks)
+    {
+        n = all_packs->npacks - first;
+    }
+    
+    /* Packs that are already loaded are skipped by load_pack(). */
+    run_parallel(load_pack_job, all_packs->pack + first, n);
+    
+    for (i = first; i < first + n; i++)
+    {
+        if (all_packs->pack[i].state != PACK_LOADED)
+        {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Job for run_parallel(), loads pack number job of an array of packs.
+ */
+
+void
+load_pack_job(void *ctx, int job)
+{
+    load_pack((levelpack_t *)ctx + job);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Records why a levelpack failed to load, unless an error was already
+ * recorded.
+ */
+
+void
+pack_error(levelpack_t *levelpack, char *message)
+{
+    char error[MAX_ERROR_LEN];
+    
+    if (levelpack->error == NULL)
+    {
+        snprintf(error, sizeof(error), "%s: %s", levelpack->lvl_file, 
+            message);
+        levelpack->error = copy_string(error);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Starts loading packs on a background thread. If the thread can't be
+ * created, packs are just loaded when they are needed.
+ */
+
+void
+start_prefetch(all_packs_t *all_packs)
+{
+    all_packs->prefetch = CreateThread(NULL, 0, prefetch_packs, all_packs,
+        0, NULL);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Waits for the background loading thread to finish. Must be called before
+ * the packs are used.
+ */
+
+void
+finish_prefetch(all_packs_t *all_packs)
+{
+    if (all_packs->prefetch != NULL)
+    {
+        WaitForSingleObject(all_packs->prefetch, INFINITE);
+        CloseHandle(all_packs->prefetch);
+        all_packs->prefetch = NULL;
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Background thread that loads packs in order, up to the first one that
+ * hasn't been beaten, as this is the pack the player is likely to choose
+ * next. Errors are left for the main thread to report.
+ */
+
+DWORD WINAPI
+prefetch_packs(LPVOID arg)
+{
+    int i;
+    all_packs_t *all_packs = arg;
+    
+    for (i = 0; i < all_packs->npacks; i++)
+    {
+        if (   !load_pack(&all_packs->pack[i])
+            || !all_beaten(all_packs->pack[i].save))
+        {
+            break;
+        }
+    }
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Gets the last write time and size of a file. Returns FALSE if the file
+ * doesn't exist.
+ */
+
+int
+get_file_stamp(char *file_name, file_stamp_t *stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    
+    if (!GetFileAttributesEx(file_name, GetFileExInfoStandard, &data))
+    {
+        return FALSE;
+    }
+    
+    stamp->time = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32)
+        | data.ftLastWriteTime.dwLowDateTime;
+    stamp->size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Opens a levelpack and copies the levels.
+ */
+
+int
+get_pack(levelpack_t *levelpack, level_reader_t *reader)
+{
+    levelpack->nlevels = 0;
+        
+    /* Add each level to the arena as it is read. */
+    return stream_levels(reader, levelpack->name, MAX_NAME_LEN, 
+        store_level, levelpack);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level function for stream_levels(), adds the level to a levelpack.
+ */
+
+int
+store_level(void *ctx, level_reader_t *reader, level_t *lvl)
+{
+    levelpack_t *levelpack = ctx;
+    
+    if (!add_level(levelpack, lvl))
+    {
+        reader_error(reader, "out of memory", reader->level_line);
+        return FALSE;
+    }
+    
+    /* A reload carries on from here if the file is only added to. */
+    levelpack->parsed = ftell(reader->fp);
+    levelpack->parsed_line = reader->line;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Appends a level to the arena of a levelpack, encoded so that it uses only
+ * as much space as its board needs. Returns FALSE if out of memory.
+ */
+
+int
+add_level(levelpack_t *levelpack, level_t *lvl)
+{
+    uint32_t buf[STORED_LEVEL_MAX / sizeof(uint32_t) + 1];
+    stored_level_t *rec = (stored_level_t *)buf;
+    
+    encode_level(lvl, rec);
+    
+    return add_stored_level(levelpack, rec);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Appends a level that is already encoded to the arena of a levelpack.
+ * Returns FALSE if out of memory.
+ */
+
+int
+add_stored_level(levelpack_t *levelpack, const stored_level_t *rec)
+{
+    size_t offset;
+    
+    offset = arena_alloc(&levelpack->arena, stored_level_size(rec));
+    
+    if (offset == ARENA_FAILED)
+    {
+        return FALSE;
+    }
+    
+    memcpy(levelpack->arena.base + offset, rec, 
+        sizeof(stored_level_t) + rec->size);
+    
+    levelpack->nlevels++;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Completes a levelpack once all its levels are in the arena. The levels
+ * are indexed, space for the save data is added, and the arena is shrunk
+ * to fit. Returns FALSE if out of memory.
+ */
+
+int
+finish_pack(levelpack_t *levelpack)
+{
+    int level;
+    size_t offset = 0, index, data;
+    uint32_t *offsets;
+    stored_level_t *stored;
+    
+    index = arena_alloc(&levelpack->arena, 
+        levelpack->nlevels * sizeof(uint32_t));
+    data = arena_alloc(&levelpack->arena, 
+        levelpack->nlevels * sizeof(progress_t));
+    
+    if (   index == ARENA_FAILED 
+        || data == ARENA_FAILED
+        || !arena_trim(&levelpack->arena))
+    {
+        return FALSE;
+    }
+    
+    offsets = (uint32_t *)(levelpack->arena.base + index);
+    levelpack->levels = levelpack->arena.base;
+    levelpack->index = offsets;
+    levelpack->save.data = (progress_t *)(levelpack->arena.base + data);
+    
+    /* Levels are stored one after another from the start of the arena. */
+    for (level = 0; level < levelpack->nlevels; level++)
+    {
+        offsets[level] = offset;
+        
+        stored = (stored_level_t *)(levelpack->arena.base + offset);
+        offset += stored_level_size(stored);
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Copies level n of a loaded levelpack into level, ready to be played.
+ * Levels are checked when they are loaded, so decoding can't fail.
+ */
+
+void
+get_level(levelpack_t *levelpack, int n, level_t *level)
+{
+    decode_level((const stored_level_t *)
+        (levelpack->levels + levelpack->index[n]), level);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Encodes a level into rec. Board values take a nibble each. Runs of four
+ * or more equal values, such as empty space and border rows, are written
+ * as a run, and a row that is the same as the row above takes a single
+ * nibble. Returns the size of rec in bytes.
+ */
+
+size_t
+encode_level(level_t *lvl, stored_level_t *rec)
+{
+    int i, j, run, val;
+    size_t n = 0;
+    
+    rec->rows = lvl->rows;
+    rec->cols = lvl->cols;
+    rec->p_row = lvl->p_row;
+    rec->p_col = lvl->p_col;
+    rec->moves = lvl->moves;
+    rec->flags = 0;
+    rec->reserved = 0;
+    
+    memset(rec->cells, 0, (lvl->rows * lvl->cols + 1) / 2);
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        /* Check for a copy of the row above. */
+        if (   i > 0 
+            && memcmp(lvl->board[i], lvl->board[i-1], 
+                      lvl->cols * sizeof(int)) == 0)
+        {
+            put_nibble(rec->cells, n++, RLE_SAME_ROW);
+            continue;
+        }
+        
+        for (j = 0; j < lvl->cols; j += run)
+        {
+            val = lvl->board[i][j];
+            
+            /* Find the length of the run starting here. */
+            for (run = 1; 
+                 j + run < lvl->cols && lvl->board[i][j + run] == val; 
+                 run++);
+            
+            if (run < RLE_MIN_RUN)
+            {
+                run = 1;
+                put_nibble(rec->cells, n++, val);
+            }
+            else if (run <= RLE_MAX_RUN)
+            {
+                put_nibble(rec->cells, n++, RLE_RUN);
+                put_nibble(rec->cells, n++, val);
+                put_nibble(rec->cells, n++, run - RLE_MIN_RUN);
+            }
+            else
+            {
+                if (run > RLE_MAX_LONG_RUN)
+                {
+                    run = RLE_MAX_LONG_RUN;
+                }
+                put_nibble(rec->cells, n++, RLE_LONG_RUN);
+                put_nibble(rec->cells, n++, val);
+                put_nibble(rec->cells, n++, (run - RLE_MIN_RUN) >> 4);
+                put_nibble(rec->cells, n++, (run - RLE_MIN_RUN) & 0x0F);
+            }
+            
+            /* Note the features of the level. */
+            if (val == BOMB_VAL)
+            {
+                rec->flags |= LEVEL_HAS_BOMB;
+            }
+            else if (val == WEAK_WALL)
+            {
+                rec->flags |= LEVEL_HAS_WEAK_WALL;
+            }
+            else if (val == MOVING_BLOCK)
+            {
+                rec->flags |= LEVEL_HAS_MOVING_BLOCK;
+            }
+            else if (val == HOLE)
+            {
+                rec->flags |= LEVEL_HAS_HOLE;
+            }
+        }
+    }
+    
+    rec->size = (n + 1) / 2;
+    
+    return sizeof(stored_level_t) + rec->size;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Decodes a stored level into level, one row at a time. Returns FALSE if
+ * the stored level is damaged.
+ */
+
+int
+decode_level(const stored_level_t *rec, level_t *level)
+{
+    int i;
+    row_decoder_t dec;
+    
+    if (   rec->rows > BOARD_MAX_R
+        || rec->cols > BOARD_MAX_C
+        || rec->p_row >= rec->rows
+        || rec->p_col >= rec->cols)
+    {
+        return FALSE;
+    }
+    
+    level->rows = rec->rows;
+    level->cols = rec->cols;
+    level->p_row = rec->p_row;
+    level->p_col = rec->p_col;
+    level->moves = rec->moves;
+    level->nmoves = 0;
+    level->bomb = 0;
+    level->message_available = FALSE;
+    
+    init_row_decoder(&dec, rec);
+    
+    for (i = 0; i < rec->rows; i++)
+    {
+        if (!decode_row(&dec, i > 0 ? level->board[i-1] : NULL, 
+                        level->board[i]))
+        {
+            return FALSE;
+        }
+    }
+    
+    level->moving_block_check = moving_block_check(level);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Sets up a decoder at the first row of a stored level.
+ */
+
+void
+init_row_decoder(row_decoder_t *dec, const stored_level_t *rec)
+{
+    dec->cells = rec->cells;
+    dec->next = 0;
+    dec->end = 2 * (size_t)rec->size;
+    dec->cols = rec->cols;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Decodes the next row of a stored level into row. prev is the row above,
+ * or NULL for the first row. Returns FALSE if the row is damaged.
+ */
+
+int
+decode_row(row_decoder_t *dec, int *prev, int *row)
+{
+    int j = 0, token, val, run;
+    
+    while (j < dec->cols)
+    {
+        if ((token = get_nibble(dec)) < 0)
+        {
+            return FALSE;
+        }
+        
+        /* A copy of the row above must be the only token in the row. */
+        if (token == RLE_SAME_ROW)
+        {
+            if (prev == NULL || j != 0)
+            {
+                return FALSE;
+            }
+            
+            memcpy(row, prev, dec->cols * sizeof(int));
+            return TRUE;
+        }
+        
+        if (token == RLE_RUN || token == RLE_LONG_RUN)
+        {
+            if ((val = get_nibble(dec)) < 0 || (run = get_nibble(dec)) < 0)
+            {
+                return FALSE;
+            }
+            
+            if (token == RLE_LONG_RUN)
+            {
+                if ((token = get_nibble(dec)) < 0)
+                {
+                    return FALSE;
+                }
+                run = (run << 4) | token;
+            }
+            run += RLE_MIN_RUN;
+            
+            if (j + run > dec->cols)
+            {
+                return FALSE;
+            }
+            
+            while (run--)
+            {
+                row[j++] = val;
+            }
+        }
+        else
+        {
+            row[j++] = token;
+        }
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes nibble number n of an encoded board. The nibble must be zero.
+ */
+
+void
+put_nibble(uint8_t *cells, size_t n, int value)
+{
+    cells[n / 2] |= value << ((n % 2) * 4);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the next nibble of an encoded board. Returns -1 at the end of the
+ * board.
+ */
+
+int
+get_nibble(row_decoder_t *dec)
+{
+    size_t n = dec->next;
+    
+    if (n >= dec->end)
+    {
+        return -1;
+    }
+    
+    dec->next++;
+    
+    return (dec->cells[n / 2] >> ((n % 2) * 4)) & 0x0F;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the space used by a stored level, rounded up so that the next
+ * level stays aligned.
+ */
+
+size_t
+stored_level_size(const stored_level_t *rec)
+{
+    size_t size = sizeof(stored_level_t) + rec->size;
+    
+    return (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Sets up a reader at the start of a text levelpack.
+ */
+
+void
+init_reader(level_reader_t *reader, FILE *fp, char *file_name)
+{
+    reader->fp = fp;
+    reader->file_name = file_name;
+    reader->line = 1;
+    reader->level_line = 1;
+    reader->nlevels = 0;
+    reader->error = NULL;
+    reader->error_line = 0;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads a text levelpack, passing each level to fn as soon as it has been
+ * read. Only one level is held at a time, so the file can be a pipe of any
+ * length. The name of the pack is copied into name. Returns FALSE if there
+ * was an error.
+ */
+
+int
+stream_levels(level_reader_t *reader, char *name, int len, level_fn_t fn,
+    void *ctx)
+{
+    level_t lvl;
+    
+    /* Get levelpack name. */
+    if (!read_word(reader, name, len))
+    {
+        reader_error(reader, "missing levelpack name", reader->line);
+        return FALSE;
+    }
+    
+    /* Loop while data is available, or until fn stops. */
+    while (   read_level(reader, &lvl) == LEVEL_READ_OK
+           && fn(ctx, reader, &lvl));
+    
+    return reader->error == NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the next level from a text level file. The information about the
+ * board is contained in the first row, followed by the board values. Each
+ * level is checked with check_level().
+ */
+
+int
+read_level(level_reader_t *reader, level_t *level)
+{
+    int i, j;
+    int rows = 0, 
+        cols = 0, 
+        moves = 0;
+    char *error;
+    
+    /* No more levels if the board information isn't available. */
+    if (!read_int(reader, &rows))
+    {
+        return reader->error == NULL ? LEVEL_READ_END : LEVEL_READ_ERROR;
+    }
+    
+    reader->level_line = reader->line;
+    
+    if (!read_int(reader, &cols) || !read_int(reader, &moves))
+    {
+        reader_error(reader, "incomplete board information", reader->line);
+        return LEVEL_READ_ERROR;
+    }
+    
+    /* Check if the board is too big. */
+    if (   rows <= 0 
+        || cols <= 0
+        || rows > BOARD_MAX_R
+        || cols > BOARD_MAX_C)
+    {
+        reader_error(reader, "board size out of range", reader->level_line);
+        return LEVEL_READ_ERROR;
+    }
+    
+    /* Copy values into level. */
+    level->rows = rows;
+    level->cols = cols;
+    level->moves = moves;
+    level->p_row = 0;
+    level->p_col = 0;
+    level->nmoves = 0;
+    level->bomb = 0;
+    level->message_available = FALSE;        
+    
+    for (i = 0; i < rows; i++)
+    {
+        for (j = 0; j < cols; j++)
+        {   
+            /* Get each individual level feature and copy into board. */
+            if (!read_int(reader, &level->board[i][j]))
+            {
+                reader_error(reader, "incomplete board", reader->line);
+                return LEVEL_READ_ERROR;
+            }
+            
+            /* Get player location. */
+            if (level->board[i][j] == PLAYER)
+            {
+                level->p_row = i;
+                level->p_col = j;
+            }
+        }
+    }
+    
+    /* The player position is needed for the moving block check. */
+    level->moving_block_check = moving_block_check(level);
+    
+    if ((error = check_level(level)) != NULL)
+    {
+        reader_error(reader, error, reader->level_line);
+        return LEVEL_READ_ERROR;
+    }
+    
+    reader->nlevels++;
+    
+    return LEVEL_READ_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the next integer from a text levelpack. Returns FALSE at the end of
+ * the file, or if the next word isn't a number, which is also recorded as
+ * an error.
+ */
+
+int
+read_int(level_reader_t *reader, int *value)
+{
+    int c, sign = 1, digits = 0;
+    long n = 0;
+    
+    /* Skip white space, counting lines. */
+    while ((c = getc(reader->fp)) != EOF && isspace(c))
+    {
+        if (c == '\n')
+        {
+            reader->line++;
+        }
+    }
+    
+    if (c == EOF)
+    {
+        return FALSE;
+    }
+    
+    if (c == '-')
+    {
+        sign = -1;
+        c = getc(reader->fp);
+    }
+    
+    while (c != EOF && isdigit(c))
+    {
+        /* Stop growing the value once it is out of range of any check. */
+        if (n <= INT16_MAX * 10L)
+        {
+            n = 10 * n + (c - '0');
+        }
+        digits++;
+        c = getc(reader->fp);
+    }
+    
+    if (!digits || (c != EOF && !isspace(c)))
+    {
+        reader_error(reader, "expected a number", reader->line);
+        return FALSE;
+    }
+    
+    /* Put back the white space so that new lines are counted. */
+    if (c != EOF)
+    {
+        ungetc(c, reader->fp);
+    }
+    
+    *value = sign * n;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the next word from a text levelpack. Words longer than len - 1
+ * characters are cut short. Returns FALSE at the end of the file.
+ */
+
+int
+read_word(level_reader_t *reader, char *word, int len)
+{
+    int c, i = 0;
+    
+    /* Skip white space, counting lines. */
+    while ((c = getc(reader->fp)) != EOF && isspace(c))
+    {
+        if (c == '\n')
+        {
+            reader->line++;
+        }
+    }
+    
+    if (c == EOF)
+    {
+        return FALSE;
+    }
+    
+    while (c != EOF && !isspace(c))
+    {
+        if (i < len - 1)
+        {
+            word[i++] = c;
+        }
+        c = getc(reader->fp);
+    }
+    word[i] = '\0';
+    
+    if (c != EOF)
+    {
+        ungetc(c, reader->fp);
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Records an error found on a line of a text levelpack. Only the first
+ * error is kept.
+ */
+
+void
+reader_error(level_reader_t *reader, char *message, int line)
+{
+    if (reader->error == NULL)
+    {
+        reader->error = message;
+        reader->error_line = line;
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the file, line and level of a reader's error into buf.
+ */
+
+void
+describe_error(level_reader_t *reader, char *buf, size_t len)
+{
+    if (reader->error == NULL)
+    {
+        snprintf(buf, len, "%s: cannot read levels", reader->file_name);
+    }
+    else if (reader->nlevels == 0 && reader->error_line == 1)
+    {
+        snprintf(buf, len, "%s:%d: %s", reader->file_name, 
+            reader->error_line, reader->error);
+    }
+    else
+    {
+        snprintf(buf, len, "%s:%d: level %d: %s", reader->file_name, 
+            reader->error_line, reader->nlevels + 1, reader->error);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Checks that a level can be played safely. Returns NULL for a valid level,
+ * or a description of the first problem found.
+ */
+
+char *
+check_level(level_t *lvl)
+{
+    int i, j, val, nplayers = 0, ngoals = 0;
+    
+    if (   lvl->rows < 3 
+        || lvl->cols < 3
+        || lvl->rows > BOARD_MAX_R
+        || lvl->cols > BOARD_MAX_C)
+    {
+        return "board size out of range";
+    }
+    
+    if (lvl->moves <= 0 || lvl->moves > UINT16_MAX)
+    {
+        return "target moves out of range";
+    }
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < lvl->cols; j++)
+        {
+            val = lvl->board[i][j];
+            
+            /* Only known board elements are allowed. */
+            if (   val != EMPTY
+                && val != WALL
+                && val != GOAL
+                && val != PLAYER
+                && val != WEAK_WALL
+                && val != BOMB_VAL
+                && val != MOVING_BLOCK
+                && val != HOLE)
+            {
+                return "unknown board value";
+            }
+            
+            /* The border must stop the player from leaving the board, so
+             * only walls and holes are allowed on it. */
+            if (   (i == 0 || i == lvl->rows - 1 
+                    || j == 0 || j == lvl->cols - 1)
+                && val != WALL
+                && val != HOLE)
+            {
+                return "board border is open";
+            }
+            
+            if (val == PLAYER)
+            {
+                nplayers++;
+            }
+            else if (val == GOAL)
+            {
+                ngoals++;
+            }
+        }
+    }
+    
+    if (nplayers != 1)
+    {
+        return "level needs exactly one player";
+    }
+    
+    if (ngoals == 0)
+    {
+        return "level has no goal";
+    }
+    
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps a compiled levelpack, the custom level store, or the levels of a
+ * hashed levelpack into memory, depending on the extension of the file.
+ * Returns FALSE if it can't be opened.
+ */
+
+int
+open_mapped_pack(lvb_t *lvb, char *file_name)
+{
+    if (strcmp(file_ext(file_name), STORE_FILE) == 0)
+    {
+        return lvs_open(lvb, file_name);
+    }
+    
+    if (strcmp(file_ext(file_name), HASHED_FILE) == 0)
+    {
+        return lvh_open(lvb, file_name);
+    }
+    
+    return lvb_open(lvb, file_name);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps a whole file into memory, read only. Returns FALSE if the file
+ * doesn't exist or is smaller than a pack header.
+ */
+
+int
+map_pack_file(lvb_t *lvb, char *file_name)
+{
+    return map_file(lvb, file_name, 
+        sizeof(lvb_header_t) > sizeof(lvs_header_t) 
+            ? sizeof(lvb_header_t) : sizeof(lvs_header_t));
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps a whole file into memory, read only. Returns FALSE if the file
+ * doesn't exist or is smaller than min_size bytes.
+ */
+
+int
+map_file(lvb_t *lvb, char *file_name, uint32_t min_size)
+{
+    lvb->mapping = NULL;
+    lvb->base = NULL;
+    lvb->own_index = NULL;
+    
+    lvb->file = CreateFile(file_name, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    
+    if (lvb->file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+    
+    lvb->size = GetFileSize(lvb->file, NULL);
+    
+    /* Empty files can't be mapped, and are too small anyway. */
+    if (lvb->size >= min_size && lvb->size > 0)
+    {
+        lvb->mapping = CreateFileMapping(lvb->file, NULL, PAGE_READONLY, 
+            0, 0, NULL);
+    }
+    
+    if (lvb->mapping != NULL)
+    {
+        lvb->base = MapViewOfFile(lvb->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    
+    if (lvb->base == NULL)
+    {
+        lvb_close(lvb);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps a compiled levelpack into memory. The header and index are checked,
+ * so that any level can then be found without reading the rest of the file.
+ * Returns FALSE if the file doesn't exist or isn't a valid compiled pack.
+ */
+
+int
+lvb_open(lvb_t *lvb, char *file_name)
+{
+    uint32_t index_end;
+    const lvb_header_t *header;
+    
+    if (!map_pack_file(lvb, file_name))
+    {
+        return FALSE;
+    }
+    
+    header = (const lvb_header_t *)lvb->base;
+    
+    /* Check the header, and that the index is inside the file. */
+    index_end = header->index_offset + header->nlevels * sizeof(uint32_t);
+        
+    if (   memcmp(header->magic, LVB_MAGIC, LVB_MAGIC_LEN) != 0
+        || header->version != LVB_VERSION
+        || header->nlevels > lvb->size / sizeof(stored_level_t)
+        || header->index_offset % LVB_ALIGN != 0
+        || header->index_offset < sizeof(lvb_header_t)
+        || index_end < header->index_offset
+        || index_end > lvb->size
+        || memchr(header->name, '\0', LVB_NAME_LEN) == NULL)
+    {
+        lvb_close(lvb);
+        return FALSE;
+    }
+    
+    lvb->name = header->name;
+    lvb->nlevels = header->nlevels;
+    lvb->start = sizeof(lvb_header_t);
+    lvb->index = (const uint32_t *)(lvb->base + header->index_offset);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps the custom level store into memory, and reads its index. If the
+ * index is missing, or belongs to an older generation of the store, the
+ * store is scanned instead. Returns FALSE if the store can't be opened.
+ */
+
+int
+lvs_open(lvb_t *lvb, char *file_name)
+{
+    size_t len = file_ext(file_name) - file_name;
+    char index_file[MAX_PATH];
+    const lvs_header_t *header;
+    
+    if (   len + strlen(STORE_INDEX_FILE) >= MAX_PATH
+        || !map_pack_file(lvb, file_name))
+    {
+        return FALSE;
+    }
+    
+    header = (const lvs_header_t *)lvb->base;
+    
+    if (   memcmp(header->magic, LVS_MAGIC, LVB_MAGIC_LEN) != 0
+        || header->version != LVS_VERSION
+        || memchr(header->name, '\0', LVB_NAME_LEN) == NULL)
+    {
+        lvb_close(lvb);
+        return FALSE;
+    }
+    
+    lvb->name = header->name;
+    lvb->start = sizeof(lvs_header_t);
+    
+    memcpy(index_file, file_name, len);
+    strcpy(index_file + len, STORE_INDEX_FILE);
+    
+    lvb->own_index = read_store_index(index_file, header->generation, 
+        &lvb->nlevels);
+    
+    if (lvb->own_index == NULL)
+    {
+        lvb->own_index = scan_store(lvb, &lvb->nlevels);
+    }
+    
+    if (lvb->own_index == NULL)
+    {
+        lvb_close(lvb);
+        return FALSE;
+    }
+    
+    lvb->index = lvb->own_index;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps the content addressed level store into memory, and reads the list
+ * of levels of a hashed levelpack. Each level is checked to be the one
+ * with the key in the list. Returns FALSE if the pack or the store can't
+ * be opened, or a level is missing.
+ */
+
+int
+lvh_open(lvb_t *lvb, char *file_name)
+{
+    int ok;
+    uint32_t i;
+    FILE *fp;
+    lvh_header_t header;
+    lvh_entry_t entry;
+    const level_keys_t *keys;
+    
+    if (!map_pack_file(lvb, CONTENT_STORE_FILE))
+    {
+        return FALSE;
+    }
+    
+    if ((fp = fopen(file_name, "rb")) == NULL)
+    {
+        lvb_close(lvb);
+        return FALSE;
+    }
+    
+    ok = (   memcmp(lvb->base, LCS_MAGIC, LVB_MAGIC_LEN) == 0
+          && ((const lcs_header_t *)lvb->base)->version == LCS_VERSION
+          && fread(&header, sizeof(header), 1, fp) == 1
+          && memcmp(header.magic, LVH_MAGIC, LVB_MAGIC_LEN) == 0
+          && header.version == LCS_VERSION
+          && header.nlevels < UINT32_MAX / sizeof(uint32_t)
+          && memchr(header.name, '\0', LVB_NAME_LEN) != NULL
+          && (lvb->own_index = malloc((header.nlevels + 1) 
+                                      * sizeof(uint32_t))) != NULL);
+    
+    for (i = 0; ok && i < header.nlevels; i++)
+    {
+        /* The keys come just before the level they belong to. */
+        ok = (   fread(&entry, sizeof(entry), 1, fp) == 1
+              && entry.offset % LCS_ALIGN == 0
+              && entry.offset >= sizeof(lcs_header_t) + sizeof(level_keys_t)
+              && entry.offset <= lvb->size - sizeof(stored_level_t));
+        
+        if (ok)
+        {
+            keys = (const level_keys_t *)
+                (lvb->base + entry.offset - sizeof(level_keys_t));
+            ok = (keys->key == entry.key);
+            lvb->own_index[i] = entry.offset;
+        }
+    }
+    
+    fclose(fp);
+    
+    if (!ok)
+    {
+        lvb_close(lvb);
+        return FALSE;
+    }
+    
+    memcpy(lvb->own_name, header.name, LVB_NAME_LEN);
+    lvb->name = lvb->own_name;
+    lvb->nlevels = header.nlevels;
+    lvb->start = sizeof(lcs_header_t) + sizeof(level_keys_t);
+    lvb->index = lvb->own_index;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Unmaps a compiled levelpack or store.
+ */
+
+void
+lvb_close(lvb_t *lvb)
+{
+    free(lvb->own_index);
+    
+    if (lvb->base != NULL)
+    {
+        UnmapViewOfFile(lvb->base);
+    }
+    
+    if (lvb->mapping != NULL)
+    {
+        CloseHandle(lvb->mapping);
+    }
+    
+    CloseHandle(lvb->file);
+    
+    lvb->base = NULL;
+    lvb->mapping = NULL;
+    lvb->own_index = NULL;
+    lvb->file = INVALID_HANDLE_VALUE;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds level record n of a compiled levelpack using the index. Returns NULL
+ * if the record doesn't fit inside the file.
+ */
+
+const stored_level_t *
+lvb_level(lvb_t *lvb, int n)
+{
+    uint32_t offset;
+    const stored_level_t *rec;
+    
+    if (n < 0 || (uint32_t)n >= lvb->nlevels)
+    {
+        return NULL;
+    }
+    
+    offset = lvb->index[n];
+    
+    /* The fixed part of the record must fit before it can be read. */
+    if (   offset % LVB_ALIGN != 0
+        || offset < lvb->start
+        || offset > lvb->size - sizeof(stored_level_t))
+    {
+        return NULL;
+    }
+    
+    rec = (const stored_level_t *)(lvb->base + offset);
+    
+    if (rec->size > lvb->size - offset - sizeof(stored_level_t))
+    {
+        return NULL;
+    }
+    
+    return rec;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Copies level n of a compiled levelpack into level. Only the requested
+ * level is read from the mapped file, and no memory is allocated.
+ */
+
+int
+lvb_get_level(lvb_t *lvb, int n, level_t *level)
+{
+    const stored_level_t *rec = lvb_level(lvb, n);
+    
+    return rec != NULL && decode_level(rec, level);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Copies the levels of a mapped compiled pack into a levelpack. Each level
+ * is checked, then copied without being encoded again.
+ */
+
+int
+get_compiled_pack(levelpack_t *levelpack, lvb_t *lvb)
+{
+    uint32_t level;
+    char error[MAX_ERROR_LEN], *message;
+    level_t lvl;
+    
+    /* Name is known to be null terminated from open_mapped_pack(). */
+    strncpy(levelpack->name, lvb->name, MAX_NAME_LEN - 1);
+    levelpack->name[MAX_NAME_LEN - 1] = '\0';
+    
+    levelpack->nlevels = 0;
+    
+    for (level = 0; level < lvb->nlevels; level++)
+    {
+        if (!lvb_get_level(lvb, level, &lvl))
+        {
+            message = "level record is damaged";
+        }
+        else if (   (message = check_level(&lvl)) == NULL 
+                 && !add_stored_level(levelpack, lvb_level(lvb, level)))
+        {
+            message = "out of memory";
+        }
+        
+        if (message != NULL)
+        {
+            snprintf(error, sizeof(error), "level %u: %s", 
+                (unsigned)level + 1, message);
+            pack_error(levelpack, error);
+            return FALSE;
+        }
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Converts a text levelpack into a compiled levelpack. Levels are read,
+ * checked and written one at a time, so the input can be a pipe. The output
+ * must be a file, as the header is written last. Returns FALSE and prints
+ * the reason if any level is invalid.
+ */
+
+int
+compile_pack(FILE *in, char *in_name, FILE *out)
+{
+    int status, nlevels = 0, capacity = 0;
+    uint32_t offset, *index = NULL, *new_index;
+    uint32_t buf[(STORED_LEVEL_MAX + LVB_ALIGN) / sizeof(uint32_t)];
+    size_t size;
+    char error[MAX_ERROR_LEN];
+    lvb_header_t header;
+    stored_level_t *rec = (stored_level_t *)buf;
+    level_t lvl;
+    level_reader_t reader;
+    
+    memset(&header, 0, sizeof(header));
+    init_reader(&reader, in, in_name);
+    
+    if (!read_word(&reader, header.name, LVB_NAME_LEN))
+    {
+        fprintf(stderr, "%s: missing levelpack name\n", in_name);
+        return FALSE;
+    }
+    
+    /* Reserve space for the header. The magic is left blank until the pack
+     * is complete, so a failed conversion can't be loaded. */
+    if (fwrite(&header, sizeof(header), 1, out) != 1)
+    {
+        fprintf(stderr, "%s: write failed\n", in_name);
+        return FALSE;
+    }
+    offset = sizeof(header);
+    
+    /* Levels are checked as they are read. */
+    while ((status = read_level(&reader, &lvl)) == LEVEL_READ_OK)
+    {
+        /* Grow the index if needed. */
+        if (nlevels == capacity)
+        {
+            capacity = capacity ? 2 * capacity : MIN_INDEX_LEN;
+            new_index = realloc(index, capacity * sizeof(uint32_t));
+            
+            if (new_index == NULL)
+            {
+                fprintf(stderr, "%s: out of memory\n", in_name);
+                free(index);
+                return FALSE;
+            }
+            index = new_index;
+        }
+        index[nlevels++] = offset;
+        
+        /* Encode the level, and pad it so that the next record stays
+         * aligned. */
+        memset(buf, 0, sizeof(buf));
+        size = encode_level(&lvl, rec);
+        size += (LVB_ALIGN - size % LVB_ALIGN) % LVB_ALIGN;
+        
+        if (fwrite(rec, 1, size, out) != size)
+        {
+            fprintf(stderr, "%s: write failed\n", in_name);
+            free(index);
+            return FALSE;
+        }
+        offset += size;
+    }
+    
+    if (status == LEVEL_READ_ERROR)
+    {
+        describe_error(&reader, error, sizeof(error));
+        fprintf(stderr, "%s\n", error);
+        free(index);
+        return FALSE;
+    }
+    
+    if (nlevels == 0)
+    {
+        fprintf(stderr, "%s: no levels found\n", in_name);
+        free(index);
+        return FALSE;
+    }
+    
+    /* Write the index, then go back and complete the header. */
+    memcpy(header.magic, LVB_MAGIC, LVB_MAGIC_LEN);
+    header.version = LVB_VERSION;
+    header.nlevels = nlevels;
+    header.index_offset = offset;
+    
+    if (   fwrite(index, sizeof(uint32_t), nlevels, out) != (size_t)nlevels
+        || fseek(out, 0, SEEK_SET) != 0
+        || fwrite(&header, sizeof(header), 1, out) != 1
+        || fflush(out) != 0)
+    {
+        fprintf(stderr, "%s: write failed\n", in_name);
+        free(index);
+        return FALSE;
+    }
+    
+    free(index);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Converts a compiled levelpack or the custom level store back into a text
+ * levelpack, checking every level on the way.
+ */
+
+int
+decompile_pack(char *in_name, FILE *out)
+{
+    int i, j, level;
+    char *error;
+    level_t lvl;
+    lvb_t lvb;
+    
+    if (!open_mapped_pack(&lvb, in_name))
+    {
+        fprintf(stderr, "%s: not a compiled levelpack\n", in_name);
+        return FALSE;
+    }
+    
+    fprintf(out, "%s\n", lvb.name);
+    
+    for (level = 0; (uint32_t)level < lvb.nlevels; level++)
+    {
+        error = NULL;
+        
+        if (!lvb_get_level(&lvb, level, &lvl))
+        {
+            error = "level record is damaged";
+        }
+        else
+        {
+            error = check_level(&lvl);
+        }
+        
+        if (error != NULL)
+        {
+            fprintf(stderr, "%s: level %d: %s\n", in_name, level + 1, error);
+            lvb_close(&lvb);
+            return FALSE;
+        }
+        
+        fprintf(out, "\n");
+        fprintf(out, "%d %d %d\n", lvl.rows, lvl.cols, lvl.moves);
+        
+        for (i = 0; i < lvl.rows; i++)
+        {
+            for (j = 0; j < lvl.cols; j++)
+            {
+                fprintf(out, "%d ", lvl.board[i][j]);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    
+    lvb_close(&lvb);
+    
+    if (fflush(out) != 0)
+    {
+        fprintf(stderr, "%s: write failed\n", in_name);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+    
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the canonical layout of a level, and its keys. The symmetry key is
+ * the smallest key of the layout over all rotations and reflections, and
+ * sym is set to the layout with that key, if it isn't NULL.
+ */
+
+void
+get_layouts(level_t *lvl, layout_t *plain, layout_t *sym, 
+    level_keys_t *keys)
+{
+    int t;
+    uint64_t key;
+    layout_t turned;
+    
+    canonical_layout(lvl, plain);
+    keys->key = layout_key(plain);
+    keys->sym_key = keys->key;
+    
+    if (sym != NULL)
+    {
+        *sym = *plain;
+    }
+    
+    /* Transform 0 is the layout itself. */
+    for (t = 1; t < NSYMMETRIES; t++)
+    {
+        transform_layout(plain, t, &turned);
+        key = layout_key(&turned);
+        
+        if (key < keys->sym_key)
+        {
+            keys->sym_key = key;
+            if (sym != NULL)
+            {
+                *sym = turned;
+            }
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Copies the board of a level into a layout, every cell as it is, with its
+ * size and par. Levels are saved from the editor already cropped by 
+ * crop_lvl(), so nothing more is cut, as any other padding plays 
+ * differently.
+ */
+
+void
+canonical_layout(level_t *lvl, layout_t *layout)
+{
+    int i, j;
+    
+    layout->rows = lvl->rows;
+    layout->cols = lvl->cols;
+    layout->moves = lvl->moves;
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < lvl->cols; j++)
+        {
+            layout->cells[i * lvl->cols + j] = lvl->board[i][j];
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Rotates or reflects a layout. Bit 0 of t mirrors the columns, bit 1 the
+ * rows, and bit 2 swaps rows and columns, which gives the 8 symmetries of
+ * the board.
+ */
+
+void
+transform_layout(layout_t *src, int t, layout_t *dst)
+{
+    int i, j, r, c;
+    
+    dst->moves = src->moves;
+    dst->rows = (t & 4) ? src->cols : src->rows;
+    dst->cols = (t & 4) ? src->rows : src->cols;
+    
+    for (i = 0; i < dst->rows; i++)
+    {
+        for (j = 0; j < dst->cols; j++)
+        {
+            r = (t & 2) ? dst->rows - 1 - i : i;
+            c = (t & 1) ? dst->cols - 1 - j : j;
+            
+            if (t & 4)
+            {
+                int_swap(&r, &c);
+            }
+            
+            dst->cells[i * dst->cols + j] = src->cells[r * src->cols + c];
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Hashes a layout with 64 bit FNV-1a. Never returns 0, which marks empty
+ * table slots.
+ */
+
+uint64_t
+layout_key(layout_t *layout)
+{
+    int i;
+    uint64_t hash = FNV_OFFSET;
+    
+    hash = (hash ^ (uint8_t)layout->rows) * FNV_PRIME;
+    hash = (hash ^ (uint8_t)layout->cols) * FNV_PRIME;
+    
+    for (i = 0; i < 32; i += 8)
+    {
+        hash = (hash ^ (uint8_t)(layout->moves >> i)) * FNV_PRIME;
+    }
+    
+    for (i = 0; i < layout->rows * layout->cols; i++)
+    {
+        hash = (hash ^ layout->cells[i]) * FNV_PRIME;
+    }
+    
+    return hash != 0 ? hash : 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if two layouts are the same.
+ */
+
+int
+same_layout(layout_t *l1, layout_t *l2)
+{
+    return l1->rows == l2->rows
+        && l1->cols == l2->cols
+        && l1->moves == l2->moves
+        && memcmp(l1->cells, l2->cells, l1->rows * l1->cols) == 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Opens the content addressed store and reads the keys of its levels into
+ * the tables. Only a store opened with create can have levels added, and 
+ * it is created if it doesn't exist. A record left partly written at the
+ * end of the store is cut off. Returns FALSE if the store can't be opened
+ * or is damaged.
+ */
+
+int
+open_content_store(content_store_t *store, int create)
+{
+    lcs_header_t header;
+    level_keys_t keys;
+    stored_level_t rec;
+    uint32_t size;
+    
+    memset(store, 0, sizeof(*store));
+    
+    if ((store->fp = fopen(CONTENT_STORE_FILE, create ? "r+b" : "rb")) 
+        == NULL)
+    {
+        if (GetFileAttributes(CONTENT_STORE_FILE) != INVALID_FILE_ATTRIBUTES)
+        {
+            return FALSE;
+        }
+        
+        /* A store that doesn't exist has no levels yet. */
+        if (!create)
+        {
+            return TRUE;
+        }
+        
+        memcpy(header.magic, LCS_MAGIC, LVB_MAGIC_LEN);
+        header.version = LCS_VERSION;
+        store->size = sizeof(header);
+        
+        return (store->fp = fopen(CONTENT_STORE_FILE, "w+b")) != NULL
+            && fwrite(&header, sizeof(header), 1, store->fp) == 1;
+    }
+    
+    if (   fread(&header, sizeof(header), 1, store->fp) != 1
+        || memcmp(header.magic, LCS_MAGIC, LVB_MAGIC_LEN) != 0
+        || header.version != LCS_VERSION)
+    {
+        close_content_store(store);
+        return FALSE;
+    }
+    
+    store->size = sizeof(header);
+    
+    while (   fseek(store->fp, store->size, SEEK_SET) == 0
+           && fread(&keys, sizeof(keys), 1, store->fp) == 1
+           && fread(&rec, sizeof(rec), 1, store->fp) == 1
+           && rec.size <= STORED_LEVEL_MAX - sizeof(rec)
+           && fseek(store->fp, store->size + sizeof(keys) + sizeof(rec) 
+                    + rec.size - 1, SEEK_SET) == 0
+           && (rec.size == 0 || fgetc(store->fp) != EOF))
+    {
+        if (   !key_table_add(&store->by_key, keys.key, 
+                              store->size + sizeof(keys))
+            || !key_table_add(&store->by_sym, keys.sym_key, 
+                              store->size + sizeof(keys)))
+        {
+            close_content_store(store);
+            return FALSE;
+        }
+        
+        size = sizeof(keys) + sizeof(rec) + rec.size;
+        store->size += size + (LCS_ALIGN - size % LCS_ALIGN) % LCS_ALIGN;
+    }
+    
+    if (!create || fseek(store->fp, 0, SEEK_END) != 0 
+        || (uint32_t)ftell(store->fp) == store->size)
+    {
+        return TRUE;
+    }
+    
+    /* Cut off the torn record, so that new records are found again. */
+    fclose(store->fp);
+    store->fp = NULL;
+    
+    if (   !truncate_file(CONTENT_STORE_FILE, store->size)
+        || (store->fp = fopen(CONTENT_STORE_FILE, "r+b")) == NULL)
+    {
+        close_content_store(store);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Cuts a file down to size bytes. Returns FALSE if it couldn't be done.
+ */
+
+int
+truncate_file(char *file_name, uint32_t size)
+{
+    int ok;
+    HANDLE file = CreateFile(file_name, GENERIC_WRITE, 0, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+    
+    ok = (   SetFilePointer(file, size, NULL, FILE_BEGIN) 
+                 != INVALID_SET_FILE_POINTER
+          && SetEndOfFile(file));
+    
+    CloseHandle(file);
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Closes the content addressed store, and frees its tables.
+ */
+
+void
+close_content_store(content_store_t *store)
+{
+    if (store->fp != NULL)
+    {
+        fclose(store->fp);
+        store->fp = NULL;
+    }
+    
+    free_key_table(&store->by_key);
+    free_key_table(&store->by_sym);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a level to the content addressed store, unless the same layout is
+ * already there. Sets key and offset to those of the stored level. Returns
+ * CONTENT_NEW or CONTENT_FOUND, or CONTENT_ERROR if writing failed.
+ */
+
+int
+add_content_level(content_store_t *store, level_t *lvl, uint64_t *key, 
+    uint32_t *offset)
+{
+    uint64_t buf[(sizeof(level_keys_t) + STORED_LEVEL_MAX + LCS_ALIGN) 
+                 / sizeof(uint64_t)];
+    stored_level_t *rec = (stored_level_t *)(buf + 2);
+    level_keys_t keys;
+    layout_t plain;
+    uint32_t size;
+    
+    get_layouts(lvl, &plain, NULL, &keys);
+    *key = keys.key;
+    
+    if (find_content_level(store, &store->by_key, keys.key, &plain, FALSE,
+                           offset))
+    {
+        return CONTENT_FOUND;
+    }
+    
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, &keys, sizeof(keys));
+    encode_level(lvl, rec);
+    
+    size = sizeof(keys) + sizeof(stored_level_t) + rec->size;
+    size += (LCS_ALIGN - size % LCS_ALIGN) % LCS_ALIGN;
+    
+    if (   fseek(store->fp, store->size, SEEK_SET) != 0
+        || fwrite(buf, size, 1, store->fp) != 1)
+    {
+        return CONTENT_ERROR;
+    }
+    
+    *offset = store->size + sizeof(keys);
+    store->size += size;
+    
+    if (   !key_table_add(&store->by_key, keys.key, *offset)
+        || !key_table_add(&store->by_sym, keys.sym_key, *offset))
+    {
+        return CONTENT_ERROR;
+    }
+    
+    return CONTENT_NEW;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Looks up a layout in one of the store's tables. Levels with the same key
+ * are read back and compared, so a match is always the same layout, or the
+ * same symmetric layout if sym is TRUE. Returns TRUE if one was found, and
+ * sets offset to it.
+ */
+
+int
+find_content_level(content_store_t *store, key_table_t *table, 
+    uint64_t key, layout_t *layout, int sym, uint32_t *offset)
+{
+    uint32_t i;
+    level_t lvl;
+    layout_t plain, turned;
+    level_keys_t keys;
+    
+    if (table->size == 0)
+    {
+        return FALSE;
+    }
+    
+    for (i = (uint32_t)key & (table->size - 1); table->slot[i].key != 0;
+         i = (i + 1) & (table->size - 1))
+    {
+        if (   table->slot[i].key == key
+            && read_content_level(store, table->slot[i].offset, &lvl))
+        {
+            get_layouts(&lvl, &plain, sym ? &turned : NULL, &keys);
+            
+            if (same_layout(sym ? &turned : &plain, layout))
+            {
+                *offset = table->slot[i].offset;
+                return TRUE;
+            }
+        }
+    }
+    
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the level at offset in the content addressed store. Returns FALSE
+ * if it can't be read.
+ */
+
+int
+read_content_level(content_store_t *store, uint32_t offset, level_t *lvl)
+{
+    uint32_t buf[(STORED_LEVEL_MAX + LVB_ALIGN) / sizeof(uint32_t)];
+    stored_level_t *rec = (stored_level_t *)buf;
+    
+    return fseek(store->fp, offset, SEEK_SET) == 0
+        && fread(rec, sizeof(stored_level_t), 1, store->fp) == 1
+        && rec->size <= STORED_LEVEL_MAX - sizeof(stored_level_t)
+        && fread(rec->cells, 1, rec->size, store->fp) == rec->size
+        && decode_level(rec, lvl);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds an offset to a key table, growing the table when it is half full.
+ * Returns FALSE if there isn't enough memory.
+ */
+
+int
+key_table_add(key_table_t *table, uint64_t key, uint32_t offset)
+{
+    uint32_t i, j, size;
+    key_slot_t *slot;
+    
+    if ((table->count + 1) * 2 > table->size)
+    {
+        size = table->size ? table->size * 2 : MIN_TABLE_SIZE;
+        
+        if ((slot = calloc(size, sizeof(key_slot_t))) == NULL)
+        {
+            return FALSE;
+        }
+        
+        for (i = 0; i < table->size; i++)
+        {
+            if (table->slot[i].key != 0)
+            {
+                for (j = (uint32_t)table->slot[i].key & (size - 1); 
+                     slot[j].key != 0; j = (j + 1) & (size - 1))
+                    ;
+                slot[j] = table->slot[i];
+            }
+        }
+        
+        free(table->slot);
+        table->slot = slot;
+        table->size = size;
+    }
+    
+    for (i = (uint32_t)key & (table->size - 1); table->slot[i].key != 0;
+         i = (i + 1) & (table->size - 1))
+        ;
+    
+    table->slot[i].key = key;
+    table->slot[i].offset = offset;
+    table->count++;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the first offset added to a key table with key. Returns FALSE if
+ * there isn't one.
+ */
+
+int
+key_table_find(key_table_t *table, uint64_t key, uint32_t *offset)
+{
+    uint32_t i;
+    
+    if (table->size == 0)
+    {
+        return FALSE;
+    }
+    
+    for (i = (uint32_t)key & (table->size - 1); table->slot[i].key != 0;
+         i = (i + 1) & (table->size - 1))
+    {
+        if (table->slot[i].key == key)
+        {
+            *offset = table->slot[i].offset;
+            return TRUE;
+        }
+    }
+    
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees the slots of a key table.
+ */
+
+void
+free_key_table(key_table_t *table)
+{
+    free(table->slot);
+    table->slot = NULL;
+    table->size = 0;
+    table->count = 0;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Starts recording an attempt, with nothing recorded yet.
+ */
+
+void
+start_recording(replay_recorder_t *rec)
+{
+    rec->slides = NULL;
+    rec->bombs = NULL;
+    rec->nslides = 0;
+    rec->capacity = 0;
+    rec->nbombs = 0;
+    rec->failed = FALSE;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Clears the recording for the next attempt, keeping its buffers.
+ */
+
+void
+restart_recording(replay_recorder_t *rec)
+{
+    if (rec->capacity > 0)
+    {
+        memset(rec->slides, 0, rec->capacity / 4);
+        memset(rec->bombs, 0, rec->capacity / 8 + 1);
+    }
+    
+    rec->nslides = 0;
+    rec->nbombs = 0;
+    rec->failed = FALSE;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Doubles the slides a recording can hold. Returns FALSE, and marks the
+ * recording as failed, if there isn't enough memory.
+ */
+
+int
+grow_recording(replay_recorder_t *rec)
+{
+    uint32_t capacity = rec->capacity ? rec->capacity * 2 : MIN_INDEX_LEN * 4;
+    uint8_t *slides, *bombs;
+    
+    if (capacity > REPLAY_MAX_SLIDES + 1)
+    {
+        rec->failed = TRUE;
+        return FALSE;
+    }
+    
+    if ((slides = realloc(rec->slides, capacity / 4)) != NULL)
+    {
+        rec->slides = slides;
+    }
+    
+    if (   slides == NULL
+        || (bombs = realloc(rec->bombs, capacity / 8 + 1)) == NULL)
+    {
+        rec->failed = TRUE;
+        return FALSE;
+    }
+    
+    rec->bombs = bombs;
+    
+    /* Only the old part of the buffers has been written. */
+    memset(rec->slides + rec->capacity / 4, 0, (capacity - rec->capacity) / 4);
+    memset(rec->bombs + (rec->capacity ? rec->capacity / 8 + 1 : 0), 0, 
+        capacity / 8 + 1 - (rec->capacity ? rec->capacity / 8 + 1 : 0));
+    rec->capacity = capacity;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a slide in direction to the recording.
+ */
+
+void
+record_slide(replay_recorder_t *rec, char direction)
+{
+    int code;
+    
+    if (rec->failed || (rec->nslides == rec->capacity && !grow_recording(rec)))
+    {
+        return;
+    }
+    
+    switch (direction)
+    {
+        case UP:    code = 0; break;
+        case RIGHT: code = 1; break;
+        case DOWN:  code = 2; break;
+        default:    code = 3; break;
+    }
+    
+    rec->slides[rec->nslides / 4] |= code << (2 * (rec->nslides % 4));
+    rec->nslides++;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Marks a bomb as used before the next slide of the recording.
+ */
+
+void
+record_bomb(replay_recorder_t *rec)
+{
+    if (rec->failed || (rec->capacity == 0 && !grow_recording(rec)))
+    {
+        return;
+    }
+    
+    rec->bombs[rec->nslides / 8] |= 1 << (rec->nslides % 8);
+    rec->nbombs++;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees the buffers of a recording.
+ */
+
+void
+stop_recording(replay_recorder_t *rec)
+{
+    free(rec->slides);
+    free(rec->bombs);
+    start_recording(rec);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the direction of slide n of a replay.
+ */
+
+char
+replay_move(const replay_t *replay, uint32_t n)
+{
+    switch ((replay->slides[n / 4] >> (2 * (n % 4))) & 3)
+    {
+        case 0:  return UP;
+        case 1:  return RIGHT;
+        case 2:  return DOWN;
+        default: return LEFT;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if a bomb was used before slide n of a replay. Slide 
+ * nslides is the end of the replay.
+ */
+
+int
+replay_bomb(const replay_t *replay, uint32_t n)
+{
+    return replay->bombs != NULL && (replay->bombs[n / 8] >> (n % 8)) & 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Opens the replay archive for adding replays, creating it if it doesn't 
+ * exist. The levels and players it already has are read, so that they
+ * aren't added again. Returns FALSE if the archive can't be opened, in
+ * which case replays aren't recorded.
+ */
+
+int
+open_replays(replay_archive_t *archive)
+{
+    char *name = getenv("USERNAME"), player[REPLAY_NAME_LEN];
+    uint32_t id;
+    uint64_t key;
+    int truncated;
+    rpa_header_t header;
+    replay_reader_t reader;
+    
+    memset(archive, 0, sizeof(*archive));
+    archive->player = REPLAY_NO_ID;
+    strncpy(archive->name, name != NULL && name[0] != '\0' 
+        ? name : REPLAY_DEFAULT_NAME, REPLAY_NAME_LEN - 1);
+    
+    if (!open_replay_reader(&reader, REPLAY_FILE REPLAY_ARCHIVE_FILE))
+    {
+        if (   GetFileAttributes(REPLAY_FILE REPLAY_ARCHIVE_FILE) 
+            != INVALID_FILE_ATTRIBUTES)
+        {
+            return FALSE;
+        }
+        
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RPA_MAGIC, LVB_MAGIC_LEN);
+        header.version = REPLAY_VERSION;
+        header.base_time = (uint32_t)time(NULL);
+        archive->base_time = header.base_time;
+        archive->size = sizeof(header);
+        
+        if ((archive->fp = fopen(REPLAY_FILE REPLAY_ARCHIVE_FILE, "wb")) 
+            == NULL)
+        {
+            return FALSE;
+        }
+        
+        if (   fwrite(&header, sizeof(header), 1, archive->fp) != 1
+            || fflush(archive->fp) != 0)
+        {
+            fclose(archive->fp);
+            archive->fp = NULL;
+            return FALSE;
+        }
+        
+        return TRUE;
+    }
+    
+    for (id = 0; id < reader.nlevels; id++)
+    {
+        if (   !get_replay_level(&reader, id, &key)
+            || !key_table_add(&archive->levels, key, id))
+        {
+            close_replay_reader(&reader);
+            free_key_table(&archive->levels);
+            return FALSE;
+        }
+    }
+    
+    for (id = 0; id < reader.nplayers; id++)
+    {
+        if (   get_replay_player(&reader, id, player)
+            && strcmp(player, archive->name) == 0)
+        {
+            archive->player = id;
+        }
+    }
+    
+    archive->nlevels = reader.nlevels;
+    archive->nplayers = reader.nplayers;
+    archive->base_time = reader.base_time;
+    archive->size = reader.end;
+    archive->unindexed = reader.ntail;
+    truncated = reader.end < reader.archive.size;
+    
+    close_replay_reader(&reader);
+    
+    /* Cut off a record that was only partly written, so that records added
+     * after it can be read. */
+    if (   (truncated 
+            && !truncate_file(REPLAY_FILE REPLAY_ARCHIVE_FILE, archive->size))
+        || (archive->fp = fopen(REPLAY_FILE REPLAY_ARCHIVE_FILE, "ab")) 
+           == NULL)
+    {
+        free_key_table(&archive->levels);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Closes the replay archive. The index is rebuilt once enough replays have
+ * been added past its end.
+ */
+
+void
+close_replays(replay_archive_t *archive)
+{
+    replay_reader_t reader;
+    
+    if (archive->fp != NULL)
+    {
+        fclose(archive->fp);
+        archive->fp = NULL;
+        
+        if (   archive->unindexed > REPLAY_INDEX_SLACK 
+            && open_replay_reader(&reader, REPLAY_FILE REPLAY_ARCHIVE_FILE))
+        {
+            write_replay_index(&reader);
+            close_replay_reader(&reader);
+        }
+    }
+    
+    free_key_table(&archive->levels);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a recorded attempt at the level with key to the archive. The level
+ * and the player are added first, if this is their first replay. Returns 
+ * FALSE if the replay couldn't be added.
+ */
+
+int
+add_replay(replay_archive_t *archive, uint64_t key, replay_recorder_t *rec,
+    int result)
+{
+    uint32_t level, len, value;
+    uint8_t *data;
+    int ok;
+    
+    if (archive->fp == NULL || rec->failed)
+    {
+        return FALSE;
+    }
+    
+    if (!key_table_find(&archive->levels, key, &level))
+    {
+        if (   !append_replay_record(archive, LEVEL_RECORD, 0, 
+                                     (uint8_t *)&key, sizeof(key))
+            || !key_table_add(&archive->levels, key, archive->nlevels))
+        {
+            return FALSE;
+        }
+        level = archive->nlevels++;
+    }
+    
+    if (archive->player == REPLAY_NO_ID)
+    {
+        if (!append_replay_record(archive, PLAYER_RECORD, 
+                strlen(archive->name), (uint8_t *)archive->name, 
+                strlen(archive->name)))
+        {
+            return FALSE;
+        }
+        archive->player = archive->nplayers++;
+    }
+    
+    if ((data = malloc(15 + (rec->nslides + 3) / 4 + rec->nslides / 8 + 1)) 
+        == NULL)
+    {
+        return FALSE;
+    }
+    
+    len = put_varint(data, level);
+    len += put_varint(data + len, archive->player);
+    len += put_varint(data + len, (uint32_t)time(NULL) - archive->base_time);
+    
+    memcpy(data + len, rec->slides, (rec->nslides + 3) / 4);
+    len += (rec->nslides + 3) / 4;
+    
+    if (rec->nbombs > 0)
+    {
+        memcpy(data + len, rec->bombs, rec->nslides / 8 + 1);
+        len += rec->nslides / 8 + 1;
+    }
+    
+    value = (rec->nslides << 3) | (result << 1) | (rec->nbombs > 0);
+    ok = append_replay_record(archive, REPLAY_RECORD, value, data, len);
+    free(data);
+    
+    if (ok)
+    {
+        archive->unindexed++;
+    }
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Appends a record of kind to the archive, with value in its first number
+ * and data after it. If writing fails, no more replays are recorded, so
+ * that nothing is written after a damaged record.
+ */
+
+int
+append_replay_record(replay_archive_t *archive, int kind, uint32_t value,
+    const uint8_t *data, size_t len)
+{
+    uint8_t *record;
+    size_t size;
+    int ok;
+    
+    if ((record = malloc(len + 6)) == NULL)
+    {
+        return FALSE;
+    }
+    
+    size = put_varint(record, (value << 2) | kind);
+    memcpy(record + size, data, len);
+    size += len;
+    record[size] = (uint8_t)crc32(record, size);
+    size++;
+    
+    ok = (   fwrite(record, size, 1, archive->fp) == 1
+          && fflush(archive->fp) == 0);
+    free(record);
+    
+    if (!ok)
+    {
+        fclose(archive->fp);
+        archive->fp = NULL;
+        return FALSE;
+    }
+    
+    archive->size += size;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps a replay archive and its index, which has the same name with the
+ * index extension. Replays past the end of the index,
+ * or all of them if there is no index, are found by reading the records 
+ * there. Reading stops at the first damaged record. Returns FALSE if there
+ * is no archive, or it can't be read.
+ */
+
+int
+open_replay_reader(replay_reader_t *reader, char *file_name)
+{
+    const rpa_header_t *header;
+    replay_record_t record;
+    uint32_t offset, next;
+    int ok = TRUE;
+    
+    memset(reader, 0, sizeof(*reader));
+    
+    if (strlen(file_name) + strlen(REPLAY_INDEX_FILE) >= MAX_PATH)
+    {
+        return FALSE;
+    }
+    
+    strcpy(reader->archive_file, file_name);
+    strcpy(reader->index_file, file_name);
+    strcpy(file_ext(reader->index_file), REPLAY_INDEX_FILE);
+    
+    if (!map_file(&reader->archive, reader->archive_file, 
+                  sizeof(rpa_header_t)))
+    {
+        return FALSE;
+    }
+    
+    header = (const rpa_header_t *)reader->archive.base;
+    
+    if (   memcmp(header->magic, RPA_MAGIC, LVB_MAGIC_LEN) != 0
+        || header->version != REPLAY_VERSION)
+    {
+        lvb_close(&reader->archive);
+        return FALSE;
+    }
+    
+    reader->base_time = header->base_time;
+    
+    if (!read_replay_index(reader))
+    {
+        reader->index_end = sizeof(rpa_header_t);
+    }
+    
+    for (offset = reader->index_end; 
+         ok && offset < reader->archive.size 
+         && (next = read_replay_record(&reader->archive, offset, &record)) 
+            != 0;
+         offset = next)
+    {
+        if (record.kind == LEVEL_RECORD)
+        {
+            ok = push_offset(&reader->level_def, &reader->nlevels, offset);
+        }
+        else if (record.kind == PLAYER_RECORD)
+        {
+            ok = push_offset(&reader->player_def, &reader->nplayers, offset);
+        }
+        else if (   record.replay.level < reader->nlevels
+                 && record.replay.player < reader->nplayers)
+        {
+            ok = push_offset(&reader->tail, &reader->ntail, offset);
+        }
+        else
+        {
+            /* The replay refers to a record that doesn't exist. */
+            break;
+        }
+    }
+    
+    if (!ok)
+    {
+        close_replay_reader(reader);
+        return FALSE;
+    }
+    
+    reader->end = offset;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Unmaps the replay archive and its index.
+ */
+
+void
+close_replay_reader(replay_reader_t *reader)
+{
+    if (reader->index.base != NULL)
+    {
+        lvb_close(&reader->index);
+    }
+    
+    if (reader->archive.base != NULL)
+    {
+        lvb_close(&reader->archive);
+    }
+    
+    free(reader->tail);
+    free(reader->level_def);
+    free(reader->player_def);
+    reader->tail = NULL;
+    reader->level_def = NULL;
+    reader->player_def = NULL;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Maps the replay index, if it exists and belongs to the archive. Returns
+ * FALSE if it can't be used, in which case the archive is read from the
+ * start.
+ */
+
+int
+read_replay_index(replay_reader_t *reader)
+{
+    const rpi_header_t *header;
+    const uint32_t *data;
+    uint64_t needed;
+    uint32_t i;
+    int ok;
+    
+    if (!map_file(&reader->index, reader->index_file, 
+                  sizeof(rpi_header_t)))
+    {
+        return FALSE;
+    }
+    
+    header = (const rpi_header_t *)reader->index.base;
+    needed = 3 * (uint64_t)header->nreplays + 2 * (uint64_t)header->nlevels
+           + 2 * (uint64_t)header->nplayers + 2;
+    
+    ok = (   memcmp(header->magic, RPI_MAGIC, LVB_MAGIC_LEN) == 0
+          && header->version == REPLAY_VERSION
+          && header->base_time == reader->base_time
+          && header->archive_size >= sizeof(rpa_header_t)
+          && header->archive_size <= reader->archive.size
+          && needed <= (reader->index.size - sizeof(rpi_header_t)) 
+                       / sizeof(uint32_t));
+    
+    if (ok)
+    {
+        data = (const uint32_t *)(reader->index.base + sizeof(rpi_header_t));
+        reader->offset = data;
+        data += header->nreplays;
+        
+        for (i = 0; ok && i < header->nlevels; i++)
+        {
+            ok = push_offset(&reader->level_def, &reader->nlevels, *data++);
+        }
+        
+        for (i = 0; ok && i < header->nplayers; i++)
+        {
+            ok = push_offset(&reader->player_def, &reader->nplayers, *data++);
+        }
+        
+        reader->level_start = data;
+        data += header->nlevels + 1;
+        reader->by_level = data;
+        data += header->nreplays;
+        reader->player_start = data;
+        data += header->nplayers + 1;
+        reader->by_player = data;
+    }
+    
+    /* The lists of replays must end with the last replay. */
+    if (   !ok
+        || reader->level_start[header->nlevels] != header->nreplays
+        || reader->player_start[header->nplayers] != header->nreplays)
+    {
+        lvb_close(&reader->index);
+        free(reader->level_def);
+        free(reader->player_def);
+        reader->level_def = NULL;
+        reader->player_def = NULL;
+        reader->nlevels = 0;
+        reader->nplayers = 0;
+        return FALSE;
+    }
+    
+    reader->nindexed = header->nreplays;
+    reader->index_end = header->archive_size;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the record at offset in the replay archive. The slides of a replay
+ * point into the mapped archive. Returns the offset of the next record, or 
+ * 0 if the record is damaged.
+ */
+
+uint32_t
+read_replay_record(lvb_t *archive, uint32_t offset, replay_record_t *record)
+{
+    const uint8_t *start = archive->base + offset, *p = start;
+    const uint8_t *end = archive->base + archive->size;
+    replay_t *replay = &record->replay;
+    uint32_t head, value, len;
+    int n;
+    
+    if (offset >= archive->size || (n = get_varint(p, end, &head)) == 0)
+    {
+        return 0;
+    }
+    
+    p += n;
+    record->kind = head & 3;
+    value = head >> 2;
+    
+    if (record->kind == REPLAY_RECORD)
+    {
+        replay->nslides = value >> 3;
+        replay->result = (value >> 1) & 3;
+        
+        if ((n = get_varint(p, end, &replay->level)) == 0)
+        {
+            return 0;
+        }
+        p += n;
+        
+        if ((n = get_varint(p, end, &replay->player)) == 0)
+        {
+            return 0;
+        }
+        p += n;
+        
+        if ((n = get_varint(p, end, &replay->time)) == 0)
+        {
+            return 0;
+        }
+        p += n;
+        
+        len = (replay->nslides + 3) / 4;
+        
+        if ((size_t)(end - p) < len)
+        {
+            return 0;
+        }
+        
+        replay->slides = p;
+        p += len;
+        replay->bombs = NULL;
+        
+        if (value & 1)
+        {
+            len = replay->nslides / 8 + 1;
+            
+            if ((size_t)(end - p) < len)
+            {
+                return 0;
+            }
+            
+            replay->bombs = p;
+            p += len;
+        }
+    }
+    else if (record->kind == LEVEL_RECORD)
+    {
+        if (end - p < (ptrdiff_t)sizeof(record->key))
+        {
+            return 0;
+        }
+        
+        memcpy(&record->key, p, sizeof(record->key));
+        p += sizeof(record->key);
+    }
+    else if (record->kind == PLAYER_RECORD)
+    {
+        if (value >= REPLAY_NAME_LEN || end - p < (ptrdiff_t)value)
+        {
+            return 0;
+        }
+        
+        memcpy(record->name, p, value);
+        record->name[value] = '\0';
+        p += value;
+    }
+    else
+    {
+        return 0;
+    }
+    
+    /* The record ends with a check byte. */
+    if (p == end || *p != (uint8_t)crc32(start, p - start))
+    {
+        return 0;
+    }
+    
+    return offset + (p - start) + 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the number of replays in the archive.
+ */
+
+uint32_t
+replay_count(replay_reader_t *reader)
+{
+    return reader->nindexed + reader->ntail;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds replay n of the archive, numbered from 0, without reading any other
+ * record. Returns FALSE if there is no such replay or it is damaged.
+ */
+
+int
+get_replay(replay_reader_t *reader, uint32_t n, replay_t *replay)
+{
+    replay_record_t record;
+    uint32_t offset;
+    
+    if (n < reader->nindexed)
+    {
+        offset = reader->offset[n];
+    }
+    else if (n - reader->nindexed < reader->ntail)
+    {
+        offset = reader->tail[n - reader->nindexed];
+    }
+    else
+    {
+        return FALSE;
+    }
+    
+    if (   read_replay_record(&reader->archive, offset, &record) == 0
+        || record.kind != REPLAY_RECORD
+        || record.replay.level >= reader->nlevels
+        || record.replay.player >= reader->nplayers)
+    {
+        return FALSE;
+    }
+    
+    *replay = record.replay;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the key of the level with id. Returns FALSE if it can't be read.
+ */
+
+int
+get_replay_level(replay_reader_t *reader, uint32_t id, uint64_t *key)
+{
+    replay_record_t record;
+    
+    if (   id >= reader->nlevels
+        || read_replay_record(&reader->archive, reader->level_def[id], 
+                              &record) == 0
+        || record.kind != LEVEL_RECORD)
+    {
+        return FALSE;
+    }
+    
+    *key = record.key;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the name of the player with id into name, which holds
+ * REPLAY_NAME_LEN characters. Returns FALSE if it can't be read.
+ */
+
+int
+get_replay_player(replay_reader_t *reader, uint32_t id, char *name)
+{
+    replay_record_t record;
+    
+    if (   id >= reader->nplayers
+        || read_replay_record(&reader->archive, reader->player_def[id], 
+                              &record) == 0
+        || record.kind != PLAYER_RECORD)
+    {
+        return FALSE;
+    }
+    
+    strcpy(name, record.name);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes an index of every replay in the archive, under a temporary name
+ * that is then renamed over the old index. The reader is opened again, so
+ * that it uses the new index. Returns FALSE if the index couldn't be 
+ * written.
+ */
+
+int
+write_replay_index(replay_reader_t *reader)
+{
+    char temp[MAX_PATH + sizeof(TEMP_FILE)], file_name[MAX_PATH];
+    uint32_t i, n = replay_count(reader), *offset, *level_start, *by_level;
+    uint32_t *player_start, *by_player, *level_of, *player_of;
+    replay_t replay;
+    rpi_header_t header;
+    FILE *fp;
+    int ok;
+    
+    offset = malloc((n + 1) * sizeof(uint32_t));
+    by_level = malloc((n + 1) * sizeof(uint32_t));
+    by_player = malloc((n + 1) * sizeof(uint32_t));
+    level_of = malloc((n + 1) * sizeof(uint32_t));
+    player_of = malloc((n + 1) * sizeof(uint32_t));
+    level_start = calloc(reader->nlevels + 1, sizeof(uint32_t));
+    player_start = calloc(reader->nplayers + 1, sizeof(uint32_t));
+    
+    ok = (   offset != NULL && by_level != NULL && by_player != NULL
+          && level_of != NULL && player_of != NULL
+          && level_start != NULL && player_start != NULL);
+    
+    /* Count the replays of each level and player. A damaged replay 
+     * stops the index being made, as every replay must be in it. */
+    for (i = 0; ok && i < n; i++)
+    {
+        if (!(ok = get_replay(reader, i, &replay)))
+        {
+            break;
+        }
+        
+        offset[i] = i < reader->nindexed 
+            ? reader->offset[i] : reader->tail[i - reader->nindexed];
+        level_of[i] = replay.level;
+        player_of[i] = replay.player;
+        level_start[replay.level]++;
+        player_start[replay.player]++;
+    }
+    
+    /* Find the end of each list, then fill it from the end, so that the
+     * ends move back to the starts and replays stay in the order they were
+     * added. */
+    for (i = 1; ok && i <= reader->nlevels; i++)
+    {
+        level_start[i] += level_start[i - 1];
+    }
+    
+    for (i = 1; ok && i <= reader->nplayers; i++)
+    {
+        player_start[i] += player_start[i - 1];
+    }
+    
+    for (i = n; ok && i-- > 0; )
+    {
+        by_level[--level_start[level_of[i]]] = i;
+        by_player[--player_start[player_of[i]]] = i;
+    }
+    
+    snprintf(temp, sizeof(temp), "%s%s", reader->index_file, TEMP_FILE);
+    
+    if (ok && (fp = fopen(temp, "wb")) != NULL)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RPI_MAGIC, LVB_MAGIC_LEN);
+        header.version = REPLAY_VERSION;
+        header.archive_size = reader->end;
+        header.nreplays = n;
+        header.nlevels = reader->nlevels;
+        header.nplayers = reader->nplayers;
+        header.base_time = reader->base_time;
+        
+        ok = (   fwrite(&header, sizeof(header), 1, fp) == 1
+              && fwrite(offset, sizeof(uint32_t), n, fp) == n
+              && fwrite(reader->level_def, sizeof(uint32_t), 
+                        reader->nlevels, fp) == reader->nlevels
+              && fwrite(reader->player_def, sizeof(uint32_t), 
+                        reader->nplayers, fp) == reader->nplayers
+              && fwrite(level_start, sizeof(uint32_t), reader->nlevels + 1, 
+                        fp) == reader->nlevels + 1
+              && fwrite(by_level, sizeof(uint32_t), n, fp) == n
+              && fwrite(player_start, sizeof(uint32_t), reader->nplayers + 1,
+                        fp) == reader->nplayers + 1
+              && fwrite(by_player, sizeof(uint32_t), n, fp) == n);
+        
+        if (fclose(fp) != 0)
+        {
+            ok = FALSE;
+        }
+    }
+    else
+    {
+        ok = FALSE;
+    }
+    
+    free(offset);
+    free(by_level);
+    free(by_player);
+    free(level_of);
+    free(player_of);
+    free(level_start);
+    free(player_start);
+    
+    /* The old index can't be replaced while it is mapped. */
+    strcpy(file_name, reader->archive_file);
+    close_replay_reader(reader);
+    
+    if (ok)
+    {
+        ok = MoveFileEx(temp, reader->index_file, 
+            MOVEFILE_REPLACE_EXISTING);
+    }
+    
+    if (!ok)
+    {
+        DeleteFile(temp);
+    }
+    
+    return open_replay_reader(reader, file_name) && ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds an offset to a growing array. Returns FALSE if there isn't enough
+ * memory.
+ */
+
+int
+push_offset(uint32_t **array, uint32_t *count, uint32_t value)
+{
+    uint32_t *grown;
+    
+    /* The array doubles in size whenever it is full. */
+    if (   *count == 0 
+        || (*count >= MIN_INDEX_LEN && (*count & (*count - 1)) == 0))
+    {
+        grown = realloc(*array, (*count ? *count * 2 : MIN_INDEX_LEN) 
+                                * sizeof(uint32_t));
+        if (grown == NULL)
+        {
+            return FALSE;
+        }
+        *array = grown;
+    }
+    
+    (*array)[(*count)++] = value;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes value as a variable length number, 7 bits to a byte with the high
+ * bit set on every byte but the last. Returns the number of bytes written,
+ * at most 5.
+ */
+
+int
+put_varint(uint8_t *p, uint32_t value)
+{
+    int n = 0;
+    
+    while (value >= 0x80)
+    {
+        p[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    
+    p[n++] = (uint8_t)value;
+    
+    return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads a variable length number that must end before end. Returns the
+ * number of bytes read, or 0 if it doesn't fit.
+ */
+
+int
+get_varint(const uint8_t *p, const uint8_t *end, uint32_t *value)
+{
+    int n;
+    
+    *value = 0;
+    
+    for (n = 0; n < 5 && p + n < end; n++)
+    {
+        *value |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+        
+        if ((p[n] & 0x80) == 0)
+        {
+            return n + 1;
+        }
+    }
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Plays the game. First makes a local copy of the level that gets edited
+ * while playing. It looks for input from the player, calls move() to move the
+ * player accordingly. Each attempt is added to replays, unless it is NULL.
+ */
+
+int
+play(level_t *level, save_t *save, int level_num, int edit_mode, 
+    replay_archive_t *replays)
+{
+    char direction = '\0';
+    int val, check, attempts = 1;
+    DWORD start = GetTickCount();
+    layout_t layout;
+    level_keys_t keys;
+    replay_recorder_t rec;
+    hint_t hint;
+    level_t currentlvl;
+    
+    memset(&hint, 0, sizeof(hint));
+    
+    /* Replays find their level by the key of its layout. */
+    if (replays != NULL && replays->fp != NULL)
+    {
+        get_layouts(level, &layout, NULL, &keys);
+    }
+    else
+    {
+        replays = NULL;
+    }
+    
+    start_recording(&rec);
+    
+    /* Make a local copy of the chosen level, so that it can be edited
+     * without changing the actual level. */
+    currentlvl = *level;
+        
+    disp_board(&currentlvl);
+    
+    /* Clear the input buffer. Not necessary if in edit mode. */
+    if (!edit_mode)
+    {
+        clear();
+    }
+    
+    /* Get input for player without displaying to the screen. */
+    while ( (direction = getch()) )
+    {
+        check = TRUE;
+        
+        /* Remove messages that were previously displayed. */
+        currentlvl.message_available = FALSE;        
+        
+        /* Another move has occurred, so increment move counter. Using a bomb
          * is not counted as a move. */
         if(    direction == LEFT
             || direction == RIGHT
             || direction == UP
             || direction == DOWN )
         {
-            currentlvl.nmoves++;
+            currentlvl.nmoves++;
+            record_slide(&rec, direction);
+        }
+        
+        /* Check if player has quit. */
+        if (direction == QUIT)
+        {
+            if (!edit_mode)
+            {
+                update_progress(save, level_num, FALSE, 0, 0, attempts);
+            }
+            if (replays != NULL)
+            {
+                add_replay(replays, keys.key, &rec, REPLAY_QUIT);
+            }
+            stop_recording(&rec);
+            close_hint(&hint);
+            return 0;
+        }
+    
+        /* Check if player restarted. */
+        if (direction == RESTART)
+        {
+            if (replays != NULL)
+            {
+                add_replay(replays, keys.key, &rec, REPLAY_RESTART);
+            }
+            restart_recording(&rec);
+            currentlvl = *level;
+            attempts++;
+            start = GetTickCount();
+        }
+        
+        /* Show the best next move. */
+        if (direction == HINT)
+        {
+            show_hint(level, &currentlvl, &hint);
+        }
+        
+        /* Check to see if player wants to usee a bomb. */
+        if (direction == BOMB_INPUT)
+        {
+            /* Check if bomb is in the inventory. */
+            if (currentlvl.bomb == TRUE)
+            {
+                /* Player can use bomb. */
+                use_bomb(&currentlvl);
+                record_bomb(&rec);
+            }
+        }
+        
+        /* Move until wall (or goal) is reached. */
+        while (TRUE)
+        {
+            /* Insert code for using a bomb here. */
+            
+            val = move(&currentlvl, direction);
+            
+            /* Check to see if movement has ended. */
+            if (val == 0)
+            {
+                /* Player is stationary, so moving block check is true. */
+                currentlvl.moving_block_check = TRUE;
+                break;
+            }
+            
+            /* Player is moving, so they are allowed to push a moving block.
+             * Therefore set moving_block_check to true. */
+            currentlvl.moving_block_check = FALSE;
+            
+            /* Check to see if the goal has been reached */
+            if (val == GOAL)
+            {
+                disp_board(&currentlvl);
+                Sleep(1000);
+                
+                /* Edit save file. */
+                if (!edit_mode)
+                {
+                    update_progress(save, level_num, 
+                        currentlvl.nmoves <= level->moves ? ACED : BEATEN,
+                        currentlvl.nmoves, GetTickCount() - start, attempts);
+                }
+                if (replays != NULL)
+                {
+                    add_replay(replays, keys.key, &rec, REPLAY_WON);
+                }
+                stop_recording(&rec);
+                close_hint(&hint);
+                    
+                /* Display victory screen. */
+                victory_screen();
+                
+                return currentlvl.nmoves;
+            }
+            
+            /* Check to see if player has fallen in a hole. */
+            if (val == HOLE)
+            {   
+                if (replays != NULL)
+                {
+                    add_replay(replays, keys.key, &rec, REPLAY_HOLE);
+                }
+                restart_recording(&rec);
+                hole(level, &currentlvl);
+                check = FALSE;
+                attempts++;
+                start = GetTickCount();
+                
+                break;
+            }
+            
+            /* Check for moving block */
+            if (val == MOVING_BLOCK)
+            {
+                moving_block(&currentlvl, direction);
+                check = FALSE;
+                
+                /* Player is now stationary next to moved block, therefore
+                 * moving_block_check is true */
+                currentlvl.moving_block_check = TRUE;
+                
+                break;
+            }
+                        
+            /* Display moves */
+            disp_board(&currentlvl);
+            Sleep(TIME_BETWEEN_FRAMES);
+            
+            /* Do not need to display screen again. */
+            check = FALSE;
+        }
+        
+        /* Warn the player once the goal can't be reached from where they
+         * are, as there is no point playing on. */
+        if (level_lost(&currentlvl))
+        {
+            currentlvl.message_available = TRUE;
+            strcpy(currentlvl.message, LEVEL_LOST_MSG);
+            check = TRUE;
+        }
+        
+        /* Display again if no valid move. */
+        if (check)
+        {
+            disp_board(&currentlvl);
+        }
+    }
+    
+    stop_recording(&rec);
+    close_hint(&hint);
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Takes input direction and checks if the player can move. Swaps positions if
+ * a move is possible - FALSE return means no move occurred. */
+
+int
+move(level_t *lvl, char move)
+{
+    /* Check to see if the player has moved up. */
+    if (move == UP)
+    {
+        /* Check to see if there is space next to player. */
+        if (lvl->board[lvl->p_row-1][lvl->p_col] == EMPTY)
+        {
+            /* As there is empty space next to the player, move player by
+             * swapping the player and the empty space. */
+            int_swap(&lvl->board[lvl->p_row-1][lvl->p_col],
+                &lvl->board[lvl->p_row][lvl->p_col]);
+            
+            /* Adjust players position. */
+            lvl->p_row -= 1;
+            
+            return TRUE;
+        }
+        
+        /* Check to see if there is a wall next to the player. */
+        if (lvl->board[lvl->p_row-1][lvl->p_col] == WALL ||
+            lvl->board[lvl->p_row-1][lvl->p_col] == WEAK_WALL)
+        {
+            return FALSE;
+        }
+        
+        /* Check to see if the player has made it to the goal. */
+        if (lvl->board[lvl->p_row-1][lvl->p_col] == GOAL)
+        {
+            /* Move the player onto the goal. */
+            lvl->board[lvl->p_row-1][lvl->p_col] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_row -= 1;
+            
+            return GOAL;
+        }
+        
+        /* Check to see if the player has fallen into a hole. */
+        if (lvl->board[lvl->p_row-1][lvl->p_col] == HOLE)
+        {   
+            /* Move player onto hole. */
+            lvl->board[lvl->p_row-1][lvl->p_col] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_row -= 1;
+            
+            return HOLE;
+        }
+        
+        /* Check for a moving block. */
+        if (lvl->board[lvl->p_row-1][lvl->p_col] == MOVING_BLOCK)
+        {
+            /* To push a moving block, there must be space on the board,
+             * and that space must be empty. */
+            if (   lvl->p_row-2 >= 0
+                && lvl->board[lvl->p_row-2][lvl->p_col] == EMPTY
+                && lvl->moving_block_check == FALSE)
+            {
+                /* Push the block back by swapping its position. */
+                int_swap(&lvl->board[lvl->p_row-2][lvl->p_col],
+                    &lvl->board[lvl->p_row-1][lvl->p_col]);
+                
+                return MOVING_BLOCK;
+            }
+            
+            /* If there is no space to push the block, it acts like a wall. */
+            else
+            {
+                return FALSE;
+            }
+        }
+        
+        /* Check to see if the player picks up a bomb. */
+        if (lvl->board[lvl->p_row-1][lvl->p_col] == BOMB_VAL)
+        {
+            /* Player moves over the bomb */
+            lvl->board[lvl->p_row-1][lvl->p_col] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+
+            /* Adjust players position. */
+            lvl->p_row -= 1;            
+            
+            /* Can only hold maximum of one bomb. Check if bomb already in
+             * inventory, and increment otherwise. */
+            if (lvl->bomb == FALSE)
+            {
+                lvl->bomb = TRUE;
+            }
+            /* If bomb is already in inventory, extra bomb was destoryed so
+             * display message. */
+            else
+            {
+                lvl->message_available = TRUE;
+                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+            }
+            
+            return BOMB_VAL;
+        }
+    }
+    
+    /* Check to see if the player has moved down. */
+    if (move == DOWN)
+    {
+        /* Check to see if there is space next to player. */
+        if (lvl->board[lvl->p_row+1][lvl->p_col] == EMPTY)
+        {
+            /* As there is empty space next to the player, move player by
+             * swapping the player and the empty space. */
+            int_swap(&lvl->board[lvl->p_row+1][lvl->p_col],
+                &lvl->board[lvl->p_row][lvl->p_col]);
+            
+            /* Adjust players position. */
+            lvl->p_row += 1;
+            
+            return TRUE;
+        }
+
+        /* Check to see if there is a wall next to the player. */
+        if (lvl->board[lvl->p_row+1][lvl->p_col] == WALL ||
+            lvl->board[lvl->p_row+1][lvl->p_col] == WEAK_WALL)
+        {
+            return FALSE;
+        }
+        
+        /* Check to see if the player has made it to the goal. */
+        if (lvl->board[lvl->p_row+1][lvl->p_col] == GOAL)
+        {
+            /* Move the player onto the goal. */
+            lvl->board[lvl->p_row+1][lvl->p_col] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_row += 1;
+            
+            return GOAL;
+        }
+        
+        /* Check to see if the player has fallen into a hole. */
+        if (lvl->board[lvl->p_row+1][lvl->p_col] == HOLE)
+        {
+            /* Move player onto hole. */
+            lvl->board[lvl->p_row+1][lvl->p_col] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_row += 1;
+            return HOLE;
+        }
+        
+        /* Check for a moving block. */
+        if (lvl->board[lvl->p_row+1][lvl->p_col] == MOVING_BLOCK)
+        {
+            /* To push a moving block, there must be space on the board,
+             * and that space must be empty. */
+            if (   lvl->p_row+2 < lvl->rows
+                && lvl->board[lvl->p_row+2][lvl->p_col] == EMPTY
+                && lvl->moving_block_check == FALSE)
+            {
+                /* Push the block back by swapping its position. */                
+                int_swap(&lvl->board[lvl->p_row+2][lvl->p_col],
+                    &lvl->board[lvl->p_row+1][lvl->p_col]);
+                
+                return MOVING_BLOCK;
+            }
+            
+            /* If there is no space to push the block, it acts like a wall. */
+            else
+            {
+                return FALSE;
+            }
+        }
+        
+        /* Check to see if the player picks up a bomb. */
+        if (lvl->board[lvl->p_row+1][lvl->p_col] == BOMB_VAL)
+        {
+            /* Player moves over the bomb */
+            lvl->board[lvl->p_row+1][lvl->p_col] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+
+            /* Adjust players position. */
+            lvl->p_row += 1;            
+            
+            /* Can only hold maximum of one bomb. Check if bomb already in
+             * inventory, and increment otherwise. */
+            if (lvl->bomb == FALSE)
+            {
+                lvl->bomb = TRUE;
+            }
+            /* If bomb is already in inventory, extra bomb was destoryed so
+             * display message. */
+            else
+            {
+                lvl->message_available = TRUE;
+                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+            }
+            
+            return BOMB_VAL;
+        }
+    }
+    
+    /* Check to see if the player has moved left. */
+    if (move == LEFT)
+    {
+        /* Check to see if there is space next to player. */
+        if (lvl->board[lvl->p_row][lvl->p_col-1] == EMPTY)
+        {
+            /* As there is empty space next to the player, move player by
+             * swapping the player and the empty space. */
+            int_swap(&lvl->board[lvl->p_row][lvl->p_col-1],
+                &lvl->board[lvl->p_row][lvl->p_col]);
+            
+            /* Adjust players position. */
+            lvl->p_col -= 1;
+            return TRUE;
+        }
+        
+        /* Check to see if there is a wall next to the player. */
+        if (lvl->board[lvl->p_row][lvl->p_col-1] == WALL ||
+            lvl->board[lvl->p_row][lvl->p_col-1] == WEAK_WALL)
+        {
+            return FALSE;
+        }
+        
+        /* Check to see if the player has made it to the goal. */
+        if (lvl->board[lvl->p_row][lvl->p_col-1] == GOAL)
+        {
+            /* Move the player onto the goal. */
+            lvl->board[lvl->p_row][lvl->p_col-1] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_col -= 1;
+                        
+            return GOAL;
+        }
+        
+        /* Check to see if the player has fallen into a hole. */
+        if (lvl->board[lvl->p_row][lvl->p_col-1] == HOLE)
+        {
+            /* Move player onto hole. */
+            lvl->board[lvl->p_row][lvl->p_col-1] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_col -= 1;
+            
+            return HOLE;
+        }
+        
+        /* Check for a moving block. */
+        if (lvl->board[lvl->p_row][lvl->p_col-1] == MOVING_BLOCK)
+        {
+            /* To push a moving block, there must be space on the board,
+             * and that space must be empty. */
+            if (   lvl->p_col-2 >= 0 
+                && lvl->board[lvl->p_row][lvl->p_col-2] == EMPTY
+                && lvl->moving_block_check == FALSE)
+            {
+                /* Push the block back by swapping its position. */
+                int_swap(&lvl->board[lvl->p_row][lvl->p_col-2],
+                    &lvl->board[lvl->p_row][lvl->p_col-1]);
+                
+                return MOVING_BLOCK;
+            }
+            
+            /* If there is no space to push the block, it acts like a wall. */
+            else
+            {
+                return FALSE;
+            }
+        }
+        
+        /* Check to see if the player picks up a bomb. */
+        if (lvl->board[lvl->p_row][lvl->p_col-1] == BOMB_VAL)
+        {
+            /* Player moves over the bomb */
+            lvl->board[lvl->p_row][lvl->p_col-1] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_col -= 1;
+            
+            /* Can only hold maximum of one bomb. Check if bomb already in
+             * inventory, and increment otherwise. */
+            if (lvl->bomb == FALSE)
+            {
+                lvl->bomb = TRUE;
+            }
+            /* If bomb is already in inventory, extra bomb was destoryed so
+             * display message. */
+            else
+            {
+                lvl->message_available = TRUE;
+                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+            }
+            
+            return BOMB_VAL;
+        }        
+    }
+    
+    /* Check to see if the player has moved right. */
+    if (move == RIGHT)
+    {
+        /* Check to see if there is space next to player. */
+        if (lvl->board[lvl->p_row][lvl->p_col+1] == EMPTY)
+        {
+            /* As there is empty space next to the player, move player by
+             * swapping the player and the empty space. */
+            int_swap(&lvl->board[lvl->p_row][lvl->p_col+1],
+                &lvl->board[lvl->p_row][lvl->p_col]);
+            
+            /* Adjust players position. */
+            lvl->p_col += 1;
+            
+            return TRUE;
+        }
+        
+        /* Check to see if there is a wall next to the player. */
+        if (lvl->board[lvl->p_row][lvl->p_col+1] == WALL ||
+            lvl->board[lvl->p_row][lvl->p_col+1] == WEAK_WALL)
+        {
+            return FALSE;
+        }
+
+        /* Check to see if the player has made it to the goal. */
+        if (lvl->board[lvl->p_row][lvl->p_col+1] == GOAL)
+        {
+            /* Move the player onto the goal. */
+            lvl->board[lvl->p_row][lvl->p_col+1] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_col += 1;
+            
+            return GOAL;
+        }
+
+        /* Check to see if the player has fallen into a hole. */
+        if (lvl->board[lvl->p_row][lvl->p_col+1] == HOLE)
+        {
+            /* Move player onto hole. */
+            lvl->board[lvl->p_row][lvl->p_col+1] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_col += 1;
+            
+            return HOLE;
+        }
+        
+        /* Check for a moving block. */
+        if (lvl->board[lvl->p_row][lvl->p_col+1] == MOVING_BLOCK)
+        {
+            /* To push a moving block, there must be space on the board,
+             * and that space must be empty. */
+            if (lvl->p_col+2 < lvl->cols && 
+                lvl->board[lvl->p_row][lvl->p_col+2] == EMPTY
+                && lvl->moving_block_check == FALSE)
+            {   
+                /* Push the block back by swapping its position. */
+                int_swap(&lvl->board[lvl->p_row][lvl->p_col+2],
+                    &lvl->board[lvl->p_row][lvl->p_col+1]);
+                
+                return MOVING_BLOCK;
+            }
+            
+            /* If there is no space to push the block, it acts like a wall. */
+            else
+            {
+                return FALSE;
+            }
+        }
+        
+        /* Check to see if the player picks up a bomb. */
+        if (lvl->board[lvl->p_row][lvl->p_col+1] == BOMB_VAL)
+        {
+            /* Player moves over the bomb */
+            lvl->board[lvl->p_row][lvl->p_col+1] = PLAYER;
+            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            
+            /* Adjust players position. */
+            lvl->p_col += 1;
+            
+            /* Can only hold maximum of one bomb. Check if bomb already in
+             * inventory, and increment otherwise. */
+            if (lvl->bomb == FALSE)
+            {
+                lvl->bomb = TRUE;
+            }
+            /* If bomb is already in inventory, extra bomb was destoryed so
+             * display message. */
+            else
+            {
+                lvl->message_available = TRUE;
+                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+            }
+            
+            return BOMB_VAL;
+        }
+    }
+    
+    /* If no move is valid, return FALSE */
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Play special animation for player falling off the board, then reset the
+ * level */
+
+#define FALL_TIME 500 /* Milliseconds. */
+
+void
+hole(level_t *stored_lvl, level_t *lvl)
+{
+    /* Display level. This shows that the player has moved onto the hole. */    
+    disp_board(lvl);
+    Sleep(FALL_TIME);
+    
+    /* Change player icon and display the board again. */
+    lvl->board[lvl->p_row][lvl->p_col] = FALL_1_SYMBOL;
+    
+    disp_board(lvl);
+    Sleep(FALL_TIME);
+    
+    /* Change player icon again, and display the board again. */
+    lvl->board[lvl->p_row][lvl->p_col] = FALL_2_SYMBOL;
+    
+    disp_board(lvl);
+    Sleep(FALL_TIME);
+    
+    /* Replace player icon with the hole, as the player has now fallen in.
+     * Display the board again. */
+    lvl->board[lvl->p_row][lvl->p_col] = HOLE;
+    
+    disp_board(lvl);
+    Sleep(FALL_TIME);
+    
+    /* Reset the level, and display again. */
+    *lvl = *stored_lvl;
+    
+    disp_board(lvl);
+    Sleep(TIME_BETWEEN_FRAMES);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Special board movements for moving block.
+ */
+
+void
+moving_block(level_t *lvl, char direction)
+{
+    /* Display the board. This shows that the player has pushed the block back
+     * one spot. */
+    disp_board(lvl);
+    Sleep(TIME_BETWEEN_FRAMES);
+    
+    /* Move player again and display the level. The moving_block_check ensures
+     * that the block now acts as a wall, and that the player doesn't push it
+     * again. */
+    move(lvl, direction);
+    disp_board(lvl);
+    Sleep(TIME_BETWEEN_FRAMES);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Checks if the player is next to a moving block.
+ */
+
+int
+moving_block_check(level_t *lvl)
+{
+    int i, j;
+    
+    for (i = -1; i <= 1; i++)
+    {
+        for (j = -1; j <= 1; j++)
+        {
+            if (lvl->board[lvl->p_row + i][lvl->p_col + j] == MOVING_BLOCK)
+            {
+                /* Moving block found. */
+                return TRUE;
+            }
+        }
+    }
+    
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Slides the player in direction until they stop, by the same rules as
+ * play(), but without showing anything. A pushed moving block stops the
+ * player where it was. Returns GOAL or HOLE if the slide ended there,
+ * MOVING_BLOCK if a block was pushed, and FALSE otherwise. The level isn't
+ * reset after a fall.
+ */
+
+int
+simulate_slide(level_t *lvl, char direction)
+{
+    int val;
+    
+    while ((val = move(lvl, direction)) != FALSE)
+    {
+        lvl->moving_block_check = FALSE;
+        
+        if (val == GOAL || val == HOLE)
+        {
+            return val;
+        }
+        
+        /* Step into the space the block was pushed out of, as 
+         * moving_block() does. */
+        if (val == MOVING_BLOCK)
+        {
+            move(lvl, direction);
+            lvl->moving_block_check = TRUE;
+            return MOVING_BLOCK;
+        }
+    }
+    
+    lvl->moving_block_check = TRUE;
+    
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Plays a replay from the start of a level, and finds whether it reaches 
+ * the goal and in how many moves. Bombs are only used if the player has 
+ * one, as in play().
+ */
+
+void
+check_replay(level_t *start, const replay_t *replay, verdict_t *verdict)
+{
+    level_t lvl = *start;
+    uint32_t i;
+    int val;
+    
+    verdict->result = REPLAY_QUIT;
+    
+    for (i = 0; i < replay->nslides; i++)
+    {
+        /* The attempt ended at the goal or in a hole, so there can't be any
+         * more slides. */
+        if (verdict->result != REPLAY_QUIT)
+        {
+            verdict->result = REPLAY_TOO_LONG;
+            break;
+        }
+        
+        val = replay_step(&lvl, replay, i);
+        
+        if (val == GOAL)
+        {
+            verdict->result = REPLAY_WON;
+        }
+        else if (val == HOLE)
+        {
+            verdict->result = REPLAY_HOLE;
+        }
+    }
+    
+    verdict->moves = lvl.nmoves;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Plays slide n of a replay, after using a bomb first if one was used 
+ * there. A bomb used after the last slide is used with it. Returns the 
+ * result of simulate_slide().
+ */
+
+int
+replay_step(level_t *lvl, const replay_t *replay, uint32_t n)
+{
+    int val;
+    
+    if (replay_bomb(replay, n) && lvl->bomb)
+    {
+        bomb_blast(lvl);
+        lvl->bomb = FALSE;
+    }
+    
+    lvl->nmoves++;
+    val = simulate_slide(lvl, replay_move(replay, n));
+    
+    if (n + 1 == replay->nslides && replay_bomb(replay, n + 1) && lvl->bomb)
+    {
+        bomb_blast(lvl);
+        lvl->bomb = FALSE;
+    }
+    
+    return val;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Plays a replay through once, without showing it, keeping the state of
+ * the level every KEYFRAME_INTERVAL slides, and positions the view at the
+ * start. Returns FALSE if out of memory.
+ */
+
+int
+open_replay_view(replay_view_t *view, level_t *start, const replay_t *replay)
+{
+    uint32_t n;
+    int val;
+    
+    view->replay = replay;
+    view->start = *start;
+    view->lvl = *start;
+    view->pos = 0;
+    view->end = replay->nslides;
+    view->arena.base = NULL;
+    view->arena.used = 0;
+    view->arena.size = 0;
+    view->nkeyframes = 0;
+    view->keyframe = malloc((replay->nslides / KEYFRAME_INTERVAL + 1) 
+                            * sizeof(keyframe_t));
+    
+    if (view->keyframe == NULL)
+    {
+        return FALSE;
+    }
+    
+    for (n = 0; n <= view->end; n++)
+    {
+        if (n % KEYFRAME_INTERVAL == 0 && !add_keyframe(view, &view->lvl))
+        {
+            close_replay_view(view);
+            return FALSE;
+        }
+        
+        /* Slides after the attempt ended can't be shown. */
+        if (n < view->end)
+        {
+            val = replay_step(&view->lvl, replay, n);
+            
+            if (val == GOAL || val == HOLE)
+            {
+                view->end = n + 1;
+            }
+        }
+    }
+    
+    view->lvl = *start;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees the keyframes of a replay view.
+ */
+
+void
+close_replay_view(replay_view_t *view)
+{
+    arena_free(&view->arena);
+    free(view->keyframe);
+    view->keyframe = NULL;
+    view->nkeyframes = 0;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Keeps the state of a level as the next keyframe. Returns FALSE if out of
+ * memory.
+ */
+
+int
+add_keyframe(replay_view_t *view, level_t *lvl)
+{
+    uint32_t buf[(STORED_LEVEL_MAX + LVB_ALIGN) / sizeof(uint32_t)];
+    stored_level_t *rec = (stored_level_t *)buf;
+    keyframe_t *keyframe = &view->keyframe[view->nkeyframes];
+    
+    encode_level(lvl, rec);
+    
+    if ((keyframe->level = arena_alloc(&view->arena, stored_level_size(rec)))
+        == ARENA_FAILED)
+    {
+        return FALSE;
+    }
+    
+    memcpy(view->arena.base + keyframe->level, rec, 
+        sizeof(stored_level_t) + rec->size);
+    keyframe->nmoves = lvl->nmoves;
+    keyframe->bomb = lvl->bomb;
+    keyframe->moving_block_check = lvl->moving_block_check;
+    view->nkeyframes++;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Moves a replay view to the state after pos slides. The nearest keyframe
+ * at or before pos is restored, and the slides after it are played without
+ * showing them, so any position takes fewer than KEYFRAME_INTERVAL slides.
+ */
+
+void
+seek_replay(replay_view_t *view, uint32_t pos)
+{
+    keyframe_t *keyframe;
+    uint32_t n;
+    
+    if (pos > view->end)
+    {
+        pos = view->end;
+    }
+    
+    /* Stepping forward from the current position is never slower. */
+    if (pos < view->pos || pos - view->pos >= KEYFRAME_INTERVAL)
+    {
+        keyframe = &view->keyframe[pos / KEYFRAME_INTERVAL];
+        
+        decode_level((stored_level_t *)(view->arena.base + keyframe->level),
+            &view->lvl);
+        view->lvl.nmoves = keyframe->nmoves;
+        view->lvl.bomb = keyframe->bomb;
+        view->lvl.moving_block_check = keyframe->moving_block_check;
+        view->pos = pos / KEYFRAME_INTERVAL * KEYFRAME_INTERVAL;
+    }
+    
+    for (n = view->pos; n < pos; n++)
+    {
+        replay_step(&view->lvl, view->replay, n);
+    }
+    
+    view->pos = pos;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Shows a replay, one slide at a time. The player can step forwards and 
+ * backwards, go to any move, and fast forward or rewind until a key is
+ * pressed or the end is reached.
+ */
+
+void
+view_replay(replay_view_t *view)
+{
+    char input;
+    int step, junk;
+    unsigned long pos;
+    
+    disp_replay(view);
+    
+    while ((input = getch()) != QUIT)
+    {
+        if (input == STEP_FORWARD && view->pos < view->end)
+        {
+            seek_replay(view, view->pos + 1);
+        }
+        else if (input == STEP_BACK && view->pos > 0)
+        {
+            seek_replay(view, view->pos - 1);
+        }
+        else if (input == SEEK)
+        {
+            printf("     Go to move: ");
+            fflush(stdout);
+            
+            if (scanf("%lu", &pos) == 1)
+            {
+                seek_replay(view, pos > view->end ? view->end : (uint32_t)pos);
+            }
+            
+            /* Remove the rest of the line. */
+            while ((junk = getchar()) != '\n' && junk != EOF)
+                ;
+        }
+        else if (input == FAST_FORWARD || input == REWIND)
+        {
+            step = input == FAST_FORWARD ? 1 : -1;
+            
+            while (   !kbhit()
+                   && (step > 0 ? view->pos < view->end 
+                                : view->pos > 0))
+            {
+                seek_replay(view, view->pos + step);
+                disp_replay(view);
+                Sleep(VIEW_FRAME_TIME);
+            }
+            
+            /* The key that stopped it isn't a command. */
+            if (kbhit())
+            {
+                getch();
+            }
+        }
+        
+        disp_replay(view);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Shows the level at the current position of a replay view, with the move
+ * number above it and the controls below it.
+ */
+
+void
+disp_replay(replay_view_t *view)
+{
+    level_t lvl = view->lvl;
+    
+    lvl.message_available = TRUE;
+    snprintf(lvl.message, MAX_MSG, "MOVE %lu OF %lu", 
+        (unsigned long)view->pos, (unsigned long)view->end);
+    
+    disp_board(&lvl);
+    
+    printf("     %c/%c: STEP   %c: FAST FORWARD   %c: REWIND   "
+        "%c: GO TO   %c: QUIT\n", STEP_BACK, STEP_FORWARD, FAST_FORWARD, 
+        REWIND, SEEK, QUIT);
+    fflush(stdout);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Use bomb. Checks blocks surrounding player, and destorys them if possible.
+ */
+
+void
+use_bomb(level_t *lvl)
+{
+    bomb_blast(lvl);
+    
+    /* Show animation of bomb */
+    bomb_animation(*lvl);
+    
+    /* Bomb has been used, so remove it from the inventory. */
+    lvl->bomb = FALSE;
+    
+    return;
+} 
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Destroys the breakable blocks around the player, without any animation.
+ */
+
+void
+bomb_blast(level_t *lvl)
+{
+    int i, j;
+    
+    /* Search 3x3 kernel centered around Player. Remove blocks if breakable. */
+    for (i = -1; i <= 1; i++)
+    {
+        for (j = -1; j <= 1; j++)
+        {
+            /* Check if location on board is breakable. */
+            if (lvl->board[lvl->p_row+j][lvl->p_col+i] == WEAK_WALL ||
+                lvl->board[lvl->p_row+j][lvl->p_col+i] == MOVING_BLOCK)
+            {
+                /* Set location in level to empty. */
+                lvl->board[lvl->p_row+j][lvl->p_col+i] = EMPTY;
+            }
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Shows bomb animation. Local copy of level so that animation can be drawn
+ * over level without changing board values.
+ */
+ 
+void
+bomb_animation(level_t lvl)
+{
+    /* Animations are 3x3 grids centred around player. */
+    char animation[][3][3]  = {
+        { {BOMB1_00, BOMB1_10, BOMB1_20},
+          {BOMB1_01, BOMB1_11, BOMB1_21},
+          {BOMB1_02, BOMB1_12, BOMB1_22} },
+        
+        { {BOMB2_00, BOMB2_10, BOMB2_20},
+          {BOMB2_01, BOMB2_11, BOMB2_21},
+          {BOMB2_02, BOMB2_12, BOMB2_22} }
+    };
+
+    int n, i, j, n_animations = 2;
+ 
+    /* Store level copy for clearing animation. */
+    level_t lvl_copy = lvl;
+    
+    for (n = 0; n < n_animations; n++)
+    {
+        /* Clear animation. */
+        lvl = lvl_copy;
+        
+        /* Search 3x3 kernel centered around Player.  */
+        for (i = -1; i <= 1; i++)
+        {
+            for (j = -1; j <= 1; j++)
+            {
+                /* Check if explosion should only be displayed if squares are 
+                 * empty or have holes. */
+                if (lvl.board[lvl.p_row+j][lvl.p_col+i] == EMPTY ||
+                    lvl.board[lvl.p_row+j][lvl.p_col+i] == HOLE)
+                {
+                    /* Background shouldn't be replaced if animation is the
+                     * null character. */
+                    if (animation[n][1+i][1+j] != 0)
+                    {
+                        /* Replace location with relevant explosion
+                         * animation. */
+                        lvl.board[lvl.p_row+j][lvl.p_col+i] 
+                            = animation[n][1+i][1+j];
+                    }
+                }
+            }
+        }
+    
+        /* Display the board. */
+        disp_board(&lvl);
+    
+        /* Wait so that animation can be seen. */
+        Sleep(TIME_BETWEEN_FRAMES);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Title screen.
+ */
+
+void
+title_screen(void)
+{
+    int i;
+    
+    /* ASCII art from patorjk.com, font name: AMC Slider. */
+    char *title[] = {    
+"-----------------------------------------------------------------------------",
+" ",
+" ",
+" ",
+"                                               ____                         ",
+"                  ..'''' |        | |``````.  |            |`````````,      ",
+"               .''       |        | |       | |______      |'''|'''''       ",
+"            ..'          |        | |       | |            |    `.          ",
+"      ....''             |_______ | |......'  |___________ |      `.        ",
+" ",
+"                                             By Mischka Kamener, 2014",
+" ",
+" ",
+"      Adjust screen height, then press any key to play",
+    NULL};
+    
+    /* Create enough new lines so that the termainal buffer is erased. */
+    for(i = 0; i < 15; i++)
+    {
+        clear_screen();
+    }
+
+    /* Display the title. */
+    print_message_screen(title);
+
+    /* Wait for input. */
+    getch();
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Shows controls for the game.
+ */
+
+void
+how_to_play(void)
+{
+    /* Pointer to string array for how to play screen. */
+    char *how_to_play[] = {
+" ",
+" ",
+"     HOW TO PLAY:",
+" ",
+"       You are Slider (O), get the tresure (X)!",
+" ",
+"     CONTROLS:",
+" ",
+"           w",
+"       a    s   d   :   MOVE",
+" ",
+"       x:   USE BOMB",
+"       q:   QUIT     r:   RESTART LEVEL",
+"       h:   HINT",
+" ",
+" ",
+" ",
+"       Press any key to return to menu.",
+    NULL};
+    
+    /* Display the how to play screen. */
+    print_message_screen(how_to_play);
+    
+    /* Wait for input to exit screen. */
+    getch();
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Checks board value against symbol type, and prints the appropriate one.
+ */
+
+void
+disp_board_element(int board_value)
+{
+    /* Empty space. */
+    if(board_value == EMPTY)
+    {
+        putchar(EMPTY_SYMBOL);
+    } 
+            
+    /* Wall. */ 
+    else if(board_value == WALL)
+    {
+        putchar(WALL_SYMBOL);
+    }
+            
+    /* Goal. */
+    else if(board_value == GOAL)
+    {
+        putchar(GOAL_SYMBOL);
+    }
+            
+    /* Player. */
+    else if(board_value == PLAYER)
+    {
+        putchar(PLAYER_SYMBOL);
+    }
+            
+    /* Moving block. */
+    else if(board_value == MOVING_BLOCK)
+    {
+        putchar(MOVING_BLOCK_SYMBOL);
+    } 
+            
+    /* Hole. */
+    else if(board_value == HOLE)
+    {
+        putchar(HOLE_SYMBOL);
+    }
+            
+    /* Weak wall. */
+    else if(board_value == WEAK_WALL)
+    {
+        putchar(WEAK_WALL_SYMBOL);
+    }
+            
+    /* Bomb. */
+    else if(board_value == BOMB_VAL)
+    {
+        putchar(BOMB_SYMBOL);
+    }
+                      
+    /* All other values are printed using their character value. */
+    else
+    {
+        putchar(board_value);
+    }
+
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Displays the current board.
+ */
+
+void 
+disp_board(level_t *level)
+{
+    int i, j;
+
+    /* Clear the screen. */
+    clear_screen();
+    
+    /* If there is a message, display it here above the board. */
+    if (level->message_available == TRUE)
+    {
+        /* Centre board columns. Pad screen on the left depending on the board
+         * size. */
+        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        {
+            printf(" ");
+        }
+        
+        /* Print message. */
+        printf("%s\n", level->message);
+    }
+    
+    /* Loop through all screen elements */ 
+    for(i = 0; i < level->rows; i++)
+    {    
+        /* Centre board columns. Pad screen on the left depending on the board
+         * size. */
+        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        {
+            printf(" ");
+        }
+        
+        /* Print board elements. */
+        for(j = 0; j < level->cols; j++)
+        {
+            disp_board_element( level->board[i][j] );                        
+        }
+        
+        /* Display move count on first row. */
+        if (i == 0)
+        {
+            printf(" %2d", level->nmoves); 
+            
+            /* Display bomb symbol if bomb is in inventory. */
+            if (level->bomb)
+            {
+                printf("  %c", BOMB_SYMBOL);
+            }
+        }
+        
+        /* Display game instructions on right of board, only if the board is
+         * big enough. */
+        if(level->rows > 6)
+        {
+            if (   i == level->rows - 5)
+            {
+                printf("  MOVE     = %c%c%c%c", UP, LEFT, DOWN, RIGHT);
+            }
+            /* Only display bomb help when bomb is available. */
+            if (i == level->rows-4 && level->bomb)
+            {
+                printf("  USE BOMB = %c", BOMB_INPUT);
+            }
+            
+            if (i == level->rows-2)
+            {
+                printf("  RESTART  = %c", RESTART);
+            }
+        
+            if (i == level->rows-1)
+            {
+                printf("  QUIT     = %c", QUIT);
+            }
+        }
+        
+        printf("\n");
+    }
+    
+    /* Centre board rows. */
+    for(i = 0; i < ((SCREEN_MAX_R - (level->rows)) / 2); i++)
+    {
+            printf("\n");
+    }
+    
+    /* Flush output to screen. */
+    fflush( stdout );
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints victory screen - treasure chest art taken from 
+ * ascii.co.uk/art/treasure.
+ */
+
+void 
+victory_screen(void)
+{
+    /* ASCII art from patorjk.com, font name: Slant. */
+    char *success[] = {
+" ",
+" ",
+"         _____ __  ______________________________ __",
+"        / ___// / / / ____/ ____/ ____/ ___/ ___// /",
+"        \\__ \\/ / / / /   / /   / __/  \\__ \\\\__ \\/ /",
+"       ___/ / /_/ / /___/ /___/ /___ ___/ /__/ /_/",
+"      /____/\\____/\\____/\\____/_____//____/____(_)",
+" ",
+"      Press any key to continue              _",
+"                                            ( )         ()     __________",
+"                                            ||  ,-**-,  ||    /\\____;;___\\",
+"                                            \\\\*'      '*//   | /         /",
+"                                             *    $  $  *    `. ())oo() .",
+"                                             *     __   *     |\\(%()*^^()^\\",
+"                                              *,   \\/ ,*     %| |-%-------|",
+"                                                `*`*`*      % \\ | %  ))   |",
+"                                                            %  \\|%________|",
+"                                                             %%%%",
+    NULL};
+
+    print_message_screen(success);
+    
+    /* Wait for player to enter key. */
+    getch();
+    
+    return;
+}
+    
+/*---------------------------------------------------------------------------*/
+/*
+ * Clears the screen by printing new lines.
+ */
+
+void
+clear_screen(void)
+{
+    int i;
+    for(i = 0; i < SCREEN_MAX_R; i++)
+    {
+        printf("\n");
+    }
+    
+    /* Flush output to screen. */
+    fflush( stdout );
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints an array of strings, and then prints remaining new lines. Used with
+ * permission from Alistair Moffatt. */
+
+void
+print_message_screen(char *msg[])
+{
+    int i, new_lines = 0;
+    
+    /* Clear the screen */
+    clear_screen();
+    
+    /* Array of pointers has NULL as final element. This is used as a sentinel
+     * to determine when to finish printing. */
+    while(*msg)
+    {
+        printf("%s\n", *msg);
+        
+        /* Move along in the array. */
+        msg++;
+        
+        /* Count the number of lines printed. */
+        new_lines++;
+    }
+    
+    for(i = 1; i <= (SCREEN_MAX_R - new_lines); i++)
+    {
+        printf("\n");
+    }
+    
+    /* Flush output to screen. */
+    fflush( stdout );
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Prints pack select screen.
+ */
+
+void 
+print_pack_select(all_packs_t *all_packs, int first)
+{
+    int i, j, k, n, beaten = 0;
+
+    /* Clear the screen. */
+    clear_screen();
+    
+    /* TODO: Size of level pack select screen is hard coded, needs to adjust
+     * according to SCREEN_MAX_R. */
+    printf("\n\n");
+    printf("     LEVEL SELECT:\n\n\n");
+    
+    for (i = 0; i < L_PER_COL; i++)
+    {
+        /* Start each row with a blank space. */
+        printf("    ");
+        
+        for (j = 0; j < PACK_COLS; j++)
+        {
+            /* Number of the pack shown in the ith row of the jth column. */
+            n = first + i + j*L_PER_COL;
+            
+            /* Check if the number of packs means that the pack list will flow
+             * over to the jth column. */
+            if (all_packs->npacks > n)
+            {
+                /* Get level pack beaten status. */
+                beaten = all_beaten(all_packs->pack[n].save);
+                
+                if (beaten == ACED)
+                {
+                    printf(" *");
+                } 
+                else if (beaten == BEATEN)
+                {
+                    printf(" ");
+                    putchar(248);    /* Degrees symbol. */
+                }
+                else
+                {
+                    printf("  ");
+                }
+                
+                /* Print level pack number. Add one due to array notation
+                 * starting at zero. */
+                printf("%2d:  ", n + 1);
+                
+                /* Print level pack name, and get length of the name. */
+                printf("%s", all_packs->pack[n].name);
+                k = strlen(all_packs->pack[n].name);
+                
+                /* Pad the name with remaining spaces. */
+                while (k < MAX_NAME_LEN)
+                {
+                    printf(" ");
+                    k++;
+                }                
+            }
+        }
+        
+        printf("\n\n");
+    }
+
+    printf("\n       q:  Back to Menu");
+    
+    /* Show page controls if there is more than one page. */
+    if (all_packs->npacks > PACKS_PER_PAGE)
+    {
+        printf("    %c:  Next page    %c:  Previous page", 
+            NEXT_PAGE, PREV_PAGE);
+    }
+    printf("\n\n\n");
+    
+    /* Flush output to screen. */
+    fflush( stdout );
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Prints level select screen depending on the number of available levels.
+ * Levels are shown from level number first.
+ */
+
+void
+print_level_select(char *name, save_t save, int first)
+{
+    int i, j, n;    
+
+    /* Clears the screen. */
+    clear_screen();
+    
+    /* TODO: Size of level select screen is hard coded, needs to adjust
+     * according to SCREEN_MAX_R. */ 
+    printf("\n\n");
+    
+    /* Print name of level pack. */
+    printf("     %s:\n\n\n", name);
+    
+    for (i = 0; i < L_PER_COL; i++)
+    {
+        for (j = 0; j < LEVEL_COLS; j++)
+        {
+            /* Number of the level shown in the ith row of the jth column. */
+            n = first + i + j*L_PER_COL;
+            
+            /* Check if there are enough levels that one appears in the jth
+             * column of the ith row. */
+            if (save.nlevels > n)
+            {
+                /* Print level beaten status. */
+                if (progress_status(&save.data[n]) == ACED)
+                {
+                    printf("     *");
+                } 
+                else if (progress_status(&save.data[n]) == BEATEN)
+                {
+                    printf("     ");
+                    putchar(248);    /* Degrees symbol. */
+                }
+                else
+                {
+                    printf("      ");
+                }
+                
+                /* Print the level number, right alligned. Add one due to
+                 * array notation starting at zero. */
+                printf("%-2d", n + 1);
+            }
+        }
+        
+        printf("\n\n");
+    }
+    
+    printf("\n       q:  Back to Menu");
+    
+    /* Show page controls if there is more than one page. */
+    if (save.nlevels > LEVELS_PER_PAGE)
+    {
+        printf("    %c:  Next page    %c:  Previous page", 
+            NEXT_PAGE, PREV_PAGE);
+    }
+    printf("\n\n\n");
+    
+    /* Flush output to screen. */
+    fflush( stdout );
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns BEATEN if all levels in levelpack have been beaten, returns ACED
+ * if all levels have been aced. The save keeps count of beaten and aced
+ * levels, so no levels need to be checked.
+ */
+
+int all_beaten(save_t save)
+{
+    /* If any level hasn't been beaten, then levelpack hasn't been beaten
+     * yet. */
+    if (save.nbeaten < save.nlevels)
+    {
+        return FALSE;
+    }
+    
+    /* If a level hasn't been ACED, then the levelpack as a whole has only
+     * been beaten. */
+    if (save.naced < save.nlevels)
+    {
+        return BEATEN;
+    }
+    
+    return ACED;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the save file, and loads information. The whole file is read at
+ * once. Save files from older versions are converted when they are read.
+ */
+
+void
+read_save(save_t *save)
+{    
+    int compact;
+    long size;
+    char *buf;
+    FILE *fp = NULL;
+    
+    /* Records still waiting to be written must reach the file first. */
+    flush_saves(save->writer);
+
+    /* Open save file. */
+    fp = fopen(save->sav_file, "rb");
+    
+    /* Return early if save file didn't open correctly. */
+    if(fp == NULL)
+    {
+        return;
+    }
+    
+    /* Read the file in one go. One extra byte ends text save files. */
+    if (   fseek(fp, 0, SEEK_END) != 0
+        || (size = ftell(fp)) < 0
+        || fseek(fp, 0, SEEK_SET) != 0
+        || (buf = malloc(size + 1)) == NULL)
+    {
+        fclose(fp);
+        return;
+    }
+    
+    if (fread(buf, 1, size, fp) != (size_t)size)
+    {
+        free(buf);
+        fclose(fp);
+        return;
+    }
+    
+    fclose(fp);
+    buf[size] = '\0';
+    
+    if (   size >= (long)sizeof(save_header_t)
+        && memcmp(buf, SAVE_MAGIC, SAVE_MAGIC_LEN) == 0)
+    {
+        compact = read_save_records(save, buf, size);
+    }
+    else
+    {
+        read_text_save(save, buf);
+        compact = (size > 0);
+    }
+    
+    free(buf);
+    
+    if (compact)
+    {
+        compact_save(save);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Applies the records of a save file in the order they were written. A
+ * record that fails its check was cut short, so it and anything after it
+ * are dropped. Returns TRUE if the file should be compacted, because it
+ * is damaged or has grown well past one record per level.
+ */
+
+int
+read_save_records(save_t *save, char *buf, size_t size)
+{
+    int nrecords = 0;
+    size_t offset = sizeof(save_header_t);
+    save_header_t header;
+    save_record_t record;
+    
+    memcpy(&header, buf, sizeof(header));
+    
+    /* Leave save files from newer versions alone. */
+    if (header.version != SAVE_VERSION)
+    {
+        return FALSE;
+    }
+    
+    for (; offset + sizeof(record) <= size; 
+         offset += sizeof(record), nrecords++)
+    {
+        memcpy(&record, buf + offset, sizeof(record));
+        
+        if (record.check != save_check(&record))
+        {
+            break;
+        }
+        
+        apply_save_record(save, &record);
+    }
+    
+    return (   offset != size
+            || nrecords > save->nlevels + SAVE_COMPACT_SLACK);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads a save file from before save files had records. It has the
+ * completion of each level in order, one per line.
+ */
+
+void
+read_text_save(save_t *save, char *text)
+{
+    int i = 0, d = 0;
+    char *end;
+    progress_t progress;
+    
+    memset(&progress, 0, sizeof(progress));
+    
+    /* Keep loading save information until file is empty. */
+    for (d = strtol(text, &end, 10); end != text; 
+         d = strtol(text, &end, 10))
+    {
+        text = end;
+        
+        /* Only keep save information if it can be attributed to a level. */ 
+        if (i < save->nlevels)
+        {
+            if (d == ACED || d == BEATEN || d == FALSE)
+            {
+                progress.bits = pack_progress(d, 0, 0);
+                set_progress(save, i, &progress);
+                i++;
+            }
+        }
+        
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Applies one save record to the save data. Records for levels that are
+ * no longer in the pack are ignored.
+ */
+
+void
+apply_save_record(save_t *save, save_record_t *record)
+{
+    int status = progress_status(&record->progress);
+    
+    if (record->level == SAVE_CLEAR_ALL)
+    {
+        clear_progress(save);
+    }
+    else if (   record->level < (uint32_t)save->nlevels
+             && (status == ACED || status == BEATEN || status == FALSE))
+    {
+        set_progress(save, record->level, &record->progress);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Records the progress on a level in the save file, or clears every level
+ * when level is SAVE_CLEAR_ALL. The record is written in the background,
+ * so this doesn't wait for the disk.
+ */
+
+void
+write_save(save_t *save, uint32_t level)
+{
+    save_batch_t *batch;
+    
+    if (save->sav_file == NULL)
+    {
+        return;
+    }
+    
+    /* Progress is kept for the session even if it can't be saved. */
+    if ((batch = new_save_batch(save->sav_file, 1)) == NULL)
+    {
+        return;
+    }
+    
+    batch->record[0].level = level;
+    if (level != SAVE_CLEAR_ALL)
+    {
+        batch->record[0].progress = save->data[level];
+    }
+    batch->record[0].check = save_check(&batch->record[0]);
+    
+    queue_save_batch(save->writer, batch);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Replaces the save file with one record for each level that has been
+ * played. The file is written in the background.
+ */
+
+void
+compact_save(save_t *save)
+{
+    int i, n = 0;
+    save_batch_t *batch;
+    
+    for (i = 0; i < save->nlevels; i++)
+    {
+        n += (save->data[i].played != 0 || save->data[i].bits != 0);
+    }
+    
+    if ((batch = new_save_batch(save->sav_file, n)) == NULL)
+    {
+        return;
+    }
+    
+    batch->replace = TRUE;
+    
+    for (i = 0, n = 0; i < save->nlevels; i++)
+    {
+        if (save->data[i].played != 0 || save->data[i].bits != 0)
+        {
+            batch->record[n].level = i;
+            batch->record[n].progress = save->data[i];
+            batch->record[n].check = save_check(&batch->record[n]);
+            n++;
+        }
+    }
+    
+    queue_save_batch(save->writer, batch);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Clears the progress on every level of a save.
+ */
+
+void
+clear_progress(save_t *save)
+{
+    memset(save->data, 0, save->nlevels * sizeof(progress_t));
+    save->nbeaten = 0;
+    save->naced = 0;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Sets the progress on a level, and keeps the counts of beaten and aced
+ * levels up to date.
+ */
+
+void
+set_progress(save_t *save, int level, progress_t *progress)
+{
+    int old = progress_status(&save->data[level]);
+    int new = progress_status(progress);
+    
+    save->nbeaten += (new != FALSE) - (old != FALSE);
+    save->naced += (new == ACED) - (old == ACED);
+    save->data[level] = *progress;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a finished play of a level to its progress, and saves it. status
+ * is FALSE if the level wasn't won, in which case moves and msecs are
+ * ignored. Completion never goes down, and only the best moves and time
+ * are kept.
+ */
+
+void
+update_progress(save_t *save, int level, int status, int moves, 
+    uint32_t msecs, int attempts)
+{
+    progress_t progress = save->data[level];
+    int best = progress_moves(&progress);
+    
+    attempts += progress_attempts(&progress);
+    if (attempts > PROGRESS_MAX_ATTEMPTS)
+    {
+        attempts = PROGRESS_MAX_ATTEMPTS;
+    }
+    
+    if (status != FALSE)
+    {
+        if (moves > PROGRESS_MAX_MOVES)
+        {
+            moves = PROGRESS_MAX_MOVES;
+        }
+        if (best == 0 || moves < best)
+        {
+            best = moves;
+        }
+        
+        /* A time of 0 means the level hasn't been won. */
+        if (msecs == 0)
+        {
+            msecs = 1;
+        }
+        if (progress.best_time == 0 || msecs < progress.best_time)
+        {
+            progress.best_time = msecs;
+        }
+    }
+    
+    if (status < progress_status(&progress))
+    {
+        status = progress_status(&progress);
+    }
+    
+    progress.bits = pack_progress(status, best, attempts);
+    progress.played = (uint32_t)time(NULL);
+    
+    set_progress(save, level, &progress);
+    write_save(save, level);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Packs completion, best moves and attempts into the bits of a progress
+ * record.
+ */
+
+uint32_t
+pack_progress(int status, int moves, int attempts)
+{
+    return (uint32_t)status 
+         | (uint32_t)moves << 2 
+         | (uint32_t)attempts << 14;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the completion of a level: FALSE, BEATEN or ACED.
+ */
+
+int
+progress_status(progress_t *progress)
+{
+    return progress->bits & 0x3;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the fewest moves a level has been won in, or 0 if it hasn't
+ * been won.
+ */
+
+int
+progress_moves(progress_t *progress)
+{
+    return (progress->bits >> 2) & PROGRESS_MAX_MOVES;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the number of attempts at a level.
+ */
+
+int
+progress_attempts(progress_t *progress)
+{
+    return progress->bits >> 14;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Prints prompt if player actually wants to erase data, removes save data
+ * if yes */
+
+void 
+clear_save(all_packs_t *all_packs)
+{
+    int junk, i;
+    char player_choice = '\0';
+    
+    /* Pointer to string array for menu screen. */
+    char *clear_save[] = {
+" ",
+" ",
+"     CLEAR COMPLETION DATA:",
+" ",
+" ",
+"       Are you sure you want to clear all completion data? (y/n)",
+" ",
+"       Completion status cannot be recovered",
+"  ",
+    NULL};
+    
+    char *clear_success[] = {
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+"                      COMPLETION DATA SUCCESSFULLY CLEARED",
+    NULL};
+    
+    while(TRUE)
+    {
+        /* Display the screen. */    
+        print_message_screen(clear_save);
+        
+        /* Get player input. */
+        junk = scanf("%c", &player_choice);
+        junk++;
+        
+        if (player_choice == YES)
+        {
+            /* Save data can't be changed while packs are being loaded. */
+            finish_prefetch(all_packs);
+            
+            /* Clear all packs. A single record clears a save file, so
+             * packs that haven't been loaded are cleared the same way. */
+            for (i = 0; i < all_packs->npacks; i++)
+            {
+                clear_progress(&all_packs->pack[i].save);
+                
+                write_save(&all_packs->pack[i].save, SAVE_CLEAR_ALL);
+            }
+            
+            /* Clearing save is always successful, display success. */
+            print_message_screen(clear_success);
+            
+            Sleep(2000);  /* 2 seconds. */    
+            
+            return;
+        }
+        else if (player_choice == NO)
+        {
+            return;
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the check value of a save record.
+ */
+
+uint32_t
+save_check(save_record_t *record)
+{
+    return crc32(record, offsetof(save_record_t, check));
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the CRC-32 of len bytes of data.
+ */
+
+uint32_t
+crc32(const void *data, size_t len)
+{
+    return crc32_add(0, data, len);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the CRC-32 of the bytes whose CRC-32 is crc followed by len 
+ * bytes of data, so data written in parts can be checked as a whole.
+ */
+
+uint32_t
+crc32_add(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    int k;
+    
+    crc = ~crc;
+    
+    while (len--)
+    {
+        crc ^= *p++;
+        
+        for (k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    
+    return ~crc;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Starts the thread that writes save files. If it can't be started, save
+ * files are written as soon as they change instead.
+ */
+
+void
+start_save_writer(save_writer_t *writer)
+{
+    InitializeCriticalSection(&writer->lock);
+    writer->head = NULL;
+    writer->tail = NULL;
+    writer->stop = FALSE;
+    writer->thread = NULL;
+    writer->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    writer->idle = CreateEvent(NULL, TRUE, TRUE, NULL);
+    
+    if (writer->wake != NULL && writer->idle != NULL)
+    {
+        writer->thread = CreateThread(NULL, 0, save_writer, writer, 0, NULL);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes any batches that are still queued, and stops the save writer.
+ */
+
+void
+stop_save_writer(save_writer_t *writer)
+{
+    if (writer->thread != NULL)
+    {
+        EnterCriticalSection(&writer->lock);
+        writer->stop = TRUE;
+        LeaveCriticalSection(&writer->lock);
+        
+        SetEvent(writer->wake);
+        WaitForSingleObject(writer->thread, INFINITE);
+        CloseHandle(writer->thread);
+        writer->thread = NULL;
+    }
+    
+    if (writer->wake != NULL)
+    {
+        CloseHandle(writer->wake);
+    }
+    if (writer->idle != NULL)
+    {
+        CloseHandle(writer->idle);
+    }
+    
+    DeleteCriticalSection(&writer->lock);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Waits until every queued batch has been written. Only needed before a
+ * save file is read.
+ */
+
+void
+flush_saves(save_writer_t *writer)
+{
+    if (writer != NULL && writer->thread != NULL)
+    {
+        WaitForSingleObject(writer->idle, INFINITE);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Allocates a batch of n records for a save file, with a copy of the file
+ * name. Returns NULL if out of memory.
+ */
+
+save_batch_t *
+new_save_batch(char *sav_file, int nrecords)
+{
+    size_t size = sizeof(save_batch_t) + nrecords * sizeof(save_record_t);
+    save_batch_t *batch;
+    
+    if ((batch = malloc(size + strlen(sav_file) + 1)) == NULL)
+    {
+        return NULL;
+    }
+    
+    batch->next = NULL;
+    batch->sav_file = (char *)batch + size;
+    batch->replace = FALSE;
+    batch->nrecords = nrecords;
+    strcpy(batch->sav_file, sav_file);
+    
+    memset(batch->record, 0, nrecords * sizeof(save_record_t));
+    
+    return batch;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Hands a batch to the save writer, which frees it once it is written.
+ */
+
+void
+queue_save_batch(save_writer_t *writer, save_batch_t *batch)
+{
+    if (writer == NULL || writer->thread == NULL)
+    {
+        write_save_batches(batch);
+        return;
+    }
+    
+    EnterCriticalSection(&writer->lock);
+    
+    if (writer->tail == NULL)
+    {
+        writer->head = batch;
+    }
+    else
+    {
+        writer->tail->next = batch;
+    }
+    writer->tail = batch;
+    ResetEvent(writer->idle);
+    
+    LeaveCriticalSection(&writer->lock);
+    
+    SetEvent(writer->wake);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Save writer thread. Each time it wakes it takes every queued batch, so
+ * levels completed close together are written with one flush.
+ */
+
+DWORD WINAPI
+save_writer(LPVOID arg)
+{
+    save_writer_t *writer = arg;
+    save_batch_t *batch;
+    int stop = FALSE;
+    
+    while (!stop)
+    {
+        WaitForSingleObject(writer->wake, INFINITE);
+        
+        EnterCriticalSection(&writer->lock);
+        batch = writer->head;
+        writer->head = NULL;
+        writer->tail = NULL;
+        stop = writer->stop;
+        LeaveCriticalSection(&writer->lock);
+        
+        write_save_batches(batch);
+        
+        /* More batches may have been queued while writing. */
+        EnterCriticalSection(&writer->lock);
+        if (writer->head == NULL)
+        {
+            SetEvent(writer->idle);
+        }
+        else
+        {
+            SetEvent(writer->wake);
+            stop = FALSE;
+        }
+        LeaveCriticalSection(&writer->lock);
+    }
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes a list of batches in order, and frees them. Batches appended to
+ * the same file one after the other share one open and one flush. After
+ * a short write, nothing more is appended to the file until it is opened
+ * again, which cuts off the partial record.
+ */
+
+void
+write_save_batches(save_batch_t *batch)
+{
+    HANDLE file;
+    DWORD size, written;
+    save_batch_t *next;
+    
+    while (batch != NULL)
+    {
+        if (batch->replace)
+        {
+            replace_save_file(batch);
+            next = batch->next;
+            free(batch);
+            batch = next;
+            continue;
+        }
+        
+        file = open_save_file(batch->sav_file);
+        
+        while (TRUE)
+        {
+            size = batch->nrecords * sizeof(save_record_t);
+            
+            if (   file != INVALID_HANDLE_VALUE
+                && (   !WriteFile(file, batch->record, size, &written, NULL)
+                    || written != size))
+            {
+                CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+            }
+            
+            next = batch->next;
+            
+            if (   next == NULL 
+                || next->replace 
+                || strcmp(next->sav_file, batch->sav_file) != 0)
+            {
+                break;
+            }
+            
+            free(batch);
+            batch = next;
+        }
+        
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            FlushFileBuffers(file);
+            CloseHandle(file);
+        }
+        
+        free(batch);
+        batch = next;
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Replaces a save file with the records of a batch. The new file is
+ * written and flushed under a temporary name first, so a crash leaves
+ * either the old file or the new one.
+ */
+
+void
+replace_save_file(save_batch_t *batch)
+{
+    char temp[MAX_PATH];
+    int ok;
+    HANDLE file;
+    DWORD size, written;
+    save_header_t header;
+    
+    snprintf(temp, sizeof(temp), "%s%s", batch->sav_file, TEMP_FILE);
+    
+    file = CreateFile(temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    
+    memcpy(header.magic, SAVE_MAGIC, SAVE_MAGIC_LEN);
+    header.version = SAVE_VERSION;
+    size = batch->nrecords * sizeof(save_record_t);
+    
+    ok = (   WriteFile(file, &header, sizeof(header), &written, NULL)
+          && written == sizeof(header)
+          && WriteFile(file, batch->record, size, &written, NULL)
+          && written == size
+          && FlushFileBuffers(file));
+    
+    CloseHandle(file);
+    
+    if (   !ok 
+        || !MoveFileEx(temp, batch->sav_file, 
+               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFile(temp);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Opens a save file so that records can be appended, creating it if it
+ * doesn't exist. A partial record left by a short write is cut off first,
+ * so that the records after it can be read. Returns INVALID_HANDLE_VALUE 
+ * if the file can't be opened, or isn't a save file with records.
+ */
+
+HANDLE
+open_save_file(char *sav_file)
+{
+    HANDLE file;
+    DWORD read, written, size, extra;
+    save_header_t header;
+    
+    file = CreateFile(sav_file, GENERIC_READ | FILE_APPEND_DATA, 
+        FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return file;
+    }
+    
+    if (!ReadFile(file, &header, sizeof(header), &read, NULL))
+    {
+        read = 0;
+    }
+    
+    /* A new file needs its header. Text save files are converted when
+     * their pack is loaded, so they are never appended to. */
+    if (read == 0)
+    {
+        memcpy(header.magic, SAVE_MAGIC, SAVE_MAGIC_LEN);
+        header.version = SAVE_VERSION;
+        
+        if (   WriteFile(file, &header, sizeof(header), &written, NULL)
+            && written == sizeof(header))
+        {
+            return file;
+        }
+    }
+    else if (   read == sizeof(header)
+             && memcmp(header.magic, SAVE_MAGIC, SAVE_MAGIC_LEN) == 0
+             && header.version == SAVE_VERSION)
+    {
+        size = GetFileSize(file, NULL);
+        extra = (size - sizeof(header)) % sizeof(save_record_t);
+        
+        if (size != INVALID_FILE_SIZE && extra == 0)
+        {
+            return file;
+        }
+        
+        CloseHandle(file);
+        
+        /* Cut off the partial record, then open the file again. */
+        if (   size == INVALID_FILE_SIZE 
+            || !truncate_file(sav_file, size - extra))
+        {
+            return INVALID_HANDLE_VALUE;
+        }
+        
+        return open_save_file(sav_file);
+    }
+    
+    CloseHandle(file);
+    
+    return INVALID_HANDLE_VALUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Swaps two integers passed through as pointers.
+ */
+
+void
+int_swap(int *p1, int *p2)
+{
+    int temp;
+    temp = *p1;
+    *p1 = *p2;
+    *p2 = temp;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints level load error.
+ */
+
+void
+level_load_error(char *detail)
+{
+    char detail_line[MAX_ERROR_LEN];
+    
+    char *error[] = {
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+"                      ERROR IN LOADING LEVELS",
+" ",
+" ",
+    NULL,       /* Room for the detail line. */
+    NULL};
+
+    /* Show where the error was, if known. */
+    if (detail != NULL)
+    {
+        snprintf(detail_line, sizeof(detail_line), "      %s", detail);
+        error[9] = detail_line;
+    }
+
+    print_message_screen(error);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/* clears input buffer */
+
+void
+clear(void)
+{ 
+    while (getchar() != '\n');
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Runs fn for every job number from 0 to njobs - 1, spread over one worker
+ * thread per core. The calling thread works too, and returns once every job
+ * is done. Jobs are claimed in order, but may finish in any order.
+ */
+
+void
+run_parallel(job_fn_t fn, void *ctx, int njobs)
+{
+    int i, nthreads = count_cores() - 1;
+    HANDLE *threads = NULL;
+    job_queue_t queue;
+    
+    queue.fn = fn;
+    queue.ctx = ctx;
+    queue.njobs = njobs;
+    queue.next = 0;
+    
+    /* No point starting more threads than there are jobs. */
+    if (nthreads > njobs - 1)
+    {
+        nthreads = njobs - 1;
+    }
+    
+    if (nthreads > 0)
+    {
+        threads = malloc(nthreads * sizeof(HANDLE));
+    }
+    
+    /* If a thread can't be started, the others do its share. */
+    for (i = 0; threads != NULL && i < nthreads; i++)
+    {
+        threads[i] = CreateThread(NULL, 0, job_worker, &queue, 0, NULL);
+    }
+    
+    job_worker(&queue);
+    
+    for (i = 0; threads != NULL && i < nthreads; i++)
+    {
+        if (threads[i] != NULL)
+        {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+    
+    free(threads);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Worker thread for run_parallel(). Claims jobs until there are none left.
+ */
+
+DWORD WINAPI
+job_worker(LPVOID arg)
+{
+    job_queue_t *queue = arg;
+    LONG job;
+    
+    while ((job = InterlockedIncrement(&queue->next) - 1) < queue->njobs)
+    {
+        queue->fn(queue->ctx, job);
+    }
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the number of processor cores available.
+ */
+
+int
+count_cores(void)
+{
+    SYSTEM_INFO info;
+    
+    GetSystemInfo(&info);
+    
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Starts a work stealing scheduler running fn for every task number from 0
+ * to ntasks - 1, on a worker thread per core. Tasks are dealt to the 
+ * workers in turn. Returns FALSE if out of memory, or if no worker could 
+ * be started.
+ */
+
+int
+start_scheduler(scheduler_t *sched, task_fn_t fn, void *ctx, int ntasks)
+{
+    sched_worker_t *worker;
+    int i, started = 0;
+    
+    memset(sched, 0, sizeof(*sched));
+    sched->fn = fn;
+    sched->ctx = ctx;
+    sched->remaining = ntasks;
+    sched->nworkers = count_cores();
+    sched->worker = calloc(sched->nworkers, sizeof(sched_worker_t));
+    sched->stop = calloc(ntasks + 1, sizeof(LONG));
+    sched->done = CreateEvent(NULL, TRUE, ntasks == 0, NULL);
+    
+    if (sched->worker == NULL || sched->stop == NULL || sched->done == NULL)
+    {
+        free_scheduler(sched);
+        return FALSE;
+    }
+    
+    for (i = 0; i < sched->nworkers; i++)
+    {
+        worker = &sched->worker[i];
+        worker->sched = sched;
+        worker->index = i;
+        InitializeCriticalSection(&worker->deque.lock);
+        
+        if ((worker->deque.task = malloc((ntasks / sched->nworkers + 1) 
+                * sizeof(int))) == NULL)
+        {
+            free_scheduler(sched);
+            return FALSE;
+        }
+    }
+    
+    /* Each worker takes from the back, so its first tasks go last. */
+    for (i = ntasks - 1; i >= 0; i--)
+    {
+        worker = &sched->worker[i % sched->nworkers];
+        worker->deque.task[worker->deque.tail++] = i;
+    }
+    
+    /* Workers that can't be started leave their tasks to be stolen. */
+    for (i = 0; i < sched->nworkers; i++)
+    {
+        sched->worker[i].thread = CreateThread(NULL, 0, stealing_worker, 
+            &sched->worker[i], 0, NULL);
+        started += (sched->worker[i].thread != NULL);
+    }
+    
+    if (started == 0)
+    {
+        free_scheduler(sched);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Waits for every task of a scheduler to finish, cancelling any that has
+ * been running for more than timeout milliseconds, unless timeout is 0.
+ */
+
+void
+wait_scheduler(scheduler_t *sched, DWORD timeout)
+{
+    sched_worker_t *worker;
+    LONG running;
+    DWORD started;
+    int i;
+    
+    while (WaitForSingleObject(sched->done, SCHED_TICK) == WAIT_TIMEOUT)
+    {
+        for (i = 0; timeout != 0 && i < sched->nworkers; i++)
+        {
+            worker = &sched->worker[i];
+            
+            /* The start time only counts if the worker was still on the
+             * same task after reading it. */
+            running = worker->running;
+            started = worker->started;
+            
+            if (   running != 0 && running == worker->running
+                && GetTickCount() - started > timeout)
+            {
+                sched->stop[running - 1] = TRUE;
+            }
+        }
+    }
+    
+    for (i = 0; i < sched->nworkers; i++)
+    {
+        if (sched->worker[i].thread != NULL)
+        {
+            WaitForSingleObject(sched->worker[i].thread, INFINITE);
+            CloseHandle(sched->worker[i].thread);
+            sched->worker[i].thread = NULL;
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees a scheduler whose workers have finished, along with the memory of
+ * each worker.
+ */
+
+void
+free_scheduler(scheduler_t *sched)
+{
+    int i;
+    
+    for (i = 0; sched->worker != NULL && i < sched->nworkers; i++)
+    {
+        if (sched->worker[i].sched != NULL)
+        {
+            DeleteCriticalSection(&sched->worker[i].deque.lock);
+        }
+        
+        free(sched->worker[i].deque.task);
+        arena_free(&sched->worker[i].arena);
+    }
+    
+    if (sched->done != NULL)
+    {
+        CloseHandle(sched->done);
+    }
+    
+    free(sched->worker);
+    free((void *)sched->stop);
+    memset(sched, 0, sizeof(*sched));
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Worker thread for a work stealing scheduler. Runs tasks until there are
+ * none left to take or steal.
+ */
+
+DWORD WINAPI
+stealing_worker(LPVOID arg)
+{
+    sched_worker_t *worker = arg;
+    scheduler_t *sched = worker->sched;
+    int task;
+    
+    while (take_task(worker, &task))
+    {
+        worker->started = GetTickCount();
+        worker->running = task + 1;
+        sched->fn(sched->ctx, worker, task, &sched->stop[task]);
+        worker->running = 0;
+        
+        if (InterlockedDecrement(&sched->remaining) == 0)
+        {
+            SetEvent(sched->done);
+        }
+    }
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Takes the next task for a worker, from the back of its own tasks, or 
+ * else from the front of another worker's. Returns FALSE if there are none
+ * left anywhere.
+ */
+
+int
+take_task(sched_worker_t *worker, int *task)
+{
+    scheduler_t *sched = worker->sched;
+    task_deque_t *deque;
+    int i, found = FALSE;
+    
+    for (i = 0; i < sched->nworkers && !found; i++)
+    {
+        deque = &sched->worker[(worker->index + i) % sched->nworkers].deque;
+        
+        EnterCriticalSection(&deque->lock);
+        
+        if (deque->tail > deque->head)
+        {
+            *task = (i == 0) ? deque->task[--deque->tail] 
+                             : deque->task[deque->head++];
+            found = TRUE;
+        }
+        
+        LeaveCriticalSection(&deque->lock);
+    }
+    
+    return found;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns a newly allocated copy of a string, or NULL if out of memory.
+ */
+
+char *
+copy_string(char *src)
+{
+    char *dst = malloc(strlen(src) + 1);
+    
+    if (dst != NULL)
+    {
+        strcpy(dst, src);
+    }
+    
+    return dst;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Allocates n bytes from an arena, growing it if needed. Returns the offset
+ * of the allocation, or ARENA_FAILED if out of memory.
+ */
+
+size_t
+arena_alloc(arena_t *arena, size_t n)
+{
+    size_t offset, size;
+    uint8_t *base;
+    
+    /* Keep every allocation aligned. */
+    offset = (arena->used + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    
+    if (offset + n > arena->size)
+    {
+        size = arena->size ? arena->size : ARENA_MIN_SIZE;
+        while (size < offset + n)
+        {
+            size *= 2;
+        }
+        
+        if ((base = realloc(arena->base, size)) == NULL)
+        {
+            return ARENA_FAILED;
+        }
+        
+        arena->base = base;
+        arena->size = size;
+    }
+    
+    arena->used = offset + n;
+    
+    return offset;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Shrinks an arena to the space that has been used. Returns FALSE if out of
+ * memory.
+ */
+
+int
+arena_trim(arena_t *arena)
+{
+    uint8_t *base;
+    
+    if (arena->used == 0 || arena->used == arena->size)
+    {
+        return TRUE;
+    }
+    
+    if ((base = realloc(arena->base, arena->used)) == NULL)
+    {
+        return FALSE;
+    }
+    
+    arena->base = base;
+    arena->size = arena->used;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees the memory of an arena, leaving it empty.
+ */
+
+void
+arena_free(arena_t *arena)
+{
+    free(arena->base);
+    
+    arena->base = NULL;
+    arena->used = 0;
+    arena->size = 0;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level editor interface. User can navigate around level, place board
+ * elements, test level, and then save the level.
+ */
+ 
+void
+level_editor(void)
+{
+    char input;
+    int number_input;
+    int has_saved = TRUE;       /* True when no blocks have been placed since
+                                 * last save, or when level is empty. */
+    int store_open;             /* True if the store has been opened. */
+    save_t dummy_save;
+    level_store_t store;
+    
+    /* Create empty level, with maximum size. */
+    level_t lvl = create_empty_lvl();
+    level_t cropped_lvl;
+    
+        /* Set cursor inside boundary. */
+    coord_t cursor = {lvl.rows / 2, lvl.cols / 2}, goal = {0, 0};
+    
+    /* Open the store that levels are saved to. It is compacted while the
+     * player edits if it has too much unused space. */
+    if ((store_open = open_store(&store)))
+    {
+        start_store_compaction(&store);
+    }
+    
+    /* Display screen. */
+    disp_editor(&lvl, cursor);
+        
+    /* Clear the input buffer. */
+    clear();
+    
+    /* Get input from user. */
+    while( (input = getch()) )
+    {
+        /* Get the int value from input (if applicable). */
+        number_input = input - '0';
+        
+        /* Check for quit. */
+        if (input == QUIT)
+        {
+            /* If the level has not beed changed since last save, do not need
+             * to ask if user wants to quit. Otherwise check if user really
+             * wants to quit, as progress will be lost. */
+            if (   has_saved
+                || editor_decision_screen(QUIT_EDITOR_CODE) == YES)
+            {
+                /* Exit the editor. */
+                if (store_open)
+                {
+                    close_store(&store);
+                }
+                return;
+            }
+        }
+        
+        /* Move the cursor if a direction is input  */
+        move_cursor(&cursor, input);
+              
+        /* Place a board elements. */
+        if (number_input == PLAYER)
+        {
+            has_saved = FALSE;
+            
+            /* Remove old player icon if aplicable. */
+            if (lvl.board[lvl.p_row][lvl.p_col] == PLAYER)
+            {
+                lvl.board[lvl.p_row][lvl.p_col] = EMPTY;
+            }
+            
+            /* Set new player icon. */
+            lvl.p_row = cursor.row;
+            lvl.p_col = cursor.col;
+            lvl.board[lvl.p_row][lvl.p_col] = PLAYER;            
+        }
+        
+        if (number_input == GOAL)
+        {
+            has_saved = FALSE;
+            
+            /* Remove old goal icon if aplicable. */
+            if (lvl.board[goal.row][goal.col] == GOAL)
+            {
+                lvl.board[goal.row][goal.col] = EMPTY;
+            }
+            
+            /* Set new goal icon. */
+            goal.row = cursor.row;
+            goal.col = cursor.col;
+            lvl.board[goal.row][goal.col] = GOAL;  
+        }
+        
+        /* All other inputs. */
+        if (number_input == EMPTY ||
+            number_input == WALL ||
+            number_input == WEAK_WALL ||
+            number_input == BOMB_VAL ||
+            number_input == MOVING_BLOCK ||
+            number_input == HOLE)
+        {
+            has_saved = FALSE;
+            
+            lvl.board[cursor.row][cursor.col] = number_input;
+        }
+            
+        /* Test the level. */
+        if (input == PLAY)
+        {
+            if (is_player_and_goal_valid(&lvl, goal))
+            {
+                cropped_lvl = crop_lvl(&lvl);
+                play(&cropped_lvl, &dummy_save, 0, TRUE, NULL);
+            }
+            else
+            {
+                /* Level was incomplete, display error. */
+                editor_message_screen(INCOMPLETE_CODE);
+            }
+        }
+        
+        /* Save the level. */
+        if (input == SAVE_LEVEL)
+        {
+            if (is_player_and_goal_valid(&lvl, goal))
+            {
+                /* Player first needs to beat the level, this sets moves. */
+                cropped_lvl = crop_lvl(&lvl);
+                cropped_lvl.moves = play(&cropped_lvl, &dummy_save, 0, TRUE, 
+                    NULL);
+            
+                if (cropped_lvl.moves > 0) 
+                {
+                    if (!store_open)
+                    {
+                        store_open = open_store(&store);
+                    }
+                    if (store_open && write_level(&store, cropped_lvl))
+                    {
+                        editor_message_screen(SUCCESSFUL_CODE); 
+                        
+                        has_saved = TRUE;
+                    }
+                    else
+                    {
+                        /* The level is still in the editor, so it can
+                         * be saved again. */
+                        editor_message_screen(WRITE_FAILED_CODE);
+                    }
+                }
+                else
+                {
+                    /* Print message saying that levels needs to be
+                     * beaten to be saved. */
+                    editor_message_screen(UNBEATEN_CODE);
+                }
+            }
+            else
+            {
+                /* Level was incomplete, display error. */
+                editor_message_screen(INCOMPLETE_CODE);
+            }
+        }
+        
+        /* Check if the user wants to clear the current level. */
+        if (input == CLEAR_EDITOR)
+        {
+            /* If the level has not beed changed since last save, do not need
+             * to ask if user wants to clear it. */
+            if (has_saved)
+            {
+                lvl = create_empty_lvl();
+                has_saved = TRUE;
+            }
+            /* Check if user really wants to quit, as progress will be lost. */
+            else if (editor_decision_screen(CLEAR_EDITOR_CODE) == YES)
+            {
+                lvl = create_empty_lvl();
+                has_saved = TRUE;
+            }
+        }
+        
+        disp_editor(&lvl, cursor);
+        Sleep(TIME_BETWEEN_FRAMES);
+    }
+    
+    if (store_open)
+    {
+        close_store(&store);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Creates an empty level ready to be edited.
+ */
+
+level_t
+create_empty_lvl(void)
+{
+    int i, j;
+    
+    level_t lvl;
+    
+    /* Loop through all the board elements */
+    for (i = 0; i < BOARD_MAX_R; i++)
+    {
+        for (j = 0; j < BOARD_MAX_C; j++)
+        {
+            /* Boarder values set as holes for default. */
+            if (i == 0 ||
+                i == BOARD_MAX_R - 1 ||
+                j == 0 ||
+                j == BOARD_MAX_C - 1)
+            {
+                lvl.board[i][j] = HOLE;
+            }
+            /* All inner board values set to empty by default. */
+            else
+            {
+                lvl.board[i][j] = EMPTY;
+            }
+        }
+    }
+    
+    /* Set board values. */
+    lvl.rows = BOARD_MAX_R;
+    lvl.cols = BOARD_MAX_C;
+    lvl.p_row = 0;
+    lvl.p_col = 0;
+    lvl.moves = 0;
+    lvl.nmoves = 0;
+    lvl.moving_block_check = FALSE;
+    lvl.bomb = FALSE;
+    lvl.message_available = FALSE;
+    
+    return lvl;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Moves the cursor in the level editor. The cursor cannot move onto the
+ * boundary of the level.
+ */
+ 
+void
+move_cursor(coord_t *cursor, char direction)
+{
+    /* Need space above to move cursor UP. */
+    if (direction == UP &&
+        cursor->row > 1)
+    {
+        /* Subtract a row. */
+        cursor->row--;
+        return;
+    }
+    
+    /* Need space below to move cursor DOWN. */
+    if (direction == DOWN &&
+        cursor->row < BOARD_MAX_R - 2)
+    {
+        /* Add a row. */
+        cursor->row++;
+        return;
+    }
+    
+    /* Need space left to move cursor LEFT. */
+    if (direction == LEFT &&
+        cursor->col > 1)
+    {
+        /* Subtract a column. */
+        cursor->col--;
+        return;
+    }
+    
+    /* Need space right to move cursor RIGHT. */
+    if (direction == RIGHT &&
+        cursor->col < BOARD_MAX_C - 2)
+    {
+        /* Add a column. */
+        cursor->col++;
+        return;
+    }
+        
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Displays the level editor interface.
+ */
+ 
+void
+disp_editor(level_t *level, coord_t cursor)
+{
+    int i, j;
+
+    /* Clear the screen. */
+    clear_screen();
+    
+    /* If there is a message, display it here above the board. */
+    if (level->message_available == TRUE)
+    {
+        /* Centre board columns. Pad screen on the left depending on the board
+         * size. */
+        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        {
+            printf(" ");
+        }
+        
+        /* Print message. */
+        printf("%s\n", level->message);
+    }
+    
+    /* Loop through all screen elements */ 
+    for(i = 0; i < level->rows; i++)
+    {    
+        /* Centre board columns. Pad screen on the left depending on the board
+         * size. */
+        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        {
+            printf(" ");
+        }
+        
+        /* Print board elements. */
+        for(j = 0; j < level->cols; j++)
+        {
+            /* Display cursor over the board. */
+            if( i == cursor.row && j == cursor.col )
+            {
+                putchar(CURSOR_SYMBOL);
+            }
+            else
+            {
+                disp_board_element( level->board[i][j] );
+            }
+        }
+        
+        /* Display editor instructions on right of board, only if the board is
+         * big enough. */
+        if(level->rows >= 15)
+        {
+            if (i == 1)
+            {
+                printf("  %c = %d", EMPTY_SYMBOL, EMPTY);
+                printf("    %c = %d", WALL_SYMBOL, WALL);
+            }
+            
+            if (i == 3)
+            {
+                printf("  %c = %d", GOAL_SYMBOL, GOAL);
+                printf("    %c = %d", PLAYER_SYMBOL, PLAYER);
+            }
+            
+            if (i == 5)
+            {
+                printf("  %c = %d", WEAK_WALL_SYMBOL, WEAK_WALL);
+                printf("    %c = %d", BOMB_SYMBOL, BOMB_VAL);
+            }
+            
+            if (i == 7)
+            {
+                printf("  %c = %d", MOVING_BLOCK_SYMBOL, MOVING_BLOCK);
+                printf("    %c = %d", HOLE_SYMBOL, HOLE);
+            }
+            
+            if (i == level->rows - 7)
+            {
+                printf("  MOVE     = %c%c%c%c", UP, LEFT, DOWN, RIGHT);
+            }
+        
+            if (i == level->rows-5)
+            {
+                printf("  PLAY     = %c", PLAY);
+            }
+            
+            if (i == level->rows-4)
+            {
+                printf("  SAVE     = %c", SAVE_LEVEL);
+            }
+
+            if (i == level->rows-2)
+            {
+                printf("  CLEAR    = %c", CLEAR_EDITOR);
+            }
+            
+            if (i == level->rows-1)
+            {
+                printf("  QUIT     = %c", QUIT);
+            }
+        }
+        
+        printf("\n");
+    }
+    
+    /* Centre board rows. */
+    for(i = 0; i < ((SCREEN_MAX_R - (level->rows)) / 2); i++)
+    {
+            printf("\n");
+    }
+    
+    /* Flush output to screen. */
+    fflush( stdout );
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Crop level. This crops the maximum sized level from the level editor, to the
+ * minimum size needed to play the level, with padding around the sides if
+ * possible.
+ */
+level_t
+crop_lvl(level_t *src_lvl)
+{
+    int i, j;
+    int min_row, min_col, max_row, max_col;
+    int element_rows, element_cols;
+    int padding_rows = PADDING_ROWS, padding_cols = PADDING_COLS;
+    level_t dst_lvl;
+    
+    /* If there are no board elements, it means there was an empty board.
+     * Just return the input level. */
+    if (!level_bounds(src_lvl, &min_row, &min_col, &max_row, &max_col))
+    {
+        return *src_lvl;
+    }
+    
+    element_rows = (max_row + 1) - min_row;
+    element_cols = (max_col + 1) - min_col;
+    
+    /* Determine padding size. */
+    
+    /* Padding is whitespace between border and first element, but BOARD_MAX_R
+     * includes the border, so subtract 2. */
+    if ( (element_rows + 2*PADDING_ROWS) > BOARD_MAX_R - 2 )
+    {
+        /* Calculate the available white space, and divide by 2. Use integer
+         * division to round down. */
+        padding_rows = ((BOARD_MAX_R - 2) - element_rows) / 2;
+    }
+    if ( (element_cols + 2*PADDING_COLS) > BOARD_MAX_C - 2 )
+    {
+        /* Calculate the available white space, and divide by 2. Use integer
+         * division to round down. */
+        padding_cols = ((BOARD_MAX_C - 2) - element_cols) / 2;
+    }
+        
+    /* Create a new board with a border, using the dimensions found. */
+    dst_lvl.rows = element_rows + 2*padding_rows + 2;
+    dst_lvl.cols = element_cols + 2*padding_cols + 2;   
+    
+    for (i = 0; i < dst_lvl.rows; i++)
+    {
+        for (j = 0; j < dst_lvl.cols; j++)
+        {
+            /* Boarder values set as holes for default. */
+            if (i == 0 ||
+                i == dst_lvl.rows - 1 ||
+                j == 0 ||
+                j == dst_lvl.cols - 1)
+            {
+                dst_lvl.board[i][j] = HOLE;
+            }
+            /* All inner board values set to empty by default. */
+            else
+            {
+                dst_lvl.board[i][j] = EMPTY;
+            }
+        }
+    }
+        
+    /* Copy board values into the centre of the new board. */
+    for (i = 0; i < element_rows; i++)
+    {
+        for (j = 0; j < element_cols; j++)
+        {
+            /* Copy in board values from input board. */
+            dst_lvl.board[i + padding_rows + 1][j + padding_cols + 1] =
+                src_lvl->board[i + min_row][j + min_col];
+        }
+    }
+    
+    /* Get the additional inital level values for the board. */
+    dst_lvl.p_row = src_lvl->p_row - min_row + padding_rows + 1;
+    dst_lvl.p_col = src_lvl->p_col - min_col + padding_cols + 1;
+    
+    dst_lvl.moves = src_lvl->moves;
+    dst_lvl.nmoves = 0;
+    dst_lvl.moving_block_check = moving_block_check(&dst_lvl);
+    dst_lvl.bomb = 0;
+    dst_lvl.message_available = 0;
+    
+    return dst_lvl;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the minimum and maximum row and column where a board element
+ * exists, ignoring the boundary of the level. Returns FALSE if the inside
+ * of the board is empty.
+ */
+
+int
+level_bounds(level_t *lvl, int *min_row, int *min_col, int *max_row, 
+    int *max_col)
+{
+    int i, j;
+    
+    *min_row = lvl->rows - 2;
+    *min_col = lvl->cols - 2;
+    *max_row = 1;
+    *max_col = 1;
+    
+    /* Ignore the boundary of the level, so add and subtract 1 to the initial
+     * and final values. */
+    for (i = 1; i < lvl->rows - 1; i++)
+    {
+        for (j = 1; j < lvl->cols - 1; j++)
+        {
+            /* Check if there is a board element. */
+            if (lvl->board[i][j] != EMPTY)
+            {
+                /* Check if a new minimum row/col has been found. */
+                if (i < *min_row)
+                {
+                    *min_row = i;
+                }
+                if (j < *min_col)
+                {
+                    *min_col = j;
+                }
+                /* Check if a new maximum row/col has been found. */
+                if (i > *max_row)
+                {
+                    *max_row = i;
+                }
+                if (j > *max_col)
+                {
+                    *max_col = j;
+                }
+            }
+        }
+    }
+    
+    /* If either the rows or the cols are negative, the board was empty. */
+    return *max_row >= *min_row && *max_col >= *min_col;
+}
+
+/*---------------------------------------------------------------------------*/
+/* 
+ * Checks if level has a player and a goal. Does not check if the level can
+ * be beaten.
+ */
+
+int
+is_player_and_goal_valid(level_t *lvl, coord_t goal)
+{
+    if (lvl->board[lvl->p_row][lvl->p_col] == PLAYER &&
+        lvl->board[goal.row][goal.col] == GOAL)
+    {
+        return TRUE;
+    }
+    
+    return FALSE;    
+}
+ 
+/*---------------------------------------------------------------------------*/
+/*
+ * Appends level to end of level editor pack. Returns FALSE if the store 
+ * couldn't be written.
+ */
+ 
+int
+write_level(level_store_t *store, level_t lvl)
+{
+    /* Wait for the store if it is being compacted. */
+    finish_store_compaction(store);
+    
+    return store_add_level(store, &lvl);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Opens the custom level store for changes, creating it if it doesn't
+ * exist yet. Returns FALSE if the store can't be opened or created.
+ */
+
+int
+open_store(level_store_t *store)
+{
+    uint32_t i, nlevels;
+    const stored_level_t *rec;
+    lvb_t lvb;
+    
+    store->index = NULL;
+    store->nlevels = 0;
+    store->capacity = 0;
+    store->compact = NULL;
+    
+    if (!lvs_open(&lvb, CUSTOM_LEVEL_FILE STORE_FILE))
+    {
+        if (GetFileAttributes(CUSTOM_LEVEL_FILE STORE_FILE) 
+                != INVALID_FILE_ATTRIBUTES)
+        {
+            /* The store exists but is damaged, leave it alone. */
+            return FALSE;
+        }
+        
+        return create_store(store);
+    }
+    
+    store->generation = ((const lvs_header_t *)lvb.base)->generation;
+    store->size = lvb.size;
+    store->used = 0;
+    
+    /* Copy the index, counting the space used by indexed levels. */
+    nlevels = lvb.nlevels;
+    store->index = lvb.own_index;
+    store->capacity = nlevels;
+    lvb.own_index = NULL;
+    
+    for (i = 0; i < nlevels; i++)
+    {
+        if ((rec = lvb_level(&lvb, i)) == NULL)
+        {
+            break;
+        }
+        store->used += stored_level_size(rec);
+    }
+    
+    lvb_close(&lvb);
+    
+    /* A damaged level ends the store. */
+    store->nlevels = i;
+    
+    /* Make sure the index file matches the store. */
+    if (!write_store_index(store, CUSTOM_LEVEL_FILE STORE_INDEX_FILE, 0))
+    {
+        close_store(store);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Waits for any compaction to finish, and frees the store.
+ */
+
+void
+close_store(level_store_t *store)
+{
+    finish_store_compaction(store);
+    
+    free(store->index);
+    store->index = NULL;
+    store->nlevels = 0;
+    store->capacity = 0;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Creates an empty custom level store. Levels from an old custom text
+ * levelpack are copied into it, after which the text file is renamed so
+ * that it no longer shows up as a levelpack. Returns FALSE if the store
+ * can't be created, or the text file can't be renamed, in which case the
+ * store is removed so that the levels are imported again next time.
+ */
+
+int
+create_store(level_store_t *store)
+{
+    char name[MAX_NAME_LEN];
+    FILE *fp;
+    lvs_header_t header;
+    level_reader_t reader;
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LVS_MAGIC, LVB_MAGIC_LEN);
+    header.version = LVS_VERSION;
+    header.generation = 1;
+    strcpy(header.name, CUSTOM_LEVEL_NAME);
+    
+    if ((fp = fopen(CUSTOM_LEVEL_FILE STORE_FILE, "wb")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+    {
+        fclose(fp);
+        return FALSE;
+    }
+    
+    fclose(fp);
+    
+    store->generation = header.generation;
+    store->size = sizeof(header);
+    store->used = 0;
+    
+    /* Import any old custom levels. Levels before an error are kept, and
+     * the text file is kept under its new name. */
+    if ((fp = fopen(CUSTOM_LEVEL_FILE LEVEL_FILE, "r")) != NULL)
+    {
+        init_reader(&reader, fp, CUSTOM_LEVEL_FILE LEVEL_FILE);
+        stream_levels(&reader, name, MAX_NAME_LEN, import_level, store);
+        fclose(fp);
+        free(reader.error);
+        
+        if (!MoveFileEx(CUSTOM_LEVEL_FILE LEVEL_FILE, 
+                CUSTOM_LEVEL_FILE LEVEL_FILE OLD_FILE, 
+                MOVEFILE_REPLACE_EXISTING))
+        {
+            DeleteFile(CUSTOM_LEVEL_FILE STORE_FILE);
+            return FALSE;
+        }
+    }
+    
+    return write_store_index(store, CUSTOM_LEVEL_FILE STORE_INDEX_FILE, 0);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level function that appends each level read to the store in ctx. The
+ * index is written once all levels are read.
+ */
+
+int
+import_level(void *ctx, level_reader_t *reader, level_t *lvl)
+{
+    level_store_t *store = ctx;
+    uint32_t offset, *new_index;
+    
+    if (store->nlevels == store->capacity)
+    {
+        store->capacity = store->capacity ? 2 * store->capacity 
+                                          : MIN_INDEX_LEN;
+        new_index = realloc(store->index, 
+            store->capacity * sizeof(uint32_t));
+        
+        if (new_index == NULL)
+        {
+            reader_error(reader, "out of memory", reader->level_line);
+            return FALSE;
+        }
+        store->index = new_index;
+    }
+    
+    if (!store_append(store, lvl, &offset))
+    {
+        reader_error(reader, "cannot write store", reader->level_line);
+        return FALSE;
+    }
+    
+    store->index[store->nlevels++] = offset;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the index of the custom level store. Returns the level offsets,
+ * or NULL if the index is missing, damaged, or from another generation of
+ * the store.
+ */
+
+uint32_t *
+read_store_index(char *file_name, uint32_t generation, uint32_t *nlevels)
+{
+    uint32_t *index;
+    FILE *fp;
+    lvi_header_t header;
+    
+    if ((fp = fopen(file_name, "rb")) == NULL)
+    {
+        return NULL;
+    }
+    
+    if (   fread(&header, sizeof(header), 1, fp) != 1
+        || memcmp(header.magic, LVI_MAGIC, LVB_MAGIC_LEN) != 0
+        || header.version != LVS_VERSION
+        || header.generation != generation
+        || header.nlevels > UINT32_MAX / sizeof(uint32_t) - 1)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    
+    /* Allocate at least one offset, so that an empty index isn't NULL. */
+    index = malloc((header.nlevels + 1) * sizeof(uint32_t));
+    
+    if (   index != NULL 
+        && fread(index, sizeof(uint32_t), header.nlevels, fp) 
+               != header.nlevels)
+    {
+        free(index);
+        index = NULL;
+    }
+    
+    fclose(fp);
+    
+    *nlevels = header.nlevels;
+    
+    return index;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Rebuilds the index of a mapped store by walking its records from the
+ * start, up to the end of the file or the first damaged record. Returns
+ * NULL if out of memory.
+ */
+
+uint32_t *
+scan_store(lvb_t *lvb, uint32_t *nlevels)
+{
+    int capacity = MIN_INDEX_LEN;
+    uint32_t offset = lvb->start, n = 0, *index, *new_index;
+    const stored_level_t *rec;
+    
+    if ((index = malloc(capacity * sizeof(uint32_t))) == NULL)
+    {
+        return NULL;
+    }
+    
+    while (   offset <= lvb->size - sizeof(stored_level_t)
+           && offset % LVB_ALIGN == 0)
+    {
+        rec = (const stored_level_t *)(lvb->base + offset);
+        
+        if (rec->size > lvb->size - offset - sizeof(stored_level_t))
+        {
+            break;
+        }
+        
+        if (n == (uint32_t)capacity)
+        {
+            capacity *= 2;
+            
+            if ((new_index = realloc(index, capacity * sizeof(uint32_t))) 
+                    == NULL)
+            {
+                free(index);
+                return NULL;
+            }
+            index = new_index;
+        }
+        
+        index[n++] = offset;
+        offset += stored_level_size(rec);
+    }
+    
+    *nlevels = n;
+    
+    return index;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Encodes a level and appends it to the end of the store file in a single
+ * write. Sets offset to where the level starts. Returns FALSE if the store
+ * can't be written.
+ */
+
+int
+store_append(level_store_t *store, level_t *lvl, uint32_t *offset)
+{
+    uint32_t buf[(STORED_LEVEL_MAX + LVB_ALIGN) / sizeof(uint32_t)];
+    stored_level_t *rec = (stored_level_t *)buf;
+    size_t size;
+    FILE *fp;
+    
+    memset(buf, 0, sizeof(buf));
+    encode_level(lvl, rec);
+    size = stored_level_size(rec);
+    
+    if ((fp = fopen(CUSTOM_LEVEL_FILE STORE_FILE, "ab")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    if (fwrite(rec, 1, size, fp) != size || fflush(fp) != 0)
+    {
+        fclose(fp);
+        return FALSE;
+    }
+    
+    fclose(fp);
+    
+    *offset = store->size;
+    store->size += size;
+    store->used += size;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a level to the end of the store. Only the new index entry and the
+ * index header are written. Returns FALSE if the store can't be written.
+ */
+
+int
+store_add_level(level_store_t *store, level_t *lvl)
+{
+    int capacity;
+    uint32_t offset, *new_index;
+    
+    if (store->nlevels == store->capacity)
+    {
+        capacity = store->capacity ? 2 * store->capacity : MIN_INDEX_LEN;
+        new_index = realloc(store->index, capacity * sizeof(uint32_t));
+        
+        if (new_index == NULL)
+        {
+            return FALSE;
+        }
+        store->index = new_index;
+        store->capacity = capacity;
+    }
+    
+    if (!store_append(store, lvl, &offset))
+    {
+        return FALSE;
+    }
+    
+    store->index[store->nlevels++] = offset;
+    
+    return write_store_index(store, CUSTOM_LEVEL_FILE STORE_INDEX_FILE,
+        store->nlevels - 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Replaces level n of the store. The new level is appended, and level n
+ * of the index is pointed at it, so the old level is never overwritten.
+ * Returns FALSE if the store can't be written.
+ */
+
+int
+store_replace_level(level_store_t *store, int n, level_t *lvl)
+{
+    uint32_t offset, old_size;
+    lvb_t lvb;
+    const stored_level_t *rec;
+    
+    /* Find the size of the level being replaced. */
+    if (!lvs_open(&lvb, CUSTOM_LEVEL_FILE STORE_FILE))
+    {
+        return FALSE;
+    }
+    
+    lvb.index = store->index;
+    lvb.nlevels = store->nlevels;
+    rec = lvb_level(&lvb, n);
+    old_size = (rec != NULL) ? stored_level_size(rec) : 0;
+    lvb_close(&lvb);
+    
+    if (!store_append(store, lvl, &offset))
+    {
+        return FALSE;
+    }
+    
+    store->index[n] = offset;
+    store->used -= old_size;
+    
+    return write_store_index(store, CUSTOM_LEVEL_FILE STORE_INDEX_FILE, n);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Deletes level n of the store. The level stays in the store file until
+ * the store is compacted, only the index is changed. Returns FALSE if the
+ * index can't be written.
+ */
+
+int
+store_delete_level(level_store_t *store, int n)
+{
+    lvb_t lvb;
+    const stored_level_t *rec;
+    
+    if (lvs_open(&lvb, CUSTOM_LEVEL_FILE STORE_FILE))
+    {
+        lvb.index = store->index;
+        lvb.nlevels = store->nlevels;
+        
+        if ((rec = lvb_level(&lvb, n)) != NULL)
+        {
+            store->used -= stored_level_size(rec);
+        }
+        lvb_close(&lvb);
+    }
+    
+    memmove(&store->index[n], &store->index[n + 1], 
+        (store->nlevels - n - 1) * sizeof(uint32_t));
+    store->nlevels--;
+    
+    return write_store_index(store, CUSTOM_LEVEL_FILE STORE_INDEX_FILE, n);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the index of the store from level first onwards, followed
+ * by the index header, so the new level count only takes effect once the
+ * entries are written. Entries past the end of the index are left as they
+ * are. The whole file is written if it doesn't exist. Returns FALSE if the
+ * index can't be written.
+ */
+
+int
+write_store_index(level_store_t *store, char *file_name, int first)
+{
+    int ok;
+    FILE *fp = NULL;
+    lvi_header_t header;
+    
+    if (first > 0)
+    {
+        fp = fopen(file_name, "r+b");
+    }
+    
+    if (fp == NULL)
+    {
+        first = 0;
+        
+        if ((fp = fopen(file_name, "wb")) == NULL)
+        {
+            return FALSE;
+        }
+    }
+    
+    memcpy(header.magic, LVI_MAGIC, LVB_MAGIC_LEN);
+    header.version = LVS_VERSION;
+    header.generation = store->generation;
+    header.nlevels = store->nlevels;
+    
+    ok = (   fseek(fp, sizeof(header) + first * sizeof(uint32_t), SEEK_SET) 
+                 == 0
+          && fwrite(&store->index[first], sizeof(uint32_t), 
+                 store->nlevels - first, fp) 
+             == (size_t)(store->nlevels - first)
+          && fflush(fp) == 0
+          && fseek(fp, 0, SEEK_SET) == 0
+          && fwrite(&header, sizeof(header), 1, fp) == 1);
+    
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if the store has more unused space than used space, and
+ * enough of it to be worth compacting.
+ */
+
+int
+store_needs_compaction(level_store_t *store)
+{
+    uint32_t unused = store->size - sizeof(lvs_header_t) - store->used;
+    
+    return unused > STORE_COMPACT_MIN && unused > store->used;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Rewrites the store with only the levels in the index, in order. The new
+ * store and index are written under temporary names, then the store and
+ * then the index are renamed over the old ones. The new store has a new
+ * generation, so if a crash leaves it with the old index, the store is
+ * scanned instead, which finds the same levels. Returns FALSE if the store
+ * couldn't be compacted, in which case it is unchanged.
+ */
+
+int
+compact_store(level_store_t *store)
+{
+    int i, ok;
+    uint32_t buf[(STORED_LEVEL_MAX + LVB_ALIGN) / sizeof(uint32_t)];
+    uint32_t offset, *new_index;
+    size_t size;
+    FILE *fp;
+    lvs_header_t header;
+    lvb_t lvb;
+    const stored_level_t *rec;
+    level_store_t new_store = *store;
+    
+    if ((new_index = malloc((store->nlevels + 1) * sizeof(uint32_t))) == NULL)
+    {
+        return FALSE;
+    }
+    
+    if (!lvs_open(&lvb, CUSTOM_LEVEL_FILE STORE_FILE))
+    {
+        free(new_index);
+        return FALSE;
+    }
+    
+    fp = fopen(CUSTOM_LEVEL_FILE STORE_FILE TEMP_FILE, "wb");
+    
+    /* Copy the header with a new generation, then each indexed level. */
+    memcpy(&header, lvb.base, sizeof(header));
+    header.generation++;
+    offset = sizeof(header);
+    
+    ok = (fp != NULL && fwrite(&header, sizeof(header), 1, fp) == 1);
+    
+    lvb.index = store->index;
+    lvb.nlevels = store->nlevels;
+    
+    for (i = 0; ok && i < store->nlevels; i++)
+    {
+        rec = lvb_level(&lvb, i);
+        
+        if (   rec == NULL 
+            || rec->size > STORED_LEVEL_MAX - sizeof(stored_level_t))
+        {
+            ok = FALSE;
+            break;
+        }
+        
+        /* Copy the level into a buffer, so that its padding is zero. */
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, rec, sizeof(stored_level_t) + rec->size);
+        size = stored_level_size(rec);
+        
+        new_index[i] = offset;
+        offset += size;
+        
+        ok = (fwrite(buf, 1, size, fp) == size);
+    }
+    
+    lvb_close(&lvb);
+    
+    if (fp != NULL && (fflush(fp) != 0 || fclose(fp) != 0))
+    {
+        ok = FALSE;
+    }
+    
+    new_store.generation = header.generation;
+    new_store.index = new_index;
+    new_store.capacity = store->nlevels + 1;
+    new_store.size = offset;
+    new_store.used = offset - sizeof(header);
+    
+    if (   !ok
+        || !write_store_index(&new_store, 
+                CUSTOM_LEVEL_FILE STORE_INDEX_FILE TEMP_FILE, 0)
+        || !MoveFileEx(CUSTOM_LEVEL_FILE STORE_FILE TEMP_FILE, 
+                CUSTOM_LEVEL_FILE STORE_FILE, 
+                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFile(CUSTOM_LEVEL_FILE STORE_FILE TEMP_FILE);
+        DeleteFile(CUSTOM_LEVEL_FILE STORE_INDEX_FILE TEMP_FILE);
+        free(new_index);
+        return FALSE;
+    }
+    
+    /* The store has changed, so the old index is of no use even if the new
+     * one can't be renamed. */
+    MoveFileEx(CUSTOM_LEVEL_FILE STORE_INDEX_FILE TEMP_FILE,
+        CUSTOM_LEVEL_FILE STORE_INDEX_FILE, 
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    
+    /* The thread handle belongs to whoever started the compaction. */
+    new_store.compact = store->compact;
+    free(store->index);
+    *store = new_store;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Starts compacting the store on a background thread, if it needs it. The
+ * store must not be used until finish_store_compaction() is called.
+ */
+
+void
+start_store_compaction(level_store_t *store)
+{
+    if (store->compact == NULL && store_needs_compaction(store))
+    {
+        /* The handle is stored before the thread runs, as the thread 
+         * copies the store. */
+        store->compact = CreateThread(NULL, 0, store_compaction, store, 
+            CREATE_SUSPENDED, NULL);
+        
+        if (store->compact != NULL)
+        {
+            ResumeThread(store->compact);
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Waits for the store to finish compacting, if it is.
+ */
+
+void
+finish_store_compaction(level_store_t *store)
+{
+    if (store->compact != NULL)
+    {
+        WaitForSingleObject(store->compact, INFINITE);
+        CloseHandle(store->compact);
+        store->compact = NULL;
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Store compaction thread.
+ */
+
+DWORD WINAPI
+store_compaction(LPVOID arg)
+{
+    compact_store(arg);
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prints error screens for unbeaten level, incomplete level and a level 
+ * that couldn't be written.
+ */
+ 
+void
+editor_message_screen(int message_code)
+{
+    char *incomplete_level[] = {
+" ",
+" ",
+"     ERROR: LEVEL IS INCOMPLETE",
+" ",
+" ",
+"       Level must have player icon and a goal icon to be playable.",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+"       Press any key to return to level editor",
+        NULL};
+
+    char *unbeaten_level[] = {
+" ",
+" ",
+"     SAVE UNSUCCESSFUL",
+" ",
+" ",
+"       Level must be beaten before it can be saved.",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+"       Press any key to return to level editor",
+        NULL};
+    
+    char *write_failed[] = {
+" ",
+" ",
+"     SAVE UNSUCCESSFUL",
+" ",
+" ",
+"       Level could not be written to the custom levelpack.",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+"       Press any key to return to level editor",
+        NULL};
+    
+    char *save_successful[] = {
+" ",
+" ",
+"     CONGRATULATIONS!",
+" ",
+"       Your level has been sucessfully saved!",
+" ",
+" ",
+"       The target number of moves has been set to the number of moves you",
+"       completed the level in.",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+" ",
+"       Press any key to return to level editor",
+        NULL};
+
+    if (message_code == INCOMPLETE_CODE)
+    {
+        print_message_screen(incomplete_level);
+    }
+    else if (message_code == UNBEATEN_CODE)
+    {
+        print_message_screen(unbeaten_level);
+    }
+    else if (message_code == SUCCESSFUL_CODE)
+    {
+        print_message_screen(save_successful);
+    }
+    else if (message_code == WRITE_FAILED_CODE)
+    {
+        print_message_screen(write_failed);
+    }
+    
+    /* Wait for player to enter key. */
+    getch();
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Displays the yes or no screens for the level editor.
+ */
+ 
+char
+editor_decision_screen(int message_code)
+{
+    char input = '\0';
+    
+    char *quit_editor[] = {
+" ",
+" ",
+"     QUIT LEVEL EDITOR:",
+" ",
+" ",
+"       Are you sure you want to quit the level editor? (y/n)",
+" ",
+"       Progress on current level will not be saved",
+"  ",
+    NULL};
+
+    char *clear_editor[] = {
+" ",
+" ",
+"     CLEAR LEVEL:",
+" ",
+" ",
+"       Are you sure you want to clear the current level? (y/n)",
+" ",
+"       Progress on current level will not be saved",
+"  ",
+    NULL};
+    
+    while(TRUE)
+    {
+        /* Display the screen. */
+        if (message_code == QUIT_EDITOR_CODE)
+        {
+            print_message_screen(quit_editor);
+        }
+        else if (message_code == CLEAR_EDITOR_CODE)
+        {
+            print_message_screen(clear_editor);
+        }
+        
+        /* Get player input. */
+        input = getch();
+        
+        if (input == YES)
+        {
+            return YES;
+        }
+        else if (input == NO)
+        {
+            return NO;
+        }
+    }
+ 
+    return NO;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if nothing on the board of a level can change as it is
+ * played, so that the only state is where the player is. Levels with
+ * moving blocks or bombs aren't static.
+ */
+
+int
+is_static_level(level_t *lvl)
+{
+    int i, j;
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < lvl->cols; j++)
+        {
+            if (   lvl->board[i][j] == MOVING_BLOCK
+                || lvl->board[i][j] == BOMB_VAL)
+            {
+                return FALSE;
+            }
+        }
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds where a slide in direction dir, 0 to 3 for UP, RIGHT, DOWN and 
+ * LEFT, from cell stops on a static level, by the same rules as move(). 
+ * The player's start counts as empty, and the edge of the board as a 
+ * wall. Returns the cell, or SOLVE_GOAL or SOLVE_NONE.
+ */
+
+int
+slide_stop(level_t *lvl, int cell, int dir)
+{
+    static const int dr[4] = {-1, 0, 1, 0};
+    static const int dc[4] = {0, 1, 0, -1};
+    int row = cell / BOARD_MAX_C, col = cell % BOARD_MAX_C, val;
+    
+    while (   row + dr[dir] >= 0 && row + dr[dir] < lvl->rows
+           && col + dc[dir] >= 0 && col + dc[dir] < lvl->cols)
+    {
+        val = lvl->board[row + dr[dir]][col + dc[dir]];
+        
+        if (val == GOAL)
+        {
+            return SOLVE_GOAL;
+        }
+        
+        if (val == HOLE)
+        {
+            return SOLVE_NONE;
+        }
+        
+        if (val != EMPTY && val != PLAYER)
+        {
+            break;
+        }
+        
+        row += dr[dir];
+        col += dc[dir];
+    }
+    
+    /* A slide that doesn't move the player isn't an edge. */
+    if (row * BOARD_MAX_C + col == cell)
+    {
+        return SOLVE_NONE;
+    }
+    
+    return row * BOARD_MAX_C + col;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Compiles a static level into the graph of the cells a slide can stop on
+ * from the player's start. Returns FALSE if the level isn't static.
+ */
+
+int
+build_stop_graph(level_t *lvl, stop_graph_t *graph)
+{
+    int16_t node_of[SOLVE_MAX_NODES];
+    int n, dir, cell;
+    
+    if (!is_static_level(lvl))
+    {
+        return FALSE;
+    }
+    
+    memset(node_of, 0xFF, sizeof(node_of));
+    
+    graph->cell[0] = lvl->p_row * BOARD_MAX_C + lvl->p_col;
+    graph->nnodes = 1;
+    node_of[graph->cell[0]] = 0;
+    
+    /* Nodes are added as they are found, so the list of nodes is also the
+     * queue of nodes still to be joined up. */
+    for (n = 0; n < graph->nnodes; n++)
+    {
+        for (dir = 0; dir < 4; dir++)
+        {
+            cell = slide_stop(lvl, graph->cell[n], dir);
+            
+            if (cell == SOLVE_GOAL || cell == SOLVE_NONE)
+            {
+                graph->next[n][dir] = cell;
+                continue;
+            }
+            
+            if (node_of[cell] < 0)
+            {
+                node_of[cell] = graph->nnodes;
+                graph->cell[graph->nnodes++] = cell;
+            }
+            
+            graph->next[n][dir] = node_of[cell];
+        }
+    }
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the fewest moves that beat a static level, with a breadth first
+ * search of its stop graph. The moves are written to moves as UP, RIGHT,
+ * DOWN and LEFT, followed by a null, so it must hold SOLVE_MAX_NODES + 1
+ * characters. Returns the number of moves, SOLVE_NO_SOLUTION, or 
+ * SOLVE_NOT_STATIC.
+ */
+
+int
+solve_level(level_t *lvl, char *moves)
+{
+    static const char dirs[4] = {UP, RIGHT, DOWN, LEFT};
+    stop_graph_t graph;
+    uint16_t queue[SOLVE_MAX_NODES], from[SOLVE_MAX_NODES];
+    uint8_t by[SOLVE_MAX_NODES], seen[SOLVE_MAX_NODES];
+    int head = 0, tail = 0, n, dir, next, len;
+    
+    if (!build_stop_graph(lvl, &graph))
+    {
+        return SOLVE_NOT_STATIC;
+    }
+    
+    memset(seen, 0, graph.nnodes);
+    queue[tail++] = 0;
+    seen[0] = TRUE;
+    
+    while (head < tail)
+    {
+        n = queue[head++];
+        
+        for (dir = 0; dir < 4; dir++)
+        {
+            next = graph.next[n][dir];
+            
+            if (next == SOLVE_GOAL)
+            {
+                /* Nodes leave the queue in order of distance, so the 
+                 * first goal found is the nearest. Walk back to the start
+                 * to count the moves, then again to write them. */
+                for (len = 1, next = n; next != 0; next = from[next])
+                {
+                    len++;
+                }
+                
+                moves[len] = '\0';
+                moves[len - 1] = dirs[dir];
+                
+                for (len -= 2, next = n; next != 0; next = from[next])
+                {
+                    moves[len--] = dirs[by[next]];
+                }
+                
+                return (int)strlen(moves);
+            }
+            
+            if (next != SOLVE_NONE && !seen[next])
+            {
+                seen[next] = TRUE;
+                from[next] = n;
+                by[next] = dir;
+                queue[tail++] = next;
+            }
+        }
+    }
+    
+    moves[0] = '\0';
+    
+    return SOLVE_NO_SOLUTION;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Level function for the solve tool. Prints the fewest moves for the level
+ * and how to make them, next to its par, and how many states were 
+ * expanded to find them. ctx is the solve_totals_t to add the level to, 
+ * and picks the solver. Without one, the solution cache is looked in 
+ * first, and what any solver finds is cached.
+ */
+
+int
+solve_print(void *ctx, level_reader_t *reader, level_t *lvl)
+{
+    solve_totals_t *totals = ctx;
+    char buf[SOLVE_MAX_NODES + 1], *moves = buf, *full = NULL;
+    uint64_t nodes = 0;
+    int n = SOLVE_NOT_STATIC;
+    DWORD start = GetTickCount();
+    solution_t sol;
+    
+    /* A chosen solver is always run, so that it can be timed. */
+    if (totals->solver == NULL && find_solution(lvl, &sol, TRUE))
+    {
+        n = sol.moves;
+        nodes = sol.nodes;
+        moves = sol.solution;
+        totals->cached++;
+    }
+    else
+    {
+        if (totals->solver == NULL)
+        {
+            n = solve_level(lvl, buf);
+        }
+        
+        if (n == SOLVE_NOT_STATIC)
+        {
+            n = (totals->solver != NULL ? totals->solver : solve_full)(lvl, 
+                &full, &nodes, NULL);
+            moves = full;
+            totals->nodes += nodes;
+        }
+        
+        store_solution(lvl, n, moves, nodes, GetTickCount() - start);
+    }
+    
+    if (n == SOLVE_TOO_BIG)
+    {
+        printf("level %d: too many states\n", reader->nlevels);
+        totals->too_big++;
+    }
+    else if (n == SOLVE_NOT_STATIC)
+    {
+        printf("level %d: not static\n", reader->nlevels);
+    }
+    else if (n == SOLVE_NO_SOLUTION)
+    {
+        printf("level %d: no solution\n", reader->nlevels);
+    }
+    else
+    {
+        printf("level %d: %d moves, par %d%s, %" PRIu64 " states: %s\n", 
+            reader->nlevels, n, lvl->moves, 
+            n < lvl->moves ? " (below par)" : "", nodes, moves);
+        totals->solved++;
+        totals->below_par += (n < lvl->moves);
+    }
+    
+    free(full);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Prepares a level for the full rules solver, and packs its starting 
+ * state into start. Returns FALSE if its states don't fit in 
+ * SOLVE_MAX_WORDS words.
+ */
+
+int
+init_state_space(level_t *lvl, state_space_t *space, uint64_t *start)
+{
+    uint8_t board[SOLVE_MAX_NODES];
+    int i, j, cell, val, bits;
+    
+    space->rows = lvl->rows;
+    space->cols = lvl->cols;
+    space->nweak = 0;
+    space->nbombs = 0;
+    space->nblocks = 0;
+    space->nfloor = 0;
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < lvl->cols; j++)
+        {
+            cell = i * lvl->cols + j;
+            val = lvl->board[i][j];
+            board[cell] = (val == PLAYER) ? EMPTY : val;
+            space->base[cell] = board[cell];
+            
+            if (val == WEAK_WALL)
+            {
+                space->weak[space->nweak++] = cell;
+            }
+            else if (val == BOMB_VAL)
+            {
+                space->bomb[space->nbombs++] = cell;
+            }
+            else if (val == MOVING_BLOCK)
+            {
+                space->nblocks++;
+            }
+            
+            /* Weak walls and bombs can be cleared, and blocks moved, 
+             * leaving empty space that a block could be pushed into. */
+            if (   val == EMPTY || val == PLAYER || val == WEAK_WALL
+                || val == BOMB_VAL || val == MOVING_BLOCK)
+            {
+                space->base[cell] = EMPTY;
+                space->floor[space->nfloor++] = cell;
+            }
+        }
+    }
+    
+    bits = SOLVE_CELL_BITS + 1 + space->nweak + space->nbombs 
+         + space->nblocks * SOLVE_CELL_BITS;
+    space->words = (bits + 63) / 64;
+    
+    if (space->words > SOLVE_MAX_WORDS)
+    {
+        return FALSE;
+    }
+    
+    pack_state(space, board, lvl->p_row * lvl->cols + lvl->p_col, lvl->bomb,
+        start);
+    find_dead_cells(lvl, space->dead);
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the low nbits of value into words at bit pos, and moves pos past
+ * them.
+ */
+
+void
+put_bits(uint64_t *words, int *pos, uint32_t value, int nbits)
+{
+    int i;
+    
+    for (i = 0; i < nbits; i++, (*pos)++)
+    {
+        if (value >> i & 1)
+        {
+            words[*pos / 64] |= (uint64_t)1 << (*pos % 64);
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads nbits from words at bit pos, and moves pos past them.
+ */
+
+uint32_t
+get_bits(const uint64_t *words, int *pos, int nbits)
+{
+    uint32_t value = 0;
+    int i;
+    
+    for (i = 0; i < nbits; i++, (*pos)++)
+    {
+        value |= (uint32_t)(words[*pos / 64] >> (*pos % 64) & 1) << i;
+    }
+    
+    return value;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Packs a board, laid out as in a state space, with the player on cell 
+ * player, into a state. The cells of the blocks are found in the order of
+ * the floor, so that the same blocks in the same cells always pack the 
+ * same way.
+ */
+
+void
+pack_state(const state_space_t *space, const uint8_t *board, int player,
+    int bomb, uint64_t *state)
+{
+    int i, pos = 0, nblocks = 0;
+    
+    memset(state, 0, space->words * sizeof(uint64_t));
+    
+    put_bits(state, &pos, player, SOLVE_CELL_BITS);
+    put_bits(state, &pos, bomb != FALSE, 1);
+    
+    for (i = 0; i < space->nweak; i++)
+    {
+        put_bits(state, &pos, board[space->weak[i]] == WEAK_WALL, 1);
+    }
+    
+    for (i = 0; i < space->nbombs; i++)
+    {
+        put_bits(state, &pos, board[space->bomb[i]] == BOMB_VAL, 1);
+    }
+    
+    for (i = 0; i < space->nfloor; i++)
+    {
+        if (board[space->floor[i]] == MOVING_BLOCK)
+        {
+            put_bits(state, &pos, space->floor[i], SOLVE_CELL_BITS);
+            nblocks++;
+        }
+    }
+    
+    /* Blocks caught in a blast are gone. */
+    for (; nblocks < space->nblocks; nblocks++)
+    {
+        put_bits(state, &pos, SOLVE_NO_CELL, SOLVE_CELL_BITS);
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Unpacks a state into the board of its state space, where the player is, 
+ * and whether they hold a bomb. The player isn't put on the board.
+ */
+
+void
+unpack_state(const state_space_t *space, const uint64_t *state, 
+    uint8_t *board, int *player, int *bomb)
+{
+    int i, pos = 0, cell;
+    
+    memcpy(board, space->base, space->rows * space->cols);
+    
+    *player = get_bits(state, &pos, SOLVE_CELL_BITS);
+    *bomb = get_bits(state, &pos, 1);
+    
+    for (i = 0; i < space->nweak; i++)
+    {
+        if (get_bits(state, &pos, 1))
+        {
+            board[space->weak[i]] = WEAK_WALL;
+        }
+    }
+    
+    for (i = 0; i < space->nbombs; i++)
+    {
+        if (get_bits(state, &pos, 1))
+        {
+            board[space->bomb[i]] = BOMB_VAL;
+        }
+    }
+    
+    for (i = 0; i < space->nblocks; i++)
+    {
+        if ((cell = get_bits(state, &pos, SOLVE_CELL_BITS)) != SOLVE_NO_CELL)
+        {
+            board[cell] = MOVING_BLOCK;
+        }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Slides the player on the board of a state space in direction dir, 0 to 
+ * 3 for UP, RIGHT, DOWN and LEFT, by the rules of move() as play() uses 
+ * it. A block can only be pushed once the player is moving, after which 
+ * the player steps into its place and stops. Bombs are picked up on the 
+ * way, and destroyed if one is already held. The edge of the board counts
+ * as a wall. Returns GOAL or HOLE if the slide ends there, and otherwise 
+ * TRUE if the player moved or FALSE if not.
+ */
+
+int
+state_slide(const state_space_t *space, uint8_t *board, int *player,
+    int *bomb, int dir)
+{
+    static const int dr[4] = {-1, 0, 1, 0};
+    static const int dc[4] = {0, 1, 0, -1};
+    int row = *player / space->cols, col = *player % space->cols;
+    int moved = FALSE, next, val;
+    
+    while (   row + dr[dir] >= 0 && row + dr[dir] < space->rows
+           && col + dc[dir] >= 0 && col + dc[dir] < space->cols)
+    {
+        next = (row + dr[dir]) * space->cols + col + dc[dir];
+        val = board[next];
+        
+        if (val == GOAL || val == HOLE)
+        {
+            *player = next;
+            return val;
+        }
+        
+        if (val == BOMB_VAL)
+        {
+            board[next] = EMPTY;
+            *bomb = TRUE;
+        }
+        else if (val == MOVING_BLOCK)
+        {
+            if (   !moved
+                || row + 2 * dr[dir] < 0 || row + 2 * dr[dir] >= space->rows
+                || col + 2 * dc[dir] < 0 || col + 2 * dc[dir] >= space->cols
+                || board[next + dr[dir] * space->cols + dc[dir]] != EMPTY)
+            {
+                break;
+            }
+            
+            board[next + dr[dir] * space->cols + dc[dir]] = MOVING_BLOCK;
+            board[next] = EMPTY;
+            *player = next;
+            
+            return TRUE;
+        }
+        else if (val != EMPTY)
+        {
+            break;
+        }
+        
+        row += dr[dir];
+        col += dc[dir];
+        moved = TRUE;
+    }
+    
+    *player = row * space->cols + col;
+    
+    return moved;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Clears the weak walls and blocks around the player on the board of a 
+ * state space, as bomb_blast() does.
+ */
+
+void
+state_blast(const state_space_t *space, uint8_t *board, int player)
+{
+    int row = player / space->cols, col = player % space->cols, i, j;
+    
+    for (i = row - 1; i <= row + 1; i++)
+    {
+        for (j = col - 1; j <= col + 1; j++)
+        {
+            if (   i >= 0 && i < space->rows && j >= 0 && j < space->cols
+                && (   board[i * space->cols + j] == WEAK_WALL
+                    || board[i * space->cols + j] == MOVING_BLOCK))
+            {
+                board[i * space->cols + j] = EMPTY;
+            }
         }
+    }
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Hashes a packed state with 64 bit FNV-1a over its words.
+ */
+
+uint64_t
+state_key(const uint64_t *state, int words)
+{
+    uint64_t hash = FNV_OFFSET;
+    int i;
+    
+    for (i = 0; i < words; i++)
+    {
+        hash = (hash ^ state[i]) * FNV_PRIME;
+    }
+    
+    /* Mix the high bits down, as only the low bits pick a slot. */
+    return hash ^ (hash >> 32);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Opens an empty state table for states of words words, that may use up 
+ * to memory bytes.
+ */
+
+void
+open_state_table(state_table_t *table, int words, size_t memory)
+{
+    memset(table, 0, sizeof(*table));
+    table->words = words;
+    table->memory = memory;
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Doubles the room in a state table. Returns FALSE if it would use more
+ * memory than it may, or if out of memory.
+ */
+
+int
+grow_state_table(state_table_t *table)
+{
+    uint32_t capacity, i, j, mask;
+    uint64_t *state;
+    uint32_t *from, *slot;
+    uint8_t *action;
+    
+    capacity = table->capacity ? table->capacity * 2 : MIN_TABLE_SIZE / 2;
+    
+    if ((double)capacity * (table->words * sizeof(uint64_t) 
+            + sizeof(uint32_t) + 1 + 2 * sizeof(uint32_t)) > table->memory)
+    {
+        return FALSE;
+    }
+    
+    if ((state = realloc(table->state, 
+            (size_t)capacity * table->words * sizeof(uint64_t))) == NULL)
+    {
+        return FALSE;
+    }
+    
+    table->state = state;
+    
+    if ((from = realloc(table->from, capacity * sizeof(uint32_t))) == NULL)
+    {
+        return FALSE;
+    }
+    
+    table->from = from;
+    
+    if ((action = realloc(table->action, capacity)) == NULL)
+    {
+        return FALSE;
+    }
+    
+    table->action = action;
+    
+    if ((slot = calloc(capacity * 2, sizeof(uint32_t))) == NULL)
+    {
+        return FALSE;
+    }
+    
+    mask = capacity * 2 - 1;
+    
+    for (i = 0; i < table->count; i++)
+    {
+        for (j = state_key(state + (size_t)i * table->words, table->words) 
+                 & mask;
+             slot[j] != 0; j = (j + 1) & mask)
+            ;
+        slot[j] = i + 1;
+    }
+    
+    free(table->slot);
+    table->slot = slot;
+    table->capacity = capacity;
+    
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a state to a state table, reached from state number from by 
+ * action, unless it is already there. Returns its number, STATE_FOUND if 
+ * it was already there, or STATE_FULL if there is no room for it.
+ */
+
+uint32_t
+add_state(state_table_t *table, const uint64_t *state, uint32_t from, 
+    int action)
+{
+    uint32_t i = 0, mask;
+    size_t size = table->words * sizeof(uint64_t);
+    
+    /* Look for the state before making room, so a state that is already 
+     * there is found even when the table is full. */
+    if (table->capacity != 0)
+    {
+        mask = table->capacity * 2 - 1;
         
-        /* Check if player has quit. */
-        if (direction == QUIT)
+        for (i = state_key(state, table->words) & mask; table->slot[i] != 0;
+             i = (i + 1) & mask)
         {
-            return 0;
+            if (memcmp(table->state 
+                    + (size_t)(table->slot[i] - 1) * table->words,
+                    state, size) == 0)
+            {
+                return STATE_FOUND;
+            }
         }
+    }
     
-        /* Check if player restarted. */
-        if (direction == RESTART)
+    /* Growing moves every slot, so the empty slot is found again. */
+    if (table->count == table->capacity)
+    {
+        if (!grow_state_table(table))
         {
-            currentlvl = *level;
+            return STATE_FULL;
         }
         
-        /* Check to see if player wants to usee a bomb. */
-        if (direction == BOMB_INPUT)
+        mask = table->capacity * 2 - 1;
+        
+        for (i = state_key(state, table->words) & mask; table->slot[i] != 0;
+             i = (i + 1) & mask)
+            ;
+    }
+    
+    memcpy(table->state + (size_t)table->count * table->words, state, size);
+    table->from[table->count] = from;
+    table->action[table->count] = action;
+    table->slot[i] = ++table->count;
+    
+    return table->count - 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Frees the memory of a state table.
+ */
+
+void
+free_state_table(state_table_t *table)
+{
+    free(table->state);
+    free(table->from);
+    free(table->action);
+    free(table->slot);
+    memset(table, 0, sizeof(*table));
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the fewest moves that beat a level by the full rules of the game,
+ * with a breadth first search of its states. A move is a slide, or using 
+ * a bomb and then a slide. The moves are returned in moves as UP, RIGHT,
+ * DOWN, LEFT and BOMB_INPUT, followed by a null, and must be freed. 
+ * Returns the number of moves, SOLVE_NO_SOLUTION, SOLVE_TOO_BIG if the 
+ * states didn't fit in SOLVE_MEMORY or memory ran out, or SOLVE_CANCELLED
+ * once stop is set.
+ */
+
+int
+solve_full(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop)
+{
+    state_space_t space;
+    state_table_t table;
+    uint64_t state[SOLVE_MAX_WORDS];
+    uint8_t board[SOLVE_MAX_NODES];
+    uint32_t n;
+    int action, player, bomb, val, nmoves;
+    
+    *moves = NULL;
+    *nodes = 0;
+    
+    if (!init_state_space(lvl, &space, state))
+    {
+        return SOLVE_TOO_BIG;
+    }
+    
+    open_state_table(&table, space.words, SOLVE_MEMORY);
+    
+    if (add_state(&table, state, 0, 0) == STATE_FULL)
+    {
+        free_state_table(&table);
+        return SOLVE_TOO_BIG;
+    }
+    
+    /* States are numbered as they are found, so the table is also the 
+     * queue of states still to be expanded. */
+    for (n = 0; n < table.count; n++)
+    {
+        if (stop != NULL && *stop)
         {
-            /* Check if bomb is in the inventory. */
-            if (currentlvl.bomb == TRUE)
-            {
-                /* Player can use bomb. */
-                use_bomb(&currentlvl);
-            }
+            free_state_table(&table);
+            return SOLVE_CANCELLED;
         }
         
-        /* Move until wall (or goal) is reached. */
-        while (TRUE)
+        (*nodes)++;
+        
+        for (action = 0; action < 2 * SOLVE_BOMB; action++)
         {
-            /* Insert code for using a bomb here. */
-            
-            val = move(&currentlvl, direction);
+            unpack_state(&space, table.state + (size_t)n * space.words, 
+                board, &player, &bomb);
             
-            /* Check to see if movement has ended. */
-            if (val == 0)
+            if (action >= SOLVE_BOMB)
             {
-                /* Player is stationary, so moving block check is true. */
-                currentlvl.moving_block_check = TRUE;
-                break;
+                if (!bomb)
+                {
+                    break;
+                }
+                
+                state_blast(&space, board, player);
+                bomb = FALSE;
             }
             
-            /* Player is moving, so they are allowed to push a moving block.
-             * Therefore set moving_block_check to true. */
-            currentlvl.moving_block_check = FALSE;
+            val = state_slide(&space, board, &player, &bomb, 
+                action % SOLVE_BOMB);
             
-            /* Check to see if the goal has been reached */
+            /* States leave the queue in order of moves, so the first goal
+             * found is the nearest. */
             if (val == GOAL)
             {
-                disp_board(&currentlvl);
-                Sleep(1000);
-                
-                /* Edit save file. */
-                if (!edit_mode)
-                {
-                    if (currentlvl.nmoves <= level->moves)
-                    {
-                        save->data[level_num] = ACED;
-                    }
-                    else if (save->data[level_num] != ACED)
-                    {
-                        save->data[level_num] = BEATEN;
-                    }
-                    write_save(*save);
-                }
-                    
-                /* Display victory screen. */
-                victory_screen();
-                
-                return currentlvl.nmoves;
+                nmoves = state_moves(table.from, table.action, n, action, 
+                    moves);
+                free_state_table(&table);
+                return nmoves;
             }
             
-            /* Check to see if player has fallen in a hole. */
-            if (val == HOLE)
-            {   
-                hole(level, &currentlvl);
-                check = FALSE;
-                
-                break;
+            /* A move that leaves the player where they were is never 
+             * worth making, as a bomb used there could as well be used
+             * with the next slide. Nor is one to a dead cell. */
+            if (val != TRUE || space.dead[player / 64] >> (player % 64) & 1)
+            {
+                continue;
+            }
+            
+            pack_state(&space, board, player, bomb, state);
+            
+            if (add_state(&table, state, n, action) == STATE_FULL)
+            {
+                free_state_table(&table);
+                return SOLVE_TOO_BIG;
             }
+        }
+    }
+    
+    free_state_table(&table);
+    
+    return SOLVE_NO_SOLUTION;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the number of a state in a state table. Returns STATE_NONE if it 
+ * isn't there.
+ */
+
+uint32_t
+find_state(const state_table_t *table, const uint64_t *state)
+{
+    uint32_t i, mask;
+    
+    if (table->capacity == 0)
+    {
+        return STATE_NONE;
+    }
+    
+    mask = table->capacity * 2 - 1;
+    
+    for (i = state_key(state, table->words) & mask; table->slot[i] != 0;
+         i = (i + 1) & mask)
+    {
+        if (memcmp(table->state + (size_t)(table->slot[i] - 1) * table->words,
+                state, table->words * sizeof(uint64_t)) == 0)
+        {
+            return table->slot[i] - 1;
+        }
+    }
+    
+    return STATE_NONE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the moves that reach the goal by taking action from state n, 
+ * walking back through the states before it to the start, state 0, by the
+ * state each was reached from and the action that reached it. Returns the
+ * number of moves, or SOLVE_TOO_BIG if out of memory.
+ */
+
+int
+state_moves(const uint32_t *from, const uint8_t *actions, uint32_t n, 
+    int action, char **moves)
+{
+    uint8_t *path;
+    uint32_t prev;
+    int nmoves = 1, i;
+    
+    for (prev = n; prev != 0; prev = from[prev])
+    {
+        nmoves++;
+    }
+    
+    if ((path = malloc(nmoves)) == NULL)
+    {
+        return SOLVE_TOO_BIG;
+    }
+    
+    path[nmoves - 1] = action;
+    
+    for (i = nmoves - 2, prev = n; prev != 0; prev = from[prev])
+    {
+        path[i--] = actions[prev];
+    }
+    
+    nmoves = action_moves(path, nmoves, moves);
+    free(path);
+    
+    return nmoves;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes a list of solver actions as moves of UP, RIGHT, DOWN, LEFT and 
+ * BOMB_INPUT, followed by a null, which must be freed. Returns nmoves, or
+ * SOLVE_TOO_BIG if out of memory.
+ */
+
+int
+action_moves(const uint8_t *action, int nmoves, char **moves)
+{
+    static const char dirs[4] = {UP, RIGHT, DOWN, LEFT};
+    int i, len = 0;
+    
+    for (i = 0; i < nmoves; i++)
+    {
+        len += 1 + (action[i] >= SOLVE_BOMB);
+    }
+    
+    if ((*moves = malloc(len + 1)) == NULL)
+    {
+        return SOLVE_TOO_BIG;
+    }
+    
+    for (i = 0, len = 0; i < nmoves; i++)
+    {
+        if (action[i] >= SOLVE_BOMB)
+        {
+            (*moves)[len++] = BOMB_INPUT;
+        }
+        
+        (*moves)[len++] = dirs[action[i] % SOLVE_BOMB];
+    }
+    
+    (*moves)[len] = '\0';
+    
+    return nmoves;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds a lower bound on the moves to the goal from each cell of a state 
+ * space. Only walls, holes, and weak walls if there are no bombs to break
+ * them, can never be moved through. A move can take the player any
+ * distance in a straight line between those, so the fewest such moves to
+ * the goal, found with a breadth first search back from it, can't be more
+ * than the fewest real moves. Cells the goal can't be reached from this 
+ * way, or that are dead, are SOLVE_FAR.
+ */
+
+void
+init_distances(state_space_t *space, int bombs)
+{
+    static const int dr[4] = {-1, 0, 1, 0};
+    static const int dc[4] = {0, 1, 0, -1};
+    uint8_t open[SOLVE_MAX_NODES];
+    uint16_t queue[SOLVE_MAX_NODES];
+    int head = 0, tail = 0, cells = space->rows * space->cols;
+    int cell, dir, row, col, i;
+    
+    memset(space->dist, 0xFF, sizeof(space->dist));
+    
+    for (i = 0; i < cells; i++)
+    {
+        open[i] = (space->base[i] == EMPTY);
+        
+        if (space->base[i] == GOAL)
+        {
+            space->dist[i] = 0;
+            queue[tail++] = i;
+        }
+    }
+    
+    for (i = 0; i < space->nweak && !bombs; i++)
+    {
+        open[space->weak[i]] = FALSE;
+    }
+    
+    while (head < tail)
+    {
+        cell = queue[head++];
+        
+        for (dir = 0; dir < 4; dir++)
+        {
+            row = cell / space->cols + dr[dir];
+            col = cell % space->cols + dc[dir];
             
-            /* Check for moving block */
-            if (val == MOVING_BLOCK)
+            for (; row >= 0 && row < space->rows && col >= 0 
+                   && col < space->cols && open[row * space->cols + col];
+                 row += dr[dir], col += dc[dir])
             {
-                moving_block(&currentlvl, direction);
-                check = FALSE;
-                
-                /* Player is now stationary next to moved block, therefore
-                 * moving_block_check is true */
-                currentlvl.moving_block_check = TRUE;
-                
-                break;
+                if (space->dist[row * space->cols + col] == SOLVE_FAR)
+                {
+                    space->dist[row * space->cols + col] 
+                        = space->dist[cell] + 1;
+                    queue[tail++] = row * space->cols + col;
+                }
             }
-                        
-            /* Display moves */
-            disp_board(&currentlvl);
-            Sleep(TIME_BETWEEN_FRAMES);
-            
-            /* Do not need to display screen again. */
-            check = FALSE;
         }
-        
-        /* Display again if no valid move. */
-        if (check)
+    }
+    
+    for (i = 0; i < cells; i++)
+    {
+        if (space->dead[i / 64] >> (i % 64) & 1)
         {
-            disp_board(&currentlvl);
+            space->dist[i] = SOLVE_FAR;
         }
     }
     
-    return 0;
+    return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Takes input direction and checks if the player can move. Swaps positions if
- * a move is possible - FALSE return means no move occurred. */
+ * Finds the cells of a level that the goal can't be reached from, however
+ * it is played from here, and sets their bits in dead, which must hold 
+ * SOLVE_SET_WORDS words. Cells are numbered row * cols + col. Slides are 
+ * traced back from the goal, and then from each cell found, to every cell 
+ * they could have started from. Weak walls that a bomb could clear, and 
+ * cells that a block could be pushed onto, are taken to be both open and
+ * in the way, so no live cell is missed. Without them it is exact.
+ */
 
-int
-move(level_t *lvl, char move)
+void
+find_dead_cells(level_t *lvl, uint64_t *dead)
 {
-    /* Check to see if the player has moved up. */
-    if (move == UP)
+    static const int dr[4] = {-1, 0, 1, 0};
+    static const int dc[4] = {0, 1, 0, -1};
+    uint8_t kind[SOLVE_MAX_NODES], block[SOLVE_MAX_NODES];
+    uint8_t live[SOLVE_MAX_NODES];
+    uint16_t queue[SOLVE_MAX_NODES];
+    int head = 0, tail = 0, cols = lvl->cols, cells = lvl->rows * lvl->cols;
+    int bombs = lvl->bomb, cell, dir, row, col, next, first, i, j;
+    
+    for (i = 0; i < lvl->rows; i++)
     {
-        /* Check to see if there is space next to player. */
-        if (lvl->board[lvl->p_row-1][lvl->p_col] == EMPTY)
-        {
-            /* As there is empty space next to the player, move player by
-             * swapping the player and the empty space. */
-            int_swap(&lvl->board[lvl->p_row-1][lvl->p_col],
-                &lvl->board[lvl->p_row][lvl->p_col]);
-            
-            /* Adjust players position. */
-            lvl->p_row -= 1;
-            
-            return TRUE;
-        }
-        
-        /* Check to see if there is a wall next to the player. */
-        if (lvl->board[lvl->p_row-1][lvl->p_col] == WALL ||
-            lvl->board[lvl->p_row-1][lvl->p_col] == WEAK_WALL)
+        for (j = 0; j < cols && !bombs; j++)
         {
-            return FALSE;
+            bombs = (lvl->board[i][j] == BOMB_VAL);
         }
-        
-        /* Check to see if the player has made it to the goal. */
-        if (lvl->board[lvl->p_row-1][lvl->p_col] == GOAL)
+    }
+    
+    memset(block, FALSE, cells);
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < cols; j++)
         {
-            /* Move the player onto the goal. */
-            lvl->board[lvl->p_row-1][lvl->p_col] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            cell = i * cols + j;
             
-            /* Adjust players position. */
-            lvl->p_row -= 1;
-            
-            return GOAL;
-        }
-        
-        /* Check to see if the player has fallen into a hole. */
-        if (lvl->board[lvl->p_row-1][lvl->p_col] == HOLE)
-        {   
-            /* Move player onto hole. */
-            lvl->board[lvl->p_row-1][lvl->p_col] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_row -= 1;
-            
-            return HOLE;
+            switch (lvl->board[i][j])
+            {
+                case EMPTY:
+                case PLAYER:
+                case BOMB_VAL:
+                    kind[cell] = REACH_OPEN;
+                    break;
+                case MOVING_BLOCK:
+                    kind[cell] = REACH_MAYBE;
+                    block[cell] = TRUE;
+                    queue[tail++] = cell;
+                    break;
+                case WEAK_WALL:
+                    kind[cell] = bombs ? REACH_MAYBE : REACH_SHUT;
+                    break;
+                case HOLE:
+                    kind[cell] = REACH_HOLE;
+                    break;
+                case GOAL:
+                    kind[cell] = REACH_GOAL;
+                    break;
+                default:
+                    kind[cell] = REACH_SHUT;
+                    break;
+            }
         }
+    }
+    
+    /* A block is only ever pushed one cell onto empty space, so it stays 
+     * in the open area around where it started. */
+    while (head < tail)
+    {
+        cell = queue[head++];
         
-        /* Check for a moving block. */
-        if (lvl->board[lvl->p_row-1][lvl->p_col] == MOVING_BLOCK)
+        for (dir = 0; dir < 4; dir++)
         {
-            /* To push a moving block, there must be space on the board,
-             * and that space must be empty. */
-            if (   lvl->p_row-2 >= 0
-                && lvl->board[lvl->p_row-2][lvl->p_col] == EMPTY
-                && lvl->moving_block_check == FALSE)
-            {
-                /* Push the block back by swapping its position. */
-                int_swap(&lvl->board[lvl->p_row-2][lvl->p_col],
-                    &lvl->board[lvl->p_row-1][lvl->p_col]);
-                
-                return MOVING_BLOCK;
-            }
+            row = cell / cols + dr[dir];
+            col = cell % cols + dc[dir];
+            next = row * cols + col;
             
-            /* If there is no space to push the block, it acts like a wall. */
-            else
+            if (   row >= 0 && row < lvl->rows && col >= 0 && col < cols
+                && kind[next] <= REACH_MAYBE && !block[next])
             {
-                return FALSE;
+                kind[next] = REACH_MAYBE;
+                block[next] = TRUE;
+                queue[tail++] = next;
             }
         }
+    }
+    
+    memset(live, FALSE, cells);
+    head = tail = 0;
+    
+    for (i = 0; i < cells; i++)
+    {
+        if (kind[i] == REACH_GOAL)
+        {
+            queue[tail++] = i;
+        }
+    }
+    
+    while (head < tail)
+    {
+        cell = queue[head++];
         
-        /* Check to see if the player picks up a bomb. */
-        if (lvl->board[lvl->p_row-1][lvl->p_col] == BOMB_VAL)
+        for (dir = 0; dir < 4; dir++)
         {
-            /* Player moves over the bomb */
-            lvl->board[lvl->p_row-1][lvl->p_col] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-
-            /* Adjust players position. */
-            lvl->p_row -= 1;            
+            row = cell / cols + dr[dir];
+            col = cell % cols + dc[dir];
+            next = row * cols + col;
             
-            /* Can only hold maximum of one bomb. Check if bomb already in
-             * inventory, and increment otherwise. */
-            if (lvl->bomb == FALSE)
+            /* A slide into the goal ends there. Otherwise it may stop on 
+             * a cell with something in the way after it, or on a block 
+             * pushed from it, but only by a player already moving. */
+            if (   kind[cell] == REACH_GOAL
+                || row < 0 || row >= lvl->rows || col < 0 || col >= cols
+                || kind[next] == REACH_SHUT || kind[next] == REACH_MAYBE)
             {
-                lvl->bomb = TRUE;
+                first = 1;
+            }
+            else if (block[cell] && kind[next] <= REACH_MAYBE)
+            {
+                first = 2;
             }
-            /* If bomb is already in inventory, extra bomb was destoryed so
-             * display message. */
             else
             {
-                lvl->message_available = TRUE;
-                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+                continue;
             }
             
-            return BOMB_VAL;
+            row = cell / cols - dr[dir];
+            col = cell % cols - dc[dir];
+            
+            for (i = 1; 
+                 row >= 0 && row < lvl->rows && col >= 0 && col < cols
+                 && kind[row * cols + col] <= REACH_MAYBE;
+                 i++, row -= dr[dir], col -= dc[dir])
+            {
+                if (i >= first && !live[row * cols + col])
+                {
+                    live[row * cols + col] = TRUE;
+                    queue[tail++] = row * cols + col;
+                }
+            }
         }
     }
     
-    /* Check to see if the player has moved down. */
-    if (move == DOWN)
+    memset(dead, 0, SOLVE_SET_WORDS * sizeof(uint64_t));
+    
+    for (i = 0; i < cells; i++)
     {
-        /* Check to see if there is space next to player. */
-        if (lvl->board[lvl->p_row+1][lvl->p_col] == EMPTY)
+        if (!live[i])
         {
-            /* As there is empty space next to the player, move player by
-             * swapping the player and the empty space. */
-            int_swap(&lvl->board[lvl->p_row+1][lvl->p_col],
-                &lvl->board[lvl->p_row][lvl->p_col]);
-            
-            /* Adjust players position. */
-            lvl->p_row += 1;
-            
-            return TRUE;
+            dead[i / 64] |= (uint64_t)1 << (i % 64);
         }
+    }
+    
+    return;
+}
 
-        /* Check to see if there is a wall next to the player. */
-        if (lvl->board[lvl->p_row+1][lvl->p_col] == WALL ||
-            lvl->board[lvl->p_row+1][lvl->p_col] == WEAK_WALL)
+/*---------------------------------------------------------------------------*/
+/*
+ * Checks if the goal can no longer be reached from where the player is,
+ * with find_dead_cells(). Returns TRUE if the level is lost.
+ */
+
+int
+level_lost(level_t *lvl)
+{
+    uint64_t dead[SOLVE_SET_WORDS];
+    int cell = lvl->p_row * lvl->cols + lvl->p_col;
+    
+    find_dead_cells(lvl, dead);
+    
+    return dead[cell / 64] >> (cell % 64) & 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds an entry to a state heap. Returns FALSE if out of memory.
+ */
+
+int
+heap_push(state_heap_t *heap, uint64_t entry)
+{
+    uint64_t *grown;
+    uint32_t i;
+    
+    if (heap->count == heap->size)
+    {
+        if ((grown = realloc(heap->entry, (heap->size ? heap->size * 2 
+                : MIN_TABLE_SIZE) * sizeof(uint64_t))) == NULL)
         {
             return FALSE;
         }
         
-        /* Check to see if the player has made it to the goal. */
-        if (lvl->board[lvl->p_row+1][lvl->p_col] == GOAL)
-        {
-            /* Move the player onto the goal. */
-            lvl->board[lvl->p_row+1][lvl->p_col] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_row += 1;
-            
-            return GOAL;
-        }
-        
-        /* Check to see if the player has fallen into a hole. */
-        if (lvl->board[lvl->p_row+1][lvl->p_col] == HOLE)
-        {
-            /* Move player onto hole. */
-            lvl->board[lvl->p_row+1][lvl->p_col] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_row += 1;
-            return HOLE;
-        }
-        
-        /* Check for a moving block. */
-        if (lvl->board[lvl->p_row+1][lvl->p_col] == MOVING_BLOCK)
-        {
-            /* To push a moving block, there must be space on the board,
-             * and that space must be empty. */
-            if (   lvl->p_row+2 < lvl->rows
-                && lvl->board[lvl->p_row+2][lvl->p_col] == EMPTY
-                && lvl->moving_block_check == FALSE)
-            {
-                /* Push the block back by swapping its position. */                
-                int_swap(&lvl->board[lvl->p_row+2][lvl->p_col],
-                    &lvl->board[lvl->p_row+1][lvl->p_col]);
-                
-                return MOVING_BLOCK;
-            }
-            
-            /* If there is no space to push the block, it acts like a wall. */
-            else
-            {
-                return FALSE;
-            }
-        }
-        
-        /* Check to see if the player picks up a bomb. */
-        if (lvl->board[lvl->p_row+1][lvl->p_col] == BOMB_VAL)
-        {
-            /* Player moves over the bomb */
-            lvl->board[lvl->p_row+1][lvl->p_col] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+        heap->entry = grown;
+        heap->size = heap->size ? heap->size * 2 : MIN_TABLE_SIZE;
+    }
+    
+    for (i = heap->count++; i > 0 && heap->entry[(i - 1) / 2] > entry; 
+         i = (i - 1) / 2)
+    {
+        heap->entry[i] = heap->entry[(i - 1) / 2];
+    }
+    
+    heap->entry[i] = entry;
+    
+    return TRUE;
+}
 
-            /* Adjust players position. */
-            lvl->p_row += 1;            
-            
-            /* Can only hold maximum of one bomb. Check if bomb already in
-             * inventory, and increment otherwise. */
-            if (lvl->bomb == FALSE)
-            {
-                lvl->bomb = TRUE;
-            }
-            /* If bomb is already in inventory, extra bomb was destoryed so
-             * display message. */
-            else
-            {
-                lvl->message_available = TRUE;
-                strcpy(lvl->message, BOMB_DESTROYED_MSG);
-            }
-            
-            return BOMB_VAL;
+/*---------------------------------------------------------------------------*/
+/*
+ * Removes the smallest entry from a state heap, which mustn't be empty, 
+ * and returns it.
+ */
+
+uint64_t
+heap_pop(state_heap_t *heap)
+{
+    uint64_t top = heap->entry[0], last = heap->entry[--heap->count];
+    uint32_t i = 0, child;
+    
+    while ((child = 2 * i + 1) < heap->count)
+    {
+        if (   child + 1 < heap->count 
+            && heap->entry[child + 1] < heap->entry[child])
+        {
+            child++;
+        }
+        
+        if (last <= heap->entry[child])
+        {
+            break;
         }
+        
+        heap->entry[i] = heap->entry[child];
+        i = child;
     }
     
-    /* Check to see if the player has moved left. */
-    if (move == LEFT)
+    heap->entry[i] = last;
+    
+    return top;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the fewest moves that beat a level by the full rules of the game,
+ * with an A* search guided by init_distances(). States are expanded in 
+ * order of the moves to them plus the distance from the player's cell, 
+ * which never overestimates, so the first goal that nothing left can beat
+ * is the nearest. States that can't reach the goal aren't kept. Returns 
+ * as solve_full().
+ */
+
+int
+solve_astar(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop)
+{
+    state_space_t space;
+    state_table_t table;
+    state_heap_t heap = {NULL, 0, 0};
+    uint64_t state[SOLVE_MAX_WORDS], entry;
+    uint8_t board[SOLVE_MAX_NODES];
+    uint16_t *cost = NULL, *grown;
+    uint32_t n, m, ncost = 0, goal_from = 0;
+    int action, player, bomb, val, g, h, goal_action = 0;
+    int best = SOLVE_FAR, full = FALSE;
+    
+    *moves = NULL;
+    *nodes = 0;
+    
+    if (!init_state_space(lvl, &space, state))
     {
-        /* Check to see if there is space next to player. */
-        if (lvl->board[lvl->p_row][lvl->p_col-1] == EMPTY)
+        return SOLVE_TOO_BIG;
+    }
+    
+    init_distances(&space, space.nbombs > 0 || lvl->bomb);
+    
+    if ((h = space.dist[lvl->p_row * space.cols + lvl->p_col]) == SOLVE_FAR)
+    {
+        return SOLVE_NO_SOLUTION;
+    }
+    
+    open_state_table(&table, space.words, SOLVE_MEMORY);
+    
+    /* Entries are the estimate, the inverted moves so far and the state 
+     * number, so that ties go to the deepest state. */
+    full = add_state(&table, state, 0, 0) == STATE_FULL
+        || (cost = calloc(ncost = table.capacity, sizeof(uint16_t))) == NULL
+        || !heap_push(&heap, (uint64_t)h << 48 | (uint64_t)0xFFFF << 32);
+    
+    while (!full && heap.count > 0)
+    {
+        entry = heap_pop(&heap);
+        n = (uint32_t)entry;
+        g = 0xFFFF - (int)(entry >> 32 & 0xFFFF);
+        
+        /* Nothing left can reach the goal in fewer moves. */
+        if ((int)(entry >> 48) >= best)
         {
-            /* As there is empty space next to the player, move player by
-             * swapping the player and the empty space. */
-            int_swap(&lvl->board[lvl->p_row][lvl->p_col-1],
-                &lvl->board[lvl->p_row][lvl->p_col]);
-            
-            /* Adjust players position. */
-            lvl->p_col -= 1;
-            return TRUE;
+            break;
         }
         
-        /* Check to see if there is a wall next to the player. */
-        if (lvl->board[lvl->p_row][lvl->p_col-1] == WALL ||
-            lvl->board[lvl->p_row][lvl->p_col-1] == WEAK_WALL)
+        /* The state has been reached in fewer moves since this entry. */
+        if (cost[n] != g)
         {
-            return FALSE;
+            continue;
         }
         
-        /* Check to see if the player has made it to the goal. */
-        if (lvl->board[lvl->p_row][lvl->p_col-1] == GOAL)
+        if (stop != NULL && *stop)
         {
-            /* Move the player onto the goal. */
-            lvl->board[lvl->p_row][lvl->p_col-1] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_col -= 1;
-                        
-            return GOAL;
+            best = SOLVE_CANCELLED;
+            break;
         }
         
-        /* Check to see if the player has fallen into a hole. */
-        if (lvl->board[lvl->p_row][lvl->p_col-1] == HOLE)
+        (*nodes)++;
+        
+        for (action = 0; action < 2 * SOLVE_BOMB && !full; action++)
         {
-            /* Move player onto hole. */
-            lvl->board[lvl->p_row][lvl->p_col-1] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
+            unpack_state(&space, table.state + (size_t)n * space.words, 
+                board, &player, &bomb);
             
-            /* Adjust players position. */
-            lvl->p_col -= 1;
+            if (action >= SOLVE_BOMB)
+            {
+                if (!bomb)
+                {
+                    break;
+                }
+                
+                state_blast(&space, board, player);
+                bomb = FALSE;
+            }
             
-            return HOLE;
-        }
-        
-        /* Check for a moving block. */
-        if (lvl->board[lvl->p_row][lvl->p_col-1] == MOVING_BLOCK)
-        {
-            /* To push a moving block, there must be space on the board,
-             * and that space must be empty. */
-            if (   lvl->p_col-2 >= 0 
-                && lvl->board[lvl->p_row][lvl->p_col-2] == EMPTY
-                && lvl->moving_block_check == FALSE)
+            val = state_slide(&space, board, &player, &bomb, 
+                action % SOLVE_BOMB);
+            
+            if (val == GOAL)
             {
-                /* Push the block back by swapping its position. */
-                int_swap(&lvl->board[lvl->p_row][lvl->p_col-2],
-                    &lvl->board[lvl->p_row][lvl->p_col-1]);
+                if (g + 1 < best)
+                {
+                    best = g + 1;
+                    goal_from = n;
+                    goal_action = action;
+                }
                 
-                return MOVING_BLOCK;
+                continue;
             }
             
-            /* If there is no space to push the block, it acts like a wall. */
-            else
+            if (val != TRUE || (h = space.dist[player]) == SOLVE_FAR)
             {
-                return FALSE;
+                continue;
             }
-        }
-        
-        /* Check to see if the player picks up a bomb. */
-        if (lvl->board[lvl->p_row][lvl->p_col-1] == BOMB_VAL)
-        {
-            /* Player moves over the bomb */
-            lvl->board[lvl->p_row][lvl->p_col-1] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
             
-            /* Adjust players position. */
-            lvl->p_col -= 1;
+            pack_state(&space, board, player, bomb, state);
             
-            /* Can only hold maximum of one bomb. Check if bomb already in
-             * inventory, and increment otherwise. */
-            if (lvl->bomb == FALSE)
+            if ((m = add_state(&table, state, n, action)) == STATE_FULL)
             {
-                lvl->bomb = TRUE;
+                full = TRUE;
+                break;
             }
-            /* If bomb is already in inventory, extra bomb was destoryed so
-             * display message. */
-            else
+            
+            if (m == STATE_FOUND)
             {
-                lvl->message_available = TRUE;
-                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+                m = find_state(&table, state);
+                
+                if (cost[m] <= g + 1)
+                {
+                    continue;
+                }
+                
+                table.from[m] = n;
+                table.action[m] = action;
+            }
+            else if (table.capacity > ncost)
+            {
+                if ((grown = realloc(cost, table.capacity 
+                        * sizeof(uint16_t))) == NULL)
+                {
+                    full = TRUE;
+                    break;
+                }
+                
+                cost = grown;
+                ncost = table.capacity;
             }
             
-            return BOMB_VAL;
-        }        
+            cost[m] = g + 1;
+            full = !heap_push(&heap, (uint64_t)(g + 1 + h) << 48 
+                | (uint64_t)(0xFFFF - g - 1) << 32 | m);
+        }
     }
     
-    /* Check to see if the player has moved right. */
-    if (move == RIGHT)
+    if (full)
     {
-        /* Check to see if there is space next to player. */
-        if (lvl->board[lvl->p_row][lvl->p_col+1] == EMPTY)
+        best = SOLVE_TOO_BIG;
+    }
+    else if (best == SOLVE_CANCELLED)
+    {
+        *moves = NULL;
+    }
+    else if (best != SOLVE_FAR)
+    {
+        best = state_moves(table.from, table.action, goal_from, goal_action, 
+            moves);
+    }
+    else
+    {
+        best = SOLVE_NO_SOLUTION;
+    }
+    
+    free(heap.entry);
+    free(cost);
+    free_state_table(&table);
+    
+    return best;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Searches depth first on from state g of the path of an IDA* search, 
+ * trying no more than its bound of moves to the goal, as estimated by the
+ * moves so far plus the distance from the player's cell. The next states 
+ * are tried nearest to the goal first, and those already on the path are
+ * skipped. Returns the number of moves if the goal is found, with the path 
+ * leading to it, SOLVE_NO_SOLUTION if not, SOLVE_TOO_BIG if more than 
+ * SOLVE_IDA_NODES states have been expanded, or SOLVE_CANCELLED.
+ */
+
+int
+ida_search(ida_search_t *ida, int g)
+{
+    uint64_t next[2 * SOLVE_BOMB][SOLVE_MAX_WORDS];
+    uint8_t board[SOLVE_MAX_NODES];
+    int h[2 * SOLVE_BOMB], act[2 * SOLVE_BOMB], order[2 * SOLVE_BOMB];
+    int nnext = 0, words = ida->space.words, action, player, bomb, val;
+    int i, j, f, result;
+    
+    if (++ida->nodes > SOLVE_IDA_NODES)
+    {
+        return SOLVE_TOO_BIG;
+    }
+    
+    if (ida->stop != NULL && *ida->stop)
+    {
+        return SOLVE_CANCELLED;
+    }
+    
+    for (action = 0; action < 2 * SOLVE_BOMB; action++)
+    {
+        unpack_state(&ida->space, ida->path[g], board, &player, &bomb);
+        
+        if (action >= SOLVE_BOMB)
         {
-            /* As there is empty space next to the player, move player by
-             * swapping the player and the empty space. */
-            int_swap(&lvl->board[lvl->p_row][lvl->p_col+1],
-                &lvl->board[lvl->p_row][lvl->p_col]);
-            
-            /* Adjust players position. */
-            lvl->p_col += 1;
+            if (!bomb)
+            {
+                break;
+            }
             
-            return TRUE;
+            state_blast(&ida->space, board, player);
+            bomb = FALSE;
         }
         
-        /* Check to see if there is a wall next to the player. */
-        if (lvl->board[lvl->p_row][lvl->p_col+1] == WALL ||
-            lvl->board[lvl->p_row][lvl->p_col+1] == WEAK_WALL)
-        {
-            return FALSE;
-        }
-
-        /* Check to see if the player has made it to the goal. */
-        if (lvl->board[lvl->p_row][lvl->p_col+1] == GOAL)
+        val = state_slide(&ida->space, board, &player, &bomb, 
+            action % SOLVE_BOMB);
+        
+        /* Every goal under the bound was looked for on the last pass, so 
+         * one found now is the nearest. */
+        if (val == GOAL && g + 1 <= ida->bound)
         {
-            /* Move the player onto the goal. */
-            lvl->board[lvl->p_row][lvl->p_col+1] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_col += 1;
-            
-            return GOAL;
+            ida->action[g] = action;
+            return g + 1;
         }
-
-        /* Check to see if the player has fallen into a hole. */
-        if (lvl->board[lvl->p_row][lvl->p_col+1] == HOLE)
+        
+        if (   val != GOAL 
+            && (val != TRUE || ida->space.dist[player] == SOLVE_FAR))
         {
-            /* Move player onto hole. */
-            lvl->board[lvl->p_row][lvl->p_col+1] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_col += 1;
-            
-            return HOLE;
+            continue;
         }
         
-        /* Check for a moving block. */
-        if (lvl->board[lvl->p_row][lvl->p_col+1] == MOVING_BLOCK)
+        f = (val == GOAL) ? g + 1 : g + 1 + ida->space.dist[player];
+        
+        if (f > ida->bound)
         {
-            /* To push a moving block, there must be space on the board,
-             * and that space must be empty. */
-            if (lvl->p_col+2 < lvl->cols && 
-                lvl->board[lvl->p_row][lvl->p_col+2] == EMPTY
-                && lvl->moving_block_check == FALSE)
-            {   
-                /* Push the block back by swapping its position. */
-                int_swap(&lvl->board[lvl->p_row][lvl->p_col+2],
-                    &lvl->board[lvl->p_row][lvl->p_col+1]);
-                
-                return MOVING_BLOCK;
-            }
-            
-            /* If there is no space to push the block, it acts like a wall. */
-            else
+            if (f < ida->next_bound)
             {
-                return FALSE;
+                ida->next_bound = f;
             }
+            
+            continue;
         }
         
-        /* Check to see if the player picks up a bomb. */
-        if (lvl->board[lvl->p_row][lvl->p_col+1] == BOMB_VAL)
+        pack_state(&ida->space, board, player, bomb, next[nnext]);
+        
+        for (j = 0; j <= g && memcmp(ida->path[j], next[nnext], 
+                words * sizeof(uint64_t)) != 0; j++)
+            ;
+        
+        if (j > g)
         {
-            /* Player moves over the bomb */
-            lvl->board[lvl->p_row][lvl->p_col+1] = PLAYER;
-            lvl->board[lvl->p_row][lvl->p_col] = EMPTY;
-            
-            /* Adjust players position. */
-            lvl->p_col += 1;
+            h[nnext] = ida->space.dist[player];
+            act[nnext] = action;
             
-            /* Can only hold maximum of one bomb. Check if bomb already in
-             * inventory, and increment otherwise. */
-            if (lvl->bomb == FALSE)
+            /* Keep the next states in order of distance. */
+            for (i = nnext; i > 0 && h[order[i - 1]] > h[nnext]; i--)
             {
-                lvl->bomb = TRUE;
-            }
-            /* If bomb is already in inventory, extra bomb was destoryed so
-             * display message. */
-            else
-            {
-                lvl->message_available = TRUE;
-                strcpy(lvl->message, BOMB_DESTROYED_MSG);
+                order[i] = order[i - 1];
             }
             
-            return BOMB_VAL;
+            order[i] = nnext++;
         }
     }
     
-    /* If no move is valid, return FALSE */
-    return FALSE;
+    for (i = 0; i < nnext; i++)
+    {
+        memcpy(ida->path[g + 1], next[order[i]], words * sizeof(uint64_t));
+        ida->action[g] = act[order[i]];
+        
+        if ((result = ida_search(ida, g + 1)) != SOLVE_NO_SOLUTION)
+        {
+            return result;
+        }
+    }
+    
+    return SOLVE_NO_SOLUTION;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Play special animation for player falling off the board, then reset the
- * level */
-
-#define FALL_TIME 500 /* Milliseconds. */
+/*
+ * Finds the fewest moves that beat a level by the full rules of the game,
+ * with an IDA* search, which keeps only the path it is on. Each pass 
+ * searches a little further than the last, until the goal is found. 
+ * Returns as solve_full(), or SOLVE_TOO_BIG if the moves would be more 
+ * than SOLVE_MAX_DEPTH or too many states were expanded.
+ */
 
-void
-hole(level_t *stored_lvl, level_t *lvl)
+int
+solve_ida(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop)
 {
-    /* Display level. This shows that the player has moved onto the hole. */    
-    disp_board(lvl);
-    Sleep(FALL_TIME);
+    ida_search_t *ida;
+    int result;
     
-    /* Change player icon and display the board again. */
-    lvl->board[lvl->p_row][lvl->p_col] = FALL_1_SYMBOL;
+    *moves = NULL;
+    *nodes = 0;
     
-    disp_board(lvl);
-    Sleep(FALL_TIME);
+    if ((ida = malloc(sizeof(ida_search_t))) == NULL)
+    {
+        return SOLVE_TOO_BIG;
+    }
     
-    /* Change player icon again, and display the board again. */
-    lvl->board[lvl->p_row][lvl->p_col] = FALL_2_SYMBOL;
+    if (!init_state_space(lvl, &ida->space, ida->path[0]))
+    {
+        free(ida);
+        return SOLVE_TOO_BIG;
+    }
     
-    disp_board(lvl);
-    Sleep(FALL_TIME);
+    init_distances(&ida->space, ida->space.nbombs > 0 || lvl->bomb);
+    ida->bound = ida->space.dist[lvl->p_row * ida->space.cols + lvl->p_col];
+    ida->nodes = 0;
+    ida->stop = stop;
+    result = SOLVE_NO_SOLUTION;
     
-    /* Replace player icon with the hole, as the player has now fallen in.
-     * Display the board again. */
-    lvl->board[lvl->p_row][lvl->p_col] = HOLE;
+    while (ida->bound != SOLVE_FAR)
+    {
+        if (ida->bound > SOLVE_MAX_DEPTH)
+        {
+            result = SOLVE_TOO_BIG;
+            break;
+        }
+        
+        ida->next_bound = SOLVE_FAR;
+        
+        if ((result = ida_search(ida, 0)) != SOLVE_NO_SOLUTION)
+        {
+            break;
+        }
+        
+        ida->bound = ida->next_bound;
+    }
     
-    disp_board(lvl);
-    Sleep(FALL_TIME);
+    if (result > 0)
+    {
+        result = action_moves(ida->action, result, moves);
+    }
     
-    /* Reset the level, and display again. */
-    *lvl = *stored_lvl;
+    *nodes = ida->nodes;
+    free(ida);
     
-    disp_board(lvl);
-    Sleep(TIME_BETWEEN_FRAMES);
+    return result;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns TRUE if a slide in direction dir on a static level would stop on
+ * cell, as the edge of the board or something other than empty space, the
+ * player's start, the goal or a hole is next to it.
+ */
+
+int
+slide_blocked(level_t *lvl, int cell, int dir)
+{
+    static const int dr[4] = {-1, 0, 1, 0};
+    static const int dc[4] = {0, 1, 0, -1};
+    int row = cell / BOARD_MAX_C + dr[dir], col = cell % BOARD_MAX_C + dc[dir];
+    int val;
     
-    return;
+    if (row < 0 || row >= lvl->rows || col < 0 || col >= lvl->cols)
+    {
+        return TRUE;
+    }
+    
+    val = lvl->board[row][col];
+    
+    return val != EMPTY && val != PLAYER && val != GOAL && val != HOLE;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Special board movements for moving block.
+ * Adds the cells a slide in direction dir reaches cell from, that the 
+ * backward side of a bidirectional search hasn't seen, to next. They are 
+ * the free cells in a line back from cell. to is the cell they lead to, 
+ * or SOLVE_GOAL if cell is the goal.
  */
 
 void
-moving_block(level_t *lvl, char direction)
+add_slide_starts(level_t *lvl, bidir_search_t *search, int cell, int to,
+    int dir, uint64_t *next)
 {
-    /* Display the board. This shows that the player has pushed the block back
-     * one spot. */
-    disp_board(lvl);
-    Sleep(TIME_BETWEEN_FRAMES);
-    
-    /* Move player again and display the level. The moving_block_check ensures
-     * that the block now acts as a wall, and that the player doesn't push it
-     * again. */
-    move(lvl, direction);
-    disp_board(lvl);
-    Sleep(TIME_BETWEEN_FRAMES);
+    static const int dr[4] = {-1, 0, 1, 0};
+    static const int dc[4] = {0, 1, 0, -1};
+    int row = cell / BOARD_MAX_C - dr[dir], col = cell % BOARD_MAX_C - dc[dir];
+    int from;
+    
+    while (   row >= 0 && row < lvl->rows && col >= 0 && col < lvl->cols
+           && (lvl->board[row][col] == EMPTY 
+               || lvl->board[row][col] == PLAYER))
+    {
+        from = row * BOARD_MAX_C + col;
+        
+        if (!(search->seen[1][from / 64] >> (from % 64) & 1))
+        {
+            search->seen[1][from / 64] |= (uint64_t)1 << (from % 64);
+            next[from / 64] |= (uint64_t)1 << (from % 64);
+            search->depth[1][from] = (to == SOLVE_GOAL) 
+                ? 1 : search->depth[1][to] + 1;
+            search->link[1][from] = to;
+            search->by[1][from] = dir;
+        }
+        
+        row -= dr[dir];
+        col -= dc[dir];
+    }
     
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Checks if the player is next to a moving block.
+ * Returns the number of cells in a set of cells.
  */
 
 int
-moving_block_check(level_t *lvl)
+count_cells(const uint64_t *set)
 {
-    int i, j;
+    int w, n = 0;
+    uint64_t bits;
     
-    for (i = -1; i <= 1; i++)
+    for (w = 0; w < SOLVE_SET_WORDS; w++)
     {
-        for (j = -1; j <= 1; j++)
+        for (bits = set[w]; bits != 0; bits &= bits - 1)
         {
-            if (lvl->board[lvl->p_row + i][lvl->p_col + j] == MOVING_BLOCK)
-            {
-                /* Moving block found. */
-                return TRUE;
-            }
+            n++;
         }
     }
     
-    return FALSE;
+    return n;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Use bomb. Checks blocks surrounding player, and destorys them if possible.
+ * Finds the fewest moves that beat a static level, with a breadth first 
+ * search forward from the player's start and another backward from the 
+ * goal, each a layer at a time from whichever frontier is smaller, until
+ * they meet. A layer is finished before checking where they meet, so the
+ * meeting with the fewest moves is the nearest. Returns as solve_full(),
+ * or SOLVE_NOT_STATIC.
  */
 
-void
-use_bomb(level_t *lvl)
+int
+solve_bidir(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop)
 {
-    int i, j;
+    static const char dirs[4] = {UP, RIGHT, DOWN, LEFT};
+    bidir_search_t search;
+    uint64_t next[SOLVE_SET_WORDS], bits;
+    int cell, to, dir, side, w, b, i, j, len, best = SOLVE_FAR, meet = 0;
     
-    /* Search 3x3 kernel centered around Player. Remove blocks if breakable. */
-    for (i = -1; i <= 1; i++)
+    *moves = NULL;
+    *nodes = 0;
+    
+    if (!is_static_level(lvl))
     {
-        for (j = -1; j <= 1; j++)
+        return SOLVE_NOT_STATIC;
+    }
+    
+    memset(&search, 0, sizeof(search));
+    
+    cell = lvl->p_row * BOARD_MAX_C + lvl->p_col;
+    search.seen[0][cell / 64] |= (uint64_t)1 << (cell % 64);
+    search.frontier[0][cell / 64] |= (uint64_t)1 << (cell % 64);
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < lvl->cols; j++)
         {
-            /* Check if location on board is breakable. */
-            if (lvl->board[lvl->p_row+j][lvl->p_col+i] == WEAK_WALL ||
-                lvl->board[lvl->p_row+j][lvl->p_col+i] == MOVING_BLOCK)
+            for (dir = 0; dir < 4 && lvl->board[i][j] == GOAL; dir++)
             {
-                /* Set location in level to empty. */
-                lvl->board[lvl->p_row+j][lvl->p_col+i] = EMPTY;
+                add_slide_starts(lvl, &search, i * BOARD_MAX_C + j, 
+                    SOLVE_GOAL, dir, search.frontier[1]);
             }
         }
     }
     
-    /* Show animation of bomb */
-    bomb_animation(*lvl);
-    
-    /* Bomb has been used, so remove it from the inventory. */
-    lvl->bomb = FALSE;
-    
-    return;
-} 
-
-/*---------------------------------------------------------------------------*/
-/*
- * Shows bomb animation. Local copy of level so that animation can be drawn
- * over level without changing board values.
- */
- 
-void
-bomb_animation(level_t lvl)
-{
-    /* Animations are 3x3 grids centred around player. */
-    char animation[][3][3]  = {
-        { {BOMB1_00, BOMB1_10, BOMB1_20},
-          {BOMB1_01, BOMB1_11, BOMB1_21},
-          {BOMB1_02, BOMB1_12, BOMB1_22} },
-        
-        { {BOMB2_00, BOMB2_10, BOMB2_20},
-          {BOMB2_01, BOMB2_11, BOMB2_21},
-          {BOMB2_02, BOMB2_12, BOMB2_22} }
-    };
-
-    int n, i, j, n_animations = 2;
- 
-    /* Store level copy for clearing animation. */
-    level_t lvl_copy = lvl;
+    /* The start may already be one slide from the goal. */
+    side = 1;
     
-    for (n = 0; n < n_animations; n++)
+    while (best == SOLVE_FAR)
     {
-        /* Clear animation. */
-        lvl = lvl_copy;
+        for (w = 0; w < SOLVE_SET_WORDS; w++)
+        {
+            for (bits = search.frontier[side][w] & search.seen[!side][w];
+                 bits != 0; bits &= bits - 1)
+            {
+                for (b = 0; !(bits >> b & 1); b++)
+                    ;
+                
+                cell = w * 64 + b;
+                
+                if (search.depth[0][cell] + search.depth[1][cell] < best)
+                {
+                    best = search.depth[0][cell] + search.depth[1][cell];
+                    meet = cell;
+                }
+            }
+        }
         
-        /* Search 3x3 kernel centered around Player.  */
-        for (i = -1; i <= 1; i++)
+        if (   best != SOLVE_FAR 
+            || count_cells(search.frontier[0]) == 0
+            || count_cells(search.frontier[1]) == 0)
         {
-            for (j = -1; j <= 1; j++)
+            break;
+        }
+        
+        if (stop != NULL && *stop)
+        {
+            return SOLVE_CANCELLED;
+        }
+        
+        side = count_cells(search.frontier[1]) 
+             < count_cells(search.frontier[0]);
+        memset(next, 0, sizeof(next));
+        
+        for (w = 0; w < SOLVE_SET_WORDS; w++)
+        {
+            for (bits = search.frontier[side][w]; bits != 0; 
+                 bits &= bits - 1)
             {
-                /* Check if explosion should only be displayed if squares are 
-                 * empty or have holes. */
-                if (lvl.board[lvl.p_row+j][lvl.p_col+i] == EMPTY ||
-                    lvl.board[lvl.p_row+j][lvl.p_col+i] == HOLE)
+                for (b = 0; !(bits >> b & 1); b++)
+                    ;
+                
+                cell = w * 64 + b;
+                (*nodes)++;
+                
+                for (dir = 0; dir < 4; dir++)
                 {
-                    /* Background shouldn't be replaced if animation is the
-                     * null character. */
-                    if (animation[n][1+i][1+j] != 0)
+                    if (side == 1)
                     {
-                        /* Replace location with relevant explosion
-                         * animation. */
-                        lvl.board[lvl.p_row+j][lvl.p_col+i] 
-                            = animation[n][1+i][1+j];
+                        if (slide_blocked(lvl, cell, dir))
+                        {
+                            add_slide_starts(lvl, &search, cell, cell, dir,
+                                next);
+                        }
+                        
+                        continue;
+                    }
+                    
+                    to = slide_stop(lvl, cell, dir);
+                    
+                    if (   to != SOLVE_GOAL && to != SOLVE_NONE
+                        && !(search.seen[0][to / 64] >> (to % 64) & 1))
+                    {
+                        search.seen[0][to / 64] |= (uint64_t)1 << (to % 64);
+                        next[to / 64] |= (uint64_t)1 << (to % 64);
+                        search.depth[0][to] = search.depth[0][cell] + 1;
+                        search.link[0][to] = cell;
+                        search.by[0][to] = dir;
                     }
                 }
             }
         }
+        
+        memcpy(search.frontier[side], next, sizeof(next));
+    }
     
-        /* Display the board. */
-        disp_board(&lvl);
+    if (best == SOLVE_FAR)
+    {
+        return SOLVE_NO_SOLUTION;
+    }
     
-        /* Wait so that animation can be seen. */
-        Sleep(TIME_BETWEEN_FRAMES);
+    if ((*moves = malloc(best + 1)) == NULL)
+    {
+        return SOLVE_TOO_BIG;
     }
     
-    return;
-}
-
-/*---------------------------------------------------------------------------*/
-/*
- * Title screen.
- */
-
-void
-title_screen(void)
-{
-    int i;
+    (*moves)[best] = '\0';
     
-    /* ASCII art from patorjk.com, font name: AMC Slider. */
-    char *title[] = {    
-"-----------------------------------------------------------------------------",
-" ",
-" ",
-" ",
-"                                               ____                         ",
-"                  ..'''' |        | |``````.  |            |`````````,      ",
-"               .''       |        | |       | |______      |'''|'''''       ",
-"            ..'          |        | |       | |            |    `.          ",
-"      ....''             |_______ | |......'  |___________ |      `.        ",
-" ",
-"                                             By Mischka Kamener, 2014",
-" ",
-" ",
-"      Adjust screen height, then press any key to play",
-    NULL};
+    /* The forward half is walked back from where the searches met, and 
+     * the backward half on from there to the goal. */
+    for (len = search.depth[0][meet], cell = meet; len > 0; 
+         cell = search.link[0][cell])
+    {
+        (*moves)[--len] = dirs[search.by[0][cell]];
+    }
     
-    /* Create enough new lines so that the termainal buffer is erased. */
-    for(i = 0; i < 15; i++)
+    for (len = search.depth[0][meet], cell = meet; cell != SOLVE_GOAL;
+         cell = search.link[1][cell])
     {
-        clear_screen();
+        (*moves)[len++] = dirs[search.by[1][cell]];
     }
-
-    /* Display the title. */
-    print_message_screen(title);
-
-    /* Wait for input. */
-    getch();
     
-    return;
+    return best;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Shows controls for the game.
+/*
+ * Adds state n of the pool of a parallel search to its set of states, 
+ * unless an equal state is there already. The state is written before its
+ * slot is claimed, and the compare and swap that claims it is a full 
+ * barrier, while volatile reads of the slots acquire, so any thread that 
+ * sees the slot sees the state. Returns TRUE if the state was added.
  */
 
-void
-how_to_play(void)
+int
+insert_parallel_state(parallel_bfs_t *bfs, uint32_t n)
 {
-    /* Pointer to string array for how to play screen. */
-    char *how_to_play[] = {
-" ",
-" ",
-"     HOW TO PLAY:",
-" ",
-"       You are Slider (O), get the tresure (X)!",
-" ",
-"     CONTROLS:",
-" ",
-"           w",
-"       a    s   d   :   MOVE",
-" ",
-"       x:   USE BOMB",
-"       q:   QUIT     r:   RESTART LEVEL",
-" ",
-" ",
-" ",
-" ",
-"       Press any key to return to menu.",
-    NULL};
-    
-    /* Display the how to play screen. */
-    print_message_screen(how_to_play);
+    const uint64_t *state = bfs->state + (size_t)n * bfs->space.words;
+    uint32_t i;
+    LONG seen;
     
-    /* Wait for input to exit screen. */
-    getch();
+    for (i = state_key(state, bfs->space.words) & bfs->mask; ; 
+         i = (i + 1) & bfs->mask)
+    {
+        if (   (seen = bfs->slot[i]) == 0
+            && (seen = InterlockedCompareExchange(&bfs->slot[i], n + 1, 0))
+               == 0)
+        {
+            return TRUE;
+        }
+        
+        if (memcmp(bfs->state + (size_t)(seen - 1) * bfs->space.words, 
+                state, bfs->space.words * sizeof(uint64_t)) == 0)
+        {
+            return FALSE;
+        }
+    }
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Checks board value against symbol type, and prints the appropriate one.
+ * Job function for solve_parallel(). Expands the job's share of the layer,
+ * adding the new states to its own list. Stops early once any job reaches
+ * the goal, as every goal found in a layer is as near as any other.
  */
 
 void
-disp_board_element(int board_value)
+expand_layer(void *ctx, int job)
 {
-    /* Empty space. */
-    if(board_value == EMPTY)
+    parallel_bfs_t *bfs = ctx;
+    layer_job_t *mine = &bfs->jobs[job];
+    uint8_t board[SOLVE_MAX_NODES];
+    uint32_t i, n, *grown;
+    uint32_t last = (uint32_t)((uint64_t)bfs->nlayer * (job + 1) / bfs->njobs);
+    int action, player, bomb, val, words = bfs->space.words;
+    
+    mine->nfound = 0;
+    
+    for (i = (uint32_t)((uint64_t)bfs->nlayer * job / bfs->njobs); 
+         i < last && !bfs->goal && !bfs->full 
+         && (bfs->stop == NULL || !*bfs->stop); i++)
     {
-        putchar(EMPTY_SYMBOL);
-    } 
+        n = bfs->layer[i];
+        
+        for (action = 0; action < 2 * SOLVE_BOMB; action++)
+        {
+            unpack_state(&bfs->space, bfs->state + (size_t)n * words, 
+                board, &player, &bomb);
             
-    /* Wall. */ 
-    else if(board_value == WALL)
-    {
-        putchar(WALL_SYMBOL);
-    }
+            if (action >= SOLVE_BOMB)
+            {
+                if (!bomb)
+                {
+                    break;
+                }
+                
+                state_blast(&bfs->space, board, player);
+                bomb = FALSE;
+            }
             
-    /* Goal. */
-    else if(board_value == GOAL)
-    {
-        putchar(GOAL_SYMBOL);
-    }
+            val = state_slide(&bfs->space, board, &player, &bomb, 
+                action % SOLVE_BOMB);
             
-    /* Player. */
-    else if(board_value == PLAYER)
-    {
-        putchar(PLAYER_SYMBOL);
-    }
+            if (val == GOAL)
+            {
+                InterlockedCompareExchange(&bfs->goal, n * 8 + action + 1, 
+                    0);
+                return;
+            }
             
-    /* Moving block. */
-    else if(board_value == MOVING_BLOCK)
-    {
-        putchar(MOVING_BLOCK_SYMBOL);
-    } 
+            if (   val != TRUE 
+                || bfs->space.dead[player / 64] >> (player % 64) & 1)
+            {
+                continue;
+            }
             
-    /* Hole. */
-    else if(board_value == HOLE)
-    {
-        putchar(HOLE_SYMBOL);
-    }
+            /* Claim more of the pool. */
+            if (mine->next == mine->end)
+            {
+                mine->next = InterlockedExchangeAdd(&bfs->used, SOLVE_CHUNK);
+                mine->end = mine->next + SOLVE_CHUNK;
+                
+                if (mine->end > bfs->capacity)
+                {
+                    mine->next = mine->end;
+                    bfs->full = TRUE;
+                    return;
+                }
+            }
             
-    /* Weak wall. */
-    else if(board_value == WEAK_WALL)
-    {
-        putchar(WEAK_WALL_SYMBOL);
-    }
+            pack_state(&bfs->space, board, player, bomb, 
+                bfs->state + (size_t)mine->next * words);
+            bfs->from[mine->next] = n;
+            bfs->action[mine->next] = action;
             
-    /* Bomb. */
-    else if(board_value == BOMB_VAL)
-    {
-        putchar(BOMB_SYMBOL);
-    }
-                      
-    /* All other values are printed using their character value. */
-    else
-    {
-        putchar(board_value);
+            /* A state that was already found leaves its room in the pool
+             * for the next. */
+            if (!insert_parallel_state(bfs, mine->next))
+            {
+                continue;
+            }
+            
+            if (mine->nfound == mine->size)
+            {
+                if ((grown = realloc(mine->found, (mine->size 
+                        ? mine->size * 2 : MIN_TABLE_SIZE) 
+                        * sizeof(uint32_t))) == NULL)
+                {
+                    bfs->full = TRUE;
+                    return;
+                }
+                
+                mine->found = grown;
+                mine->size = mine->size ? mine->size * 2 : MIN_TABLE_SIZE;
+            }
+            
+            mine->found[mine->nfound++] = mine->next++;
+        }
     }
-
+    
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Displays the current board.
+ * Finds the fewest moves that beat a level by the full rules of the game,
+ * with a breadth first search that expands each layer on every core. The
+ * pool of states is sized to SOLVE_MEMORY up front. Returns as 
+ * solve_full().
  */
 
-void 
-disp_board(level_t *level)
+int
+solve_parallel(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop)
 {
-    int i, j;
-
-    /* Clear the screen. */
-    clear_screen();
+    parallel_bfs_t bfs;
+    uint64_t start[SOLVE_MAX_WORDS];
+    uint32_t total, *grown;
+    int j, result = SOLVE_TOO_BIG;
+    size_t per_state;
     
-    /* If there is a message, display it here above the board. */
-    if (level->message_available == TRUE)
+    *moves = NULL;
+    *nodes = 0;
+    memset(&bfs, 0, sizeof(bfs));
+    
+    if (!init_state_space(lvl, &bfs.space, start))
     {
-        /* Centre board columns. Pad screen on the left depending on the board
-         * size. */
-        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        return SOLVE_TOO_BIG;
+    }
+    
+    /* Each state has its words, where it came from and how, and two 
+     * slots. */
+    per_state = bfs.space.words * sizeof(uint64_t) + sizeof(uint32_t) + 1
+              + 2 * sizeof(LONG);
+    
+    for (bfs.capacity = MIN_TABLE_SIZE; 
+         2 * (size_t)bfs.capacity * per_state <= SOLVE_MEMORY; 
+         bfs.capacity *= 2)
+        ;
+    
+    bfs.mask = 2 * bfs.capacity - 1;
+    bfs.njobs = count_cores() * SOLVE_JOBS_PER_CORE;
+    bfs.state = malloc((size_t)bfs.capacity * bfs.space.words 
+                       * sizeof(uint64_t));
+    bfs.from = malloc(bfs.capacity * sizeof(uint32_t));
+    bfs.action = malloc(bfs.capacity);
+    bfs.slot = calloc(2 * bfs.capacity, sizeof(LONG));
+    bfs.layer = malloc(sizeof(uint32_t));
+    bfs.jobs = calloc(bfs.njobs, sizeof(layer_job_t));
+    
+    if (   bfs.state != NULL && bfs.from != NULL && bfs.action != NULL
+        && bfs.slot != NULL && bfs.layer != NULL && bfs.jobs != NULL)
+    {
+        /* The start is state 0. */
+        memcpy(bfs.state, start, bfs.space.words * sizeof(uint64_t));
+        insert_parallel_state(&bfs, 0);
+        bfs.used = 1;
+        bfs.layer[0] = 0;
+        bfs.nlayer = 1;
+        bfs.stop = stop;
+        result = SOLVE_NO_SOLUTION;
+    }
+    
+    while (result == SOLVE_NO_SOLUTION && bfs.nlayer > 0)
+    {
+        run_parallel(expand_layer, &bfs, bfs.njobs);
+        *nodes += bfs.nlayer;
+        
+        if (bfs.full)
         {
-            printf(" ");
+            result = SOLVE_TOO_BIG;
+            break;
         }
         
-        /* Print message. */
-        printf("%s\n", level->message);
-    }
-    
-    /* Loop through all screen elements */ 
-    for(i = 0; i < level->rows; i++)
-    {    
-        /* Centre board columns. Pad screen on the left depending on the board
-         * size. */
-        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        if (stop != NULL && *stop)
         {
-            printf(" ");
+            result = SOLVE_CANCELLED;
+            break;
         }
         
-        /* Print board elements. */
-        for(j = 0; j < level->cols; j++)
+        if (bfs.goal)
         {
-            disp_board_element( level->board[i][j] );                        
+            result = state_moves(bfs.from, bfs.action, 
+                (uint32_t)(bfs.goal - 1) / 8, (bfs.goal - 1) % 8, moves);
+            break;
         }
         
-        /* Display move count on first row. */
-        if (i == 0)
+        /* The layer is finished, so the jobs' lists become the next. */
+        for (total = 0, j = 0; j < bfs.njobs; j++)
         {
-            printf(" %2d", level->nmoves); 
-            
-            /* Display bomb symbol if bomb is in inventory. */
-            if (level->bomb)
-            {
-                printf("  %c", BOMB_SYMBOL);
-            }
+            total += bfs.jobs[j].nfound;
         }
         
-        /* Display game instructions on right of board, only if the board is
-         * big enough. */
-        if(level->rows > 6)
+        if ((grown = realloc(bfs.layer, (total + 1) * sizeof(uint32_t))) 
+            == NULL)
         {
-            if (   i == level->rows - 5)
+            result = SOLVE_TOO_BIG;
+            break;
+        }
+        
+        bfs.layer = grown;
+        
+        for (bfs.nlayer = 0, j = 0; j < bfs.njobs; j++)
+        {
+            memcpy(bfs.layer + bfs.nlayer, bfs.jobs[j].found, 
+                bfs.jobs[j].nfound * sizeof(uint32_t));
+            bfs.nlayer += bfs.jobs[j].nfound;
+        }
+    }
+    
+    for (j = 0; bfs.jobs != NULL && j < bfs.njobs; j++)
+    {
+        free(bfs.jobs[j].found);
+    }
+    
+    free(bfs.jobs);
+    free(bfs.layer);
+    free((void *)bfs.slot);
+    free(bfs.action);
+    free(bfs.from);
+    free(bfs.state);
+    
+    return result;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Task for the audit tool. Looks up level task of the pack in the solution
+ * cache, or else solves it, on its stop graph if it is static and with A*
+ * otherwise, and caches the result. Keeps the moves in the worker's arena.
+ */
+
+void
+audit_level(void *ctx, sched_worker_t *worker, int task, 
+    volatile LONG *stop)
+{
+    pack_tasks_t *tasks = ctx;
+    audit_result_t *res = (audit_result_t *)tasks->result + task;
+    char buf[SOLVE_MAX_NODES + 1], *moves = buf, *full = NULL;
+    DWORD start = GetTickCount();
+    level_t lvl;
+    solution_t sol;
+    
+    get_level(tasks->pack, task, &lvl);
+    
+    if ((res->cached = find_solution(&lvl, &sol, TRUE)))
+    {
+        res->moves = sol.moves;
+        res->nodes = sol.nodes;
+        res->time = sol.time;
+        moves = sol.solution;
+    }
+    else
+    {
+        if ((res->moves = solve_level(&lvl, buf)) == SOLVE_NOT_STATIC)
+        {
+            res->moves = solve_astar(&lvl, &full, &res->nodes, stop);
+            moves = full;
+        }
+        
+        res->time = GetTickCount() - start;
+        store_solution(&lvl, res->moves, moves, res->nodes, res->time);
+    }
+    
+    res->worker = worker->index;
+    res->solution = ARENA_FAILED;
+    
+    if (res->moves > 0)
+    {
+        res->solution = arena_alloc(&worker->arena, strlen(moves) + 1);
+        
+        if (res->solution != ARENA_FAILED)
+        {
+            strcpy((char *)worker->arena.base + res->solution, moves);
+        }
+    }
+    
+    free(full);
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Solves a level with a breadth first search that keeps its layers in 
+ * files, so that it may find more states than fit in memory. It writes a
+ * checkpoint after every layer, and a search of the same level that was 
+ * stopped, or killed, goes on from the last one. Returns the fewest moves,
+ * SOLVE_NO_SOLUTION, SOLVE_TOO_BIG if the files couldn't be written, or 
+ * SOLVE_CANCELLED if stop was set, in which case the files are kept.
+ */
+
+int
+solve_external(level_t *lvl, char **moves, uint64_t *nodes, 
+    volatile LONG *stop)
+{
+    ext_search_t ext;
+    layout_t layout;
+    level_keys_t keys;
+    uint64_t start[SOLVE_MAX_WORDS], ncandidates;
+    int64_t nfound;
+    int result = SOLVE_TOO_BIG;
+    
+    *moves = NULL;
+    *nodes = 0;
+    memset(&ext, 0, sizeof(ext));
+    
+    if (!init_state_space(lvl, &ext.space, start))
+    {
+        return SOLVE_TOO_BIG;
+    }
+    
+    get_layouts(lvl, &layout, NULL, &keys);
+    ext.key = keys.key;
+    ext.state_size = ext.space.words * sizeof(uint64_t);
+    ext.rec_size = ext.state_size + sizeof(ext_link_t);
+    ext.buffer_size = EXT_MEMORY / 2 / ext.rec_size;
+    
+    for (ext.bloom_mask = 64; 
+         ext.bloom_mask * 2 <= (uint64_t)EXT_MEMORY / 4 * 8; 
+         ext.bloom_mask *= 2)
+        ;
+    
+    ext.bloom = calloc(ext.bloom_mask / 64, sizeof(uint64_t));
+    ext.buffer = malloc(ext.buffer_size * ext.rec_size);
+    ext.bloom_mask--;
+    
+    if (   ext.bloom != NULL && ext.buffer != NULL
+        && (resume_search(&ext, start) || start_search(&ext, start)))
+    {
+        while ((result = expand_external(&ext, moves, stop)) 
+               == SOLVE_NO_SOLUTION)
+        {
+            if (   !merge_runs(&ext, 0, EXT_CANDIDATE_FILE, &ncandidates)
+                || (nfound = drop_seen(&ext, ncandidates)) < 0)
             {
-                printf("  MOVE     = %c%c%c%c", UP, LEFT, DOWN, RIGHT);
+                result = SOLVE_TOO_BIG;
+                break;
             }
-            /* Only display bomb help when bomb is available. */
-            if (i == level->rows-4 && level->bomb)
+            
+            /* Nothing new was found, so every state has been seen. */
+            if (nfound == 0)
             {
-                printf("  USE BOMB = %c", BOMB_INPUT);
+                break;
             }
             
-            if (i == level->rows-2)
+            ext.nlayers++;
+            
+            if (!write_checkpoint(&ext))
             {
-                printf("  RESTART  = %c", RESTART);
+                result = SOLVE_TOO_BIG;
+                break;
             }
+        }
         
-            if (i == level->rows-1)
-            {
-                printf("  QUIT     = %c", QUIT);
-            }
+        remove_runs(&ext);
+        
+        if (result != SOLVE_CANCELLED)
+        {
+            remove_search(&ext);
         }
+    }
+    
+    *nodes = ext.nodes;
+    free(ext.buffer);
+    free(ext.bloom);
+    
+    return result;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the name of a file of an external search, numbered n, to name, 
+ * which must be MAX_PATH long. Returns TRUE if it fit.
+ */
+
+int
+ext_name(ext_search_t *ext, char *name, uint32_t n, const char *suffix)
+{
+    int len;
+    
+    len = snprintf(name, MAX_PATH, "%s\\%016" PRIx64 "-%lu%s", EXT_DIR, 
+        ext->key, (unsigned long)n, suffix);
+    
+    return len > 0 && len < MAX_PATH;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a state to the Bloom filter of an external search. Returns FALSE if
+ * it can't have been added before, and TRUE if it may have been.
+ */
+
+int
+bloom_check_add(ext_search_t *ext, const uint64_t *state)
+{
+    uint64_t hash = FNV_OFFSET, step, bit;
+    int i, found = TRUE;
+    
+    for (i = 0; i < ext->space.words; i++)
+    {
+        hash = (hash ^ state[i]) * FNV_PRIME;
+    }
+    
+    /* The bits are a fixed, odd step apart, both from the one hash. */
+    step = (hash >> 32) | 1;
+    hash ^= hash >> 29;
+    
+    for (i = 0; i < EXT_HASHES; i++)
+    {
+        bit = (hash + i * step) & ext->bloom_mask;
         
-        printf("\n");
+        if ((ext->bloom[bit / 64] & (1ULL << bit % 64)) == 0)
+        {
+            ext->bloom[bit / 64] |= 1ULL << bit % 64;
+            found = FALSE;
+        }
+    }
+    
+    return found;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Sorts n records of size bytes by their first key_size bytes, in place, 
+ * with a heap sort.
+ */
+
+void
+sort_records(uint8_t *rec, size_t n, size_t size, size_t key_size)
+{
+    size_t i;
+    
+    if (n < 2)
+    {
+        return;
     }
     
-    /* Centre board rows. */
-    for(i = 0; i < ((SCREEN_MAX_R - (level->rows)) / 2); i++)
+    for (i = n / 2; i-- > 0; )
     {
-            printf("\n");
+        sift_record(rec, i, n, size, key_size);
     }
     
-    /* Flush output to screen. */
-    fflush( stdout );
+    for (i = n - 1; i > 0; i--)
+    {
+        swap_records(rec, rec + i * size, size);
+        sift_record(rec, 0, i, size, key_size);
+    }
     
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Prints victory screen - treasure chest art taken from 
- * ascii.co.uk/art/treasure.
+ * Moves record root of a heap of n records down until it is no smaller 
+ * than those below it.
  */
 
-void 
-victory_screen(void)
+void
+sift_record(uint8_t *rec, size_t root, size_t n, size_t size, 
+    size_t key_size)
 {
-    /* ASCII art from patorjk.com, font name: Slant. */
-    char *success[] = {
-" ",
-" ",
-"         _____ __  ______________________________ __",
-"        / ___// / / / ____/ ____/ ____/ ___/ ___// /",
-"        \\__ \\/ / / / /   / /   / __/  \\__ \\\\__ \\/ /",
-"       ___/ / /_/ / /___/ /___/ /___ ___/ /__/ /_/",
-"      /____/\\____/\\____/\\____/_____//____/____(_)",
-" ",
-"      Press any key to continue              _",
-"                                            ( )         ()     __________",
-"                                            ||  ,-**-,  ||    /\\____;;___\\",
-"                                            \\\\*'      '*//   | /         /",
-"                                             *    $  $  *    `. ())oo() .",
-"                                             *     __   *     |\\(%()*^^()^\\",
-"                                              *,   \\/ ,*     %| |-%-------|",
-"                                                `*`*`*      % \\ | %  ))   |",
-"                                                            %  \\|%________|",
-"                                                             %%%%",
-    NULL};
-
-    print_message_screen(success);
+    size_t child;
     
-    /* Wait for player to enter key. */
-    getch();
+    while ((child = 2 * root + 1) < n)
+    {
+        if (   child + 1 < n 
+            && memcmp(rec + child * size, rec + (child + 1) * size, 
+                      key_size) < 0)
+        {
+            child++;
+        }
+        
+        if (memcmp(rec + root * size, rec + child * size, key_size) >= 0)
+        {
+            return;
+        }
+        
+        swap_records(rec + root * size, rec + child * size, size);
+        root = child;
+    }
     
     return;
 }
-    
+
 /*---------------------------------------------------------------------------*/
 /*
- * Clears the screen by printing new lines.
+ * Swaps two records of size bytes.
  */
 
 void
-clear_screen(void)
+swap_records(uint8_t *a, uint8_t *b, size_t size)
 {
-    int i;
-    for(i = 0; i < SCREEN_MAX_R; i++)
+    uint8_t t;
+    
+    while (size-- > 0)
     {
-        printf("\n");
+        t = *a;
+        *a++ = *b;
+        *b++ = t;
     }
     
-    /* Flush output to screen. */
-    fflush( stdout );
-    
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Prints an array of strings, and then prints remaining new lines. Used with
- * permission from Alistair Moffatt. */
+ * Starts an external search from the start state, with it as the only 
+ * state of layer 0. Returns FALSE if its files couldn't be written.
+ */
 
-void
-print_message_screen(char *msg[])
+int
+start_search(ext_search_t *ext, const uint64_t *start)
 {
-    int i, new_lines = 0;
+    char name[MAX_PATH];
+    ext_link_t link;
+    FILE *fp;
+    int ok;
     
-    /* Clear the screen */
-    clear_screen();
+    /* Fails harmlessly if the directory is already there. */
+    CreateDirectory(EXT_DIR, NULL);
     
-    /* Array of pointers has NULL as final element. This is used as a sentinel
-     * to determine when to finish printing. */
-    while(*msg)
+    memset(&link, 0, sizeof(link));
+    
+    if (   !ext_name(ext, name, 0, EXT_LAYER_FILE)
+        || (fp = fopen(name, "wb")) == NULL)
     {
-        printf("%s\n", *msg);
+        return FALSE;
+    }
+    
+    ok = (   fwrite(start, ext->state_size, 1, fp) == 1
+          && fwrite(&link, sizeof(link), 1, fp) == 1);
+    
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    bloom_check_add(ext, start);
+    ext->nlayers = 1;
+    ext->nodes = 0;
+    
+    return ok && write_checkpoint(ext);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Goes on with an external search from its checkpoint, filling the Bloom
+ * filter again from its layers. Returns FALSE if there is no checkpoint,
+ * or it isn't of a search from the start state.
+ */
+
+int
+resume_search(ext_search_t *ext, const uint64_t *start)
+{
+    char name[MAX_PATH];
+    uint64_t rec[SOLVE_MAX_WORDS + 1];
+    ext_checkpoint_t ckp;
+    uint32_t layer;
+    size_t len = 0;
+    FILE *fp;
+    int ok;
+    
+    if (   !ext_name(ext, name, 0, EXT_CHECKPOINT_FILE)
+        || (fp = fopen(name, "rb")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    ok = (   fread(&ckp, sizeof(ckp), 1, fp) == 1
+          && memcmp(ckp.magic, EXT_MAGIC, LVB_MAGIC_LEN) == 0
+          && ckp.version == EXT_VERSION
+          && ckp.key == ext->key
+          && ckp.words == (uint32_t)ext->space.words
+          && ckp.nlayers > 0);
+    fclose(fp);
+    
+    /* Every layer must be whole, and the first just the start. */
+    for (layer = 0; ok && layer < ckp.nlayers; layer++)
+    {
+        if (   !ext_name(ext, name, layer, EXT_LAYER_FILE)
+            || (fp = fopen(name, "rb")) == NULL)
+        {
+            ok = FALSE;
+            break;
+        }
         
-        /* Move along in the array. */
-        msg++;
+        while ((len = fread(rec, 1, ext->rec_size, fp)) == ext->rec_size)
+        {
+            bloom_check_add(ext, rec);
+        }
         
-        /* Count the number of lines printed. */
-        new_lines++;
+        ok = (   len == 0 && !ferror(fp)
+              && (   layer != 0 || ftell(fp) == (long)ext->rec_size)
+              && ftell(fp) != 0);
+        
+        if (ok && layer == 0)
+        {
+            rewind(fp);
+            ok = (   fread(rec, ext->state_size, 1, fp) == 1
+                  && memcmp(rec, start, ext->state_size) == 0);
+        }
+        
+        fclose(fp);
     }
     
-    for(i = 1; i <= (SCREEN_MAX_R - new_lines); i++)
+    if (!ok)
     {
-        printf("\n");
+        memset(ext->bloom, 0, (ext->bloom_mask + 1) / 8);
+        return FALSE;
     }
     
-    /* Flush output to screen. */
-    fflush( stdout );
+    ext->nlayers = ckp.nlayers;
+    ext->nodes = ckp.nodes;
     
-    return;
+    return TRUE;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Prints pack select screen.
+/*
+ * Writes the checkpoint of an external search, through a temporary file so
+ * that a search killed while writing it still has the one before. Returns
+ * TRUE if written.
  */
 
-void 
-print_pack_select(all_packs_t *all_packs)
+int
+write_checkpoint(ext_search_t *ext)
 {
-    int i, j, k, beaten = 0;
+    char name[MAX_PATH], temp[MAX_PATH + 16];
+    ext_checkpoint_t ckp;
+    FILE *fp;
+    int ok;
+    
+    if (!ext_name(ext, name, 0, EXT_CHECKPOINT_FILE))
+    {
+        return FALSE;
+    }
+    
+    snprintf(temp, sizeof(temp), "%s%s", name, TEMP_FILE);
+    
+    memset(&ckp, 0, sizeof(ckp));
+    memcpy(ckp.magic, EXT_MAGIC, LVB_MAGIC_LEN);
+    ckp.version = EXT_VERSION;
+    ckp.key = ext->key;
+    ckp.words = ext->space.words;
+    ckp.nlayers = ext->nlayers;
+    ckp.nodes = ext->nodes;
+    
+    if ((fp = fopen(temp, "wb")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    ok = (fwrite(&ckp, sizeof(ckp), 1, fp) == 1);
+    
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    if (!ok || !MoveFileEx(temp, name, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(temp);
+        return FALSE;
+    }
+    
+    return TRUE;
+}
 
-    /* Clear the screen. */
-    clear_screen();
+/*---------------------------------------------------------------------------*/
+/*
+ * Expands the last layer of an external search, writing the states it 
+ * reaches to sorted runs. Returns SOLVE_NO_SOLUTION if the goal wasn't 
+ * reached, the fewest moves if it was, SOLVE_TOO_BIG if the runs couldn't
+ * be written, or SOLVE_CANCELLED if stop was set.
+ */
+
+int
+expand_external(ext_search_t *ext, char **moves, volatile LONG *stop)
+{
+    char name[MAX_PATH];
+    uint64_t rec[SOLVE_MAX_WORDS + 1];
+    uint8_t board[SOLVE_MAX_NODES], *child;
+    ext_link_t *link;
+    uint32_t n;
+    int action, player, bomb, val, result = SOLVE_NO_SOLUTION;
+    FILE *fp;
     
-    /* TODO: Size of level pack select screen is hard coded, needs to adjust
-     * according to SCREEN_MAX_R. */
-    printf("\n\n");
-    printf("     LEVEL SELECT:\n\n\n");
+    if (   !ext_name(ext, name, ext->nlayers - 1, EXT_LAYER_FILE)
+        || (fp = fopen(name, "rb")) == NULL)
+    {
+        return SOLVE_TOO_BIG;
+    }
     
-    for (i = 0; i < L_PER_COL; i++)
+    ext->nruns = 0;
+    ext->nbuffer = 0;
+    
+    /* Records are numbered in the order of the file, for their children
+     * to find them by. */
+    for (n = 0; 
+         result == SOLVE_NO_SOLUTION 
+         && fread(rec, ext->rec_size, 1, fp) == 1;
+         n++)
     {
-        /* Start each row with a blank space. */
-        printf("    ");
+        if (stop != NULL && *stop)
+        {
+            result = SOLVE_CANCELLED;
+            break;
+        }
         
-        for (j = 0; j < PACK_COLS; j++)
+        ext->nodes++;
+        
+        for (action = 0; action < 2 * SOLVE_BOMB; action++)
         {
-            /* Check if the number of packs means that the pack list will flow
-             * over to the jth column. */
-            if (all_packs->npacks > i + j*L_PER_COL)
+            unpack_state(&ext->space, rec, board, &player, &bomb);
+            
+            if (action >= SOLVE_BOMB)
             {
-                /* Get level pack beaten status. */
-                beaten = all_beaten(all_packs->
-                    pack[i + j*L_PER_COL].save);
-                
-                if (beaten == ACED)
-                {
-                    printf(" *");
-                } 
-                else if (beaten == BEATEN)
-                {
-                    printf(" ");
-                    putchar(248);    /* Degrees symbol. */
-                }
-                else
+                if (!bomb)
                 {
-                    printf("  ");
+                    break;
                 }
                 
-                /* Print level pack number. Add one due to array notation
-                 * starting at zero. */
-                printf("%2d:  ", i + j*L_PER_COL + 1);
-                
-                /* Print level pack name, and get length of the name. */
-                printf("%s", all_packs->pack[i + j*L_PER_COL].
-                    name);
-                k = strlen(all_packs->pack[i + j*L_PER_COL].
-                    name);
-                
-                /* Pad the name with remaining spaces. */
-                while (k < MAX_NAME_LEN)
-                {
-                    printf(" ");
-                    k++;
-                }                
+                state_blast(&ext->space, board, player);
+                bomb = FALSE;
+            }
+            
+            val = state_slide(&ext->space, board, &player, &bomb, 
+                action % SOLVE_BOMB);
+            
+            if (val == GOAL)
+            {
+                result = ext_moves(ext, n, action, moves);
+                break;
+            }
+            
+            if (   val != TRUE 
+                || ext->space.dead[player / 64] >> (player % 64) & 1)
+            {
+                continue;
+            }
+            
+            if (ext->nbuffer == ext->buffer_size && !flush_run(ext))
+            {
+                result = SOLVE_TOO_BIG;
+                break;
             }
+            
+            child = ext->buffer + ext->nbuffer++ * ext->rec_size;
+            pack_state(&ext->space, board, player, bomb, (uint64_t *)child);
+            link = (ext_link_t *)(child + ext->state_size);
+            link->parent = n;
+            link->action = action;
+            link->check = bloom_check_add(ext, (uint64_t *)child);
+            link->reserved = 0;
         }
-        
-        printf("\n\n");
     }
-
-    printf("\n       q:  Back to Menu\n\n\n");
     
-    /* Flush output to screen. */
-    fflush( stdout );
+    if (ferror(fp))
+    {
+        result = SOLVE_TOO_BIG;
+    }
     
-    return;
+    fclose(fp);
+    
+    if (result == SOLVE_NO_SOLUTION && !flush_run(ext))
+    {
+        result = SOLVE_TOO_BIG;
+    }
+    
+    return result;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Prints level select screen depending on the number of available levels.
+/*
+ * Sorts the records gathered by an external search and writes them as a 
+ * run, keeping one of each state. If there are already EXT_MAX_RUNS runs,
+ * they are first merged into one. Returns TRUE if written.
  */
 
-void
-print_level_select(char *name, save_t save)
+int
+flush_run(ext_search_t *ext)
 {
-    int i, j;    
+    char name[MAX_PATH];
+    uint8_t *rec;
+    ext_link_t *link;
+    size_t i, j;
+    FILE *fp;
+    int ok = TRUE;
+    
+    if (ext->nbuffer == 0)
+    {
+        return TRUE;
+    }
+    
+    if (   (ext->nruns == EXT_MAX_RUNS && !compact_runs(ext))
+        || !ext_name(ext, name, ext->nruns, EXT_RUN_FILE)
+        || (fp = fopen(name, "wb")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    ext->nruns++;
+    sort_records(ext->buffer, ext->nbuffer, ext->rec_size, ext->state_size);
+    
+    /* Copies of a state are now side by side. It can only have been seen
+     * in an earlier layer if the Bloom filter said so for every copy, as
+     * it said no to the first. */
+    for (i = 0; ok && i < ext->nbuffer; i = j)
+    {
+        rec = ext->buffer + i * ext->rec_size;
+        link = (ext_link_t *)(rec + ext->state_size);
+        
+        for (j = i + 1; 
+             j < ext->nbuffer 
+             && memcmp(ext->buffer + j * ext->rec_size, rec, 
+                       ext->state_size) == 0;
+             j++)
+        {
+            link->check &= ((ext_link_t *)(ext->buffer + j * ext->rec_size
+                + ext->state_size))->check;
+        }
+        
+        ok = (fwrite(rec, ext->rec_size, 1, fp) == 1);
+    }
+    
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    ext->nbuffer = 0;
+    
+    return ok;
+}
 
-    /* Clears the screen. */
-    clear_screen();
+/*---------------------------------------------------------------------------*/
+/*
+ * Merges the runs of an external search into one sorted file, numbered out
+ * with suffix, keeping one of each state, and counts them. The runs are 
+ * removed. Returns TRUE if written.
+ */
+
+int
+merge_runs(ext_search_t *ext, uint32_t n, const char *suffix, 
+    uint64_t *count)
+{
+    char name[MAX_PATH];
+    FILE *run[EXT_MAX_RUNS], *out = NULL;
+    int live[EXT_MAX_RUNS];
+    uint8_t *head, *last, *rec;
+    ext_link_t *last_link;
+    int i, best, pending = FALSE, ok;
+    
+    *count = 0;
+    
+    if ((head = malloc((ext->nruns + 1) * ext->rec_size)) == NULL)
+    {
+        return FALSE;
+    }
     
-    /* TODO: Size of level select screen is hard coded, needs to adjust
-     * according to SCREEN_MAX_R. */ 
-    printf("\n\n");
+    /* Each run has its next record in head, and the last record taken is
+     * kept back until it's known to be the last copy of its state. */
+    last = head + ext->nruns * ext->rec_size;
+    last_link = (ext_link_t *)(last + ext->state_size);
     
-    /* Print name of level pack. */
-    printf("     %s:\n\n\n", name);
+    ok = (   ext_name(ext, name, n, suffix)
+          && (out = fopen(name, "wb")) != NULL);
     
-    for (i = 0; i < L_PER_COL; i++)
+    for (i = 0; i < ext->nruns; i++)
     {
-        for (j = 0; j < LEVEL_COLS; j++)
+        run[i] = NULL;
+        
+        if (ok && ext_name(ext, name, i, EXT_RUN_FILE))
         {
-            /* Check if there are enough levels that one appears in the jth
-             * column of the ith row. */
-            if (save.nlevels > i + j*L_PER_COL)
+            run[i] = fopen(name, "rb");
+        }
+        
+        live[i] = (   run[i] != NULL 
+                   && fread(head + i * ext->rec_size, ext->rec_size, 1, 
+                            run[i]) == 1);
+        ok = ok && run[i] != NULL;
+    }
+    
+    while (ok)
+    {
+        for (best = -1, i = 0; i < ext->nruns; i++)
+        {
+            if (   live[i]
+                && (   best < 0 
+                    || memcmp(head + i * ext->rec_size, 
+                              head + best * ext->rec_size, 
+                              ext->state_size) < 0))
             {
-                /* Print level beaten status. */
-                if (save.data[i + (j*L_PER_COL)] == ACED)
-                {
-                    printf("     *");
-                } 
-                else if (save.data[i + (j*L_PER_COL)] 
-                    == BEATEN)
-                {
-                    printf("     ");
-                    putchar(248);    /* Degrees symbol. */
-                }
-                else
-                {
-                    printf("      ");
-                }
-                
-                /* Print the level number, right alligned. Add one due to
-                 * array notation starting at zero. */
-                printf("%-2d", i + j*L_PER_COL + 1);
+                best = i;
             }
         }
         
-        printf("\n\n");
+        if (best < 0)
+        {
+            break;
+        }
+        
+        rec = head + best * ext->rec_size;
+        
+        if (pending && memcmp(rec, last, ext->state_size) == 0)
+        {
+            last_link->check &= ((ext_link_t *)(rec + ext->state_size))->check;
+        }
+        else
+        {
+            if (pending)
+            {
+                ok = (fwrite(last, ext->rec_size, 1, out) == 1);
+                (*count)++;
+            }
+            
+            memcpy(last, rec, ext->rec_size);
+            pending = TRUE;
+        }
+        
+        live[best] = (fread(rec, ext->rec_size, 1, run[best]) == 1);
+    }
+    
+    if (ok && pending)
+    {
+        ok = (fwrite(last, ext->rec_size, 1, out) == 1);
+        (*count)++;
     }
     
-    printf("\n       q:  Back to Menu\n\n\n");
+    for (i = 0; i < ext->nruns; i++)
+    {
+        if (run[i] != NULL)
+        {
+            ok = ok && !ferror(run[i]);
+            fclose(run[i]);
+        }
+    }
     
-    /* Flush output to screen. */
-    fflush( stdout );
+    if (out != NULL && fclose(out) != 0)
+    {
+        ok = FALSE;
+    }
     
-    return;
+    free(head);
+    remove_runs(ext);
+    
+    if (!ok && ext_name(ext, name, n, suffix))
+    {
+        DeleteFile(name);
+    }
+    
+    return ok;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Returns BEATEN if all levels in levelpack have been beaten, returns ACED
- * if all levels have been aced.
+ * Merges the EXT_MAX_RUNS runs of an external search into run 0, so that 
+ * a layer can have more runs than can be merged at once. The merged run 
+ * is written as run EXT_MAX_RUNS, then renamed once the others are gone.
+ * Returns TRUE if merged.
  */
 
-int all_beaten(save_t save)
+int
+compact_runs(ext_search_t *ext)
 {
-    int i;
+    char name[MAX_PATH], merged[MAX_PATH];
+    uint64_t count;
     
-    /* Check all levels to see if they have been beaten. */
-    for (i = 0; i < save.nlevels; i++)
+    if (   !ext_name(ext, name, 0, EXT_RUN_FILE)
+        || !ext_name(ext, merged, EXT_MAX_RUNS, EXT_RUN_FILE)
+        || !merge_runs(ext, EXT_MAX_RUNS, EXT_RUN_FILE, &count))
     {
-        /* If any level hasn't been beaten, then levelpack hasn't been beaten
-         * yet. Return FALSE */
-        if (save.data[i] == 0)
-        {
-            return FALSE;
-        }
+        return FALSE;
     }
     
-    /* All levels have been beaten. Now check all levels again to see if all
-     * of them have been ACED. */
-    for (i = 0; i < save.nlevels; i++)
+    if (!MoveFileEx(merged, name, MOVEFILE_REPLACE_EXISTING))
     {
-        /* If a level hasn't been ACED, then the levelpack as a whole has only
-         * been beaten. */
-        if (save.data[i] == BEATEN)
-        {
-            return BEATEN;
-        }
+        DeleteFile(merged);
+        return FALSE;
     }
     
-    /* All levels have been checked, and they have all been ACED. */
-    return ACED;
+    ext->nruns = 1;
+    
+    return TRUE;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Reads the save file, and loads information.
+ * Writes the candidates of an external search that aren't in any earlier
+ * layer as its next layer. They are taken a window at a time, marking in 
+ * a bit set those found by a merge with each layer. Returns the number 
+ * written, or -1 if they couldn't be.
  */
 
-void
-read_save(save_t *save)
-{    
-    int i = 0, d =0;
-    FILE *fp = NULL;
-
-    /* Open save file. */
-    fp = fopen(save->sav_file, "r");
+int64_t
+drop_seen(ext_search_t *ext, uint64_t ncandidates)
+{
+    char name[MAX_PATH];
+    uint64_t rec[SOLVE_MAX_WORDS + 1], *seen, first, window, nwindow, i;
+    ext_link_t *link = (ext_link_t *)((uint8_t *)rec + ext->state_size);
+    int64_t nfound = 0;
+    uint32_t layer;
+    FILE *cand = NULL, *out = NULL;
+    int ok;
     
-    /* Return early if save file didn't open correctly. */
-    if(fp == NULL)
+    window = (uint64_t)EXT_MEMORY / 4 * 8;
+    
+    if (ncandidates < window)
     {
-        return;
+        window = ncandidates;
     }
     
-    /* Keep loading save information until file is empty. */
-    while(fscanf(fp, "%d", &d) != EOF )
+    if ((seen = malloc((window + 64) / 64 * sizeof(uint64_t))) == NULL)
     {
-        /* Only keep save information if it can be attributed to a level. */ 
-        if (i < save->nlevels)
+        return -1;
+    }
+    
+    ok = (   ext_name(ext, name, 0, EXT_CANDIDATE_FILE)
+          && (cand = fopen(name, "rb")) != NULL
+          && ext_name(ext, name, ext->nlayers, EXT_LAYER_FILE)
+          && (out = fopen(name, "wb")) != NULL);
+    
+    for (first = 0; ok && first < ncandidates; first += nwindow)
+    {
+        nwindow = ncandidates - first < window ? ncandidates - first 
+                                               : window;
+        memset(seen, 0, (nwindow + 63) / 64 * sizeof(uint64_t));
+        
+        for (layer = 0; ok && layer < ext->nlayers; layer++)
         {
-            if (d == ACED)
-            {
-                save->data[i] = ACED;
-                i++;
-            }
-            else if (d == BEATEN)
+            ok = mark_seen(ext, cand, first, nwindow, layer, seen);
+        }
+        
+        ok = ok && _fseeki64(cand, (int64_t)(first * ext->rec_size), 
+            SEEK_SET) == 0;
+        
+        for (i = 0; ok && i < nwindow; i++)
+        {
+            if (fread(rec, ext->rec_size, 1, cand) != 1)
             {
-                save->data[i] = BEATEN;
-                i++;
+                ok = FALSE;
             }
-            else if (d == FALSE)
+            else if ((seen[i / 64] & (1ULL << i % 64)) == 0)
             {
-                save->data[i] = FALSE;
-                i++;
+                link->check = FALSE;
+                ok = (   fwrite(rec, ext->rec_size, 1, out) == 1
+                      && ++nfound <= STATE_NONE);
             }
         }
-        
     }
     
-    fclose(fp);
+    if (cand != NULL)
+    {
+        fclose(cand);
+    }
     
-    return;
+    if (out != NULL && fclose(out) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    free(seen);
+    
+    if (ext_name(ext, name, 0, EXT_CANDIDATE_FILE))
+    {
+        DeleteFile(name);
+    }
+    
+    return ok ? nfound : -1;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Replaces the save file with what is currently on the game.
+/*
+ * Marks in seen those of the nwindow candidates from first that are in a
+ * layer of an external search, by merging the two. Only candidates the 
+ * Bloom filter couldn't rule out are looked for. Returns FALSE if either 
+ * couldn't be read.
  */
 
-void
-write_save(save_t save)
+int
+mark_seen(ext_search_t *ext, FILE *cand, uint64_t first, uint64_t nwindow,
+    uint32_t layer, uint64_t *seen)
 {
-    int i;
-    FILE *fp = NULL;
-        
-    fp = fopen(save.sav_file, "w");
+    char name[MAX_PATH];
+    uint64_t rec[SOLVE_MAX_WORDS + 1], old[SOLVE_MAX_WORDS + 1], i;
+    ext_link_t *link = (ext_link_t *)((uint8_t *)rec + ext->state_size);
+    int have, cmp, ok;
+    FILE *fp;
     
-    /* Return early if save file didn't open correctly. */
-    if(fp == NULL)
+    if (   !ext_name(ext, name, layer, EXT_LAYER_FILE)
+        || (fp = fopen(name, "rb")) == NULL)
     {
-        return;
+        return FALSE;
     }
     
-    /* Loop through all save levels and print their completion state. */
-    for (i = 0; i < save.nlevels; i++)
+    ok = (_fseeki64(cand, (int64_t)(first * ext->rec_size), SEEK_SET) == 0);
+    have = (fread(old, ext->rec_size, 1, fp) == 1);
+    
+    for (i = 0; ok && have && i < nwindow; i++)
     {
-        if (save.data[i] == ACED)
+        if (fread(rec, ext->rec_size, 1, cand) != 1)
         {
-            fprintf(fp, "%d", ACED);
+            ok = FALSE;
+            break;
         }
-        else if (save.data[i] == BEATEN)
+        
+        if (!link->check)
         {
-            fprintf(fp, "%d", BEATEN);
+            continue;
         }
-        else
+        
+        while (have && (cmp = memcmp(old, rec, ext->state_size)) < 0)
         {
-            fprintf(fp, "%d", FALSE);
+            have = (fread(old, ext->rec_size, 1, fp) == 1);
         }
         
-        /* New line allows each value to be read individually. */
-        fprintf(fp, "\n");
+        if (have && cmp == 0)
+        {
+            seen[i / 64] |= 1ULL << i % 64;
+        }
     }
     
+    ok = ok && !ferror(fp);
     fclose(fp);
     
-    return;
+    return ok;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Prints prompt if player actually wants to erase data, removes save data
- * if yes */
+/*
+ * Removes the runs of an external search.
+ */
 
-void 
-clear_save(all_packs_t *all_packs)
+void
+remove_runs(ext_search_t *ext)
 {
-    int junk, i;
-    char player_choice = '\0';
-    
-    /* Pointer to string array for menu screen. */
-    char *clear_save[] = {
-" ",
-" ",
-"     CLEAR COMPLETION DATA:",
-" ",
-" ",
-"       Are you sure you want to clear all completion data? (y/n)",
-" ",
-"       Completion status cannot be recovered",
-"  ",
-    NULL};
-    
-    char *clear_success[] = {
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-"                      COMPLETION DATA SUCCESSFULLY CLEARED",
-    NULL};
+    char name[MAX_PATH];
+    int i;
     
-    while(TRUE)
+    for (i = 0; i < ext->nruns; i++)
     {
-        /* Display the screen. */    
-        print_message_screen(clear_save);
-        
-        /* Get player input. */
-        junk = scanf("%c", &player_choice);
-        junk++;
-        
-        if (player_choice == YES)
+        if (ext_name(ext, name, i, EXT_RUN_FILE))
         {
-            /* Clear all packs. */
-            for (i = 0; i < all_packs->npacks; i++)
-            {
-                set_zero(all_packs->pack[i].save.data,
-                    all_packs->pack[i].nlevels);
-                
-                write_save(all_packs->pack[i].save);
-            }
-            
-            /* Clearing save is always successful, display success. */
-            print_message_screen(clear_success);
-            
-            Sleep(2000);  /* 2 seconds. */    
-            
-            return;
-        }
-        else if (player_choice == NO)
-        {
-            return;
+            DeleteFile(name);
         }
     }
     
+    ext->nruns = 0;
+    
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Swaps two integers passed through as pointers.
+ * Removes the files of an external search, including a layer that was 
+ * being written and runs left by a search that was killed.
  */
 
 void
-int_swap(int *p1, int *p2)
+remove_search(ext_search_t *ext)
 {
-    int temp;
-    temp = *p1;
-    *p1 = *p2;
-    *p2 = temp;
+    char name[MAX_PATH];
+    uint32_t layer;
+    
+    /* Run EXT_MAX_RUNS is where compact_runs() merges to. */
+    ext->nruns = EXT_MAX_RUNS + 1;
+    remove_runs(ext);
+    
+    for (layer = 0; layer <= ext->nlayers; layer++)
+    {
+        if (ext_name(ext, name, layer, EXT_LAYER_FILE))
+        {
+            DeleteFile(name);
+        }
+    }
+    
+    if (ext_name(ext, name, 0, EXT_CHECKPOINT_FILE))
+    {
+        DeleteFile(name);
+    }
     
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Prints level load error.
+ * Writes the moves that reach the goal by taking action from record rec 
+ * of the last layer of an external search, reading back through the 
+ * layers for the record each was reached from. Returns the number of 
+ * moves, or SOLVE_TOO_BIG if the layers couldn't be read.
  */
 
-void
-level_load_error(void)
+int
+ext_moves(ext_search_t *ext, uint32_t rec, int action, char **moves)
 {
+    char name[MAX_PATH];
+    uint8_t *path;
+    ext_link_t link;
+    uint32_t layer;
+    int nmoves = ext->nlayers, ok = TRUE;
+    FILE *fp;
     
-    char *error[] = {
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-"                      ERROR IN LOADING LEVELS",
-" ",
-" ",
-    NULL};
-
-    print_message_screen(error);
+    if ((path = malloc(nmoves)) == NULL)
+    {
+        return SOLVE_TOO_BIG;
+    }
     
-    return;
-}
-
-/*---------------------------------------------------------------------------*/
-/* clears input buffer */
-
-void
-clear(void)
-{ 
-    while (getchar() != '\n');
+    path[nmoves - 1] = action;
     
-    return;
+    for (layer = ext->nlayers - 1; ok && layer > 0; layer--)
+    {
+        ok = (   ext_name(ext, name, layer, EXT_LAYER_FILE)
+              && (fp = fopen(name, "rb")) != NULL);
+        
+        if (ok)
+        {
+            ok = (   _fseeki64(fp, (int64_t)rec * ext->rec_size 
+                                   + ext->state_size, SEEK_SET) == 0
+                  && fread(&link, sizeof(link), 1, fp) == 1);
+            fclose(fp);
+            path[layer - 1] = link.action;
+            rec = link.parent;
+        }
+    }
+    
+    nmoves = ok ? action_moves(path, nmoves, moves) : SOLVE_TOO_BIG;
+    free(path);
+    
+    return nmoves;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Sets interger array to be zero.
+ * Task for the tables tool. Makes the distance table of level task of the
+ * pack.
  */
 
-void 
-set_zero(int array[], int n)
+void
+table_level(void *ctx, sched_worker_t *worker, int task, 
+    volatile LONG *stop)
 {
-    int i;
-
-    for (i = 0; i < n; i++)
-    {
-        /* Set each element up to n to be zero. */
-        array[i] = 0;
-    }
+    pack_tasks_t *tasks = ctx;
+    table_result_t *res = (table_result_t *)tasks->result + task;
+    DWORD start = GetTickCount();
+    level_t lvl;
+    
+    (void)worker;
+    
+    get_level(tasks->pack, task, &lvl);
+    
+    res->moves = build_table(&lvl, &res->nstates, stop);
+    res->time = GetTickCount() - start;
     
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Converts a positive two digit number into a string.
+ * Writes the name of the distance table of a level to name, which must be
+ * MAX_PATH long, and the key and CRC-32 of its board, see solution_key(),
+ * to key and board. Returns TRUE if it fit.
  */
 
-void
-itoa_2digit(int n, char *s)
+int
+table_name(level_t *lvl, char *name, uint64_t *key, uint32_t *board)
 {
-    int i = 0;
-    char tens = '\0', ones = '\0';
-    
-    /* Add interger value to zero character. */
-    ones = n%10 + '0';    
-    n /= 10;
-    tens = n%10 + '0';
-    
-    /* Only use tens column if it is non zero. Incrememtning position in array
-     * is skipped if tens column is zero, and therefore leading zeros are
-     * ignored. */
-    if (tens != '0')
-    {
-        s[i++] = tens;
-    }
+    int len;
     
-    /* Add ones and increment. */
-    s[i++] = ones;
+    *key = solution_key(lvl, board);
+    len = snprintf(name, MAX_PATH, "%s\\%016" PRIx64 "%s", TABLE_DIR, 
+        *key, TABLE_FILE);
     
-    /* Close string. */
-    s[i] = '\0';
-    
-    return;
+    return len > 0 && len < MAX_PATH;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Level editor interface. User can navigate around level, place board
- * elements, test level, and then save the level.
+ * Makes the distance table of a level by retrograde analysis. Every state
+ * reachable from the start is found, keeping each move between them, and 
+ * then a breadth first search back along the moves from the states one 
+ * move from the goal gives the fewest moves to the goal from all the 
+ * others. Sets nstates to the number of states written. Returns the 
+ * fewest moves from the start, SOLVE_NO_SOLUTION, SOLVE_TOO_BIG if out of
+ * memory or the table couldn't be written, or SOLVE_CANCELLED if stop was 
+ * set. The table is written unless SOLVE_TOO_BIG or SOLVE_CANCELLED.
  */
- 
-void
-level_editor(void)
+
+int
+build_table(level_t *lvl, uint32_t *nstates, volatile LONG *stop)
 {
-    char input;
-    int number_input;
-    int has_saved = TRUE;       /* True when no blocks have been placed since
-                                 * last save, or when level is empty. */
-    save_t dummy_save;
-    
-    /* Create empty level, with maximum size. */
-    level_t lvl = create_empty_lvl();
-    level_t cropped_lvl;
+    state_space_t space;
+    state_table_t table;
+    uint64_t state[SOLVE_MAX_WORDS], *rec = NULL;
+    uint8_t board[SOLVE_MAX_NODES];
+    uint32_t *edge = NULL, *grown, *first = NULL, *pred = NULL;
+    uint32_t *queue = NULL, n, m, head = 0, tail = 0;
+    uint16_t *dist = NULL;
+    size_t nedges = 0, size = 0, e;
+    int action, player, bomb, val, words, result = SOLVE_TOO_BIG;
+    
+    *nstates = 0;
+    
+    if (!init_state_space(lvl, &space, state))
+    {
+        return SOLVE_TOO_BIG;
+    }
     
-        /* Set cursor inside boundary. */
-    coord_t cursor = {lvl.rows / 2, lvl.cols / 2}, goal = {0, 0};
+    words = space.words;
+    open_state_table(&table, words, SOLVE_MEMORY);
     
-    /* Display screen. */
-    disp_editor(&lvl, cursor);
-        
-    /* Clear the input buffer. */
-    clear();
+    if (add_state(&table, state, 0, 0) == STATE_FULL)
+    {
+        free_state_table(&table);
+        return SOLVE_TOO_BIG;
+    }
     
-    /* Get input from user. */
-    while( (input = getch()) )
+    /* Moves are kept as pairs of state numbers, with moves that reach the 
+     * goal going to STATE_NONE. */
+    for (n = 0; n < table.count; n++)
     {
-        /* Get the int value from input (if applicable). */
-        number_input = input - '0';
+        if (stop != NULL && *stop)
+        {
+            free(edge);
+            free_state_table(&table);
+            return SOLVE_CANCELLED;
+        }
         
-        /* Check for quit. */
-        if (input == QUIT)
+        for (action = 0; action < 2 * SOLVE_BOMB; action++)
         {
-            /* If the level has not beed changed since last save, do not need
-             * to ask if user wants to quit. */
-            if (has_saved)
+            unpack_state(&space, table.state + (size_t)n * words, board, 
+                &player, &bomb);
+            
+            if (action >= SOLVE_BOMB)
             {
-                return;
+                if (!bomb)
+                {
+                    break;
+                }
+                
+                state_blast(&space, board, player);
+                bomb = FALSE;
             }
-            /* Check if user really wants to quit, as progress will be lost. */
-            else if (editor_decision_screen(QUIT_EDITOR_CODE) == YES)
+            
+            val = state_slide(&space, board, &player, &bomb, 
+                action % SOLVE_BOMB);
+            
+            if (val == GOAL)
             {
-                /* Exit the editor. */
-                return;
+                m = STATE_NONE;
+            }
+            else if (val != TRUE 
+                     || space.dead[player / 64] >> (player % 64) & 1)
+            {
+                continue;
+            }
+            else
+            {
+                pack_state(&space, board, player, bomb, state);
+                
+                if ((m = add_state(&table, state, n, action)) == STATE_FULL)
+                {
+                    free(edge);
+                    free_state_table(&table);
+                    return SOLVE_TOO_BIG;
+                }
+                
+                if (m == STATE_FOUND)
+                {
+                    m = find_state(&table, state);
+                }
             }
-        }
-        
-        /* Move the cursor if a direction is input  */
-        move_cursor(&cursor, input);
-              
-        /* Place a board elements. */
-        if (number_input == PLAYER)
-        {
-            has_saved = FALSE;
             
-            /* Remove old player icon if aplicable. */
-            if (lvl.board[lvl.p_row][lvl.p_col] == PLAYER)
+            if (nedges == size)
             {
-                lvl.board[lvl.p_row][lvl.p_col] = EMPTY;
+                size = size ? size * 2 : MIN_TABLE_SIZE;
+                
+                if ((grown = realloc(edge, size * 2 * sizeof(uint32_t))) 
+                    == NULL)
+                {
+                    free(edge);
+                    free_state_table(&table);
+                    return SOLVE_TOO_BIG;
+                }
+                
+                edge = grown;
             }
             
-            /* Set new player icon. */
-            lvl.p_row = cursor.row;
-            lvl.p_col = cursor.col;
-            lvl.board[lvl.p_row][lvl.p_col] = PLAYER;            
+            edge[2 * nedges] = n;
+            edge[2 * nedges++ + 1] = m;
         }
+    }
+    
+    n = table.count;
+    dist = malloc(n * sizeof(uint16_t));
+    first = calloc(n + 1, sizeof(uint32_t));
+    pred = malloc((nedges + 1) * sizeof(uint32_t));
+    queue = malloc(n * sizeof(uint32_t));
+    rec = malloc((size_t)n * (words + 1) * sizeof(uint64_t));
+    
+    if (   dist != NULL && first != NULL && pred != NULL && queue != NULL
+        && rec != NULL)
+    {
+        /* The states each state is reached from are listed together, 
+         * those of state m ending at first[m]. */
+        memset(dist, 0xFF, n * sizeof(uint16_t));
         
-        if (number_input == GOAL)
+        for (e = 0; e < nedges; e++)
         {
-            has_saved = FALSE;
-            
-            /* Remove old goal icon if aplicable. */
-            if (lvl.board[goal.row][goal.col] == GOAL)
+            if (edge[2 * e + 1] == STATE_NONE)
             {
-                lvl.board[goal.row][goal.col] = EMPTY;
+                if (dist[edge[2 * e]] == SOLVE_FAR)
+                {
+                    dist[edge[2 * e]] = 1;
+                    queue[tail++] = edge[2 * e];
+                }
+            }
+            else
+            {
+                first[edge[2 * e + 1] + 1]++;
             }
-            
-            /* Set new goal icon. */
-            goal.row = cursor.row;
-            goal.col = cursor.col;
-            lvl.board[goal.row][goal.col] = GOAL;  
         }
         
-        /* All other inputs. */
-        if (number_input == EMPTY ||
-            number_input == WALL ||
-            number_input == WEAK_WALL ||
-            number_input == BOMB_VAL ||
-            number_input == MOVING_BLOCK ||
-            number_input == HOLE)
+        for (m = 0; m < n; m++)
         {
-            has_saved = FALSE;
-            
-            lvl.board[cursor.row][cursor.col] = number_input;
+            first[m + 1] += first[m];
         }
-            
-        /* Test the level. */
-        if (input == PLAY)
+        
+        for (e = 0; e < nedges; e++)
         {
-            if (is_player_and_goal_valid(&lvl, goal))
-            {
-                cropped_lvl = crop_lvl(&lvl);
-                play(&cropped_lvl, &dummy_save, 0, TRUE);
-            }
-            else
+            if (edge[2 * e + 1] != STATE_NONE)
             {
-                /* Level was incomplete, display error. */
-                editor_message_screen(INCOMPLETE_CODE);
+                pred[first[edge[2 * e + 1]]++] = edge[2 * e];
             }
         }
         
-        /* Save the level. */
-        if (input == SAVE_LEVEL)
+        result = SOLVE_NO_SOLUTION;
+        
+        while (head < tail && result == SOLVE_NO_SOLUTION)
         {
-            if (is_player_and_goal_valid(&lvl, goal))
+            m = queue[head++];
+            
+            if (stop != NULL && *stop)
             {
-                /* Player first needs to beat the level, this sets moves. */
-                cropped_lvl = crop_lvl(&lvl);
-                cropped_lvl.moves = play(&cropped_lvl, &dummy_save, 0, TRUE);
+                result = SOLVE_CANCELLED;
+            }
             
-                if (cropped_lvl.moves > 0) 
-                {
-                    write_level(cropped_lvl);
-                    editor_message_screen(SUCCESSFUL_CODE); 
-                    
-                    has_saved = TRUE;
-                }
-                else
+            for (e = (m == 0) ? 0 : first[m - 1]; e < first[m]; e++)
+            {
+                if (dist[pred[e]] == SOLVE_FAR && dist[m] + 1 < SOLVE_FAR)
                 {
-                    /* Print message saying that levels needs to be
-                     * beaten to be saved. */
-                    editor_message_screen(UNBEATEN_CODE);
+                    dist[pred[e]] = dist[m] + 1;
+                    queue[tail++] = pred[e];
                 }
             }
-            else
-            {
-                /* Level was incomplete, display error. */
-                editor_message_screen(INCOMPLETE_CODE);
-            }
         }
         
-        /* Check if the user wants to clear the current level. */
-        if (input == CLEAR_EDITOR)
+        if (result == SOLVE_NO_SOLUTION)
         {
-            /* If the level has not beed changed since last save, do not need
-             * to ask if user wants to clear it. */
-            if (has_saved)
+            /* Only states the goal can be reached from are kept, each 
+             * with its distance in the word after it. */
+            for (m = 0; m < n; m++)
             {
-                lvl = create_empty_lvl();
-                has_saved = TRUE;
+                if (dist[m] != SOLVE_FAR)
+                {
+                    memcpy(rec + (size_t)*nstates * (words + 1), 
+                        table.state + (size_t)m * words, 
+                        words * sizeof(uint64_t));
+                    rec[(size_t)*nstates * (words + 1) + words] = dist[m];
+                    (*nstates)++;
+                }
             }
-            /* Check if user really wants to quit, as progress will be lost. */
-            else if (editor_decision_screen(CLEAR_EDITOR_CODE) == YES)
+            
+            sort_records((uint8_t *)rec, *nstates, 
+                (words + 1) * sizeof(uint64_t), words * sizeof(uint64_t));
+            
+            if (!write_table(lvl, rec, *nstates, words))
             {
-                lvl = create_empty_lvl();
-                has_saved = TRUE;
+                result = SOLVE_TOO_BIG;
+            }
+            else if (dist[0] != SOLVE_FAR)
+            {
+                result = dist[0];
             }
         }
-        
-        disp_editor(&lvl, cursor);
-        Sleep(TIME_BETWEEN_FRAMES);
     }
     
-    return;
+    free(rec);
+    free(queue);
+    free(pred);
+    free(first);
+    free(dist);
+    free(edge);
+    free_state_table(&table);
+    
+    return result;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Creates an empty level ready to be edited.
+ * Writes the distance table of a level from n records of a state of words
+ * words followed by its distance, sorted by state. It is written through a
+ * temporary file, so that a table that is there is always whole. Returns 
+ * TRUE if written.
  */
 
-level_t
-create_empty_lvl(void)
+int
+write_table(level_t *lvl, const uint64_t *rec, uint32_t n, int words)
 {
-    int i, j;
+    char name[MAX_PATH], temp[MAX_PATH + 32];
+    table_header_t header;
+    state_space_t space;
+    file_stamp_t stamp;
+    uint16_t dist;
+    uint32_t i;
+    FILE *fp;
+    int ok;
     
-    level_t lvl;
+    memset(&header, 0, sizeof(header));
     
-    /* Loop through all the board elements */
-    for (i = 0; i < BOARD_MAX_R; i++)
+    if (   !table_name(lvl, name, &header.key, &header.board)
+        || !init_state_space(lvl, &space, header.start))
     {
-        for (j = 0; j < BOARD_MAX_C; j++)
-        {
-            /* Boarder values set as holes for default. */
-            if (i == 0 ||
-                i == BOARD_MAX_R - 1 ||
-                j == 0 ||
-                j == BOARD_MAX_C - 1)
-            {
-                lvl.board[i][j] = HOLE;
-            }
-            /* All inner board values set to empty by default. */
-            else
-            {
-                lvl.board[i][j] = EMPTY;
-            }
-        }
+        return FALSE;
     }
     
-    /* Set board values. */
-    lvl.rows = BOARD_MAX_R;
-    lvl.cols = BOARD_MAX_C;
-    lvl.p_row = 0;
-    lvl.p_col = 0;
-    lvl.moves = 0;
-    lvl.nmoves = 0;
-    lvl.moving_block_check = FALSE;
-    lvl.bomb = FALSE;
-    lvl.message_available = FALSE;
+    /* Fails harmlessly if the directory is already there. */
+    CreateDirectory(TABLE_DIR, NULL);
     
-    return lvl;
+    /* Workers of one process may make tables of the same level. */
+    snprintf(temp, sizeof(temp), "%s.%lu.%lu%s", name, 
+        (unsigned long)GetCurrentProcessId(), 
+        (unsigned long)GetCurrentThreadId(), TEMP_FILE);
+    
+    if ((fp = fopen(temp, "wb")) == NULL)
+    {
+        return FALSE;
+    }
+    
+    memcpy(header.magic, TABLE_MAGIC, LVB_MAGIC_LEN);
+    header.version = TABLE_VERSION;
+    header.words = words;
+    header.nstates = n;
+    header.rows = lvl->rows;
+    header.cols = lvl->cols;
+    
+    ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    
+    for (i = 0; ok && i < n; i++)
+    {
+        ok = (fwrite(rec + (size_t)i * (words + 1), sizeof(uint64_t), words,
+                  fp) == (size_t)words);
+    }
+    
+    for (i = 0; ok && i < n; i++)
+    {
+        dist = (uint16_t)rec[(size_t)i * (words + 1) + words];
+        ok = (fwrite(&dist, sizeof(dist), 1, fp) == 1);
+    }
+    
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    
+    /* Another process may have written the same table first, which is 
+     * just as good. */
+    if (!ok || !MoveFileEx(temp, name, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(temp);
+        return ok && get_file_stamp(name, &stamp);
+    }
+    
+    return TRUE;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Moves the cursor in the level editor. The cursor cannot move onto the
- * boundary of the level.
+ * Maps the distance table of a level into memory. Returns FALSE if there 
+ * isn't one, or it isn't valid for the level.
  */
- 
-void
-move_cursor(coord_t *cursor, char direction)
+
+int
+open_table(level_t *lvl, dist_table_t *table)
 {
-    /* Need space above to move cursor UP. */
-    if (direction == UP &&
-        cursor->row > 1)
-    {
-        /* Subtract a row. */
-        cursor->row--;
-        return;
-    }
+    char name[MAX_PATH];
+    uint64_t start[SOLVE_MAX_WORDS], key;
+    uint32_t board;
+    const table_header_t *header;
     
-    /* Need space below to move cursor DOWN. */
-    if (direction == DOWN &&
-        cursor->row < BOARD_MAX_R - 2)
-    {
-        /* Add a row. */
-        cursor->row++;
-        return;
-    }
+    memset(start, 0, sizeof(start));
     
-    /* Need space left to move cursor LEFT. */
-    if (direction == LEFT &&
-        cursor->col > 1)
+    if (   !init_state_space(lvl, &table->space, start)
+        || !table_name(lvl, name, &key, &board)
+        || !map_file(&table->map, name, sizeof(table_header_t)))
     {
-        /* Subtract a column. */
-        cursor->col--;
-        return;
+        return FALSE;
     }
     
-    /* Need space right to move cursor RIGHT. */
-    if (direction == RIGHT &&
-        cursor->col < BOARD_MAX_C - 2)
+    header = (const table_header_t *)table->map.base;
+    
+    if (   memcmp(header->magic, TABLE_MAGIC, LVB_MAGIC_LEN) != 0
+        || header->version != TABLE_VERSION
+        || header->key != key
+        || header->board != board
+        || header->rows != (uint32_t)lvl->rows
+        || header->cols != (uint32_t)lvl->cols
+        || header->words != (uint32_t)table->space.words
+        || memcmp(header->start, start, 
+                  table->space.words * sizeof(uint64_t)) != 0
+        || table->map.size != sizeof(table_header_t) + (uint64_t)
+           header->nstates * (header->words * sizeof(uint64_t) 
+                              + sizeof(uint16_t)))
     {
-        /* Add a column. */
-        cursor->col++;
-        return;
+        lvb_close(&table->map);
+        return FALSE;
     }
-        
-    return;
+    
+    table->nstates = header->nstates;
+    table->state = (const uint64_t *)(table->map.base + sizeof(*header));
+    table->dist = (const uint16_t *)(table->state 
+        + (size_t)table->nstates * header->words);
+    
+    return TRUE;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Displays the level editor interface.
+ * Finds the fewest moves to the goal from a state in a distance table, 
+ * with a binary search. Returns SOLVE_FAR if the state isn't there, as the
+ * goal can't be reached from it.
  */
- 
-void
-disp_editor(level_t *level, coord_t cursor)
-{
-    int i, j;
 
-    /* Clear the screen. */
-    clear_screen();
+uint16_t
+table_distance(const dist_table_t *table, const uint64_t *state)
+{
+    uint32_t low = 0, high = table->nstates, mid;
+    size_t size = table->space.words * sizeof(uint64_t);
+    int cmp;
     
-    /* If there is a message, display it here above the board. */
-    if (level->message_available == TRUE)
+    while (low < high)
     {
-        /* Centre board columns. Pad screen on the left depending on the board
-         * size. */
-        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+        mid = low + (high - low) / 2;
+        cmp = memcmp(table->state + (size_t)mid * table->space.words, 
+            state, size);
+        
+        if (cmp == 0)
         {
-            printf(" ");
+            return table->dist[mid];
         }
         
-        /* Print message. */
-        printf("%s\n", level->message);
+        if (cmp < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
     }
     
-    /* Loop through all screen elements */ 
-    for(i = 0; i < level->rows; i++)
-    {    
-        /* Centre board columns. Pad screen on the left depending on the board
-         * size. */
-        for(j = 0; j < ((SCREEN_MAX_C - level->cols) / 4); j++)
+    return SOLVE_FAR;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Finds the best next move for a level being played, by looking up the 
+ * state after each move in its distance table. The state the player is in
+ * needn't be in the table, as after using a bomb without moving. Sets 
+ * action to the move, a slide 0 to 3, plus SOLVE_BOMB if a bomb is used 
+ * first. Returns the fewest moves to the goal, or SOLVE_NO_SOLUTION.
+ */
+
+int
+get_hint(const dist_table_t *table, level_t *lvl, int *action)
+{
+    const state_space_t *space = &table->space;
+    uint64_t state[SOLVE_MAX_WORDS];
+    uint8_t board[SOLVE_MAX_NODES], after[SOLVE_MAX_NODES];
+    int i, j, a, player, bomb, val, dist, best = SOLVE_FAR;
+    
+    for (i = 0; i < lvl->rows; i++)
+    {
+        for (j = 0; j < lvl->cols; j++)
         {
-            printf(" ");
+            board[i * lvl->cols + j] 
+                = (lvl->board[i][j] == PLAYER) ? EMPTY : lvl->board[i][j];
         }
+    }
+    
+    for (a = 0; a < 2 * SOLVE_BOMB; a++)
+    {
+        memcpy(after, board, lvl->rows * lvl->cols);
+        player = lvl->p_row * lvl->cols + lvl->p_col;
+        bomb = lvl->bomb;
         
-        /* Print board elements. */
-        for(j = 0; j < level->cols; j++)
+        if (a >= SOLVE_BOMB)
         {
-            /* Display cursor over the board. */
-            if( i == cursor.row && j == cursor.col )
-            {
-                putchar(CURSOR_SYMBOL);
-            }
-            else
+            if (!bomb)
             {
-                disp_board_element( level->board[i][j] );
+                break;
             }
+            
+            state_blast(space, after, player);
+            bomb = FALSE;
         }
         
-        /* Display editor instructions on right of board, only if the board is
-         * big enough. */
-        if(level->rows >= 15)
-        {
-            if (i == 1)
-            {
-                printf("  %c = %d", EMPTY_SYMBOL, EMPTY);
-                printf("    %c = %d", WALL_SYMBOL, WALL);
-            }
-            
-            if (i == 3)
-            {
-                printf("  %c = %d", GOAL_SYMBOL, GOAL);
-                printf("    %c = %d", PLAYER_SYMBOL, PLAYER);
-            }
-            
-            if (i == 5)
-            {
-                printf("  %c = %d", WEAK_WALL_SYMBOL, WEAK_WALL);
-                printf("    %c = %d", BOMB_SYMBOL, BOMB_VAL);
-            }
-            
-            if (i == 7)
-            {
-                printf("  %c = %d", MOVING_BLOCK_SYMBOL, MOVING_BLOCK);
-                printf("    %c = %d", HOLE_SYMBOL, HOLE);
-            }
-            
-            if (i == level->rows - 7)
-            {
-                printf("  MOVE     = %c%c%c%c", UP, LEFT, DOWN, RIGHT);
-            }
+        val = state_slide(space, after, &player, &bomb, a % SOLVE_BOMB);
         
-            if (i == level->rows-5)
-            {
-                printf("  PLAY     = %c", PLAY);
-            }
-            
-            if (i == level->rows-4)
-            {
-                printf("  SAVE     = %c", SAVE_LEVEL);
-            }
-
-            if (i == level->rows-2)
-            {
-                printf("  CLEAR    = %c", CLEAR_EDITOR);
-            }
-            
-            if (i == level->rows-1)
-            {
-                printf("  QUIT     = %c", QUIT);
-            }
+        if (val == GOAL)
+        {
+            dist = 1;
+        }
+        else if (val == TRUE)
+        {
+            pack_state(space, after, player, bomb, state);
+            dist = table_distance(table, state) + 1;
+        }
+        else
+        {
+            continue;
         }
         
-        printf("\n");
-    }
-    
-    /* Centre board rows. */
-    for(i = 0; i < ((SCREEN_MAX_R - (level->rows)) / 2); i++)
-    {
-            printf("\n");
+        /* Slides come first, so a bomb is only used if it saves moves. */
+        if (dist < best)
+        {
+            best = dist;
+            *action = a;
+        }
     }
     
-    /* Flush output to screen. */
-    fflush( stdout );
-    
-    return;
+    return (best >= SOLVE_FAR) ? SOLVE_NO_SOLUTION : best;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Crop level. This crops the maximum sized level from the level editor, to the
- * minimum size needed to play the level, with padding around the sides if
- * possible.
+ * Puts the best next move for a level being played in its message. The 
+ * first time, if the level has no distance table yet, one is started on
+ * another thread, so that play carries on meanwhile. Until it is done, 
+ * the first move can still be taken from the solution cache, unless 
+ * another process is writing it, as play mustn't wait.
  */
-level_t
-crop_lvl(level_t *src_lvl)
+
+void
+show_hint(level_t *level, level_t *current, hint_t *hint)
 {
-    int i, j;
-    int min_row = src_lvl->rows - 2, min_col = src_lvl->cols - 2;
-    int max_row = 1, max_col = 1;
-    int element_rows, element_cols;
-    int padding_rows = PADDING_ROWS, padding_cols = PADDING_COLS;
-    level_t dst_lvl;
+    static const char *dirs[4] = {"up", "right", "down", "left"};
+    static const char keys[4] = {UP, RIGHT, DOWN, LEFT};
+    table_job_t *job;
+    HANDLE thread;
+    solution_t sol;
+    char *key;
+    int moves = SOLVE_NO_SOLUTION, action = 0, known = FALSE;
+    
+    if (!hint->open 
+        && (hint->job == NULL || hint->job->result != TABLE_BUILDING))
+    {
+        hint->open = open_table(level, &hint->table);
+    }
     
-    /* Find the minimum and maximum row and column where a block exists.
-     * Ignore the boundary of the level, so add and subtract 1 to the initial
-     * and final values. */
-    for (i = 1; i < src_lvl->rows - 1; i++)
+    if (!hint->open && hint->job == NULL 
+        && (job = malloc(sizeof(table_job_t))) != NULL)
     {
-        for (j = 1; j < src_lvl->cols - 1; j++)
+        job->lvl = *level;
+        job->result = TABLE_BUILDING;
+        job->owners = 2;
+        
+        if ((thread = CreateThread(NULL, 0, table_thread, job, 0, NULL)) 
+            != NULL)
         {
-            /* Check if there is a board element. */
-            if (src_lvl->board[i][j] != EMPTY)
-            {
-                /* Check if a new minimum row/col has been found. */
-                if (i < min_row)
-                {
-                    min_row = i;
-                }
-                if (j < min_col)
-                {
-                    min_col = j;
-                }
-                /* Check if a new maximum row/col has been found. */
-                if (i > max_row)
-                {
-                    max_row = i;
-                }
-                if (j > max_col)
-                {
-                    max_col = j;
-                }
-            }
+            CloseHandle(thread);
+            hint->job = job;
+        }
+        else
+        {
+            free(job);
         }
     }
     
-    /* If either the rows or the cols are negative, it means there was an empty
-     * board. Just return the input level. */
-    element_rows = (max_row + 1) - min_row;
-    element_cols = (max_col + 1) - min_col;
+    current->message_available = TRUE;
     
-    if ( element_rows < 0 || element_cols < 0)
+    if (hint->open)
     {
-        return *src_lvl;
+        moves = get_hint(&hint->table, current, &action);
+        known = TRUE;
+    }
+    else if (   current->nmoves == 0 && current->bomb == level->bomb
+             && find_solution(level, &sol, FALSE))
+    {
+        /* Bombs aren't counted as moves, but use up the bomb. */
+        moves = sol.moves;
+        action = (sol.solution[0] == BOMB_INPUT) ? SOLVE_BOMB : 0;
+        key = memchr(keys, sol.solution[action / SOLVE_BOMB], 4);
+        known = (moves == SOLVE_NO_SOLUTION || key != NULL);
+        action += (key != NULL) ? (int)(key - keys) : 0;
     }
     
-    /* Determine padding size. */
+    if (known && moves == SOLVE_NO_SOLUTION)
+    {
+        strcpy(current->message, LEVEL_LOST_MSG);
+    }
+    else if (known)
+    {
+        snprintf(current->message, MAX_MSG, "Hint: %s%s, %d to go", 
+            action >= SOLVE_BOMB ? "bomb, " : "", 
+            dirs[action % SOLVE_BOMB], moves);
+    }
+    else if (hint->job != NULL && hint->job->result == TABLE_BUILDING)
+    {
+        strcpy(current->message, HINT_WAIT_MSG);
+    }
+    else
+    {
+        strcpy(current->message, HINT_NONE_MSG);
+    }
     
-    /* Padding is whitespace between border and first element, but BOARD_MAX_R
-     * includes the border, so subtract 2. */
-    if ( (element_rows + 2*PADDING_ROWS) > BOARD_MAX_R - 2 )
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Thread that makes the distance table of a level for show_hint().
+ */
+
+DWORD WINAPI
+table_thread(LPVOID arg)
+{
+    table_job_t *job = arg;
+    uint32_t nstates;
+    
+    InterlockedExchange(&job->result, 
+        build_table(&job->lvl, &nstates, NULL) != SOLVE_TOO_BIG);
+    release_table_job(job);
+    
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Lets go of a table job, freeing it if the other owner already has.
+ */
+
+void
+release_table_job(table_job_t *job)
+{
+    if (InterlockedDecrement(&job->owners) == 0)
     {
-        /* Calculate the available white space, and divide by 2. Use integer
-         * division to round down. */
-        padding_rows = ((BOARD_MAX_R - 2) - element_rows) / 2;
+        free(job);
     }
-    if ( (element_cols + 2*PADDING_COLS) > BOARD_MAX_C - 2 )
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Closes the distance table of a level that was being played. A table 
+ * still being made is left to finish, for the next time.
+ */
+
+void
+close_hint(hint_t *hint)
+{
+    if (hint->open)
     {
-        /* Calculate the available white space, and divide by 2. Use integer
-         * division to round down. */
-        padding_cols = ((BOARD_MAX_C - 2) - element_cols) / 2;
+        lvb_close(&hint->table.map);
+        hint->open = FALSE;
     }
-        
-    /* Create a new board with a border, using the dimensions found. */
-    dst_lvl.rows = element_rows + 2*padding_rows + 2;
-    dst_lvl.cols = element_cols + 2*padding_cols + 2;   
     
-    for (i = 0; i < dst_lvl.rows; i++)
+    if (hint->job != NULL)
     {
-        for (j = 0; j < dst_lvl.cols; j++)
-        {
-            /* Boarder values set as holes for default. */
-            if (i == 0 ||
-                i == dst_lvl.rows - 1 ||
-                j == 0 ||
-                j == dst_lvl.cols - 1)
-            {
-                dst_lvl.board[i][j] = HOLE;
-            }
-            /* All inner board values set to empty by default. */
-            else
-            {
-                dst_lvl.board[i][j] = EMPTY;
-            }
-        }
+        release_table_job(hint->job);
+        hint->job = NULL;
     }
-        
-    /* Copy board values into the centre of the new board. */
-    for (i = 0; i < element_rows; i++)
+    
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Looks up what a solver found for a level, under the rules of this 
+ * version, in the solution cache. Unless wait is TRUE, a cache that is 
+ * being written is taken as not having the level. Returns TRUE and fills 
+ * sol if it is there.
+ */
+
+int
+find_solution(level_t *lvl, solution_t *sol, int wait)
+{
+    HANDLE file;
+    slc_header_t header;
+    slc_slot_t slot;
+    uint32_t i, n, board;
+    uint64_t key = solution_key(lvl, &board);
+    int found = FALSE;
+    
+    if ((file = open_solutions(FALSE, wait)) == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+    
+    /* Slots are never emptied, so the level can't be past an empty one. */
+    if (read_solutions_header(file, &header))
     {
-        for (j = 0; j < element_cols; j++)
+        for (i = solution_slot(key, SOLVE_RULES, header.nslots), n = 0; 
+             !found && n < header.nslots && read_slot(file, i, &slot); 
+             i = (i + 1) & (header.nslots - 1), n++)
         {
-            /* Copy in board values from input board. */
-            dst_lvl.board[i + padding_rows + 1][j + padding_cols + 1] =
-                src_lvl->board[i + min_row][j + min_col];
+            found = (   slot.key == key && slot.board == board 
+                     && slot.rules == SOLVE_RULES);
         }
     }
     
-    /* Get the additional inital level values for the board. */
-    dst_lvl.p_row = src_lvl->p_row - min_row + padding_rows + 1;
-    dst_lvl.p_col = src_lvl->p_col - min_col + padding_cols + 1;
+    close_solutions(file);
     
-    dst_lvl.moves = src_lvl->moves;
-    dst_lvl.nmoves = 0;
-    dst_lvl.moving_block_check = moving_block_check(&dst_lvl);
-    dst_lvl.bomb = 0;
-    dst_lvl.message_available = 0;
+    if (found)
+    {
+        sol->moves = slot.moves;
+        sol->nodes = slot.nodes;
+        sol->time = slot.time;
+        memcpy(sol->solution, slot.solution, slot.len);
+        sol->solution[slot.len] = '\0';
+    }
     
-    return dst_lvl;
+    return found;
 }
 
 /*---------------------------------------------------------------------------*/
-/* 
- * Checks if level has a player and a goal. Does not check if the level can
- * be beaten.
+/*
+ * Keeps what a solver found for a level in the solution cache, in place of
+ * anything kept for it before, and grows the cache if it is half full. 
+ * Only the fewest moves or SOLVE_NO_SOLUTION are kept, and not solutions 
+ * longer than SLC_MAX_LEN. Returns TRUE if it was kept.
  */
 
 int
-is_player_and_goal_valid(level_t *lvl, coord_t goal)
+store_solution(level_t *lvl, int moves, const char *solution, 
+    uint64_t nodes, DWORD time)
 {
-    if (lvl->board[lvl->p_row][lvl->p_col] == PLAYER &&
-        lvl->board[goal.row][goal.col] == GOAL)
+    HANDLE file;
+    slc_header_t header;
+    slc_slot_t slot, old;
+    size_t len = (moves > 0) ? strlen(solution) : 0;
+    uint32_t i, n;
+    int ok, used;
+    
+    if (   (moves <= 0 && moves != SOLVE_NO_SOLUTION) || len > SLC_MAX_LEN
+        || (file = open_solutions(TRUE, TRUE)) == INVALID_HANDLE_VALUE)
     {
-        return TRUE;
+        return FALSE;
     }
     
-    return FALSE;    
+    memset(&slot, 0, sizeof(slot));
+    slot.key = solution_key(lvl, &slot.board);
+    slot.nodes = nodes;
+    slot.rules = SOLVE_RULES;
+    slot.moves = moves;
+    slot.time = time;
+    slot.len = (uint16_t)len;
+    memcpy(slot.solution, solution, len);
+    slot.check = crc32(&slot, offsetof(slc_slot_t, check));
+    
+    /* A new or damaged cache starts again, empty. */
+    if (!read_solutions_header(file, &header))
+    {
+        header.nslots = 0;
+        header.count = 0;
+    }
+    
+    ok = (   (header.count + 1) * 2 <= header.nslots
+          || grow_solutions(file, &header, header.nslots > 0 
+                                 ? header.nslots * 2 : MIN_TABLE_SIZE));
+    
+    for (i = solution_slot(slot.key, SOLVE_RULES, header.nslots), n = 0;
+         ok && n < header.nslots; i = (i + 1) & (header.nslots - 1), n++)
+    {
+        if (   (used = read_slot(file, i, &old))
+            && (   old.key != slot.key || old.board != slot.board 
+                || old.rules != SOLVE_RULES))
+        {
+            continue;
+        }
+        
+        header.count += !used;
+        ok = write_slot(file, i, &slot) 
+            && write_solutions_header(file, &header);
+        break;
+    }
+    
+    close_solutions(file);
+    
+    return ok && n < header.nslots;
 }
- 
+
 /*---------------------------------------------------------------------------*/
 /*
- * Appends level to end of level editor pack.
+ * Opens the solution cache, with a lock on it that is shared with other 
+ * readers, or if write is TRUE, one of its own. If wait is FALSE and the
+ * lock is held, it gives up rather than waiting. The cache is made if it
+ * doesn't exist and write is TRUE. Returns the file, or 
+ * INVALID_HANDLE_VALUE.
  */
- 
-void
-write_level(level_t lvl)
-{
-    int i, j;
-    char file_name[MAX_FILE_LEN];
-    FILE *fp = NULL;
-    
-    strcpy(file_name, CUSTOM_LEVEL_FILE);
-    strcat(file_name, LEVEL_FILE);
 
-    fp = fopen(file_name, "r");
+HANDLE
+open_solutions(int write, int wait)
+{
+    OVERLAPPED lock;
+    HANDLE file;
     
-    /* If the file doesn't exist already, create it with the title. */ 
-    if (fp == NULL)
+    if (write)
     {
-        fp = fopen(file_name, "w");
-        fprintf(fp, "%s\n", CUSTOM_LEVEL_NAME);
+        CreateDirectory(CACHE_DIR, NULL);
     }
-    fclose(fp);
     
-    /* Open file to append new level on the end. */
-    fp = fopen(file_name, "a");
+    file = CreateFile(CACHE_DIR "\\" SOLUTION_FILE, 
+        GENERIC_READ | (write ? GENERIC_WRITE : 0), 
+        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, 
+        write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
     
-    if (fp == NULL)
+    if (file == INVALID_HANDLE_VALUE)
     {
-        /* Failed opening file, display error and return. */
-        
-        /* TODO: display error. */
-        return;
+        return file;
     }
     
-    fprintf(fp, "\n");
-    fprintf(fp, "%d %d %d\n", lvl.rows, lvl.cols, lvl.moves);
+    memset(&lock, 0, sizeof(lock));
+    lock.OffsetHigh = SLC_LOCK_OFFSET;
     
-    for (i = 0; i < lvl.rows; i++)
+    if (!LockFileEx(file, (write ? LOCKFILE_EXCLUSIVE_LOCK : 0) 
+            | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY), 0, 1, 0, &lock))
     {
-        for (j = 0; j < lvl.cols; j++)
-        {
-            fprintf(fp, "%d ", lvl.board[i][j]);
-        }
-        fprintf(fp, "\n");
+        CloseHandle(file);
+        return INVALID_HANDLE_VALUE;
     }
     
-    fclose(fp);
+    return file;
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Lets go of the lock on the solution cache, and closes it.
+ */
+
+void
+close_solutions(HANDLE file)
+{
+    OVERLAPPED lock;
+    
+    memset(&lock, 0, sizeof(lock));
+    lock.OffsetHigh = SLC_LOCK_OFFSET;
+    UnlockFileEx(file, 0, 1, 0, &lock);
+    CloseHandle(file);
     
     return;
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Prints error screens for unbeaten level and incomplete level.
+ * Reads size bytes from offset in a file. Returns TRUE if they were all 
+ * read.
  */
- 
-void
-editor_message_screen(int message_code)
+
+int
+read_at(HANDLE file, uint64_t offset, void *buf, DWORD size)
 {
-    char *incomplete_level[] = {
-" ",
-" ",
-"     ERROR: LEVEL IS INCOMPLETE",
-" ",
-" ",
-"       Level must have player icon and a goal icon to be playable.",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-"       Press any key to return to level editor",
-        NULL};
+    LONG high = (LONG)(offset >> 32);
+    DWORD done;
+    
+    return (   (SetFilePointer(file, (LONG)(uint32_t)offset, &high, 
+                    FILE_BEGIN) != INVALID_SET_FILE_POINTER
+                || GetLastError() == NO_ERROR)
+            && ReadFile(file, buf, size, &done, NULL) && done == size);
+}
 
-    char *unbeaten_level[] = {
-" ",
-" ",
-"     SAVE UNSUCCESSFUL",
-" ",
-" ",
-"       Level must be beaten before it can be saved.",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-"       Press any key to return to level editor",
-        NULL};
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes size bytes at offset in a file. Returns TRUE if they were all 
+ * written.
+ */
+
+int
+write_at(HANDLE file, uint64_t offset, const void *buf, DWORD size)
+{
+    LONG high = (LONG)(offset >> 32);
+    DWORD done;
     
-    char *save_successful[] = {
-" ",
-" ",
-"     CONGRATULATIONS!",
-" ",
-"       Your level has been sucessfully saved!",
-" ",
-" ",
-"       The target number of moves has been set to the number of moves you",
-"       completed the level in.",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-" ",
-"       Press any key to return to level editor",
-        NULL};
+    return (   (SetFilePointer(file, (LONG)(uint32_t)offset, &high, 
+                    FILE_BEGIN) != INVALID_SET_FILE_POINTER
+                || GetLastError() == NO_ERROR)
+            && WriteFile(file, buf, size, &done, NULL) && done == size);
+}
 
-    if (message_code == INCOMPLETE_CODE)
-    {
-        print_message_screen(incomplete_level);
-    }
-    else if (message_code == UNBEATEN_CODE)
-    {
-        print_message_screen(unbeaten_level);
-    }
-    else if (message_code == SUCCESSFUL_CODE)
-    {
-        print_message_screen(save_successful);
-    }
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the key of a level in the solution cache and of its distance 
+ * table, a hash of its board with every cell, the player and its size, 
+ * and sets board to a CRC-32 of the same. Par doesn't change either, so 
+ * it is left out.
+ */
+
+uint64_t
+solution_key(level_t *lvl, uint32_t *board)
+{
+    layout_t layout;
     
-    /* Wait for player to enter key. */
-    getch();
+    canonical_layout(lvl, &layout);
+    layout.moves = 0;
+    *board = crc32(&layout, 
+        offsetof(layout_t, cells) + layout.rows * layout.cols);
     
-    return;
+    return layout_key(&layout);
 }
 
 /*---------------------------------------------------------------------------*/
 /*
- * Displays the yes or no screens for the level editor.
+ * Returns the first slot to look in for a level key and rules version, in
+ * a cache of nslots slots.
  */
- 
-char
-editor_decision_screen(int message_code)
+
+uint32_t
+solution_slot(uint64_t key, uint32_t rules, uint32_t nslots)
 {
-    char input = '\0';
+    uint64_t hash = (key ^ rules) * FNV_PRIME;
     
-    char *quit_editor[] = {
-" ",
-" ",
-"     QUIT LEVEL EDITOR:",
-" ",
-" ",
-"       Are you sure you want to quit the level editor? (y/n)",
-" ",
-"       Progress on current level will not be saved",
-"  ",
-    NULL};
+    return (uint32_t)(hash ^ (hash >> 32)) & (nslots - 1);
+}
 
-    char *clear_editor[] = {
-" ",
-" ",
-"     CLEAR LEVEL:",
-" ",
-" ",
-"       Are you sure you want to clear the current level? (y/n)",
-" ",
-"       Progress on current level will not be saved",
-"  ",
-    NULL};
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads slot i of the solution cache. Returns FALSE if it is empty, 
+ * damaged or can't be read.
+ */
+
+int
+read_slot(HANDLE file, uint32_t i, slc_slot_t *slot)
+{
+    return (   read_at(file, sizeof(slc_header_t) 
+                   + (uint64_t)i * sizeof(slc_slot_t), slot, sizeof(*slot))
+            && slot->check == crc32(slot, offsetof(slc_slot_t, check))
+            && slot->rules != 0 && slot->len <= SLC_MAX_LEN);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes slot i of the solution cache. Returns TRUE if it was written.
+ */
+
+int
+write_slot(HANDLE file, uint32_t i, const slc_slot_t *slot)
+{
+    return write_at(file, sizeof(slc_header_t) 
+        + (uint64_t)i * sizeof(slc_slot_t), slot, sizeof(*slot));
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads the header of the solution cache. Returns FALSE if it is damaged 
+ * or can't be read.
+ */
+
+int
+read_solutions_header(HANDLE file, slc_header_t *header)
+{
+    return (   read_at(file, 0, header, sizeof(*header))
+            && memcmp(header->magic, SLC_MAGIC, LVB_MAGIC_LEN) == 0
+            && header->version == SLC_VERSION
+            && header->check == crc32(header, offsetof(slc_header_t, check))
+            && header->nslots >= MIN_TABLE_SIZE
+            && (header->nslots & (header->nslots - 1)) == 0
+            && header->count < header->nslots);
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Writes the header of the solution cache. Returns TRUE if it was written.
+ */
+
+int
+write_solutions_header(HANDLE file, slc_header_t *header)
+{
+    memcpy(header->magic, SLC_MAGIC, LVB_MAGIC_LEN);
+    header->version = SLC_VERSION;
+    header->check = crc32(header, offsetof(slc_header_t, check));
     
-    while(TRUE)
+    return write_at(file, 0, header, sizeof(*header));
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Moves the slots of the solution cache into a table of nslots slots. The
+ * table is made in memory and then written over the old one, header last.
+ * A crash part way through can only leave slots where they won't be 
+ * found. Returns FALSE if out of memory or it couldn't be written.
+ */
+
+int
+grow_solutions(HANDLE file, slc_header_t *header, uint32_t nslots)
+{
+    slc_slot_t *table = calloc(nslots, sizeof(slc_slot_t)), slot;
+    uint32_t i, j;
+    int ok = TRUE;
+    
+    if (table == NULL)
     {
-        /* Display the screen. */
-        if (message_code == QUIT_EDITOR_CODE)
-        {
-            print_message_screen(quit_editor);
-        }
-        else if (message_code == CLEAR_EDITOR_CODE)
+        return FALSE;
+    }
+    
+    /* No rules are numbered 0, so slots without any are empty. */
+    for (i = 0; i < header->nslots; i++)
+    {
+        if (!read_slot(file, i, &slot))
         {
-            print_message_screen(clear_editor);
+            continue;
         }
         
-        /* Get player input. */
-        input = getch();
+        for (j = solution_slot(slot.key, slot.rules, nslots); 
+             table[j].rules != 0; 
+             j = (j + 1) & (nslots - 1))
+            ;
         
-        if (input == YES)
-        {
-            return YES;
-        }
-        else if (input == NO)
-        {
-            return NO;
-        }
+        table[j] = slot;
     }
- 
-    return NO;
+    
+    header->nslots = nslots;
+    header->count = 0;
+    
+    for (i = 0; i < nslots; i++)
+    {
+        header->count += (table[i].rules != 0);
+    }
+    
+    for (i = 0; ok && i < nslots; i += MIN_TABLE_SIZE)
+    {
+        ok = write_at(file, sizeof(slc_header_t) 
+            + (uint64_t)i * sizeof(slc_slot_t), table + i, 
+            MIN_TABLE_SIZE * sizeof(slc_slot_t));
+    }
+    
+    free(table);
+    
+    return ok && write_solutions_header(file, header);
 }
 
 /*-----------------------------------END-------------------------------------*/